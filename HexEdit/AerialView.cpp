@@ -343,7 +343,7 @@ void CAerialView::OnDraw(CDC* pDC)
 	std::vector<FILE_ADDRESS>::const_iterator pbm;
 	if (disp_.draw_bdr_bm)
 	{
-		bm = GetDocument()->bm_posn_;
+		GetDocument()->bm_posn_.get(bm);
 		std::sort(bm.begin(), bm.end());
 		pbm = bm.begin();
 		while (pbm != bm.end() && *pbm < scrollpos_)
@@ -469,12 +469,9 @@ void CAerialView::OnDraw(CDC* pDC)
 	}
 	if (disp_.draw_ants_bm)
 	{
-		for (std::vector<FILE_ADDRESS>::const_iterator pbm = GetDocument()->bm_posn_.begin();
-				pbm != GetDocument()->bm_posn_.end(); ++pbm)
-		{
-			if (*pbm >= scrollpos_ && *pbm <= scrollpos_ + width*rows_)
-				draw_ants(&(bufDC.GetDC()), *pbm, *pbm + 1, phev_->GetBookmarkCol());
-		}
+		bookmark_posns &posns = GetDocument()->bm_posn_;
+		for (size_t rr = posns.lower(scrollpos_); rr < posns.size() && posns.sorted(rr) <= scrollpos_ + width*rows_; ++rr)
+			draw_ants(&(bufDC.GetDC()), posns.sorted(rr), posns.sorted(rr) + 1, phev_->GetBookmarkCol());
 	}
 }
 
@@ -706,12 +703,9 @@ void CAerialView::OnTimer(UINT nIDEvent)
 		}
 		if (disp_.draw_ants_bm)
 		{
-			for (std::vector<FILE_ADDRESS>::const_iterator pbm = GetDocument()->bm_posn_.begin();
-				pbm != GetDocument()->bm_posn_.end(); ++pbm)
-			{
-				if (*pbm >= scrollpos_ && *pbm <= scrollpos_ + width*rows_)
-					invalidate_addr_range(*pbm, *pbm + 1);
-			}
+			bookmark_posns &posns = GetDocument()->bm_posn_;
+			for (size_t rr = posns.lower(scrollpos_); rr < posns.size() && posns.sorted(rr) <= scrollpos_ + width*rows_; ++rr)
+				invalidate_addr_range(posns.sorted(rr), posns.sorted(rr) + 1);
 		}
 		t00_.stop();
 
@@ -1034,23 +1028,26 @@ void CAerialView::update_display()
 		// Cache search occurrences found in the display area
 		FILE_ADDRESS end = scrollpos_ + rows_*cols_*GetDocument()->GetBpe();
 		size_t len = theApp.pboyer_->length();
-		std::vector<FILE_ADDRESS> sf = GetDocument()->SearchAddresses(scrollpos_ - len + 1, end + len);
+		std::vector<int> ids;
+		std::vector<FILE_ADDRESS> sf = GetDocument()->SearchAddresses(scrollpos_ - len + 1, end + len, &ids);
 
 		std::vector<FILE_ADDRESS>::const_iterator pp = sf.begin();
 		std::vector<FILE_ADDRESS>::const_iterator pend = sf.end();
+		std::vector<int>::const_iterator pid = ids.begin();
 		pair<FILE_ADDRESS, FILE_ADDRESS> good_pair;
 		if (pp != pend)
 		{
 			good_pair.first = *pp;
-			good_pair.second = *pp + len;
+			good_pair.second = *pp + theApp.pboyer_->pattern_length(*pid);
 			while (++pp != pend)
 			{
+				++pid;
 				if (*pp >= good_pair.second)
 				{
 					search_pair_.push_back(good_pair);
 					good_pair.first = *pp;
 				}
-				good_pair.second = *pp + len;
+				good_pair.second = max(good_pair.second, *pp + FILE_ADDRESS(theApp.pboyer_->pattern_length(*pid)));
 			}
 			search_pair_.push_back(good_pair);
 		}
@@ -1593,7 +1590,8 @@ void CAerialView::go_border_elt(CPoint pt)
 	if (disp_.draw_bdr_bm && abs_x >= 7)
 	{
 		// Get sorted list of bookmarks
-		std::vector<FILE_ADDRESS> bm = GetDocument()->bm_posn_;
+		std::vector<FILE_ADDRESS> bm;
+		GetDocument()->bm_posn_.get(bm);
 		std::sort(bm.begin(), bm.end());
 
 		std::vector<FILE_ADDRESS>::const_iterator pbm;
@@ -0,0 +1,101 @@
+// AhoCorasick.cpp : implements aho_corasick (see AhoCorasick.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include <deque>
+#include "AhoCorasick.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+aho_corasick::aho_corasick(const std::vector<std::vector<unsigned char> > &pats, const unsigned char *fold /*=NULL*/)
+	: pat_(pats), max_len_(0), min_len_(0)
+{
+	ASSERT(!pats.empty());
+	size_t ii, jj;
+	int cc;
+
+	// Work out the byte classes: class 0 is for bytes not in any pattern
+	int cls[256];                       // Class of each folded value (0 if not used)
+	memset(cls, 0, sizeof(cls));
+	nclass_ = 1;
+	for (ii = 0; ii < pats.size(); ++ii)
+		for (jj = 0; jj < pats[ii].size(); ++jj)
+		{
+			unsigned char ff = fold == NULL ? pats[ii][jj] : fold[pats[ii][jj]];
+			if (cls[ff] == 0)
+				cls[ff] = nclass_++;
+		}
+	for (cc = 0; cc < 256; ++cc)
+		class_[cc] = (unsigned short)cls[fold == NULL ? cc : fold[cc]];
+	ASSERT(nclass_ <= 257);             // (class 0 is unused if every byte is in a pattern)
+
+	// Build the trie (missing transitions are -1 for now)
+	next_.assign(nclass_, -1);
+	term_.push_back(-1);
+	len_.resize(pats.size());
+	end_.resize(pats.size());
+	for (ii = 0; ii < pats.size(); ++ii)
+	{
+		ASSERT(!pats[ii].empty());      // an empty pattern would match everywhere
+		int state = 0;
+		for (jj = 0; jj < pats[ii].size(); ++jj)
+		{
+			int &nxt = next_[state*nclass_ + class_[pats[ii][jj]]];
+			if (nxt == -1)
+			{
+				nxt = int(term_.size());    // new state
+				next_.insert(next_.end(), nclass_, -1);
+				term_.push_back(-1);
+			}
+			state = next_[state*nclass_ + class_[pats[ii][jj]]];   // (nxt may be invalid after insert)
+		}
+		if (term_[state] == -1)
+			term_[state] = int(ii);         // (if the same pattern is given twice only the first is found)
+		end_[ii] = state;
+		len_[ii] = pats[ii].size();
+		if (ii == 0 || len_[ii] > max_len_) max_len_ = len_[ii];
+		if (ii == 0 || len_[ii] < min_len_) min_len_ = len_[ii];
+	}
+
+	// Visit states in breadth first order (so the failure state of each state, which is
+	// shorter, has already been done) to fill in the missing transitions
+	std::vector<int> fail(term_.size(), 0);
+	dict_.assign(term_.size(), -1);
+	std::deque<int> todo;
+	for (cc = 0; cc < nclass_; ++cc)
+	{
+		int &nxt = next_[cc];
+		if (nxt == -1)
+			nxt = 0;                    // no pattern starts with this byte so stay at the start
+		else
+			todo.push_back(nxt);        // failure state of a state of one byte is the start (0)
+	}
+	while (!todo.empty())
+	{
+		int state = todo.front();
+		todo.pop_front();
+		for (cc = 0; cc < nclass_; ++cc)
+		{
+			int &nxt = next_[state*nclass_ + cc];
+			int alt = next_[fail[state]*nclass_ + cc];    // where the failure state goes
+			if (nxt == -1)
+				nxt = alt;
+			else
+			{
+				fail[nxt] = alt;
+				dict_[nxt] = term_[alt] != -1 ? alt : dict_[alt];
+				todo.push_back(nxt);
+			}
+		}
+	}
+}
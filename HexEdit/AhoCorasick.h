@@ -0,0 +1,71 @@
+// AhoCorasick.h : automaton for finding any of a list of byte patterns
+//
+// For implementation see: AhoCorasick.cpp
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Searching for hundreds of patterns (eg magic numbers of file formats) one at
+// a time means reading the whole file once for every pattern.  An Aho-Corasick
+// automaton finds all occurrences of all the patterns in one pass, looking at
+// each byte only once however many patterns there are.
+//
+// The patterns are put in a trie, where each state is a prefix of one or more
+// patterns.  The "failure" links (the longest proper suffix of a state that is
+// also a state) are then used to fill in the missing transitions, so that the
+// automaton is a DFA with exactly one lookup per byte: next_ has a row for each
+// state with the next state for each byte class.  Bytes that are the same after
+// folding (eg upper and lower case letters for case-insensitive searches) are in
+// the same class, as are all bytes not used in any pattern, to keep rows short.
+// (There can be 257 classes if the patterns use every byte value.)
+//
+// After a byte the current state is the longest pattern prefix that ends there.
+// The patterns that end at that byte are the one ending at the state (term_) and
+// those ending at its suffixes, which are chained together by dict_.
+//
+// The automaton is not changed once built so it can be shared by searches in
+// several threads (see boyer, which uses it for multi-pattern searches).
+
+#ifndef AHOCORASICK_INCLUDED
+#define AHOCORASICK_INCLUDED  1
+
+#include <vector>
+
+class aho_corasick
+{
+public:
+	// Builds the automaton - fold (if not NULL) gives a value for each byte so that
+	// bytes with the same value are treated as equal (eg for ignoring case)
+	aho_corasick(const std::vector<std::vector<unsigned char> > &pats, const unsigned char *fold = NULL);
+
+	size_t count() const { return len_.size(); }            // Number of patterns
+	size_t length(int id) const { ASSERT(size_t(id) < len_.size()); return len_[id]; }
+	size_t max_length() const { return max_len_; }
+	size_t min_length() const { return min_len_; }
+	const std::vector<unsigned char> &pattern(int id) const { ASSERT(size_t(id) < pat_.size()); return pat_[id]; }
+
+	// Scanning: start with state 0 and get the state after each byte with next().  Then the
+	// patterns that end at that byte are first(state), then after(id) until -1 is returned.
+	int next(int state, unsigned char cc) const { return next_[state*nclass_ + class_[cc]]; }
+	int first(int state) const { return term_[state] != -1 ? term_[state] : after_state(dict_[state]); }
+	int after(int id) const { return after_state(dict_[end_[id]]); }
+
+private:
+	int after_state(int state) const { return state == -1 ? -1 : term_[state]; }
+
+	std::vector<std::vector<unsigned char> > pat_;  // The patterns
+	std::vector<size_t> len_;           // Length of each pattern
+	std::vector<int> end_;              // State for the whole of each pattern
+	size_t max_len_, min_len_;
+
+	unsigned short class_[256];         // Byte class of each byte value (0 = not in any pattern)
+	int nclass_;                        // Number of byte classes (row length of next_)
+	std::vector<int> next_;             // Next state for each state and byte class
+	std::vector<int> term_;             // Pattern that is the whole of each state (-1 if none)
+	std::vector<int> dict_;             // Longest proper suffix of each state that is a pattern (or -1)
+};
+
+#endif
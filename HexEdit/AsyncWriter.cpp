@@ -0,0 +1,184 @@
+// AsyncWriter.cpp : implements async_writer (see AsyncWriter.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include <malloc.h>
+#include "HexEdit.h"
+#include "CFile64.h"
+#include "AsyncWriter.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+async_writer::async_writer(CFile64 *pfile, size_t buf_size /*= default_size*/, bool async /*= true*/)
+ : pfile_(pfile), buf_size_(buf_size), async_(async), curr_(0), filling_(false), error_(0), pthread_(NULL)
+{
+	ASSERT(pfile != NULL && buf_size > 0);
+	for (int ii = 0; ii < buf_count; ++ii)
+	{
+		// Aligned on a (big) sector boundary so the OS can write the memory directly
+		buf_[ii] = (ii == 0 || async_) ? (unsigned char *)_aligned_malloc(buf_size_, 4096) : NULL;
+		if (buf_[ii] == NULL && (ii == 0 || async_))
+			AfxThrowMemoryException();
+		addr_[ii] = 0;
+		len_[ii] = 0;
+		empty_[ii].SetEvent();          // all buffers are free to start with
+	}
+
+	if (async_)
+	{
+		pthread_ = AfxBeginThread(&writer_func, this, THREAD_PRIORITY_NORMAL, 0, CREATE_SUSPENDED);
+		ASSERT(pthread_ != NULL);
+		pthread_->m_bAutoDelete = FALSE;    // we need the handle to wait for it to finish
+		pthread_->ResumeThread();
+	}
+}
+
+async_writer::~async_writer()
+{
+	if (pthread_ != NULL)
+	{
+		if (filling_)
+			empty_[curr_].SetEvent();   // give back the unused buffer
+		filling_ = false;
+
+		// Tell the thread to finish (after any queued writes) and wait for it
+		::WaitForSingleObject(HANDLE(empty_[curr_]), INFINITE);
+		len_[curr_] = 0;
+		full_[curr_].SetEvent();
+		::WaitForSingleObject(pthread_->m_hThread, INFINITE);
+		delete pthread_;
+	}
+
+	for (int ii = 0; ii < buf_count; ++ii)
+		if (buf_[ii] != NULL)
+			_aligned_free(buf_[ii]);
+}
+
+unsigned char *async_writer::buffer()
+{
+	if (!async_)
+		return buf_[0];
+
+	if (!filling_)
+	{
+		::WaitForSingleObject(HANDLE(empty_[curr_]), INFINITE);
+		filling_ = true;
+		check_error();
+	}
+	return buf_[curr_];
+}
+
+void async_writer::write(FILE_ADDRESS address, size_t len)
+{
+	ASSERT(len <= buf_size_);
+	if (!async_)
+	{
+		VERIFY(pfile_->Seek(address, CFile::begin) == address);
+		pfile_->Write(buf_[0], DWORD(len));
+		return;
+	}
+
+	ASSERT(filling_);                   // buffer() must be called first
+	if (len == 0)
+		return;                         // keep the buffer for next time (0 would stop the thread)
+	addr_[curr_] = address;
+	len_[curr_] = len;
+	filling_ = false;
+	full_[curr_].SetEvent();
+	curr_ = (curr_ + 1) % buf_count;
+}
+
+void async_writer::write(FILE_ADDRESS address, const void *pp, FILE_ADDRESS len)
+{
+	if (!async_)
+	{
+		// Just write it from where it is
+		VERIFY(pfile_->Seek(address, CFile::begin) == address);
+		pfile_->Write(pp, DWORD(len));
+		return;
+	}
+
+	const unsigned char *pc = (const unsigned char *)pp;
+	while (len > 0)
+	{
+		size_t count = size_t(min(len, FILE_ADDRESS(buf_size_)));
+		memcpy(buffer(), pc, count);
+		write(address, count);
+		pc += count;
+		address += count;
+		len -= count;
+	}
+}
+
+void async_writer::finish()
+{
+	if (!async_)
+		return;
+
+	if (filling_)
+	{
+		empty_[curr_].SetEvent();       // give back the unused buffer
+		filling_ = false;
+	}
+	wait_all();
+	check_error();
+}
+
+// Waits till all buffers have been written
+void async_writer::wait_all()
+{
+	for (int ii = 0; ii < buf_count; ++ii)
+		::WaitForSingleObject(HANDLE(empty_[ii]), INFINITE);
+	for (int ii = 0; ii < buf_count; ++ii)
+		empty_[ii].SetEvent();          // they are all still free
+}
+
+// Throws an exception (in the caller's thread) if a write failed
+void async_writer::check_error()
+{
+	DWORD err = error_;
+	if (err != 0)
+		CFileException::ThrowOsError(LONG(err), pfile_->GetFilePath());
+}
+
+UINT async_writer::writer_func(LPVOID pParam)
+{
+	return ((async_writer *)pParam)->run();
+}
+
+UINT async_writer::run()
+{
+	for (int ii = 0; ; ii = (ii + 1) % buf_count)
+	{
+		::WaitForSingleObject(HANDLE(full_[ii]), INFINITE);
+		if (len_[ii] == 0)
+			break;                      // no more to write
+
+		// Once a write fails we just skip the rest (the caller gets the error)
+		if (error_ == 0)
+		{
+			OVERLAPPED overlapped;
+			memset(&overlapped, 0, sizeof(overlapped));
+			overlapped.Offset     = DWORD(addr_[ii]);
+			overlapped.OffsetHigh = DWORD(addr_[ii] >> 32);
+
+			DWORD actual = 0;
+			if (!::WriteFile(pfile_->GetHandle(), buf_[ii], DWORD(len_[ii]), &actual, &overlapped))
+				error_ = ::GetLastError();
+			else if (actual != DWORD(len_[ii]))
+				error_ = ERROR_DISK_FULL;
+		}
+		empty_[ii].SetEvent();
+	}
+	return 0;
+}
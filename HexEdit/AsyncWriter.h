@@ -0,0 +1,73 @@
+// AsyncWriter.h : writes blocks to a file in a separate thread while the next is read
+//
+// For implementation see: AsyncWriter.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Saving used to read 16K of data then write it then read the next 16K and so
+// on, so the disk was always waiting for one or the other.  An async_writer
+// has 2 big (sector aligned) buffers.  While one is being written (by its own
+// thread) the caller fills the other, so reading and writing overlap.
+//
+// Usage: get a buffer with buffer(), fill it and pass it to write() with the
+// file address to write it to.  Repeat, then call finish() which waits for
+// all writes and throws a CFileException if any of them failed.  (An error
+// may also be thrown by buffer() or write() for an earlier write.)
+//
+// Note: blocks are written with WriteFile given the offset in an OVERLAPPED
+// (like CFile64::ReadAt).  This also moves the file position (the handle is
+// not opened for overlapped I/O) so nothing may rely on the position while
+// writes are queued.  The caller can read the same file using ReadAt (which
+// also gives the offset) as long as it does not read what a queued write will
+// change.
+// Devices (CFileNC) buffer sectors so must use async = false, which just
+// writes each block in the caller's thread (using Seek/Write) as before.
+
+#ifndef ASYNCWRITER_INCLUDED
+#define ASYNCWRITER_INCLUDED  1
+
+class CFile64;
+
+class async_writer
+{
+public:
+	enum { default_size = 4*1024*1024 };  // Default size of each buffer
+
+	async_writer(CFile64 *pfile, size_t buf_size = default_size, bool async = true);
+	~async_writer();                    // Waits for queued writes (but does not report errors - use finish)
+
+	size_t size() const { return buf_size_; }
+	unsigned char *buffer();            // Get a buffer to fill (waits for an earlier write if nec.)
+	void write(FILE_ADDRESS address, size_t len);   // Write len bytes of the buffer (from buffer()) at address
+	void write(FILE_ADDRESS address, const void *pp, FILE_ADDRESS len);  // Copy any amount and write it
+	void finish();                      // Wait for all writes to complete
+
+private:
+	async_writer(const async_writer &);     // not copyable
+	async_writer &operator=(const async_writer &);
+
+	enum { buf_count = 2 };
+	static UINT writer_func(LPVOID pParam);
+	UINT run();                         // Main loop of the writer thread
+	void wait_all();
+	void check_error();
+
+	CFile64 *pfile_;
+	size_t buf_size_;
+	bool async_;
+	int curr_;                          // Buffer that the caller is using (or will use next)
+	bool filling_;                      // Has buffer curr_ been given to the caller?
+	unsigned char *buf_[buf_count];
+	FILE_ADDRESS addr_[buf_count];      // Where to write each buffer
+	size_t len_[buf_count];             // Bytes to write (0 tells the thread to finish)
+	CEvent full_[buf_count];            // Signals the writer thread that a buffer is ready
+	CEvent empty_[buf_count];           // Signals the caller that a buffer has been written
+	volatile DWORD error_;              // Error code of a failed write (or 0)
+	CWinThread *pthread_;
+};
+
+#endif
@@ -30,11 +30,11 @@ aerial_command_: command to the thread to tell it what to do: scan, stop, die
 aerial_state_: updated by the thread to say what it's doing: waiting, scanning or dying
 aerial_fin_: true if last scan finished OK, false if none done yet or last stopped
 docdata_: a critical section to protect access to shared document members
+docrw_: read/write lock for the document data below - GetData() takes a read lock so
+		the bg threads can all read at once, the main thread takes a write lock to change it
 
-pfile3_: is a ptr to file open the same as pfile1_.  Using a separate file allows the main thread
-		 to read from the file without having to lock docdata_.  Locking is only required
-		 when the background thread accesses the file or the main thread changes it.
-		 This means that file display should never be slowed by the background thread.
+pfile1_: the file is shared with the main thread - GetData() uses positional reads
+		 (CFile64::ReadAt) so no separate copy of the file is needed.
 loc_: accessed (via GetData) in main/search/aerial threads to get data from the file
 undo_: loc_ uses data stored in undo array
 
@@ -60,14 +60,16 @@ It also sets aerial_fin_ to true.
 Changes (CHexEditDoc::Change, CHexEditDoc::Undo in DocData.cpp)
 -------
 
-When a document is changed the scan needs to be restarted.
+The thread scans a snapshot of the document (aerial_snap_ - see TakeSnapshot
+in DocData.cpp) so a change does not stop the scan.  Instead the thread is
+signalled and when the current scan finishes it takes a new snapshot and works
+out what has changed since the last one (SnapshotDiff).  If bytes were only
+replaced then just the changed pixels are redone, otherwise the bitmap is
+redone from the first change to the end of file.
 
-This may later be changed to allow small document changes to update
-the bitmap without having to rescan the whole thing.  This would work
-fine for replacements.  For deletions a memove() would be required.
-For small insertions only a memove may be required but it may be that
-the bitmap has to be resized, which may be handled by realloc or
-just a complete re-scan.
+If the bitmap is no longer big enough (at the current bytes per pixel) the
+scan is stopped, a new bitmap is allocated and the whole file is rescanned
+(aerial_rescan_).  This is also done when the colours change.
 
 
 Views (see CBGAerialHint used by CHexEditView::OnUpdate)
@@ -165,6 +167,22 @@ void CHexEditDoc::AerialChange(CHexEditView *pview /*= NULL*/)
 	ASSERT(pthread3_ != NULL);
 	if (pthread3_ == NULL) return;
 
+	if (pview == NULL)
+	{
+		// If the bitmap is still big enough (see GetAerialBitmap) the thread can just
+		// update the bitmap for what has changed without stopping the current scan
+		CSingleLock sl(&docdata_, TRUE);
+		if (dib_ != NULL &&
+			int(FreeImage_GetPitch(dib_) * FreeImage_GetHeight(dib_)) >= MAX_WIDTH*(int(length_/bpe_/MAX_WIDTH) + 2)*3)
+		{
+			aerial_fin_ = false;
+			sl.Unlock();
+			TRACE("+++ Pulsing aerial event (change)\n");
+			start_aerial_event_.SetEvent();
+			return;
+		}
+	}
+
 	// Wait for thread to stop if necessary
 	bool waiting;
 	docdata_.Lock();
@@ -199,6 +217,7 @@ void CHexEditDoc::AerialChange(CHexEditView *pview /*= NULL*/)
 	// Restart the scan
 	aerial_command_ = NONE;  // make sure we don't stop the scan before it starts
 	aerial_fin_ = false;
+	aerial_rescan_ = true;   // new bitmap or colours so it all has to be redone
 	docdata_.Unlock();
 
 	TRACE("+++ Pulsing aerial event (restart)\n");
@@ -302,23 +321,6 @@ void CHexEditDoc::KillAerialThread()
 	ASSERT(wait_status == WAIT_OBJECT_0 || wait_status == WAIT_FAILED);
 	tt.stop();
 	TRACE1("+++ Thread took %g secs to kill\n", double(tt.elapsed()));
-
-	// Free resources that are only needed during scan
-	if (pfile3_ != NULL)
-	{
-		pfile3_->Close();
-		delete pfile3_;
-		pfile3_ = NULL;
-	}
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		if (data_file3_[ii] != NULL)
-		{
-			data_file3_[ii]->Close();
-			delete data_file3_[ii];
-			data_file3_[ii] = NULL;
-		}
-	}
 }
 
 // bg_func is the entry point for the thread.
@@ -336,36 +338,12 @@ static UINT bg_func(LPVOID pParam)
 void CHexEditDoc::CreateAerialThread()
 {
 	ASSERT(pthread3_ == NULL);
-	ASSERT(pfile3_ == NULL);
-
-	// Open copy of file to be used by background thread
-	if (pfile1_ != NULL)
-	{
-		if (IsDevice())
-			pfile3_ = new CFileNC();
-		else
-			pfile3_ = new CFile64();
-		if (!pfile3_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE1("+++ Aerial file open failed for %p\n", this);
-			return;
-		}
-	}
-
-	// Open copy of any data files in use too
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		ASSERT(data_file3_[ii] == NULL);
-		if (data_file_[ii] != NULL)
-			data_file3_[ii] = new CFile64(data_file_[ii]->GetFilePath(), 
-										  CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-	}
 
 	// Create new thread
 	aerial_command_ = NONE;
 	aerial_state_ = STARTING;    // pre start and very beginning
 	aerial_fin_ = false;
+	aerial_rescan_ = true;
 	TRACE1("+++ Creating aerial thread for %p\n", this);
 	pthread3_ = AfxBeginThread(&bg_func, this, THREAD_PRIORITY_LOWEST);
 	ASSERT(pthread3_ != NULL);
@@ -398,55 +376,123 @@ UINT CHexEditDoc::RunAerialThread()
 		docdata_.Lock();
 		aerial_fin_ = false;
 		aerial_addr_ = 0;
-		FILE_ADDRESS file_len = length_;
+		bool rescan = aerial_rescan_;
+		aerial_rescan_ = false;
 		int file_bpe = bpe_;
 		unsigned char *file_dib = FreeImage_GetBits(dib_);
-		unsigned dib_size = FreeImage_GetDIBSize(dib_);
+		FILE_ADDRESS max_len = FILE_ADDRESS(dib_size_/3) * file_bpe;  // Most bytes the bitmap can show
 		docdata_.Unlock();
 		TRACE("+++ BGAerial: using bitmap at %p\n", file_dib);
 
+		// Work out which parts of the file need to be scanned
+		std::vector<edit_log::range> todo;
+		FILE_ADDRESS file_len;
+		if (!rescan && aerial_snap_.active)
+		{
+			// Only redo what has changed since the bitmap was last done
+			doc_snapshot prev;
+			prev.swap(aerial_snap_);
+			TakeSnapshot(aerial_snap_);
+			file_len = min(aerial_snap_.length, max_len);
+
+			std::vector<edit_log::range> removed, added;
+			if (!SnapshotDiff(prev, aerial_snap_, removed, added))
+				todo.push_back(edit_log::range(0, file_len));
+			else if (prev.length == aerial_snap_.length && removed == added)
+			{
+				// Only replacements so just redo the pixels of the replaced bytes
+				for (std::vector<edit_log::range>::const_iterator pr = added.begin(); pr != added.end(); ++pr)
+				{
+					FILE_ADDRESS start = (pr->first/file_bpe)*file_bpe;
+					FILE_ADDRESS end = min(((pr->second + file_bpe - 1)/file_bpe)*file_bpe, file_len);
+					if (!todo.empty() && start <= todo.back().second)
+						todo.back().second = max(todo.back().second, end);  // overlaps (same pixel)
+					else if (start < end)
+						todo.push_back(edit_log::range(start, end));
+				}
+			}
+			else if (!removed.empty() || !added.empty())
+			{
+				// Bytes have moved so redo everything after the first change
+				FILE_ADDRESS start = file_len;
+				if (!removed.empty())
+					start = min(start, removed.front().first);
+				if (!added.empty())
+					start = min(start, added.front().first);
+				start = (start/file_bpe)*file_bpe;
+				if (start < file_len)
+					todo.push_back(edit_log::range(start, file_len));
+			}
+			ReleaseSnapshot(prev);
+		}
+		else
+		{
+			ReleaseSnapshot(aerial_snap_);
+			TakeSnapshot(aerial_snap_);
+			file_len = min(aerial_snap_.length, max_len);
+			todo.push_back(edit_log::range(0, file_len));
+		}
+
 		// Get the file buffer
 		size_t buf_len = (size_t)min(file_len, 65536);
 		ASSERT(aerial_buf_ == NULL);
 		aerial_buf_ = new unsigned char[buf_len];
+		doc_cursor cursor;              // Speeds up reading of consecutive blocks
+		bool stopped = false;
 
-		for (;;)
+		for (std::vector<edit_log::range>::const_iterator pr = todo.begin(); !stopped && pr != todo.end(); ++pr)
 		{
-			// First check if we need to stop
-			if (AerialProcessStop())
-				break;   // stop processing and go back to WAITING state
-
-			// Check if we have finished scanning the file
-			if (aerial_addr_ >= file_len)
+			for (aerial_addr_ = pr->first; aerial_addr_ < pr->second; )
 			{
-				TRACE2("+++ BGAerial: finished scan for %p at address %p\n", this, file_dib + 3*size_t(aerial_addr_/file_bpe));
-				CSingleLock sl(&docdata_, TRUE); // Protect shared data access
-
-				aerial_fin_ = true;
-				break;                          // falls out to end_scan
-			}
+				// First check if we need to stop
+				if (AerialProcessStop())
+				{
+					stopped = true;
+					break;   // stop processing and go back to WAITING state
+				}
 
-			// Get the next buffer full from the file and scan it
-			size_t got = GetData(aerial_buf_, buf_len, aerial_addr_, 3);
-			ASSERT(got <= buf_len);
+				// Get the next buffer full from the file and scan it
+				size_t got = GetData(aerial_buf_, size_t(min(FILE_ADDRESS(buf_len), pr->second - aerial_addr_)), aerial_addr_, cursor, aerial_snap_);
+				ASSERT(got <= buf_len);
+				if (got == 0)
+				{
+					// Snapshot is stale (eg file has been saved) so start again
+					TRACE1("+++ BGAerial: rescan for %p\n", this);
+					CSingleLock sl(&docdata_, TRUE);
+					aerial_rescan_ = true;
+					start_aerial_event_.SetEvent();
+					stopped = true;
+					break;
+				}
 
-			unsigned char *pbm = file_dib + 3*size_t(aerial_addr_/file_bpe);    // where we write to bitmap
-			unsigned char *pbuf;                                        // where we read from the file buffer
-			for (pbuf = aerial_buf_; pbuf < aerial_buf_ + got; pbuf += file_bpe, pbm += 3)
-			{
-				int r, g, b;
-				r = g = b = 0;
-				for (unsigned char *pp = pbuf; pp < pbuf + file_bpe; ++pp)
+				unsigned char *pbm = file_dib + 3*size_t(aerial_addr_/file_bpe);    // where we write to bitmap
+				unsigned char *pbuf;                                        // where we read from the file buffer
+				for (pbuf = aerial_buf_; pbuf < aerial_buf_ + got; pbuf += file_bpe, pbm += 3)
 				{
-					r += GetRValue(kala_[*pp]);
-					g += GetGValue(kala_[*pp]);
-					b += GetBValue(kala_[*pp]);
+					int r, g, b;
+					r = g = b = 0;
+					for (unsigned char *pp = pbuf; pp < pbuf + file_bpe; ++pp)
+					{
+						r += GetRValue(kala_[*pp]);
+						g += GetGValue(kala_[*pp]);
+						b += GetBValue(kala_[*pp]);
+					}
+					*pbm     = unsigned char(b/file_bpe);
+					*(pbm+1) = unsigned char(g/file_bpe);
+					*(pbm+2) = unsigned char(r/file_bpe);
 				}
-				*pbm     = unsigned char(b/file_bpe);
-				*(pbm+1) = unsigned char(g/file_bpe);
-				*(pbm+2) = unsigned char(r/file_bpe);
+				aerial_addr_ += got;
 			}
-			aerial_addr_ += got;
+		}
+
+		if (stopped)
+			ReleaseSnapshot(aerial_snap_);  // bitmap is incomplete so we can't update it later
+		else
+		{
+			// Finished - the bitmap is now for aerial_snap_
+			TRACE1("+++ BGAerial: finished scan for %p\n", this);
+			CSingleLock sl(&docdata_, TRUE); // Protect shared data access
+			aerial_fin_ = true;
 		}
 
 		delete[] aerial_buf_;
@@ -471,6 +517,7 @@ bool CHexEditDoc::AerialProcessStop()
 		TRACE1("+++ BGAerial: killed thread for %p\n", this);
 		aerial_state_ = DYING;
 		sl.Unlock();                // we need this here as AfxEndThread() never returns so d'tor is not called
+		ReleaseSnapshot(aerial_snap_);
 		delete[] aerial_buf_;
 		aerial_buf_ = NULL;
 		AfxEndThread(1);            // kills thread (no return)
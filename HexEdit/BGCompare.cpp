@@ -930,10 +930,10 @@ std::pair<FILE_ADDRESS, FILE_ADDRESS> CHexEditDoc::GetLastDiffAll()
 // Note when comparing that there are 4 files involved:
 //   pfile1_         = Original file opened for general use in GUI thread
 //   pfile1_compare_ = Compare file opened for use in the main (GUI) thread (used by CCompareView)
-//   pfile4_         = Original file opened again to use for comparing in the background thread (see below)
+//   pfile4_         = Copy of original file used in the background thread when doing a self-compare (see below)
 //   pfile4_compare_ = Compare file opened again for use in the background thread
 // When comparing different files:
-//   pfile1_, pfile4_ is original file
+//   pfile1_ is original file (also used by the bg thread - see GetData) and pfile4_ is NULL
 //   pfile1_compare_, pfile4_compare_ is file to compare with
 // When doing self-compare:
 //   pfile1_ is original file
@@ -941,36 +941,20 @@ std::pair<FILE_ADDRESS, FILE_ADDRESS> CHexEditDoc::GetLastDiffAll()
 //   pfile1_compare_, pfile4_compare_ is older temp file (file name = tempFileB_)
 bool CHexEditDoc::OpenCompFile()
 {
-	// Open file to be used by background thread
-	if (pfile1_ != NULL)
+	// For a self-compare the background thread reads the original data from a copy of the file
+	if (pfile1_ != NULL && bCompSelf_)
 	{
-		CString fileName;
-		if (bCompSelf_)
-			fileName = tempFileA_;
-		else
-			fileName = pfile1_->GetFilePath();
-		ASSERT(!fileName.IsEmpty());
-
-		if (IsDevice() && !bCompSelf_)
-			pfile4_ = new CFileNC();
-		else
-			pfile4_ = new CFile64();
-		if (!pfile4_->Open(fileName, CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
+		ASSERT(!tempFileA_.IsEmpty());
+		pfile4_ = new CFile64();
+		if (!pfile4_->Open(tempFileA_, CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
 		{
 			TRACE1("+++ Compare (file4) open failed for %p\n", this);
+			delete pfile4_;
+			pfile4_ = NULL;
 			return false;
 		}
 	}
 
-	// Open any data files in use too, since we need to compare against the in-memory file
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		ASSERT(data_file4_[ii] == NULL);
-		if (data_file_[ii] != NULL)
-			data_file4_[ii] = new CFile64(data_file_[ii]->GetFilePath(), 
-										  CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-	}
-
 	// Open file to compare against
 	ASSERT(pfile1_compare_ == NULL && pfile4_compare_ == NULL);
 
@@ -1003,15 +987,6 @@ void CHexEditDoc::CloseCompFile()
 		delete pfile4_;
 		pfile4_ = NULL;
 	}
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		if (data_file4_[ii] != NULL)
-		{
-			data_file4_[ii]->Close();
-			delete data_file4_[ii];
-			data_file4_[ii] = NULL;
-		}
-	}
 
 	// Close the compare file (both open instances)
 	ASSERT(pfile1_compare_ != NULL && pfile4_compare_ != NULL);
@@ -1250,9 +1225,13 @@ UINT CHexEditDoc::RunCompThread()
 			TRACE("+++ BGCompare: _aligned_malloc error in %p\n", this);
 			continue;
 		}
+		// Compare a snapshot of the doc so that we can read it without stopping changes
+		TakeSnapshot(comp_snap_);
+
 		size_t gota = 0, gotb = 0;              // Current amount of data obtained from each file (at addra, addrb)
 		FILE_ADDRESS addra = 0, addrb = 0;      // Address of byte at start of buffers (comp_bufa_, comp_bufb_)
 		FILE_ADDRESS cumulative_replace = 0;    // Keeps track of a long differrence - treated as a replacement
+		doc_cursor cursor;                      // Speeds up reading of consecutive blocks of the doc
 
 		// Keep looping until we are finished processing blocks or we receive a command to stop etc
 		for (;;)
@@ -1271,7 +1250,7 @@ UINT CHexEditDoc::RunCompThread()
 			if (gota >= buf_size)
 				gota = buf_size;
 			else
-				gota += GetData(comp_bufa_ + gota, buf_size - gota, addra + gota, 4);
+				gota += GetData(comp_bufa_ + gota, buf_size - gota, addra + gota, cursor, comp_snap_, pfile4_);
 			if (gotb >= buf_size)
 				gotb = buf_size;
 			else
@@ -1338,7 +1317,7 @@ UINT CHexEditDoc::RunCompThread()
 					memmove(comp_bufb_, comp_bufb_+diff, gotb);
 
 					// Top up the buffers
-					gota += GetData    (comp_bufa_ + gota, buf_size - gota + (min_match - 4), addra + gota, 4);
+					gota += GetData    (comp_bufa_ + gota, buf_size - gota + (min_match - 4), addra + gota, cursor, comp_snap_, pfile4_);
 					gotb += GetCompData(comp_bufb_ + gotb, buf_size - gotb + (min_match - 4), addrb + gotb, true);
 
 					const unsigned char * pfound;     // Pointer to the found bytes (in whichever buffer was searched)
@@ -1468,7 +1447,7 @@ UINT CHexEditDoc::RunCompThread()
 
 					result.m_insert_A.push_back(addra + diff);
 					result.m_delete_B.push_back(addrb + diff);
-					result.m_insert_len.push_back(length_ - (addra + diff)); // to eof
+					result.m_insert_len.push_back(comp_snap_.length - (addra + diff)); // to eof
 				}
 
 				// We save the results of the compare along with when it was done
@@ -1483,13 +1462,21 @@ UINT CHexEditDoc::RunCompThread()
 				ASSERT(result.m_delete_A.size() == result.m_insert_B.size());
 				ASSERT(result.m_delete_A.size() == result.m_delete_len.size());
 
+				if (SnapshotStale(comp_snap_))
+				{
+					// The doc data moved (eg file saved) while we were reading it so do it again
+					TRACE("+++ BGCompare: restarting stale compare for %p\n", this);
+					start_comp_event_.SetEvent();
+					break;
+				}
+
 				TRACE("+++ BGCompare: finished scan for %p\n", this);
 				{
 					CSingleLock sl(&docdata_, TRUE); // Protect shared data access
 
 					comp_[0] = result;
 					comp_fin_ = true;
-					comp_progress_ = length_;
+					comp_progress_ = comp_snap_.length;
 				}
 				break;                          // falls out to wait state
 			}
@@ -1500,6 +1487,7 @@ UINT CHexEditDoc::RunCompThread()
 			gota -= to_check;
 			gotb -= to_check;
 		}
+		ReleaseSnapshot(comp_snap_);
 		_aligned_free(comp_bufa_); comp_bufa_ = NULL;
 		_aligned_free(comp_bufb_); comp_bufb_ = NULL;
 	}
@@ -1522,6 +1510,7 @@ bool CHexEditDoc::CompProcessStop()
 		TRACE1("+++ BGCompare: killed thread for %p\n", this);
 		comp_state_ = DYING;
 		sl.Unlock();                // we need this here as AfxEndThread() never returns so d'tor is not called
+		ReleaseSnapshot(comp_snap_);
 		_aligned_free(comp_bufa_); comp_bufa_ = NULL;
 		_aligned_free(comp_bufb_); comp_bufb_ = NULL;
 		AfxEndThread(1);            // kills thread (no return)
@@ -258,23 +258,6 @@ void CHexEditDoc::KillPreviewThread()
 	ASSERT(wait_status == WAIT_OBJECT_0 || wait_status == WAIT_FAILED);
 	tt.stop();
 	TRACE1("+++ Thread took %g secs to kill\n", double(tt.elapsed()));
-
-	// Free resources that are only needed during scan
-	if (pfile6_ != NULL)
-	{
-		pfile6_->Close();
-		delete pfile6_;
-		pfile6_ = NULL;
-	}
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		if (data_file6_[ii] != NULL)
-		{
-			data_file6_[ii]->Close();
-			delete data_file6_[ii];
-			data_file6_[ii] = NULL;
-		}
-	}
 }
 
 // bg_func is the entry point for the thread.
@@ -292,31 +275,6 @@ static UINT bg_func(LPVOID pParam)
 void CHexEditDoc::CreatePreviewThread()
 {
 	ASSERT(pthread6_ == NULL);
-	ASSERT(pfile6_ == NULL);
-
-	// Open copy of file to be used by background thread
-	if (pfile1_ != NULL)
-	{
-		if (IsDevice())
-			pfile6_ = new CFileNC();
-		else
-			pfile6_ = new CFile64();
-		if (!pfile6_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE1("+++ Preview file open failed for %p\n", this);
-			return;
-		}
-	}
-
-	// Open copy of any data files in use too
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		ASSERT(data_file6_[ii] == NULL);
-		if (data_file_[ii] != NULL)
-			data_file6_[ii] = new CFile64(data_file_[ii]->GetFilePath(), 
-										  CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-	}
 
 	// Create new thread
 	preview_command_ = NONE;
@@ -34,21 +34,20 @@ clear_found_: signals the bg thread to clear() found_ at the start of a new sear
               Previously the fg thread did this but if found_ had millions of entries
 			  this would freeze the main thread for a few seconds (minutes in debug mode).
 docdata_: is a critical section used to protect access to the other shared data members below
+docrw_: read/write lock for pfile1_/loc_/undo_ - GetData() takes a read lock
 
-pfile2_: is a ptr to file open the same as pfile1_.  Using a separate file allows the main thread
-		 to read from pfile1_ without having to lock docdata_.  Locking is only required
-		 when the background thread accesses the file or the main thread changes it.
-		 This means that file display should never be slowed by the background thread.
+pfile1_: the file is shared with the main thread - GetData() uses positional reads
+		 (CFile64::ReadAt) so no separate copy of the file is needed.
 loc_: accessed (via GetData) in both threads to get data from the file
 undo_: loc_ uses data stored in undo array
 
 to_search_: list of areas of the file to search
-found_: addresses where occurences were found
+found_: addresses where occurences were found (and the id of the pattern found, which is
+        always 0 unless searching for several patterns - see boyer::findall)
 main_thread_id: used by background thread to signal the main thread (PostThreadMessage)
 
-to_adjust_: list of adjustments to be done by bg thread when a file change is made
-			allows bg thread to fix found_ to allow for file changes and the bg thread
-			to fix its internal addresses to allow for insertions/deletions
+search_snap_: snapshot of the document being searched (see TakeSnapshot in DocData.cpp)
+			   so the bg thread can read the data without holding any lock
 
 Background thread
 -----------------
@@ -120,12 +119,12 @@ When a document is changed the changed area has to be updated in all views
 in case some search occurrences have gone or been created.  Also if there
 are deletions/insertions the displayed occurrences move within the views.
 
-Any bg search currently in progress has to be informed of any address changes
-due to insertions or deletions (see to_adjust_).  Also the changed area is added
-to to_search_ so that any new occurrences are found.
-
-In the bg thread whenever the document data is accessed the to_adjust_ list
-of address adjustments is checked and internal variables adjusted first.
+The bg thread searches a snapshot of the document so changes made while it is
+searching do not affect what it reads.  After each buffer it checks whether the
+document has changed since the snapshot was taken and if so moves the addresses
+of the occurrences it found (see MapAddress) before adding them to found_.  Any
+occurrence that overlaps a changed area is dropped.  The changed area is also
+added to to_search_ so that any new occurrences are found.
 
 Views (see CBGSearchHint used by CHexEditView::OnUpdate)
 -----
@@ -228,9 +227,9 @@ int CHexEditDoc::SearchOccurrences()
 	// Protect access to shared data
 	CSingleLock sl(&docdata_, TRUE);
 
-	if (!to_search_.empty())
+	if (!to_search_.empty() || batch_level_ > 0)
 	{
-		// background search still in progress
+		// background search still in progress (or found_ not yet updated for a batch of changes)
 		return -2;
 	}
 
@@ -311,6 +310,7 @@ FILE_ADDRESS CHexEditDoc::GetNextFound(const unsigned char *pat, const unsigned
 		CSingleLock s2(&theApp.appdata_, TRUE);
 
 		if (theApp.pboyer_ == NULL ||
+			!theApp.pboyer_->simple() ||          // bg search is for several patterns or a regex
 			icase != theApp.icase_ ||
 			tt != theApp.text_type_ ||
 			wholeword != theApp.wholeword_ ||
@@ -336,19 +336,19 @@ FILE_ADDRESS CHexEditDoc::GetNextFound(const unsigned char *pat, const unsigned
 	// Protect access to shared data
 	CSingleLock sl(&docdata_, TRUE);
 
-	if (!to_search_.empty())
+	if (!to_search_.empty() || batch_level_ > 0)
 	{
-		// background search still in progress
+		// background search still in progress (or found_ not yet updated for a batch of changes)
 		return -2;
 	}
 
 	// Find the first address greater or equal to from in found_
-	std::set<FILE_ADDRESS>::const_iterator pp = found_.lower_bound(from);
+	std::map<FILE_ADDRESS, int>::const_iterator pp = found_.lower_bound(from);
 
 	if (pp == found_.end())
 		return -1;                      // None found
 	else
-		return *pp;                     // Return the address found
+		return pp->first;               // Return the address found
 }
 
 // Same as GetNextFound but finds the previous occurrence if any
@@ -367,6 +367,7 @@ FILE_ADDRESS CHexEditDoc::GetPrevFound(const unsigned char *pat, const unsigned
 		CSingleLock s2(&theApp.appdata_, TRUE);
 
 		if (theApp.pboyer_ == NULL ||
+			!theApp.pboyer_->simple() ||          // bg search is for several patterns or a regex
 			icase != theApp.icase_ ||
 			tt != theApp.text_type_ ||
 			wholeword != theApp.wholeword_ ||
@@ -392,24 +393,25 @@ FILE_ADDRESS CHexEditDoc::GetPrevFound(const unsigned char *pat, const unsigned
 	// Protect access to shared data
 	CSingleLock sl(&docdata_, TRUE);
 
-	if (!to_search_.empty())
+	if (!to_search_.empty() || batch_level_ > 0)
 	{
-		// background search still in progress
+		// background search still in progress (or found_ not yet updated for a batch of changes)
 		return -2;
 	}
 
 	// Find the first address greater or equal to form in found_
-	std::set<FILE_ADDRESS>::const_iterator pp = found_.upper_bound(from);
+	std::map<FILE_ADDRESS, int>::const_iterator pp = found_.upper_bound(from);
 
 	if (pp == found_.begin())
 		return -1;                      // None found
 	else
-		return *(--pp);                 // Return the address
+		return (--pp)->first;           // Return the address
 }
 
-// Get all the found search addresses in a range
+// Get all the found search addresses in a range (and which pattern was found at each
+// if pids is not NULL, for working out their lengths - see boyer::pattern_length)
 std::vector<FILE_ADDRESS> CHexEditDoc::SearchAddresses(FILE_ADDRESS start, 
-										FILE_ADDRESS end)
+										FILE_ADDRESS end, std::vector<int> *pids /*=NULL*/)
 {
 	std::vector<FILE_ADDRESS> retval;
 
@@ -417,7 +419,7 @@ std::vector<FILE_ADDRESS> CHexEditDoc::SearchAddresses(FILE_ADDRESS start,
 	CSingleLock sl(&docdata_, TRUE);
 
 	// Return nothing until background searching has finished
-	if (!to_search_.empty())
+	if (!to_search_.empty() || batch_level_ > 0)
 		return retval;
 
 #if 0 // this won't compile - needs inserter?
@@ -425,11 +427,13 @@ std::vector<FILE_ADDRESS> CHexEditDoc::SearchAddresses(FILE_ADDRESS start,
 				  found_.lower_bound(start),
 				  found_.lower_bound(end));
 #else
-	std::set<FILE_ADDRESS>::const_iterator pp = found_.lower_bound(start);
-	std::set<FILE_ADDRESS>::const_iterator pend = found_.lower_bound(end);
+	std::map<FILE_ADDRESS, int>::const_iterator pp = found_.lower_bound(start);
+	std::map<FILE_ADDRESS, int>::const_iterator pend = found_.lower_bound(end);
 	while (pp != pend)
 	{
-		retval.push_back(*pp);
+		retval.push_back(pp->first);
+		if (pids != NULL)
+			pids->push_back(pp->second);
 		++pp;
 	}
 #endif
@@ -480,34 +484,15 @@ void CHexEditDoc::FixFound(FILE_ADDRESS start, FILE_ADDRESS end,
 		}
 	}
 #else
-	std::set<FILE_ADDRESS> tmp;
-	if (adjust < 0)
-	{
-		for (std::set<FILE_ADDRESS>::iterator paddr = found_.begin(); paddr != found_.end(); ++paddr)
-		{
-			if (*paddr >= address)
-			{
-				ASSERT(*paddr + adjust >= address); // Anything in this range should have been deleted by erase above
-				tmp.insert(*paddr + adjust);
-			}
-			else
-				tmp.insert(*paddr);
-		}
-	}
-	else
+	// Only the addresses after the change move so take them out and put them back adjusted
+	std::map<FILE_ADDRESS, int>::iterator pfirst = found_.lower_bound(address);
+	std::vector<std::pair<FILE_ADDRESS, int> > tail(pfirst, found_.end());
+	found_.erase(pfirst, found_.end());
+	for (std::vector<std::pair<FILE_ADDRESS, int> >::const_iterator paddr = tail.begin(); paddr != tail.end(); ++paddr)
 	{
-		for (std::set<FILE_ADDRESS>::reverse_iterator paddr = found_.rbegin(); paddr != found_.rend(); ++paddr)
-		{
-			if (*paddr >= address)
-			{
-				ASSERT(*paddr + adjust >= address); // Anything in this range should have been deleted by erase above
-				tmp.insert(*paddr + adjust);
-			}
-			else
-				tmp.insert(*paddr);
-		}
+		ASSERT(paddr->first + adjust >= address); // Anything in this range should have been deleted by erase above
+		found_.insert(found_.end(), std::make_pair(paddr->first + adjust, paddr->second));
 	}
-	found_.swap(tmp);  // Quick way to put tmp into found_ (tmp d'tor will destroy old found_)
 #endif
 }
 
@@ -556,7 +541,6 @@ void CHexEditDoc::StartSearch(FILE_ADDRESS start /*=-1*/, FILE_ADDRESS end /*=-1
 	docdata_.Lock();
 
 	to_search_.clear();
-	to_adjust_.clear();
 	find_total_ = 0;
 	find_done_ = 0.0;
 
@@ -644,23 +628,6 @@ void CHexEditDoc::KillSearchThread()
 	DWORD wait_status = ::WaitForSingleObject(hh, INFINITE);
 	ASSERT(wait_status == WAIT_OBJECT_0 || wait_status == WAIT_FAILED);
 
-	// Free resources that are only needed during bg searches
-	if (pfile2_ != NULL)
-	{
-		pfile2_->Close();
-		delete pfile2_;
-		pfile2_ = NULL;
-	}
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		if (data_file2_[ii] != NULL)
-		{
-			data_file2_[ii]->Close();
-			delete data_file2_[ii];
-			data_file2_[ii] = NULL;
-		}
-	}
-
 	found_.clear();      // Even though we set clear_found_ above we still need to do this in case the bg thread was not waiting and did not get the message
 
 	to_search_.clear();
@@ -680,31 +647,6 @@ void CHexEditDoc::CreateSearchThread()
 {
 	ASSERT(CanDoSearch());
 	ASSERT(pthread2_ == NULL);
-	ASSERT(pfile2_ == NULL);
-
-	// Open copy of file to be used by background thread
-	if (pfile1_ != NULL)
-	{
-		if (IsDevice())
-			pfile2_ = new CFileNC();
-		else
-			pfile2_ = new CFile64();
-		if (!pfile2_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE1("+++ File2 open failed for %p\n", this);
-			return;
-		}
-	}
-
-	// Open copy of any data files in use too
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		ASSERT(data_file2_[ii] == NULL);
-		if (data_file_[ii] != NULL)
-			data_file2_[ii] = new CFile64(data_file_[ii]->GetFilePath(), 
-										  CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-	}
 
 	// Create new thread
 	search_command_ = NONE;
@@ -765,7 +707,7 @@ UINT CHexEditDoc::RunSearchThread()
 		ASSERT(bb.length() > 0);
 		ASSERT(tt == 0 || tt == 1 || tt == 2 || tt == 3);
 
-		if (bb.length() > file_len)
+		if (bb.min_length() > file_len)
 		{
 			// Nothing can be found
 			CSingleLock sl(&docdata_, TRUE);
@@ -792,19 +734,6 @@ UINT CHexEditDoc::RunSearchThread()
 			{
 				CSingleLock sl(&docdata_, TRUE); // Protect shared data access
 
-				// Check if there has been a file insertion/deletion
-				while (!to_adjust_.empty())
-				{
-					FixFound(to_adjust_.front().start_, 
-							 to_adjust_.front().end_,
-							 to_adjust_.front().address_,
-							 to_adjust_.front().adjust_);
-
-					// start, end should have already been adjusted at this point
-					to_adjust_.pop_front();
-				}
-				file_len = length_;
-
 				// Find where we have to search
 				if (to_search_.empty())
 				{
@@ -816,6 +745,10 @@ UINT CHexEditDoc::RunSearchThread()
 				start = to_search_.front().first;
 				if (start < 0) start = 0;
 				end = to_search_.front().second;
+
+				// Search this version of the doc - to_search_ can't change until we unlock docdata_
+				TakeSnapshot(search_snap_);
+				file_len = search_snap_.length;
 				if (end < 0) end = file_len;
 			}
 			//TRACE("+++ BGSearch: search %d to %d\n", int(start), int(end));
@@ -823,8 +756,10 @@ UINT CHexEditDoc::RunSearchThread()
 			// We need to extend the search a little for wholeword searches since even though the pattern match
 			// does not change the fact that a match is discarded due to the "alphabeticity" of characters at
 			// either end changing when chars are inserted or deleted.
+			int before = 0;                 // Bytes before an occurrence that affect whether it matches
 			if (wholeword)
 			{
+				before = tt == 2 ? 2 : 1;
 				if (start > 0) start--;
 				if (tt == 2 && start > 0) start--;  // Go back 2 bytes for Unicode searches
 				++end;                  // No test needed here since "end" is adjusted below if past EOF
@@ -835,100 +770,95 @@ UINT CHexEditDoc::RunSearchThread()
 			end = min(end + bb.length() - 1, file_len);
 
 			find_done_ = 0.0;               // We haven't searched any of this to_search_ block yet
-
-			while (addr_buf + bb.length() <= end)
+			doc_cursor cursor;              // Speeds up reading of consecutive blocks
+			doc_span span;                  // Keeps the bytes being searched (pbuf) valid
+			bool stale = false;             // File data moved (eg file saved) so redo this block
+			std::vector<std::pair<FILE_ADDRESS, int> > found; // Occurrences (snapshot address + pattern) found in the current buffer
+			std::vector<std::pair<size_t, int> > multi_found; // Occurrences of several patterns in the current buffer
+			FILE_ADDRESS match_end = start; // Where the last regex match found ends (see findall)
+
+			while (addr_buf + bb.min_length() <= end)
 			{
 				size_t got;
 				bool alpha_before = false;
 				bool alpha_after = false;
 
-				// Get the next block
+				// Get a buffer full (plus an extra char for wholeword test at end of buffer).  The bytes are
+				// searched in place if they are all in one span (see GetSpan), otherwise (where an edit or
+				// mapped view of the file ends) they are copied to search_buf_ so that occurrences across
+				// the boundary are found.
+				// Note: there is no need to lock docdata_ since the snapshot does not change
+				size_t want = size_t(min(FILE_ADDRESS(buf_len), end - addr_buf)) + 1;
+				const unsigned char *pspan;
+				got = GetSpan(pspan, search_buf_, want, addr_buf, -1, cursor, span, search_snap_);
+				if (got < want && addr_buf + got < file_len)
 				{
-					CSingleLock sl(&docdata_, TRUE);   // For accessing file data
-
-					// Check if search cancelled or thread killed
-					if (search_command_ != NONE)
-						goto stop_search;
+					span.release();
+					pspan = search_buf_;
+					got = GetData(search_buf_, want, addr_buf, cursor, search_snap_);
+				}
+				if (got == 0)
+				{
+					stale = true;
+					break;
+				}
+				unsigned char *pbuf = const_cast<unsigned char *>(pspan);  // (searching does not change the bytes)
+				ASSERT(got == min(buf_len, end - addr_buf) || got == min(buf_len, end - addr_buf) + 1);
+				//TRACE1("+++ BGSearch: got %d\n", int(got));
 
-					// Check for any file insertions/deletions
-					while (!to_adjust_.empty())
+				if (wholeword)
+				{
+					// Work out whether the character before the buf is alphabetic
+					if (addr_buf > 0 && tt == 1)
 					{
-						//TRACE("+++ Adjusting already found\n");
-						FixFound(to_adjust_.front().start_, 
-								 to_adjust_.front().end_,
-								 to_adjust_.front().address_,
-								 to_adjust_.front().adjust_);
-						//TRACE("+++ Finished adjusting\n");
-
-						if (start >= to_adjust_.front().address_)
+						// Check if alphabetic ASCII
+						unsigned char cc;
+						if (GetData(&cc, 1, addr_buf-1, cursor, search_snap_) != 1)
 						{
-							start += to_adjust_.front().adjust_;
-							if (start < to_adjust_.front().address_)
-								start = to_adjust_.front().address_;
+							stale = true;
+							break;
 						}
-						if (end >= to_adjust_.front().address_)
-						{
-							end += to_adjust_.front().adjust_;
-							if (end < to_adjust_.front().address_)
-								end = to_adjust_.front().address_;
-						}
-						if (addr_buf >= to_adjust_.front().address_)
-						{
-							addr_buf += to_adjust_.front().adjust_;
-							if (addr_buf < to_adjust_.front().address_)
-								addr_buf = to_adjust_.front().address_;
-						}
-						to_adjust_.pop_front();
-					}
-					file_len = length_;   // file length may have changed
-
-					// Get a buffer full (plus an extra char for wholeword test at end of buffer)
-					got = GetData(search_buf_, size_t(min(FILE_ADDRESS(buf_len), end - addr_buf)) + 1, addr_buf, 2);
-					ASSERT(got == min(buf_len, end - addr_buf) || got == min(buf_len, end - addr_buf) + 1);
-					//TRACE1("+++ BGSearch: got %d\n", int(got));
 
-					if (wholeword)
+						alpha_before = isalnum(cc) != 0;
+					}
+					else if (addr_buf > 1 && tt == 2)
 					{
-						// Work out whether the character before the buf is alphabetic
-						if (addr_buf > 0 && tt == 1)
+						// Check if alphabetic Unicode
+						unsigned char cc[2];
+						if (GetData(cc, 2, addr_buf-2, cursor, search_snap_) != 2)
 						{
-							// Check if alphabetic ASCII
-							unsigned char cc;
-							VERIFY(GetData(&cc, 1, addr_buf-1, 2) == 1);
-
-							alpha_before = isalnum(cc) != 0;
+							stale = true;
+							break;
 						}
-						else if (addr_buf > 1 && tt == 2)
-						{
-							// Check if alphabetic Unicode
-							unsigned char cc[2];
-							VERIFY(GetData(cc, 2, addr_buf-2, 2) == 2);
 
-							alpha_before = isalnum(cc[0]) != 0;  // Check if low byte has ASCII alpha
-						}
-						else if (addr_buf > 0 && tt == 3)
+						alpha_before = isalnum(cc[0]) != 0;  // Check if low byte has ASCII alpha
+					}
+					else if (addr_buf > 0 && tt == 3)
+					{
+						// Check if alphabetic EBCDIC
+						unsigned char cc;
+						if (GetData(&cc, 1, addr_buf-1, cursor, search_snap_) != 1)
 						{
-							// Check if alphabetic EBCDIC
-							unsigned char cc;
-							VERIFY(GetData(&cc, 1, addr_buf-1, 2) == 1);
-
-							alpha_before = isalnum(e2a_tab[cc]) != 0;
+							stale = true;
+							break;
 						}
 
-						// If we read an extra character check if it is alphabetic
-						if (got == min(buf_len, end - addr_buf) + 1)
-						{
-							if (tt == 3)
-								alpha_after = isalnum(e2a_tab[search_buf_[got-1]]) != 0;
-							else
-								alpha_after = isalnum(search_buf_[got-1]) != 0;
-						}
+						alpha_before = isalnum(e2a_tab[cc]) != 0;
 					}
 
-					// Remove extra character obtained for wholeword test
+					// If we read an extra character check if it is alphabetic
 					if (got == min(buf_len, end - addr_buf) + 1)
-						got--;
+					{
+						if (tt == 3)
+							alpha_after = isalnum(e2a_tab[pbuf[got-1]]) != 0;
+						else
+							alpha_after = isalnum(pbuf[got-1]) != 0;
+					}
 				}
+
+				// Remove extra character obtained for wholeword test
+				if (got == min(buf_len, end - addr_buf) + 1)
+					got--;
 #ifdef TESTING1
 				// For testing we allow 2 seconds for some changes to be made to the first
 				// search block so that we can check that found_ is updated correctly
@@ -939,32 +869,80 @@ UINT CHexEditDoc::RunSearchThread()
 				}
 #endif
 
-				for (unsigned char *pp = search_buf_;
-					 (pp = bb.findforw(pp, got - (pp-search_buf_), ignorecase, tt, wholeword,
-						  alpha_before, alpha_after, alignment, offset, base_addr, addr_buf + (pp-search_buf_))) != NULL;
-					 ++pp)
+				found.clear();
+				if (!bb.simple())
+				{
+					// Find all the patterns (or regex matches) in one pass.  Occurrences that start in the part of the
+					// buffer that is searched again next time (at the end) are left until then.
+					size_t limit = addr_buf + got < end ? got - (bb.length() - 1) : got;
+					multi_found.clear();
+					bb.findall(pbuf, got, limit, match_end > addr_buf ? size_t(match_end - addr_buf) : 0, ignorecase, tt, wholeword,
+							   alpha_before, alpha_after, alignment, offset, base_addr, addr_buf, multi_found);
+					for (std::vector<std::pair<size_t, int> >::const_iterator pm = multi_found.begin(); pm != multi_found.end(); ++pm)
+					{
+						++count;
+						found.push_back(std::make_pair(addr_buf + pm->first, pm->second));
+						match_end = max(match_end, addr_buf + FILE_ADDRESS(pm->first + bb.pattern_length(pm->second)));
+					}
+				}
+				else
 				{
-					// Found one
-					++count;
+					for (unsigned char *pp = pbuf;
+						 (pp = bb.findforw(pp, got - (pp-pbuf), ignorecase, tt, wholeword,
+							  alpha_before, alpha_after, alignment, offset, base_addr, addr_buf + (pp-pbuf))) != NULL;
+						 ++pp)
+					{
+						// Found one
+						++count;
+						found.push_back(std::make_pair(addr_buf + (pp - pbuf), 0));
+
+						if (tt == 1)
+							alpha_before = isalnum(*pp) != 0;
+						else if (tt == 3)
+							alpha_before = isalnum(e2a_tab[*pp]) != 0;
+						else if (pp > pbuf)
+							alpha_before = isalnum(*(pp-1)) != 0;   // Check low byte of Unicode
+						else
+							alpha_before = false;                   // Only one byte before - we need 2 for Unicode
+					}
+				}
+
+				span.release();                 // (before locking docdata_)
 
+				// Add what we found to found_ - moving them if the doc has changed since the snapshot
+				{
 					CSingleLock sl(&docdata_, TRUE);
 
+					// Check if search cancelled or thread killed
 					if (search_command_ != NONE)
 						goto stop_search;
 
-					found_.insert(addr_buf + (pp - search_buf_));
-					//TRACE("+++ added %d (count is now %d)\n", int(addr_buf + (pp - search_buf_)), int(found_.size()));
-
-					if (tt == 1)
-						alpha_before = isalnum(*pp) != 0;
-					else if (tt == 3)
-						alpha_before = isalnum(e2a_tab[*pp]) != 0;
-					else if (pp > search_buf_)
-						alpha_before = isalnum(*(pp-1)) != 0;   // Check low byte of Unicode
+					if (SnapshotCurrent(search_snap_))
+					{
+						for (std::vector<std::pair<FILE_ADDRESS, int> >::const_iterator pf = found.begin(); pf != found.end(); ++pf)
+							found_.insert(found_.end(), *pf);
+					}
 					else
-						alpha_before = false;                   // Only one byte before - we need 2 for Unicode
+					{
+						// Any occurrence in (or next to for wholeword) a changed area is dropped as
+						// Change/Undo has added the area to to_search_ (and may have moved it).
+						for (std::vector<std::pair<FILE_ADDRESS, int> >::const_iterator pf = found.begin(); pf != found.end(); ++pf)
+						{
+							FILE_ADDRESS addr = MapAddress(search_snap_, pf->first - before, bb.pattern_length(pf->second) + 2*before);
+							if (addr == -1)
+								continue;
+							addr += before;
+							// An insertion/deletion before the occurrence may mean it is no longer aligned
+							if (alignment > 1 && addr != pf->first && (addr - pf->first) % alignment != 0)
+								continue;
+							found_.insert(std::make_pair(addr, pf->second));
+						}
+					}
+					//TRACE("+++ found_ has %d\n", int(found_.size()));
 				}
 
+				if (addr_buf + got >= end)
+					break;                  // (with several patterns got may be less than the overlap)
 				addr_buf += got - (bb.length() - 1);
 
 				find_done_ = double(addr_buf - start) / double(end - start);
@@ -973,24 +951,14 @@ UINT CHexEditDoc::RunSearchThread()
 			{
 				CSingleLock sl(&docdata_, TRUE);
 
-				// Check for any file insertions/deletions
-				while (!to_adjust_.empty())
-				{
-					FixFound(to_adjust_.front().start_, 
-							 to_adjust_.front().end_,
-							 to_adjust_.front().address_,
-							 to_adjust_.front().adjust_);
-
-					to_adjust_.pop_front();
-				}
-				file_len = length_;
-
-				// Remove the block just searched from to_search_
-				to_search_.pop_front();
+				// Remove the block just searched from to_search_ (unless we have to do it again)
+				if (!stale)
+					to_search_.pop_front();
 			}
 		stop_search:
-			;
+			ReleaseSnapshot(search_snap_);
 		} // for
+		ReleaseSnapshot(search_snap_);
 		delete[] search_buf_;
 		search_buf_ = NULL;
 	}
@@ -1011,6 +979,7 @@ bool CHexEditDoc::SearchProcessStop()
 		TRACE1("+++ BGSearch: killed thread for %p\n", this);
 		search_state_ = DYING;
 		sl.Unlock();                // we need this here as AfxEndThread() never returns so d'tor is not called
+		ReleaseSnapshot(search_snap_);
 		delete[] search_buf_;
 		search_buf_ = NULL;
 		AfxEndThread(1);            // kills thread (no return)
@@ -23,6 +23,8 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
+static const size_t stats_buf_size = 16384;     // Size of stats_buf_
+
 // Returns true if global options says we can do background stats on this file
 bool CHexEditDoc::CanDoStats()
 {
@@ -109,7 +111,7 @@ int CHexEditDoc::GetCRC32(unsigned long &retval)
 	if (!theApp.bg_stats_crc32_)
 		return -1;
 
-	if (!stats_fin_)
+	if (!digests_fin_)
 		return -2;         // stats calcs in progress
 
 	retval = crc32_;
@@ -127,7 +129,7 @@ int CHexEditDoc::GetMd5(unsigned char buf[16])
 	if (!theApp.bg_stats_md5_)
 		return -1;
 
-	if (!stats_fin_)
+	if (!digests_fin_)
 		return -2;         // stats calcs in progress
 
 	memcpy(buf, md5_, sizeof(md5_));
@@ -145,7 +147,7 @@ int CHexEditDoc::GetSha1(unsigned char buf[20])
 	if (!theApp.bg_stats_sha1_)
 		return -1;
 
-	if (!stats_fin_)
+	if (!digests_fin_)
 		return -2;         // stats calcs in progress
 
 	memcpy(buf, sha1_, sizeof(sha1_));
@@ -163,7 +165,7 @@ int CHexEditDoc::GetSha256(unsigned char buf[32])
 	if (!theApp.bg_stats_sha256_)
 		return -1;
 
-	if (!stats_fin_)
+	if (!digests_fin_)
 		return -2;         // stats calcs in progress
 
 	memcpy(buf, sha256_, sizeof(sha256_));
@@ -181,51 +183,29 @@ int CHexEditDoc::GetSha512(unsigned char buf[64])
 	if (!theApp.bg_stats_sha512_)
 		return -1;
 
-	if (!stats_fin_)
+	if (!digests_fin_)
 		return -2;         // stats calcs in progress
 
 	memcpy(buf, sha512_, sizeof(sha512_));
 	return 0;
 }
 
-// Doc has changed - signal current scan to stop then start new scan
+// Doc has changed - signal the thread to update the stats.  The current scan is not
+// stopped as it scans a snapshot of the doc - at the end the byte counts are updated
+// for what has changed since (see stats_update_counts) and digests are continued with
+// the new version if the change is after what has been done so far (see stats_rebase).
+// The snapshot is released when the scan finishes (so that the doc does not have to
+// keep old data for it) so a change made after that means the doc is scanned again.
 void CHexEditDoc::StatsChange()
 {
 	if (pthread5_ == NULL) return;
 
-	// Make sure the current (main) thread does not have docdata_ locked
-	ASSERT(docdata_.m_sect.LockCount == -1 ||                                    // not locked OR
-		   (DWORD)docdata_.m_sect.OwningThread != ::GetCurrentThreadId() ||      // locked by other thread OR
-		   docdata_.m_sect.RecursionCount == 0);                                 // finished with it now
-
-	// Wait for thread to stop if necessary
-	bool waiting;
-	docdata_.Lock();
-	stats_command_ = STOP;
-	docdata_.Unlock();
-	SetThreadPriority(pthread5_->m_hThread, THREAD_PRIORITY_NORMAL);
-	for (int ii = 0; ii < 100; ++ii)
-	{
-		// Wait just a little bit in case the thread was just about to go into wait state
-		docdata_.Lock();
-		waiting = stats_state_ == WAITING;
-		docdata_.Unlock();
-		if (waiting)
-			break;
-		TRACE("+++ StatsChange - thread not waiting [lock=%d recurse=%d]\n", docdata_.m_sect.LockCount, docdata_.m_sect.RecursionCount);
-		Sleep(1);
-	}
-	SetThreadPriority(pthread5_->m_hThread, THREAD_PRIORITY_LOWEST);
-	//ASSERT(waiting);
-
-	// Reset and restart the scan
 	docdata_.Lock();
-	stats_command_ = NONE;  // make sure we don't stop the scan before it starts
-	stats_fin_ = false;
+	stats_fin_ = digests_fin_ = false;
 	stats_progress_ = 0;
 	docdata_.Unlock();
 
-	TRACE("+++ Pulsing stats event (restart) for %p\n", this);
+	TRACE("+++ Pulsing stats event (change) for %p\n", this);
 	start_stats_event_.SetEvent();
 }
 
@@ -272,7 +252,8 @@ void CHexEditDoc::StartStats()
 
 	// Restart the scan
 	stats_command_ = NONE;
-	stats_fin_ = false;
+	stats_fin_ = digests_fin_ = false;
+	stats_rescan_ = true;               // options may have changed so we can't use previous results
 	stats_progress_ = 0;
 	docdata_.Unlock();
 
@@ -316,23 +297,6 @@ void CHexEditDoc::KillStatsThread()
 	pthread5_ = NULL;
 	DWORD wait_status = ::WaitForSingleObject(hh, INFINITE);
 	ASSERT(wait_status == WAIT_OBJECT_0 || wait_status == WAIT_FAILED);
-
-	// Free resources that are only needed during bg scan
-	if (pfile5_ != NULL)
-	{
-		pfile5_->Close();
-		delete pfile5_;
-		pfile5_ = NULL;
-	}
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		if (data_file5_[ii] != NULL)
-		{
-			data_file5_[ii]->Close();
-			delete data_file5_[ii];
-			data_file5_[ii] = NULL;
-		}
-	}
 }
 
 static UINT bg_func(LPVOID pParam)
@@ -348,36 +312,12 @@ void CHexEditDoc::CreateStatsThread()
 {
 	ASSERT(CanDoStats());
 	ASSERT(pthread5_ == NULL);
-	ASSERT(pfile5_ == NULL);
-
-	// Open copy of file to be used by background thread
-	if (pfile1_ != NULL)
-	{
-		if (IsDevice())
-			pfile5_ = new CFileNC();
-		else
-			pfile5_ = new CFile64();
-		if (!pfile5_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE("+++ File5 open failed for %p\n", this);
-			return;
-		}
-	}
-
-	// Open copy of any data files in use too
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		ASSERT(data_file5_[ii] == NULL);
-		if (data_file_[ii] != NULL)
-			data_file5_[ii] = new CFile64(data_file_[ii]->GetFilePath(), 
-										  CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-	}
 
 	// Create new thread
 	stats_command_ = NONE;
 	stats_state_ = STARTING;
-	stats_fin_ = false;
+	stats_fin_ = digests_fin_ = false;
+	stats_rescan_ = true;
 	stats_progress_ = 0;
 	TRACE("+++ Creating stats thread for %p\n", this);
 	pthread5_ = AfxBeginThread(&bg_func, this, THREAD_PRIORITY_LOWEST);
@@ -407,19 +347,37 @@ UINT CHexEditDoc::RunStatsThread()
 			continue;
 
 		docdata_.Lock();
-		stats_fin_ = false;
-		stats_progress_ = 0;
-		FILE_ADDRESS file_len = length_;
+		bool rescan = stats_rescan_;
+		stats_rescan_ = false;
 		BOOL do_crc32 = theApp.bg_stats_crc32_;
 		BOOL do_md5   = theApp.bg_stats_md5_;
 		BOOL do_sha1 = theApp.bg_stats_sha1_;
 		BOOL do_sha256 = theApp.bg_stats_sha256_;
 		BOOL do_sha512 = theApp.bg_stats_sha512_;
 		docdata_.Unlock();
+		bool do_digests = do_crc32 || do_md5 || do_sha1 || do_sha256 || do_sha512;
 
-		const size_t buf_size = 16384;
 		ASSERT(stats_buf_ == NULL && c32_ == NULL && c64_ == NULL);
-		stats_buf_ = new unsigned char[buf_size];
+		stats_buf_ = new unsigned char[stats_buf_size];
+
+		// If the last scan finished and nothing has changed since we don't need to scan again
+		if (!rescan && stats_done_ && stats_edit_ == EditCount())
+		{
+			CSingleLock sl(&docdata_, TRUE);
+			stats_fin_ = true;
+			digests_fin_ = do_digests != FALSE;
+			stats_progress_ = 100;
+
+			delete[] stats_buf_;
+			stats_buf_ = NULL;
+			continue;
+		}
+
+		// Scan the current version of the doc
+		stats_done_ = false;
+		ASSERT(!stats_snap_.active);
+		TakeSnapshot(stats_snap_);
+		FILE_ADDRESS file_len = stats_snap_.length;
 
 		if (file_len < LONG_MAX)
 		{
@@ -433,6 +391,8 @@ UINT CHexEditDoc::RunStatsThread()
 		}
 
 		FILE_ADDRESS addr = 0;
+		doc_cursor cursor;              // Speeds up reading of consecutive blocks
+		doc_span span;                  // Keeps the bytes being processed (pbuf below) valid
 		void * hcrc32 = NULL;
 
 		CryptoPP::Weak1::MD5 md5;
@@ -448,9 +408,95 @@ UINT CHexEditDoc::RunStatsThread()
 		// Scan all the data blocks of the file
 		for (;;)
 		{
-			if (StatsProcessStop())
+			bool stop = StatsProcessStop();
+			bool restart = false;           // The doc changed in a way that means we have to start again
+
+			// If the doc has changed while calculating digests we continue with the new version if we can
+			if (!stop && do_digests && !SnapshotCurrent(stats_snap_))
+			{
+				if (stats_rebase(addr))
+				{
+					file_len = stats_snap_.length;
+					if (c32_ != NULL && file_len >= LONG_MAX)
+					{
+						// Doc is now too big for 32-bit counts
+						c64_ = new __int64[256];
+						for (int ii = 0; ii < 256; ++ii)
+							c64_[ii] = c32_[ii];
+						delete[] c32_;
+						c32_ = NULL;
+					}
+				}
+				else
+					restart = true;
+			}
+
+			size_t got = 0;
+			const unsigned char *pbuf;      // Data to process (in stats_buf_ or straight from the snapshot memory or file map)
+			if (!stop && !restart &&
+				(got = GetSpan(pbuf, stats_buf_, stats_buf_size, addr, -1, cursor, span, stats_snap_)) <= 0)
+			{
+				if (addr < stats_snap_.length)
+					restart = true;         // snapshot is stale (eg doc was saved)
+				else
+				{
+					// We reached the end of the file at last - save results and go back to wait state
+					CSingleLock sl(&docdata_, TRUE); // Protect shared data access
+
+					// Digests must be for the current doc so continue with the latest version (see above)
+					bool current = SnapshotCurrent(stats_snap_);
+					if (do_digests && !current)
+						continue;
+
+					if (c32_ != NULL)
+					{
+						for (int ii = 0; ii < 256; ++ii)
+							count_[ii] = c32_[ii];
+					}
+					else
+					{
+						ASSERT(c64_ != NULL);
+						for (int ii = 0; ii < 256; ++ii)
+							count_[ii] = c64_[ii];
+					}
+
+					// Get results of any digests to be calculated
+					if (do_crc32)
+						crc32_ = crc_32_final(hcrc32);
+					if (do_md5)
+						md5.Final(md5_);
+					if (do_sha1)
+						sha1.Final(sha1_);
+					if (do_sha256)
+						sha256.Final(sha256_);
+					if (do_sha512)
+						sha512.Final(sha512_);
+#ifdef _DEBUG
+					__int64 total_count = 0;
+					for (int ii = 0; ii < 256; ++ii)
+						total_count += count_[ii];
+					TRACE("+++ BGStats: finished scan for %p +++++++++++ TOTAL = %d\n", this, int(total_count));
+#endif
+					stats_fin_ = current;
+					digests_fin_ = do_digests && stats_fin_;
+					stats_progress_ = stats_fin_ ? 100 : 0;
+					sl.Unlock();
+
+					// Just count the bytes that were changed during the scan (digests are current - see above)
+					if (stats_fin_ || stats_update_counts())
+					{
+						stats_edit_ = stats_snap_.edit;
+						stats_done_ = true;
+						ReleaseSnapshot(stats_snap_);
+						break;
+					}
+					restart = true;         // snapshot is stale or asked to stop
+				}
+			}
+
+			if (stop || restart)
 			{
-				// Terminated early so reset the calcs
+				// Reset the calcs
 				if (do_crc32)
 					(void)crc_32_final(hcrc32);
 				if (do_md5)
@@ -461,48 +507,28 @@ UINT CHexEditDoc::RunStatsThread()
 					sha256.Restart();
 				if (do_sha512)
 					sha512.Restart();
-				break;
-			}
-
-			size_t got;
-
-			if ((got = GetData(stats_buf_, buf_size, addr, 5)) <= 0)
-			{
-				// We reached the end of the file at last - save results and go back to wait state
-				CSingleLock sl(&docdata_, TRUE); // Protect shared data access
+				ReleaseSnapshot(stats_snap_);
+				if (stop)
+					break;
 
-				if (c32_ != NULL)
+				// Start again with the current version of the doc
+				TRACE("+++ BGStats: restarting scan for %p\n", this);
+				TakeSnapshot(stats_snap_);
+				file_len = stats_snap_.length;
+				addr = 0;
+				if (c64_ == NULL && file_len >= LONG_MAX)
 				{
-					for (int ii = 0; ii < 256; ++ii)
-						count_[ii] = c32_[ii];
+					delete[] c32_;
+					c32_ = NULL;
+					c64_ = new __int64[256];
 				}
+				if (c32_ != NULL)
+					memset(c32_, '\0', 256*sizeof(*c32_));
 				else
-				{
-					ASSERT(c64_ != NULL);
-					for (int ii = 0; ii < 256; ++ii)
-						count_[ii] = c64_[ii];
-				}
-
-				// Get results of any digests to be calculated
+					memset(c64_, '\0', 256*sizeof(*c64_));
 				if (do_crc32)
-					crc32_ = crc_32_final(hcrc32);
-				if (do_md5)
-					md5.Final(md5_);
-				if (do_sha1)
-					sha1.Final(sha1_);
-				if (do_sha256)
-					sha256.Final(sha256_);
-				if (do_sha512)
-					sha512.Final(sha512_);
-#ifdef _DEBUG
-				__int64 total_count = 0;
-				for (int ii = 0; ii < 256; ++ii)
-					total_count += count_[ii];
-				TRACE("+++ BGStats: finished scan for %p +++++++++++ TOTAL = %d\n", this, int(total_count));
-#endif
-				stats_fin_ = true;
-				stats_progress_ = 100;
-				break;
+					hcrc32 = crc_32_init();
+				continue;
 			}
 
 			// Do count of different bytes
@@ -510,7 +536,7 @@ UINT CHexEditDoc::RunStatsThread()
 			{
 				for (size_t ii = 0; ii < got; ++ii)
 				{
-					++c32_[stats_buf_[ii]];
+					++c32_[pbuf[ii]];
 				}
 			}
 			else
@@ -518,23 +544,24 @@ UINT CHexEditDoc::RunStatsThread()
 				ASSERT(c64_ != NULL);
 				for (size_t ii = 0; ii < got; ++ii)
 				{
-					++c64_[stats_buf_[ii]];
+					++c64_[pbuf[ii]];
 				}
 			}
 
 			// Do CRC
 			if (do_crc32)
-				crc_32_update(hcrc32, stats_buf_, got);
+				crc_32_update(hcrc32, pbuf, got);
 
 			// Update any digests (MD5, SHA1, etc) being calculated
 			if (do_md5)
-				md5.Update(stats_buf_, got);
+				md5.Update(pbuf, got);
 			if (do_sha1)
-				sha1.Update(stats_buf_, got);
+				sha1.Update(pbuf, got);
 			if (do_sha256)
-				sha256.Update(stats_buf_, got);
+				sha256.Update(pbuf, got);
 			if (do_sha512)
-				sha512.Update(stats_buf_, got);
+				sha512.Update(pbuf, got);
+			span.release();                 // (before locking docdata_)
 
 			addr += got;
 			{
@@ -552,6 +579,97 @@ UINT CHexEditDoc::RunStatsThread()
 	return 0;  // never reached
 }
 
+// Brings count_ up to date by counting just the bytes that have changed since
+// stats_snap_ was taken (bytes removed are subtracted and bytes added are added).
+// This is done when a scan finishes so that changes made during the scan don't
+// mean starting again.  On return stats_snap_ is the version that count_ is for.
+// Returns false if this can't be done so the whole doc has to be scanned again.
+bool CHexEditDoc::stats_update_counts()
+{
+	ASSERT(stats_snap_.active);
+	for (;;)
+	{
+		{
+			CSingleLock sl(&docdata_, TRUE);
+			if (SnapshotCurrent(stats_snap_))
+			{
+				stats_fin_ = true;
+				stats_progress_ = 100;
+				return true;
+			}
+		}
+
+		doc_snapshot prev;              // Version that count_ is for
+		prev.swap(stats_snap_);
+		TakeSnapshot(stats_snap_);
+
+		std::vector<edit_log::range> removed, added;
+		__int64 diff[256];
+		memset(diff, '\0', sizeof(diff));
+		bool ok = SnapshotDiff(prev, stats_snap_, removed, added) &&
+		          stats_count(prev, removed, diff, -1) &&
+		          stats_count(stats_snap_, added, diff, 1);
+		ReleaseSnapshot(prev);
+		if (!ok)
+			return false;
+
+		CSingleLock sl(&docdata_, TRUE);
+		for (int ii = 0; ii < 256; ++ii)
+			count_[ii] += diff[ii];
+	}
+}
+
+// Moves the scan (stats_snap_) to the current version of the doc.  Returns false if
+// bytes before addr have changed, in which case the scan has to be started again.
+bool CHexEditDoc::stats_rebase(FILE_ADDRESS addr)
+{
+	doc_snapshot prev;
+	prev.swap(stats_snap_);
+	TakeSnapshot(stats_snap_);
+
+	std::vector<edit_log::range> removed, added;
+	bool ok = SnapshotDiff(prev, stats_snap_, removed, added);
+	std::vector<edit_log::range>::const_iterator pr;
+	for (pr = removed.begin(); ok && pr != removed.end(); ++pr)
+		if (pr->first < addr)
+			ok = false;
+	for (pr = added.begin(); ok && pr != added.end(); ++pr)
+		if (pr->first < addr)
+			ok = false;
+
+	ReleaseSnapshot(prev);
+	return ok;
+}
+
+// Adds sign times the count of each byte value in the ranges rr of snap to cnt.
+// Returns false if the snapshot is stale or the thread has been asked to stop.
+bool CHexEditDoc::stats_count(const doc_snapshot &snap, const std::vector<edit_log::range> &rr, __int64 *cnt, int sign)
+{
+	doc_cursor cursor;
+	doc_span span;
+	for (std::vector<edit_log::range>::const_iterator pr = rr.begin(); pr != rr.end(); ++pr)
+	{
+		for (FILE_ADDRESS addr = pr->first; addr < pr->second; )
+		{
+			{
+				CSingleLock sl(&docdata_, TRUE);
+				if (stats_command_ != NONE)
+					return false;
+			}
+
+			const unsigned char *pbuf;
+			size_t got = GetSpan(pbuf, stats_buf_, stats_buf_size, addr, pr->second, cursor, span, snap);
+			if (got == 0)
+				return false;
+			for (size_t ii = 0; ii < got; ++ii)
+				cnt[pbuf[ii]] += sign;
+			span.release();
+			addr += got;
+		}
+	}
+	return true;
+}
+
 bool CHexEditDoc::StatsProcessStop()
 {
 	bool retval = false;
@@ -567,6 +685,7 @@ bool CHexEditDoc::StatsProcessStop()
 		//TRACE("+++ BGstats: killed thread for %p\n", this);
 		stats_state_ = DYING;
 		sl.Unlock();                // we need this here as AfxEndThread() never returns so d'tor is not called
+		ReleaseSnapshot(stats_snap_);
 		delete[] stats_buf_;
 		stats_buf_ = NULL;
 		if (c32_ != NULL) (delete[] c32_), c32_ = NULL;
@@ -0,0 +1,225 @@
+// BookmarkPosns.cpp : implements bookmark_posns (see BookmarkPosns.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include <algorithm>
+#include "HexEdit.h"
+#include "BookmarkPosns.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+void bookmark_posns::set(size_t ii, FILE_ADDRESS pos)
+{
+	ASSERT(ii < posn_.size());
+	unindex();
+	posn_[ii] = pos;
+}
+
+void bookmark_posns::push_back(FILE_ADDRESS pos)
+{
+	unindex();
+	posn_.push_back(pos);
+}
+
+void bookmark_posns::erase(size_t ii)
+{
+	ASSERT(ii < posn_.size());
+	unindex();
+	posn_.erase(posn_.begin() + ii);
+}
+
+void bookmark_posns::clear()
+{
+	posn_.clear();
+	indexed_ = false;
+	stale_ = false;
+}
+
+void bookmark_posns::assign(const std::vector<FILE_ADDRESS> &posn)
+{
+	posn_ = posn;
+	indexed_ = false;
+	stale_ = false;
+}
+
+void bookmark_posns::get(std::vector<FILE_ADDRESS> &posn)
+{
+	unindex();
+	posn = posn_;
+}
+
+void bookmark_posns::insert(FILE_ADDRESS address, FILE_ADDRESS len)
+{
+	index();
+	size_t rr = search(address, false);     // first bookmark at or after address
+	if (rr < gap_.size())
+	{
+		add(rr, len);
+		stale_ = true;
+	}
+}
+
+void bookmark_posns::remove(FILE_ADDRESS address, FILE_ADDRESS len)
+{
+	index();
+	size_t first = search(address, true);       // first bookmark after address
+	size_t last  = search(address + len, true); // first bookmark after the deleted bytes
+	if (first == gap_.size())
+		return;                                 // no bookmarks affected
+
+	FILE_ADDRESS prev = first > 0 ? prefix(first - 1) : 0;
+	FILE_ADDRESS last_posn = last < gap_.size() ? prefix(last) : 0;
+
+	// Bookmarks in the deleted bytes all move to address
+	for (size_t rr = first; rr < last; ++rr)
+	{
+		add(rr, (rr == first ? address - prev : 0) - gap_[rr]);
+		prev = address;
+	}
+	// The rest move back by len
+	if (last < gap_.size())
+		add(last, last_posn - len - prev - gap_[last]);
+	stale_ = true;
+}
+
+int bookmark_posns::find(FILE_ADDRESS pos)
+{
+	index();
+	size_t rr = search(pos, false);
+	if (rr < gap_.size() && prefix(rr) == pos)
+		return order_[rr];
+	else
+		return -1;
+}
+
+int bookmark_posns::before(FILE_ADDRESS pos)
+{
+	index();
+	size_t rr = search(pos, false);
+	return rr > 0 ? order_[rr - 1] : -1;
+}
+
+int bookmark_posns::after(FILE_ADDRESS pos)
+{
+	index();
+	size_t rr = search(pos, true);
+	return rr < gap_.size() ? order_[rr] : -1;
+}
+
+size_t bookmark_posns::lower(FILE_ADDRESS pos)
+{
+	index();
+	return search(pos, false);
+}
+
+FILE_ADDRESS bookmark_posns::sorted(size_t rr)
+{
+	index();
+	ASSERT(rr < gap_.size());
+	return prefix(rr);
+}
+
+void bookmark_posns::index()
+{
+	if (indexed_)
+		return;
+	ASSERT(!stale_);
+
+	size_t nn = posn_.size();
+	std::vector<std::pair<FILE_ADDRESS, int> > tmp(nn);
+	for (size_t ii = 0; ii < nn; ++ii)
+		tmp[ii] = std::make_pair(posn_[ii], int(ii));
+	std::sort(tmp.begin(), tmp.end());
+
+	order_.resize(nn);
+	rank_.resize(nn);
+	gap_.resize(nn);
+	tree_.assign(nn + 1, 0);
+	FILE_ADDRESS prev = 0;
+	for (size_t rr = 0; rr < nn; ++rr)
+	{
+		order_[rr] = tmp[rr].second;
+		rank_[tmp[rr].second] = int(rr);
+		gap_[rr] = tmp[rr].first - prev;
+		prev = tmp[rr].first;
+	}
+
+	// Build the Fenwick tree in O(n): each node adds itself into its parent
+	for (size_t kk = 1; kk <= nn; ++kk)
+	{
+		tree_[kk] += gap_[kk - 1];
+		size_t parent = kk + (kk & (0 - kk));
+		if (parent <= nn)
+			tree_[parent] += tree_[kk];
+	}
+	indexed_ = true;
+}
+
+void bookmark_posns::unindex()
+{
+	if (stale_)
+	{
+		// Get the current positions from the gaps
+		FILE_ADDRESS pos = 0;
+		for (size_t rr = 0; rr < gap_.size(); ++rr)
+		{
+			pos += gap_[rr];
+			posn_[order_[rr]] = pos;
+		}
+		stale_ = false;
+	}
+	indexed_ = false;
+}
+
+// Returns index (in address order) of the first bookmark at or after pos (or the first
+// one after pos if inclusive is true, ie bookmarks at pos are included in those before),
+// or size() if there are none.  As the gaps are never negative we can descend the
+// Fenwick tree to find it in O(log n).
+size_t bookmark_posns::search(FILE_ADDRESS pos, bool inclusive) const
+{
+	ASSERT(indexed_);
+	size_t nn = gap_.size();
+	size_t step = 1;
+	while (step*2 <= nn)
+		step *= 2;
+
+	size_t kk = 0;                      // Number of bookmarks found to be before pos
+	FILE_ADDRESS sum = 0;
+	for ( ; step > 0; step /= 2)
+	{
+		if (kk + step <= nn &&
+			(sum + tree_[kk + step] < pos || (inclusive && sum + tree_[kk + step] == pos)))
+		{
+			kk += step;
+			sum += tree_[kk];
+		}
+	}
+	return kk;
+}
+
+FILE_ADDRESS bookmark_posns::prefix(size_t rr) const
+{
+	ASSERT(indexed_ && rr < gap_.size());
+	FILE_ADDRESS retval = 0;
+	for (size_t kk = rr + 1; kk > 0; kk -= kk & (0 - kk))
+		retval += tree_[kk];
+	return retval;
+}
+
+void bookmark_posns::add(size_t rr, FILE_ADDRESS delta)
+{
+	ASSERT(indexed_ && rr < gap_.size());
+	gap_[rr] += delta;
+	for (size_t kk = rr + 1; kk <= gap_.size(); kk += kk & (0 - kk))
+		tree_[kk] += delta;
+}
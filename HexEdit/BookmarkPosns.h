@@ -0,0 +1,83 @@
+// BookmarkPosns.h : file positions of the bookmarks of a document
+//
+// For implementation see: BookmarkPosns.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// The positions of a document's bookmarks used to be kept in a vector (parallel
+// to CHexEditDoc::bm_index_) and every insertion or deletion in the document had
+// to adjust all the bookmarks after it.  With thousands of bookmarks (eg after
+// "Bookmark All") every keystroke in insert mode was slowed down.
+//
+// bookmark_posns is still accessed by bookmark number (same as bm_index_) but
+// also keeps the bookmarks in address order with the difference (gap) between
+// each one and the one before.  The gaps are stored in a Fenwick tree (binary
+// indexed tree) so that the position of a bookmark (the sum of the gaps before
+// it) can be found in O(log n).  Moving all bookmarks after an address (for
+// an insertion or deletion) only needs one gap to be changed so is O(log n) too,
+// as are finding the bookmark at an address and the closest one before or after.
+//
+// Adding, removing or moving a bookmark just changes a plain vector of positions
+// and the sorted order is rebuilt (O(n log n)) when next needed.
+
+#ifndef BOOKMARKPOSNS_INCLUDED
+#define BOOKMARKPOSNS_INCLUDED  1
+
+#include <vector>
+
+class bookmark_posns
+{
+public:
+	bookmark_posns() : indexed_(true), stale_(false) { }
+
+	size_t size() const { return posn_.size(); }
+	bool empty() const { return posn_.empty(); }
+	FILE_ADDRESS operator[](size_t ii) const    // Position of bookmark ii
+	{
+		ASSERT(ii < posn_.size());
+		return stale_ ? prefix(rank_[ii]) : posn_[ii];
+	}
+
+	// Changes to the bookmarks (bookmark numbers are the same as for a vector)
+	void set(size_t ii, FILE_ADDRESS pos);
+	void push_back(FILE_ADDRESS pos);
+	void erase(size_t ii);
+	void clear();
+	void assign(const std::vector<FILE_ADDRESS> &posn);
+	void get(std::vector<FILE_ADDRESS> &posn);  // Positions of all bookmarks (in bookmark order)
+
+	// Update for changes to the document
+	void insert(FILE_ADDRESS address, FILE_ADDRESS len);  // Bookmarks at or after address move up by len
+	void remove(FILE_ADDRESS address, FILE_ADDRESS len);  // Bytes deleted - bookmarks in them move to address
+
+	// These return a bookmark number or -1 if there is none
+	int find(FILE_ADDRESS pos);         // A bookmark at pos
+	int before(FILE_ADDRESS pos);       // Closest bookmark before pos
+	int after(FILE_ADDRESS pos);        // Closest bookmark after pos
+
+	// Accessing bookmarks in address order, eg for the bookmarks from start to end:
+	//   for (size_t rr = bm.lower(start); rr < bm.size() && bm.sorted(rr) < end; ++rr)
+	size_t lower(FILE_ADDRESS pos);     // Index (in address order) of first bookmark at or after pos
+	FILE_ADDRESS sorted(size_t rr);     // Position of a bookmark given its index in address order
+
+private:
+	void index();                       // Make sure sorted order and gaps are up to date
+	void unindex();                     // Make sure posn_ is up to date (before changing it)
+	size_t search(FILE_ADDRESS pos, bool inclusive) const;
+	FILE_ADDRESS prefix(size_t rr) const;   // Sum of gaps up to and including rr = posn of rr
+	void add(size_t rr, FILE_ADDRESS delta);
+
+	std::vector<FILE_ADDRESS> posn_;    // Position of each bookmark (not up to date if stale_)
+	bool indexed_;                      // Are the following up to date?
+	bool stale_;                        // Have bookmarks been moved since posn_ was updated?
+	std::vector<int> order_;            // Bookmark numbers in address order
+	std::vector<int> rank_;             // Inverse of order_ (where each bookmark is in address order)
+	std::vector<FILE_ADDRESS> gap_;     // Distance of each bookmark (in address order) from the previous
+	std::vector<FILE_ADDRESS> tree_;    // Fenwick tree of gap_ (1-based)
+};
+
+#endif
@@ -9,6 +9,9 @@
 
 #include "stdafx.h"
 #include <string.h>
+#include <intrin.h>             // For _BitScanForward etc
+#include <emmintrin.h>          // For SSE2 intrinsics
+#include <algorithm>
 
 #include "boyer.h"
 
@@ -111,6 +114,41 @@ static unsigned char bit_count[] =
 	3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8
 };
 
+// Can SSE2 instructions be used?  This is only checked the first time.
+static bool use_sse2()
+{
+	static int avail = -1;              // -1 = not yet checked
+	if (avail == -1)
+		avail = ::IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) ? 1 : 0;
+	return avail != 0;
+}
+
+// Gets the byte values that compare equal to cc (using the same comparisons as findforw)
+// where mode is 0 = exact, 1 = ASCII/Unicode ignore case, 2 = EBCDIC ignore case.
+// Returns the number of values put in vals, or 0 if there are more than 2.
+static int match_set(unsigned char cc, int mode, unsigned char vals[2])
+{
+	int count = 0;
+	for (int xx = 0; xx < 256; ++xx)
+	{
+		bool same;
+		if (mode == 0)
+			same = xx == cc;
+		else if (mode == 1)
+			same = toupper(xx) == toupper(cc);
+		else
+			same = e2u_tab[xx] == e2u_tab[cc];
+		if (same)
+		{
+			if (count == 2)
+				return 0;
+			vals[count++] = (unsigned char)xx;
+		}
+	}
+	ASSERT(count > 0);
+	return count;
+}
+
 // Normal constructor
 boyer::boyer(const unsigned char *pat, size_t patlen, const unsigned char *mask)
 {
@@ -134,6 +172,9 @@ boyer::boyer(const unsigned char *pat, size_t patlen, const unsigned char *mask)
 	for (ii = patlen; ii > 0; ii--)
 		bskip_[pat[ii-1]] = ii - 1;
 	pattern_len_ = patlen;
+	simd_setup();
+	bitap_setup();
+	multi_mode_ = 0;
 
 #ifdef _DEBUG
 	ASSERT(sizeof(bit_count) == 256);
@@ -148,6 +189,65 @@ boyer::boyer(const unsigned char *pat, size_t patlen, const unsigned char *mask)
 #endif
 }
 
+// Constructor for searching for any of several patterns in one pass (see aho_corasick).
+// The case-insensitivity and char set are fixed when the automaton is built so findforw
+// etc must be called with the same icase and tt.
+boyer::boyer(const std::vector<std::vector<unsigned char> > &pats, BOOL icase, int tt)
+{
+	ASSERT(!pats.empty());
+	size_t ii;
+
+	// Bytes that compare equal (see match_set) are folded to the same value
+	multi_mode_ = !icase ? 0 : (tt == 3 ? 2 : 1);
+	unsigned char fold[256];
+	for (ii = 0; ii < 256; ++ii)
+	{
+		if (multi_mode_ == 0)
+			fold[ii] = (unsigned char)ii;
+		else if (multi_mode_ == 1)
+			fold[ii] = (unsigned char)toupper(int(ii));
+		else
+			fold[ii] = e2u_tab[ii];
+	}
+	multi_.reset(new aho_corasick(pats, fold));
+
+	// Keep the longest pattern so that length() is the most bytes an occurrence can cover
+	size_t longest = 0;
+	for (ii = 1; ii < pats.size(); ++ii)
+		if (pats[ii].size() > pats[longest].size())
+			longest = ii;
+	pattern_len_ = pats[longest].size();
+	pattern_ = new unsigned char[pattern_len_];
+	memcpy(pattern_, &pats[longest][0], pattern_len_);
+	mask_ = NULL;
+
+	for (ii = 0; ii < 256; ++ii)
+		fskip_[ii] = bskip_[ii] = pattern_len_;  // (not used)
+	for (int mode = 0; mode < 3; ++mode)
+		nfirst_[mode] = nlast_[mode] = 0;
+	bitap_setup();
+}
+
+// Constructor for searching for a regular expression (see byte_regex).  length() is the
+// longest match (so searches of a buffer must overlap by length() - 1 as for other
+// searches).  If the expression is not valid regex_error() says why.
+boyer::boyer(const char *regex, BOOL icase)
+{
+	regex_.reset(new byte_regex(regex, icase != 0));
+	multi_mode_ = !icase ? 0 : 1;
+
+	pattern_len_ = regex_->error() == NULL ? regex_->max_length() : 1;
+	pattern_ = new unsigned char[pattern_len_];
+	memset(pattern_, '\0', pattern_len_);      // (not used)
+	mask_ = NULL;
+
+	for (size_t ii = 0; ii < 256; ++ii)
+		fskip_[ii] = bskip_[ii] = pattern_len_;  // (not used)
+	for (int mode = 0; mode < 3; ++mode)
+		nfirst_[mode] = nlast_[mode] = 0;
+	bitap_setup();
+}
+
 // Copy constructor
 boyer::boyer(const boyer &from)
 {
@@ -164,6 +264,15 @@ boyer::boyer(const boyer &from)
 
 	memcpy(fskip_, from.fskip_, sizeof(fskip_));
 	memcpy(bskip_, from.bskip_, sizeof(bskip_));
+	memcpy(first_, from.first_, sizeof(first_));
+	memcpy(last_, from.last_, sizeof(last_));
+	memcpy(nfirst_, from.nfirst_, sizeof(nfirst_));
+	memcpy(nlast_, from.nlast_, sizeof(nlast_));
+	copy_bitap(from);
+	multi_ = from.multi_;
+	multi_mode_ = from.multi_mode_;
+	if (from.regex_)
+		regex_.reset(new byte_regex(*from.regex_));
 }
 
 // Copy assignment operator
@@ -184,6 +293,18 @@ boyer &boyer::operator=(const boyer &from)
 
 		memcpy(fskip_, from.fskip_, sizeof(fskip_));
 		memcpy(bskip_, from.bskip_, sizeof(bskip_));
+		memcpy(first_, from.first_, sizeof(first_));
+		memcpy(last_, from.last_, sizeof(last_));
+		memcpy(nfirst_, from.nfirst_, sizeof(nfirst_));
+		memcpy(nlast_, from.nlast_, sizeof(nlast_));
+		delete[] bitap_;
+		copy_bitap(from);
+		multi_ = from.multi_;
+		multi_mode_ = from.multi_mode_;
+		if (from.regex_)
+			regex_.reset(new byte_regex(*from.regex_));
+		else
+			regex_.reset();
 	}
 	return *this;
 }
@@ -193,6 +314,22 @@ boyer::~boyer()
 	delete[] pattern_;
 	if (mask_ != NULL)
 		delete[] mask_;
+	delete[] bitap_;
+}
+
+void boyer::copy_bitap(const boyer &from)
+{
+	bitap_words_ = from.bitap_words_;
+	if (from.bitap_ != NULL)
+	{
+		bitap_ = new unsigned __int64[3*256*bitap_words_];
+		memcpy(bitap_, from.bitap_, 3*256*bitap_words_*sizeof(*bitap_));
+	}
+	else
+		bitap_ = NULL;
+	memcpy(anchor_, from.anchor_, sizeof(anchor_));
+	memcpy(anchor_val_, from.anchor_val_, sizeof(anchor_val_));
+	memcpy(nanchor_, from.nanchor_, sizeof(nanchor_));
 }
 
 // - extra params: wholeword, alignment, mask
@@ -205,12 +342,32 @@ boyer::~boyer()
 // address = address of first byte within file - used for alignment check
 unsigned char *boyer::findforw(unsigned char *pp, size_t len, BOOL icase, int tt,
 						   BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
-						   int alignment, int offset, __int64 base_addr,  __int64 address) const
+						   int alignment, int offset, __int64 base_addr,  __int64 address, int *pid /*=NULL*/) const
 {
+	if (multi_)
+	{
+		ASSERT(multi_mode_ == (!icase ? 0 : (tt == 3 ? 2 : 1)));
+		return multi_findforw(pp, len, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address, pid);
+	}
+	if (regex_)
+	{
+		ASSERT(multi_mode_ == (!icase ? 0 : 1));
+		return regex_find(pp, len, true, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address, pid);
+	}
+	if (pid != NULL)
+		*pid = 0;
+
 	// Search with a mask is handled completely differently
-	if (mask_ != NULL)
+	int mode = !icase ? 0 : (tt == 3 ? 2 : 1);
+	if (mask_ != NULL && bitap_ != NULL)
+		return bitap_find(pp, len, mode, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address);
+	else if (mask_ != NULL)
 		return mask_find(pp, len, icase, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address);
 
+	// Short patterns are faster using SSE2 (if available)
+	if (nfirst_[mode] > 0 && nlast_[mode] > 0 && use_sse2())
+		return simd_findforw(pp, len, mode, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address);
+
 	size_t spos = pattern_len_ - 1;     // Posn within searched bytes
 	size_t patpos = pattern_len_ - 1;   // Posn within search pattern
 
@@ -369,12 +526,32 @@ unsigned char *boyer::findforw(unsigned char *pp, size_t len, BOOL icase, int tt
 
 unsigned char *boyer::findback(unsigned char *pp, size_t len, BOOL icase, int tt,
 							   BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
-							   int alignment, int offset, __int64 base_addr, __int64 address) const
+							   int alignment, int offset, __int64 base_addr, __int64 address, int *pid /*=NULL*/) const
 {
+	if (multi_)
+	{
+		ASSERT(multi_mode_ == (!icase ? 0 : (tt == 3 ? 2 : 1)));
+		return multi_findback(pp, len, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address, pid);
+	}
+	if (regex_)
+	{
+		ASSERT(multi_mode_ == (!icase ? 0 : 1));
+		return regex_find(pp, len, false, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address, pid);
+	}
+	if (pid != NULL)
+		*pid = 0;
+
 	// Search with a mask is handled completely differently
-	if (mask_ != NULL)
+	int mode = !icase ? 0 : (tt == 3 ? 2 : 1);
+	if (mask_ != NULL && bitap_ != NULL)
+		return bitap_findback(pp, len, mode, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address);
+	else if (mask_ != NULL)
 		return mask_findback(pp, len, icase, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address);
 
+	// Short patterns are faster using SSE2 (if available)
+	if (nfirst_[mode] > 0 && nlast_[mode] > 0 && use_sse2())
+		return simd_findback(pp, len, mode, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address);
+
 	long spos = len - pattern_len_;     // Current position within search bytes
 	size_t patpos = 0;                  // Current position within pattern
 
@@ -528,25 +705,176 @@ unsigned char *boyer::findback(unsigned char *pp, size_t len, BOOL icase, int tt
 	return NULL;                // Pattern not matched
 }
 
-// This does not use a Boyer Moore search but simply searches for one character of the
-// search text and then sees if the rest of the string matches.  This will be slower
-// but in the future we may be able to pass stats on number of different bytes
-// in the file to at least look for the least common byte.
-unsigned char *boyer::mask_find(unsigned char *pp, size_t len, BOOL icase, int tt,
-								BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
-								int alignment, int offset, __int64 base_addr, __int64 address) const
+void boyer::simd_setup()
 {
-#ifdef _DEBUG
-	// If case-insensitive mask can only have all bits on or off
-	if (icase) { for (size_t  ii=0; ii < pattern_len_; ++ii) ASSERT(mask_[ii] == 0 || mask_[ii] == 0xFF); }
-#endif
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		if (mask_ != NULL || pattern_len_ == 0 || pattern_len_ > simd_max_len)
+			nfirst_[mode] = nlast_[mode] = 0;
+		else
+		{
+			nfirst_[mode] = match_set(pattern_[0], mode, first_[mode]);
+			nlast_[mode] = match_set(pattern_[pattern_len_ - 1], mode, last_[mode]);
+		}
+	}
+}
 
-	int best_pos = -1;          // Index into pattern_ of byte that we will search for
-	int best_bits = 0;          // Number of bits in mask_[bestpos]
-	BOOL best_alpha = TRUE;     // Is the best found so far an alpha (and icase is on)
+// Do all the bytes of the pattern match at pp (see match_set for mode)?
+bool boyer::match_at(const unsigned char *pp, int mode) const
+{
 	size_t ii;
+	switch (mode)
+	{
+	case 0:
+		return memcmp(pp, pattern_, pattern_len_) == 0;
+	case 1:
+		for (ii = 0; ii < pattern_len_; ++ii)
+			if (toupper(pp[ii]) != toupper(pattern_[ii]))
+				return false;
+		return true;
+	case 2:
+		for (ii = 0; ii < pattern_len_; ++ii)
+			if (e2u_tab[pp[ii]] != e2u_tab[pattern_[ii]])
+				return false;
+		return true;
+	}
+	ASSERT(0);
+	return false;
+}
 
-	for (ii = 0; ii < pattern_len_; ++ii)
+// Checks the whole word and alignment options for a match at pp[spos] - the same tests
+// as done in findforw/findback when all bytes match.
+bool boyer::accept(const unsigned char *pp, size_t len, size_t spos, size_t patlen, int tt,
+				   BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+				   int alignment, int offset, __int64 base_addr, __int64 address) const
+{
+	if (wholeword)
+	{
+		if (spos == 0 && alpha_before)
+			return false;                       // start of search buffer but alpha before buffer
+		if (spos + patlen == len && alpha_after)
+			return false;                       // match at end of buffer but alpha after buffer
+		if (spos > 0 && (tt == 3 ? isalnum(e2a_tab[pp[spos-1]]) : isalnum(pp[spos-1])))
+			return false;                       // alpha before match so whole word search fails
+		if (spos + patlen < len &&
+			(tt == 3 ? isalnum(e2a_tab[pp[spos+patlen]]) : isalnum(pp[spos+patlen])))
+			return false;                       // alpha after match so it's not a whole word
+	}
+	if (alignment > 1 && ((address - base_addr + spos) < 0 || (address - base_addr + spos) % alignment != offset))
+		return false;
+	return true;
+}
+
+// Finds the first match in the same way as findforw, but 16 positions are checked at a time
+// for the first and last bytes of the pattern (which can each match up to 2 byte values
+// so that case-insensitive searches work too).  Only the positions where both match are
+// checked further.
+unsigned char *boyer::simd_findforw(unsigned char *pp, size_t len, int mode, int tt,
+									BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+									int alignment, int offset, __int64 base_addr, __int64 address) const
+{
+	if (len < pattern_len_)
+		return NULL;
+	size_t last = pattern_len_ - 1;             // Offset of last byte of pattern
+	size_t nstart = len - last;                 // Number of positions where a match can start
+
+	__m128i f0 = _mm_set1_epi8(char(first_[mode][0]));
+	__m128i f1 = _mm_set1_epi8(char(first_[mode][nfirst_[mode] - 1]));
+	__m128i l0 = _mm_set1_epi8(char(last_[mode][0]));
+	__m128i l1 = _mm_set1_epi8(char(last_[mode][nlast_[mode] - 1]));
+
+	size_t spos;
+	for (spos = 0; spos + 16 <= nstart; spos += 16)
+	{
+		__m128i vf = _mm_loadu_si128((const __m128i *)(pp + spos));
+		__m128i vl = _mm_loadu_si128((const __m128i *)(pp + spos + last));
+		__m128i eq = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(vf, f0), _mm_cmpeq_epi8(vf, f1)),
+								   _mm_or_si128(_mm_cmpeq_epi8(vl, l0), _mm_cmpeq_epi8(vl, l1)));
+		unsigned long bits = (unsigned long)_mm_movemask_epi8(eq);
+		while (bits != 0)
+		{
+			unsigned long bit;
+			_BitScanForward(&bit, bits);
+			bits &= bits - 1;                   // clear the bit
+			if (match_at(pp + spos + bit, mode) &&
+				accept(pp, len, spos + bit, pattern_len_, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+			{
+				return pp + spos + bit;
+			}
+		}
+	}
+
+	// Check the last few (less than 16) positions one at a time
+	for ( ; spos < nstart; ++spos)
+	{
+		if (match_at(pp + spos, mode) &&
+			accept(pp, len, spos, pattern_len_, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+		{
+			return pp + spos;
+		}
+	}
+	return NULL;
+}
+
+// Finds the last match in the same way as findback (see simd_findforw)
+unsigned char *boyer::simd_findback(unsigned char *pp, size_t len, int mode, int tt,
+									BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+									int alignment, int offset, __int64 base_addr, __int64 address) const
+{
+	if (len < pattern_len_)
+		return NULL;
+	size_t last = pattern_len_ - 1;             // Offset of last byte of pattern
+	size_t spos = len - last;                   // Positions from here on have been checked
+
+	__m128i f0 = _mm_set1_epi8(char(first_[mode][0]));
+	__m128i f1 = _mm_set1_epi8(char(first_[mode][nfirst_[mode] - 1]));
+	__m128i l0 = _mm_set1_epi8(char(last_[mode][0]));
+	__m128i l1 = _mm_set1_epi8(char(last_[mode][nlast_[mode] - 1]));
+
+	while (spos >= 16)
+	{
+		spos -= 16;
+		__m128i vf = _mm_loadu_si128((const __m128i *)(pp + spos));
+		__m128i vl = _mm_loadu_si128((const __m128i *)(pp + spos + last));
+		__m128i eq = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(vf, f0), _mm_cmpeq_epi8(vf, f1)),
+								   _mm_or_si128(_mm_cmpeq_epi8(vl, l0), _mm_cmpeq_epi8(vl, l1)));
+		unsigned long bits = (unsigned long)_mm_movemask_epi8(eq);
+		while (bits != 0)
+		{
+			unsigned long bit;
+			_BitScanReverse(&bit, bits);
+			bits &= ~(1UL << bit);              // clear the bit
+			if (match_at(pp + spos + bit, mode) &&
+				accept(pp, len, spos + bit, pattern_len_, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+			{
+				return pp + spos + bit;
+			}
+		}
+	}
+
+	// Check the first few (less than 16) positions one at a time
+	while (spos > 0)
+	{
+		--spos;
+		if (match_at(pp + spos, mode) &&
+			accept(pp, len, spos, pattern_len_, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+		{
+			return pp + spos;
+		}
+	}
+	return NULL;
+}
+
+// Works out which byte of the pattern is best to search for in a masked search (the one
+// with the most bits in the mask, preferring non-alpha chars when ignoring case).
+// Returns its index in pattern_ or -1 if the mask has no bits on.
+int boyer::mask_best(BOOL icase, int tt, int &best_bits, BOOL &best_alpha) const
+{
+	int best_pos = -1;          // Index into pattern_ of byte that we will search for
+	best_bits = 0;              // Number of bits in mask_[bestpos]
+	best_alpha = TRUE;          // Is the best found so far an alpha (and icase is on)
+
+	for (size_t ii = 0; ii < pattern_len_; ++ii)
 	{
 		if (mask_[ii] == 0xFF &&
 			(!icase || (tt==3 && !isalpha(e2a_tab[pattern_[ii]])) || (tt != 3 && !isalpha(pattern_[ii]))) )
@@ -568,6 +896,465 @@ unsigned char *boyer::mask_find(unsigned char *pp, size_t len, BOOL icase, int t
 			best_pos = ii;
 		}
 	}
+	return best_pos;
+}
+
+// Does byte cc match pattern_[ii] (with the mask) - the same test as mask_find
+bool boyer::mask_match(unsigned char cc, size_t ii, BOOL icase, int tt) const
+{
+	if (mask_[ii] == 0)
+		return true;
+	else if (mask_[ii] != 0xFF)
+		return (cc & mask_[ii]) == (pattern_[ii] & mask_[ii]);
+	else if (!icase)
+		return cc == pattern_[ii];
+	else if (tt != 3)
+		return toupper(cc) == toupper(pattern_[ii]);
+	else
+		return e2u_tab[cc] == e2u_tab[pattern_[ii]];
+}
+
+// Sets up the tables for bitap_find/bitap_findback.  For each mode (see match_set) and byte
+// value there is a bit for each byte of the pattern which is on if the byte value matches.
+// (For the byte that mask_find searches for first, only the values it searches for are on.)
+// The first fully-specified byte of the pattern is used to skip ahead (see bitap_skip).
+void boyer::bitap_setup()
+{
+	bitap_ = NULL;
+	bitap_words_ = 0;
+	for (int mode = 0; mode < 3; ++mode)
+		anchor_[mode] = -1;
+	if (mask_ == NULL || pattern_len_ == 0 || pattern_len_ > bitap_max_len)
+		return;
+
+	size_t words = (pattern_len_ + 63)/64;
+	bitap_words_ = int(words);
+	bitap_ = new unsigned __int64[3*256*words];
+	memset(bitap_, 0, 3*256*words*sizeof(*bitap_));
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		BOOL icase = mode != 0;
+		int tt = mode == 2 ? 3 : 1;
+		int best_bits;
+		BOOL best_alpha;
+		int best_pos = mask_best(icase, tt, best_bits, best_alpha);
+		unsigned __int64 *tab = bitap_ + mode*256*words;
+
+		for (size_t ii = 0; ii < pattern_len_; ++ii)
+		{
+			int count = 0;                  // Number of byte values that match this byte of the pattern
+			unsigned char vals[2];          // The first 2 of them
+			for (int cc = 0; cc < 256; ++cc)
+			{
+				bool ok = mask_match((unsigned char)cc, ii, icase, tt);
+				if (ok && int(ii) == best_pos)
+				{
+					unsigned char pc = pattern_[ii];
+					if (best_bits == 8)
+						ok = cc == pc;
+					else if (icase && best_alpha && tt == 3)
+						ok = cc == e2l_tab[pc] || cc == e2u_tab[pc];
+					else if (icase && best_alpha)
+						ok = cc == tolower(pc) || cc == toupper(pc);
+				}
+				if (ok)
+				{
+					tab[cc*words + ii/64] |= (unsigned __int64)1 << (ii%64);
+					if (count < 2)
+						vals[count] = (unsigned char)cc;
+					++count;
+				}
+			}
+			if (anchor_[mode] == -1 && mask_[ii] == 0xFF && count > 0 && count <= 2)
+			{
+				anchor_[mode] = int(ii);
+				nanchor_[mode] = count;
+				memcpy(anchor_val_[mode], vals, sizeof(vals));
+			}
+		}
+	}
+}
+
+// Finds where the anchor byte (see bitap_setup) is next found in pp[from] to pp[len-1] if
+// forward, else the last one in pp[0] to pp[from].  Returns its index or -1 if not found.
+long boyer::bitap_skip(const unsigned char *pp, size_t len, long from, int mode, bool forward) const
+{
+	unsigned char v0 = anchor_val_[mode][0];
+	unsigned char v1 = anchor_val_[mode][nanchor_[mode] - 1];
+	if (forward)
+	{
+		long ii = from;
+		if (use_sse2())
+		{
+			__m128i c0 = _mm_set1_epi8(char(v0)), c1 = _mm_set1_epi8(char(v1));
+			for ( ; ii + 16 <= long(len); ii += 16)
+			{
+				__m128i vv = _mm_loadu_si128((const __m128i *)(pp + ii));
+				unsigned long bits = (unsigned long)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(vv, c0), _mm_cmpeq_epi8(vv, c1)));
+				if (bits != 0)
+				{
+					unsigned long bit;
+					_BitScanForward(&bit, bits);
+					return ii + long(bit);
+				}
+			}
+		}
+		for ( ; ii < long(len); ++ii)
+			if (pp[ii] == v0 || pp[ii] == v1)
+				return ii;
+	}
+	else
+	{
+		long ii = from + 1;             // Bytes before ii are still to be checked
+		if (use_sse2())
+		{
+			__m128i c0 = _mm_set1_epi8(char(v0)), c1 = _mm_set1_epi8(char(v1));
+			for ( ; ii >= 16; ii -= 16)
+			{
+				__m128i vv = _mm_loadu_si128((const __m128i *)(pp + ii - 16));
+				unsigned long bits = (unsigned long)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(vv, c0), _mm_cmpeq_epi8(vv, c1)));
+				if (bits != 0)
+				{
+					unsigned long bit;
+					_BitScanReverse(&bit, bits);
+					return ii - 16 + long(bit);
+				}
+			}
+		}
+		while (ii > 0)
+		{
+			--ii;
+			if (pp[ii] == v0 || pp[ii] == v1)
+				return ii;
+		}
+	}
+	return -1;
+}
+
+// Finds the first match of a pattern with a mask, giving the same result as mask_find.
+// This is a Shift-And (bitap) search: bit ii of the state is on if the last ii+1 bytes
+// match the start of the pattern.  When no partial match is in progress we skip to where
+// the anchor byte is next found.
+unsigned char *boyer::bitap_find(unsigned char *pp, size_t len, int mode, int tt,
+								 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								 int alignment, int offset, __int64 base_addr, __int64 address) const
+{
+	if (len < pattern_len_)
+		return NULL;
+
+	size_t words = bitap_words_;
+	const unsigned __int64 *tab = bitap_ + mode*256*words;
+	int anchor = anchor_[mode];
+	size_t top = (pattern_len_ - 1)/64;                     // Word with bit for last byte of pattern
+	unsigned __int64 hi = (unsigned __int64)1 << ((pattern_len_ - 1)%64);
+	unsigned __int64 state[bitap_max_len/64];
+	memset(state, 0, words*sizeof(state[0]));
+	bool active = false;                                    // Are any bits of state on?
+
+	for (size_t ii = 0; ii < len; ++ii)
+	{
+		if (!active && anchor != -1)
+		{
+			// A match must start at ii or later so skip to where it could start
+			long next = bitap_skip(pp, len, long(ii) + anchor, mode, true);
+			if (next == -1 || size_t(next - anchor) + pattern_len_ > len)
+				return NULL;
+			ii = size_t(next - anchor);
+		}
+
+		const unsigned __int64 *pt = tab + pp[ii]*words;
+		if (words == 1)
+		{
+			state[0] = ((state[0] << 1) | 1) & pt[0];
+			active = state[0] != 0;
+		}
+		else
+		{
+			active = false;
+			for (size_t ww = words - 1; ww > 0; --ww)
+			{
+				state[ww] = ((state[ww] << 1) | (state[ww-1] >> 63)) & pt[ww];
+				active = active || state[ww] != 0;
+			}
+			state[0] = ((state[0] << 1) | 1) & pt[0];
+			active = active || state[0] != 0;
+		}
+
+		if ((state[top] & hi) != 0)
+		{
+			size_t spos = ii + 1 - pattern_len_;
+			if (accept(pp, len, spos, pattern_len_, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+				return pp + spos;
+		}
+	}
+	return NULL;
+}
+
+// Finds the last match of a pattern with a mask (like mask_findback) using Shift-And
+// backwards: bit ii of the state is on if the bytes from the current one on match the
+// end of the pattern starting at pattern_[ii].
+unsigned char *boyer::bitap_findback(unsigned char *pp, size_t len, int mode, int tt,
+									 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+									 int alignment, int offset, __int64 base_addr, __int64 address) const
+{
+	if (len < pattern_len_)
+		return NULL;
+
+	size_t words = bitap_words_;
+	const unsigned __int64 *tab = bitap_ + mode*256*words;
+	int anchor = anchor_[mode];
+	long after = long(pattern_len_) - 1 - anchor;          // Bytes of the pattern after the anchor
+	size_t top = (pattern_len_ - 1)/64;                     // Word with bit for last byte of pattern
+	unsigned __int64 hi = (unsigned __int64)1 << ((pattern_len_ - 1)%64);
+	unsigned __int64 state[bitap_max_len/64];
+	memset(state, 0, words*sizeof(state[0]));
+	bool active = false;                                    // Are any bits of state on?
+
+	for (long ii = long(len) - 1; ii >= 0; --ii)
+	{
+		if (!active && anchor != -1)
+		{
+			// A match must end at ii or before so skip back to where it could end
+			long next = ii - after < 0 ? -1 : bitap_skip(pp, len, ii - after, mode, false);
+			if (next == -1 || next < anchor)
+				return NULL;
+			ii = next + after;
+		}
+
+		const unsigned __int64 *pt = tab + pp[ii]*words;
+		if (words == 1)
+		{
+			state[0] = ((state[0] >> 1) | hi) & pt[0];
+			active = state[0] != 0;
+		}
+		else
+		{
+			active = false;
+			for (size_t ww = 0; ww < top; ++ww)
+			{
+				state[ww] = ((state[ww] >> 1) | (state[ww+1] << 63)) & pt[ww];
+				active = active || state[ww] != 0;
+			}
+			state[top] = ((state[top] >> 1) | hi) & pt[top];
+			active = active || state[top] != 0;
+		}
+
+		if ((state[0] & 1) != 0 &&
+			accept(pp, len, size_t(ii), pattern_len_, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+		{
+			return pp + ii;
+		}
+	}
+	return NULL;
+}
+
+size_t boyer::min_length() const
+{
+	if (multi_)
+		return multi_->min_length();
+	else if (regex_ && regex_->error() == NULL)
+		return regex_->min_length();
+	else
+		return pattern_len_;
+}
+
+size_t boyer::pattern_length(int id) const
+{
+	if (multi_ && id >= 0 && size_t(id) < multi_->count())
+		return multi_->length(id);
+	else if (regex_ && id > 0)
+		return size_t(id);              // length of the match
+	else
+		return pattern_len_;            // (also used if id is for an older search)
+}
+
+// Is this a search for the same patterns (in the same order) or the same regex?  (Only
+// for searches that are not simple() as they are the only ones that can be compared.)
+bool boyer::same_search(const boyer &other) const
+{
+	if (regex_ || other.regex_)
+		return regex_ && other.regex_ && regex_->source() == other.regex_->source() && multi_mode_ == other.multi_mode_;
+
+	if (!multi_ || !other.multi_ || multi_->count() != other.multi_->count() || multi_mode_ != other.multi_mode_)
+		return false;
+	for (size_t ii = 0; ii < multi_->count(); ++ii)
+		if (multi_->pattern(int(ii)) != other.multi_->pattern(int(ii)))
+			return false;
+	return true;
+}
+
+// Finds the occurrence (of any of the patterns) with the lowest address, or the longest of
+// those that start there.  Bytes are only scanned until no earlier occurrence could end.
+unsigned char *boyer::multi_findforw(unsigned char *pp, size_t len, int tt,
+									 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+									 int alignment, int offset, __int64 base_addr, __int64 address, int *pid) const
+{
+	size_t best = len;                  // Start of best occurrence so far (len if none)
+	int best_id = -1;
+	size_t max_len = multi_->max_length();
+	int state = 0;
+	for (size_t ii = 0; ii < len; ++ii)
+	{
+		if (best < len && ii >= best + max_len)
+			break;                      // any occurrence that starts before best would have ended by now
+
+		state = multi_->next(state, pp[ii]);
+		for (int id = multi_->first(state); id != -1; id = multi_->after(id))
+		{
+			size_t patlen = multi_->length(id);
+			size_t spos = ii + 1 - patlen;
+			if ((spos < best || (spos == best && patlen > multi_->length(best_id))) &&
+				accept(pp, len, spos, patlen, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+			{
+				best = spos;
+				best_id = id;
+			}
+		}
+	}
+	if (best == len)
+		return NULL;
+	if (pid != NULL)
+		*pid = best_id;
+	return pp + best;
+}
+
+// Finds the occurrence with the highest address (the longest of those that start there).
+// The automaton only works forwards so the whole buffer is scanned.
+unsigned char *boyer::multi_findback(unsigned char *pp, size_t len, int tt,
+									 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+									 int alignment, int offset, __int64 base_addr, __int64 address, int *pid) const
+{
+	std::vector<std::pair<size_t, int> > found;
+	findall(pp, len, len, 0, multi_mode_ != 0, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address, found);
+	if (found.empty())
+		return NULL;
+	if (pid != NULL)
+		*pid = found.back().second;
+	return pp + found.back().first;
+}
+
+// Orders occurrences by address, and the longest first when they start at the same address
+struct multi_order
+{
+	const aho_corasick *pac;
+	bool operator()(const std::pair<size_t, int> &a, const std::pair<size_t, int> &b) const
+	{
+		return a.first < b.first || (a.first == b.first && pac->length(a.second) > pac->length(b.second));
+	}
+};
+
+void boyer::findall(const unsigned char *pp, size_t len, size_t limit, size_t from,
+					BOOL icase, int tt,
+					BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+					int alignment, int offset, __int64 base_addr, __int64 address,
+					std::vector<std::pair<size_t, int> > &found) const
+{
+	if (regex_)
+	{
+		ASSERT(multi_mode_ == (!icase ? 0 : 1));
+		regex_findall(pp, len, limit, from, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address, found);
+		return;
+	}
+	ASSERT(multi_ && multi_mode_ == (!icase ? 0 : (tt == 3 ? 2 : 1)));
+	size_t first = found.size();
+
+	int state = 0;
+	for (size_t ii = 0; ii < len; ++ii)
+	{
+		state = multi_->next(state, pp[ii]);
+		for (int id = multi_->first(state); id != -1; id = multi_->after(id))
+		{
+			size_t patlen = multi_->length(id);
+			size_t spos = ii + 1 - patlen;
+			if (spos < limit &&
+				accept(pp, len, spos, patlen, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+			{
+				found.push_back(std::make_pair(spos, id));
+			}
+		}
+	}
+
+	// Occurrences were found in order of where they end so sort them by where they start,
+	// keeping only the longest of those that start at the same address
+	multi_order mo;
+	mo.pac = multi_.get();
+	std::sort(found.begin() + first, found.end(), mo);
+	std::vector<std::pair<size_t, int> >::iterator pout = found.begin() + first;
+	for (std::vector<std::pair<size_t, int> >::const_iterator pf = found.begin() + first; pf != found.end(); ++pf)
+		if (pout == found.begin() + first || pf->first != (pout-1)->first)
+			*pout++ = *pf;
+	found.erase(pout, found.end());
+}
+
+// Finds the regex match that starts at the lowest (or highest if !forward) address.  The
+// reversed regex finds where matches start (in one backward pass) then the longest match
+// at each start is checked until one is accepted (eg is a whole word).
+unsigned char *boyer::regex_find(unsigned char *pp, size_t len, bool forward, int tt,
+								 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								 int alignment, int offset, __int64 base_addr, __int64 address, int *pid) const
+{
+	ASSERT(regex_ && regex_->error() == NULL);
+	std::vector<size_t> starts;         // Where matches start (highest address first)
+	regex_->starts(pp, len, starts);
+	for (size_t ii = 0; ii < starts.size(); ++ii)
+	{
+		size_t spos = forward ? starts[starts.size() - 1 - ii] : starts[ii];
+		size_t matchlen = regex_->longest(pp + spos, len - spos);
+		if (matchlen > 0 &&
+			accept(pp, len, spos, matchlen, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+		{
+			if (pid != NULL)
+				*pid = int(matchlen);
+			return pp + spos;
+		}
+	}
+	return NULL;
+}
+
+void boyer::regex_findall(const unsigned char *pp, size_t len, size_t limit, size_t from, int tt,
+						  BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+						  int alignment, int offset, __int64 base_addr, __int64 address,
+						  std::vector<std::pair<size_t, int> > &found) const
+{
+	ASSERT(regex_ && regex_->error() == NULL);
+	std::vector<size_t> starts;
+	regex_->starts(pp, len, starts);
+
+	// Starts inside a match already found are skipped - as well as not reporting overlapping
+	// matches this means that longest() does not have to scan most of the same bytes again
+	// for every start (eg .{1,1000} matches at every byte)
+	size_t next = from;                 // Where the last match found ends
+	for (std::vector<size_t>::const_reverse_iterator ps = starts.rbegin(); ps != starts.rend() && *ps < limit; ++ps)
+	{
+		if (*ps < next)
+			continue;
+		size_t matchlen = regex_->longest(pp + *ps, len - *ps);
+		if (matchlen > 0 &&
+			accept(pp, len, *ps, matchlen, tt, wholeword, alpha_before, alpha_after, alignment, offset, base_addr, address))
+		{
+			found.push_back(std::make_pair(*ps, int(matchlen)));
+			next = *ps + matchlen;
+		}
+	}
+}
+
+// This does not use a Boyer Moore search but simply searches for one character of the
+// search text and then sees if the rest of the string matches.  This will be slower
+// but in the future we may be able to pass stats on number of different bytes
+// in the file to at least look for the least common byte.
+unsigned char *boyer::mask_find(unsigned char *pp, size_t len, BOOL icase, int tt,
+								BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								int alignment, int offset, __int64 base_addr, __int64 address) const
+{
+#ifdef _DEBUG
+	// If case-insensitive mask can only have all bits on or off
+	if (icase) { for (size_t  ii=0; ii < pattern_len_; ++ii) ASSERT(mask_[ii] == 0 || mask_[ii] == 0xFF); }
+#endif
+
+	int best_bits;              // Number of bits in mask_[bestpos]
+	BOOL best_alpha;            // Is the best found an alpha (and icase is on)
+	int best_pos = mask_best(icase, tt, best_bits, best_alpha);  // Index into pattern_ of byte that we will search for
+	size_t ii;
 
 	ASSERT(best_pos >= -1 && best_pos < int(pattern_len_));
 
@@ -718,35 +1505,12 @@ unsigned char *boyer::mask_findback(unsigned char *pp, size_t len, BOOL icase, i
 	if (icase) { for (size_t  ii=0; ii < pattern_len_; ++ii) ASSERT(mask_[ii] == 0 || mask_[ii] == 0xFF); }
 #endif
 
-	int best_pos = -1;          // Index into pattern_ of byte that we will search for
-	int best_bits = 0;          // Number of bits in mask_[bestpos]
-	BOOL best_alpha = TRUE;     // Is the best found so far an alpha (and icase is on)
+	int best_bits;              // Number of bits in mask_[bestpos]
+	BOOL best_alpha;            // Is the best found an alpha (and icase is on)
+	int best_pos = mask_best(icase, tt, best_bits, best_alpha);  // Index into pattern_ of byte that we will search for
 	size_t ii;
 
-	for (ii = 0; ii < pattern_len_; ++ii)
-	{
-		if (mask_[ii] == 0xFF &&
-			(!icase || (tt==3 && !isalpha(e2a_tab[pattern_[ii]])) || (tt != 3 && !isalpha(pattern_[ii]))) )
-		{
-			best_pos = ii;
-			best_bits = 8;
-			best_alpha = FALSE;
-			break;              // Best possible character to search for so exit loop
-		}
-		else if (bit_count[mask_[ii]] > best_bits &&
-			(!icase || (tt==3 && !isalpha(e2a_tab[pattern_[ii]])) || (tt != 3 && !isalpha(pattern_[ii]))) )
-		{
-			best_pos = ii;
-			best_bits = bit_count[mask_[ii]];
-			best_alpha = FALSE;
-		}
-		else if (best_alpha && bit_count[mask_[ii]] > 0)
-		{
-			best_pos = ii;
-		}
-	}
-
-	ASSERT(best_pos >= 0 && best_pos < int(pattern_len_));
+	ASSERT(best_pos >= -1 && best_pos < int(pattern_len_));
 
 	// Now do the search
 	for (unsigned char *pfound = pp + len - pattern_len_ + best_pos; ; pfound--)
@@ -821,8 +1585,8 @@ unsigned char *boyer::mask_findback(unsigned char *pp, size_t len, BOOL icase, i
 				pfound = qq;
 		}
 
-		// If not found return
-		if (pfound == NULL)
+		// If not found (or the pattern would start before the buffer) return
+		if (pfound == NULL || pfound < pp + best_pos)
 			return NULL;
 
 		BOOL passed = TRUE;     // Signals if the match failed for any reason
@@ -9,31 +9,63 @@
 
 /////////////////////////////////////////////////////////////////////////////
 
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "AhoCorasick.h"
+#include "ByteRegex.h"
+
 class boyer
 {
 public:
 	// Construction
 	boyer(const unsigned char *pat, size_t len, const unsigned char *mask);
+	boyer(const std::vector<std::vector<unsigned char> > &pats, BOOL icase, int tt);  // Any of several patterns
+	boyer(const char *regex, BOOL icase);                     // Regular expression (see byte_regex)
 	boyer(const boyer &);
 	boyer &operator=(const boyer &);
 	~boyer();
 
 	// Attributes
-	size_t length() { return pattern_len_; }
+	size_t length() const { return pattern_len_; }  // (for several patterns or a regex the longest)
 	const unsigned char *pattern() { return pattern_; }
 	const unsigned char *mask() { return mask_; }
 
-	// Operations
+	// Is this a search for one pattern (of fixed length) rather than several or a regex?
+	bool simple() const { return !multi_ && !regex_; }
+
+	// When searching for several patterns (else there is one pattern with id 0).  For
+	// a regex the id of an occurrence is the length of the match.
+	size_t patterns() const { return multi_ ? multi_->count() : 1; }
+	size_t min_length() const;
+	size_t pattern_length(int id) const;
+	bool same_search(const boyer &other) const;     // Same patterns (in the same order) or regex?
+
+	// When searching for a regex: did it compile (NULL if so else the reason)
+	const char *regex_error() const { return regex_ ? regex_->error() : NULL; }
+
+	// Operations (pid, if not NULL, is set to the id of the pattern found)
 	unsigned char *findforw(unsigned char *pp, size_t len,
 						BOOL icase, int tt,
 						BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
-						int alignment, int offset, __int64 base_addr, __int64 address) const;
+						int alignment, int offset, __int64 base_addr, __int64 address, int *pid = NULL) const;
 	unsigned char *findback(unsigned char *pp, size_t len,
 							BOOL icase, int tt,
 							BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
-							int alignment, int offset, __int64 base_addr, __int64 address) const;
+							int alignment, int offset, __int64 base_addr, __int64 address, int *pid = NULL) const;
+	// Finds all occurrences (of several patterns or a regex) starting before limit, in one
+	// pass.  The positions (in address order) and pattern ids are appended to found.
+	// Regex matches do not overlap - a match that starts inside the last one found is skipped.
+	// When a search is done in several buffers from is where the last match found in the
+	// previous buffer ends (so the matches found don't depend on where the buffers start).
+	void findall(const unsigned char *pp, size_t len, size_t limit, size_t from,
+				 BOOL icase, int tt,
+				 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+				 int alignment, int offset, __int64 base_addr, __int64 address,
+				 std::vector<std::pair<size_t, int> > &found) const;
 
 private:
+	friend struct boyer_test;           // Tests\Search compares the search methods with each other
+
 	unsigned char *mask_find(unsigned char *pp, size_t len,
 							 BOOL icase, int tt,
 							 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
@@ -43,9 +75,75 @@ private:
 								 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
 								 int alignment, int offset, __int64 base_addr, __int64 address) const;
 
+	// Short patterns (without a mask) are searched for using SSE2 instructions to find where
+	// the first and last bytes match (16 positions at a time) then checking the rest.
+	enum { simd_max_len = 16 };         // Longer patterns use Boyer-Moore (big skips)
+	void simd_setup();
+	unsigned char *simd_findforw(unsigned char *pp, size_t len, int mode, int tt,
+								 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								 int alignment, int offset, __int64 base_addr, __int64 address) const;
+	unsigned char *simd_findback(unsigned char *pp, size_t len, int mode, int tt,
+								 BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								 int alignment, int offset, __int64 base_addr, __int64 address) const;
+	bool match_at(const unsigned char *pp, int mode) const;
+
+	// Patterns with a mask use a bit-parallel (Shift-And) search, with one bit for each byte of
+	// the pattern, so that every byte of the searched memory is only looked at once.
+	enum { bitap_max_len = 1024 };      // Longer patterns use mask_find
+	void bitap_setup();
+	void copy_bitap(const boyer &from);
+	int mask_best(BOOL icase, int tt, int &best_bits, BOOL &best_alpha) const;
+	bool mask_match(unsigned char cc, size_t ii, BOOL icase, int tt) const;
+	long bitap_skip(const unsigned char *pp, size_t len, long from, int mode, bool forward) const;
+	unsigned char *bitap_find(unsigned char *pp, size_t len, int mode, int tt,
+							  BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+							  int alignment, int offset, __int64 base_addr, __int64 address) const;
+	unsigned char *bitap_findback(unsigned char *pp, size_t len, int mode, int tt,
+								  BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								  int alignment, int offset, __int64 base_addr, __int64 address) const;
+	bool accept(const unsigned char *pp, size_t len, size_t spos, size_t patlen, int tt,
+				BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+				int alignment, int offset, __int64 base_addr, __int64 address) const;
+
 	unsigned char *pattern_;	// Current search bytes
 	unsigned char *mask_;		// Which bits are used (all if NULL)
 	size_t pattern_len_;		// Length of search bytes
 	size_t fskip_[256];			// Use internally in forward searches
 	size_t bskip_[256];			// Use internally in backward searches
+
+	// For each mode (0 = exact, 1 = ASCII/Unicode ignore case, 2 = EBCDIC ignore case) the byte
+	// values that match the first and last byte of the pattern - nfirst_/nlast_ are 0 if
+	// there are too many values (or the SSE2 search is not used for this pattern).
+	unsigned char first_[3][2], last_[3][2];
+	int nfirst_[3], nlast_[3];
+
+	// Bitap tables (NULL if not used): for each mode and byte value bitap_words_ words with
+	// a bit on for each byte of the pattern that the value matches.
+	unsigned __int64 *bitap_;
+	int bitap_words_;
+	int anchor_[3];                     // First fully-specified byte of pattern (-1 if none)
+	unsigned char anchor_val_[3][2];    // Byte values that match it
+	int nanchor_[3];                    // Number of values in anchor_val_ (1 or 2)
+
+	// For several patterns (NULL for one) an Aho-Corasick automaton is used, built for the
+	// mode (as above) given when constructed.  It is never changed so copies share it.
+	boost::shared_ptr<const aho_corasick> multi_;
+	int multi_mode_;
+	unsigned char *multi_findforw(unsigned char *pp, size_t len, int tt,
+								  BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								  int alignment, int offset, __int64 base_addr, __int64 address, int *pid) const;
+	unsigned char *multi_findback(unsigned char *pp, size_t len, int tt,
+								  BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+								  int alignment, int offset, __int64 base_addr, __int64 address, int *pid) const;
+
+	// For a regex (NULL if none).  The DFA is built as it is used so each copy has its own,
+	// which also means that one boyer object must not be used by two threads at once.
+	boost::shared_ptr<byte_regex> regex_;
+	unsigned char *regex_find(unsigned char *pp, size_t len, bool forward, int tt,
+							  BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+							  int alignment, int offset, __int64 base_addr, __int64 address, int *pid) const;
+	void regex_findall(const unsigned char *pp, size_t len, size_t limit, size_t from, int tt,
+					   BOOL wholeword, BOOL alpha_before, BOOL alpha_after,
+					   int alignment, int offset, __int64 base_addr, __int64 address,
+					   std::vector<std::pair<size_t, int> > &found) const;
 };
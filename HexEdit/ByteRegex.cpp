@@ -0,0 +1,667 @@
+// ByteRegex.cpp : implements byte_regex (see ByteRegex.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include <algorithm>
+#include "ByteRegex.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+static const size_t unbounded = size_t(-1);     // Max length of an expression with * or +
+
+static inline bool in_set(const std::vector<unsigned char> &set, unsigned char cc)
+{
+	return (set[cc>>3] & (1<<(cc&7))) != 0;
+}
+
+static inline void add_byte(std::vector<unsigned char> &set, unsigned char cc)
+{
+	set[cc>>3] |= (unsigned char)(1<<(cc&7));
+}
+
+// Returns the number of bytes in set (so 1 if it is just one byte)
+static int set_count(const std::vector<unsigned char> &set)
+{
+	int retval = 0;
+	for (int cc = 0; cc < 256; ++cc)
+		if (in_set(set, (unsigned char)cc))
+			++retval;
+	return retval;
+}
+
+static inline size_t add_len(size_t aa, size_t bb)
+{
+	return aa == unbounded || bb == unbounded ? unbounded : aa + bb;
+}
+
+byte_regex::byte_regex(const char *re, bool icase)
+	: source_(re), icase_(icase), min_len_(0), max_len_(0), root_(-1), depth_(0)
+{
+	const char *ps = re;
+	if (*ps == '\0')
+	{
+		error_ = "The regular expression is empty.";
+		return;
+	}
+
+	root_ = parse_alt(ps);
+	if (root_ != -1 && *ps == ')')
+		error_ = "The regular expression has a ) without a matching (.";
+	if (!error_.IsEmpty())
+		return;
+
+	build(root_, false, forw_);
+	if (!error_.IsEmpty())
+		return;
+
+	lengths(root_, min_len_, max_len_);
+	if (min_len_ == 0)
+	{
+		error_ = "The regular expression can match an empty sequence of bytes.";
+		return;
+	}
+	else if (min_len_ > max_match_len)
+	{
+		error_.Format("Matches of the regular expression would be longer than %d bytes.", int(max_match_len));
+		return;
+	}
+	if (max_len_ > max_match_len)
+		max_len_ = max_match_len;
+
+	build(root_, true, back_);
+}
+
+// Searching
+
+void byte_regex::starts(const unsigned char *pp, size_t len, std::vector<size_t> &found)
+{
+	int state = 0;                      // The start state is always 0
+	for (size_t ii = len; ii > 0; )
+	{
+		state = move(back_, state, pp[--ii]);
+		if (back_.accept[state])
+			found.push_back(ii);
+	}
+}
+
+size_t byte_regex::longest(const unsigned char *pp, size_t len)
+{
+	size_t retval = 0;
+	if (len > max_len_)
+		len = max_len_;
+
+	int state = 0;
+	for (size_t ii = 0; ii < len; ++ii)
+	{
+		state = move(forw_, state, pp[ii]);
+		if (forw_.accept[state])
+			retval = ii + 1;
+		else if (forw_.states[state].empty())
+			break;                      // No match can get past here
+	}
+	return retval;
+}
+
+// Parsing
+
+int byte_regex::parse_alt(const char *&ps)
+{
+	int retval = parse_cat(ps);
+	while (retval != -1 && *ps == '|')
+	{
+		++ps;
+		int right = parse_cat(ps);
+		if (right == -1)
+			return -1;
+		retval = add_node(RE_ALT, retval, right);
+	}
+	return retval;
+}
+
+int byte_regex::parse_cat(const char *&ps)
+{
+	int retval = -1;
+	while (*ps != '\0' && *ps != '|' && *ps != ')')
+	{
+		int right = parse_repeat(ps);
+		if (right == -1)
+			return -1;
+		retval = retval == -1 ? right : add_node(RE_CAT, retval, right);
+	}
+	if (retval == -1)
+		retval = add_node(RE_EMPTY);    // eg "a|" or "()"
+	return retval;
+}
+
+int byte_regex::parse_repeat(const char *&ps)
+{
+	int retval = parse_atom(ps);
+	while (retval != -1)
+	{
+		if (*ps == '*')
+			retval = add_node(RE_STAR, retval);
+		else if (*ps == '+')
+			retval = add_node(RE_PLUS, retval);
+		else if (*ps == '?')
+			retval = add_node(RE_QUEST, retval);
+		else if (*ps == '{')
+		{
+			// Get the counts n and m of {n}, {n,} or {n,m}
+			if (!isdigit((unsigned char)ps[1]))
+			{
+				error_ = "The regular expression has a { that is not followed by a number.";
+				return -1;
+			}
+			char *end;
+			long nn = strtol(ps + 1, &end, 10), mm;
+			if (*end == '}')
+				mm = nn;
+			else if (end[0] == ',' && end[1] == '}')
+			{
+				mm = -1;
+				++end;
+			}
+			else if (end[0] == ',' && isdigit((unsigned char)end[1]))
+				mm = strtol(end + 1, &end, 10);
+			else
+				mm = -2;
+			if (mm == -2 || *end != '}')
+			{
+				error_ = "The regular expression has a repeat count that is not like {n}, {n,} or {n,m}.";
+				return -1;
+			}
+			if (nn > max_repeat || mm > max_repeat || (mm != -1 && mm < nn))
+			{
+				error_.Format("The regular expression has a repeat count that is not valid (more than %d or n greater than m in {n,m}).", int(max_repeat));
+				return -1;
+			}
+			ps = end + 1;
+
+			// Expand into n copies followed by a star or (m - n) nested optional copies
+			int atom = retval, tail = -1;
+			if (mm == -1)
+				tail = add_node(RE_STAR, atom);
+			else
+				for (long ii = nn; ii < mm; ++ii)
+					tail = add_node(RE_QUEST, tail == -1 ? atom : add_node(RE_CAT, atom, tail));
+			retval = tail;
+			for (long ii = 0; ii < nn; ++ii)
+				retval = retval == -1 ? atom : add_node(RE_CAT, atom, retval);
+			if (retval == -1)
+				retval = add_node(RE_EMPTY);    // {0} or {0,0}
+			continue;                   // (ps already moved past the })
+		}
+		else
+			break;
+		++ps;
+	}
+	return retval;
+}
+
+int byte_regex::parse_atom(const char *&ps)
+{
+	std::vector<unsigned char> set(32, 0);
+
+	switch (*ps)
+	{
+	case '(':
+		{
+			if (++depth_ > max_depth)
+			{
+				error_ = "The regular expression has too many nested brackets.";
+				return -1;
+			}
+			++ps;
+			if (ps[0] == '?' && ps[1] == ':')
+				ps += 2;
+			int retval = parse_alt(ps);
+			if (retval == -1)
+				return -1;
+			if (*ps != ')')
+			{
+				error_ = "The regular expression has a ( without a matching ).";
+				return -1;
+			}
+			++ps;
+			--depth_;
+			return retval;
+		}
+	case '[':
+		return parse_class(ps);
+	case '.':
+		++ps;
+		set.assign(32, 0xFF);
+		break;
+	case '\\':
+		if (!parse_escape(ps, set))
+			return -1;
+		fold(set);
+		break;
+	case '*':
+	case '+':
+	case '?':
+	case '{':
+		error_.Format("The regular expression has a %c with nothing before it to repeat.", *ps);
+		return -1;
+	case '^':
+	case '$':
+		error_.Format("Anchors are not supported in regular expressions (use \\%c to search for the character %c).", *ps, *ps);
+		return -1;
+	default:
+		add_byte(set, (unsigned char)*ps++);
+		fold(set);
+		break;
+	}
+	sets_.push_back(set);
+	return add_node(RE_BYTES, -1, -1, int(sets_.size()) - 1);
+}
+
+int byte_regex::parse_class(const char *&ps)
+{
+	ASSERT(*ps == '[');
+	std::vector<unsigned char> set(32, 0), tmp(32, 0);
+	bool negate = *++ps == '^';
+	if (negate)
+		++ps;
+
+	for (bool first = true; ; first = false)
+	{
+		if (*ps == '\0')
+		{
+			error_ = "The regular expression has a [ without a matching ].";
+			return -1;
+		}
+		if (*ps == ']' && !first)
+		{
+			++ps;
+			break;
+		}
+
+		// Get the first (or only) byte of a range
+		unsigned char lo, hi;
+		if (*ps == '\\')
+		{
+			tmp.assign(32, 0);
+			if (!parse_escape(ps, tmp))
+				return -1;
+			if (set_count(tmp) != 1)
+			{
+				// A set (eg \d) can't start a range so just add them all
+				for (int ii = 0; ii < 32; ++ii)
+					set[ii] |= tmp[ii];
+				continue;
+			}
+			for (lo = 0; !in_set(tmp, lo); ++lo)
+				;
+		}
+		else
+			lo = (unsigned char)*ps++;
+
+		// Get the end of the range if there is one
+		hi = lo;
+		if (ps[0] == '-' && ps[1] != ']' && ps[1] != '\0')
+		{
+			++ps;
+			if (*ps == '\\')
+			{
+				tmp.assign(32, 0);
+				if (!parse_escape(ps, tmp))
+					return -1;
+				if (set_count(tmp) != 1)
+				{
+					error_ = "The regular expression has a range in [] that ends with a set of bytes (eg \\d).";
+					return -1;
+				}
+				for (hi = 0; !in_set(tmp, hi); ++hi)
+					;
+			}
+			else
+				hi = (unsigned char)*ps++;
+			if (hi < lo)
+			{
+				error_ = "The regular expression has a range in [] with the end before the start.";
+				return -1;
+			}
+		}
+		for (int cc = lo; cc <= hi; ++cc)
+			add_byte(set, (unsigned char)cc);
+	}
+
+	fold(set);                          // (before negating so that [^a] does not match A)
+	if (negate)
+		for (int ii = 0; ii < 32; ++ii)
+			set[ii] = (unsigned char)~set[ii];
+	sets_.push_back(set);
+	return add_node(RE_BYTES, -1, -1, int(sets_.size()) - 1);
+}
+
+// Adds the byte(s) of the escape sequence at ps to set and moves ps past it
+bool byte_regex::parse_escape(const char *&ps, std::vector<unsigned char> &set)
+{
+	ASSERT(*ps == '\\');
+	int cc;
+	bool negate = false;
+	switch (*++ps)
+	{
+	case '\0':
+		error_ = "The regular expression ends with a \\.";
+		return false;
+	case 'x':
+		if (!isxdigit((unsigned char)ps[1]) || !isxdigit((unsigned char)ps[2]))
+		{
+			error_ = "The regular expression has a \\x that is not followed by 2 hex digits.";
+			return false;
+		}
+		cc = isdigit((unsigned char)ps[1]) ? ps[1] - '0' : toupper((unsigned char)ps[1]) - 'A' + 10;
+		cc = cc*16 + (isdigit((unsigned char)ps[2]) ? ps[2] - '0' : toupper((unsigned char)ps[2]) - 'A' + 10);
+		add_byte(set, (unsigned char)cc);
+		ps += 2;
+		break;
+	case 'n': add_byte(set, '\n'); break;
+	case 'r': add_byte(set, '\r'); break;
+	case 't': add_byte(set, '\t'); break;
+	case 'f': add_byte(set, '\f'); break;
+	case 'v': add_byte(set, '\v'); break;
+	case '0': add_byte(set, '\0'); break;
+	case 'D':
+		negate = true;
+		// fall through
+	case 'd':
+		for (cc = '0'; cc <= '9'; ++cc)
+			add_byte(set, (unsigned char)cc);
+		break;
+	case 'W':
+		negate = true;
+		// fall through
+	case 'w':
+		for (cc = 0; cc < 128; ++cc)
+			if (isalnum(cc) || cc == '_')
+				add_byte(set, (unsigned char)cc);
+		break;
+	case 'S':
+		negate = true;
+		// fall through
+	case 's':
+		for (cc = 0; cc < 128; ++cc)
+			if (isspace(cc))
+				add_byte(set, (unsigned char)cc);
+		break;
+	default:
+		if (isalnum((unsigned char)*ps))
+		{
+			error_.Format("The regular expression has an unknown escape sequence \\%c.", *ps);
+			return false;
+		}
+		add_byte(set, (unsigned char)*ps);     // eg \. or \\ .
+		break;
+	}
+	if (negate)
+		for (cc = 0; cc < 32; ++cc)
+			set[cc] = (unsigned char)~set[cc];
+	++ps;
+	return true;
+}
+
+int byte_regex::add_node(int type, int left /*=-1*/, int right /*=-1*/, int set /*=-1*/)
+{
+	re_node nn;
+	nn.type = type;
+	nn.left = left;
+	nn.right = right;
+	nn.set = set;
+	node_.push_back(nn);
+	return int(node_.size()) - 1;
+}
+
+// If ignoring case, adds the other case of any (ASCII) letters in set
+void byte_regex::fold(std::vector<unsigned char> &set) const
+{
+	if (!icase_)
+		return;
+	for (int cc = 'A'; cc <= 'Z'; ++cc)
+	{
+		if (in_set(set, (unsigned char)cc) || in_set(set, (unsigned char)(cc + 'a' - 'A')))
+		{
+			add_byte(set, (unsigned char)cc);
+			add_byte(set, (unsigned char)(cc + 'a' - 'A'));
+		}
+	}
+}
+
+// Gets the shortest and longest sequences that a (sub)expression can match
+void byte_regex::lengths(int node, size_t &min_len, size_t &max_len) const
+{
+	const re_node &nn = node_[node];
+	size_t min2, max2;
+	switch (nn.type)
+	{
+	case RE_EMPTY:
+		min_len = max_len = 0;
+		break;
+	case RE_BYTES:
+		min_len = max_len = 1;
+		break;
+	case RE_CAT:
+		lengths(nn.left, min_len, max_len);
+		lengths(nn.right, min2, max2);
+		min_len += min2;
+		max_len = add_len(max_len, max2);
+		break;
+	case RE_ALT:
+		lengths(nn.left, min_len, max_len);
+		lengths(nn.right, min2, max2);
+		min_len = min(min_len, min2);
+		max_len = max(max_len, max2);
+		break;
+	case RE_STAR:
+		min_len = 0;
+		max_len = unbounded;
+		break;
+	case RE_PLUS:
+		lengths(nn.left, min_len, max_len);
+		max_len = unbounded;
+		break;
+	case RE_QUEST:
+		lengths(nn.left, min_len, max_len);
+		min_len = 0;
+		break;
+	default:
+		ASSERT(0);
+	}
+}
+
+// NFA
+
+// Builds the NFA for the expression (or the reversed expression) and clears the DFA
+void byte_regex::build(int node, bool reverse, dfa &dd)
+{
+	int end;
+	dd.nfa.clear();
+	dd.init.clear();
+	compile(node, reverse, dd.nfa, dd.start, end);
+	if (dd.nfa.size() > max_nfa_states)
+	{
+		error_ = "The regular expression is too big (eg repeat counts are too large).";
+		return;
+	}
+	int match = add_nfa(dd.nfa, NFA_MATCH);  // (not in the assignment below as nfa may move)
+	dd.nfa[end].out = match;
+	dd.anchored = !reverse;
+	clear_cache(dd);
+}
+
+// Adds NFA states for node - on return start is the first one and end is an NFA_EMPTY
+// state whose out has not been set yet.
+void byte_regex::compile(int node, bool reverse, std::vector<nfa_state> &nfa, int &start, int &end)
+{
+	if (nfa.size() > max_nfa_states)
+	{
+		start = end = add_nfa(nfa, NFA_EMPTY);  // just stop (build() reports the error)
+		return;
+	}
+
+	const re_node &nn = node_[node];
+	int s1, e1, s2, e2;
+	switch (nn.type)
+	{
+	case RE_EMPTY:
+		start = end = add_nfa(nfa, NFA_EMPTY);
+		break;
+	case RE_BYTES:
+		end = add_nfa(nfa, NFA_EMPTY);
+		start = add_nfa(nfa, NFA_BYTES, end, -1, nn.set);
+		break;
+	case RE_CAT:
+		compile(reverse ? nn.right : nn.left, reverse, nfa, s1, e1);
+		compile(reverse ? nn.left : nn.right, reverse, nfa, s2, e2);
+		nfa[e1].out = s2;
+		start = s1;
+		end = e2;
+		break;
+	case RE_ALT:
+		compile(nn.left, reverse, nfa, s1, e1);
+		compile(nn.right, reverse, nfa, s2, e2);
+		end = add_nfa(nfa, NFA_EMPTY);
+		nfa[e1].out = nfa[e2].out = end;
+		start = add_nfa(nfa, NFA_SPLIT, s1, s2);
+		break;
+	case RE_STAR:
+		compile(nn.left, reverse, nfa, s1, e1);
+		end = add_nfa(nfa, NFA_EMPTY);
+		start = add_nfa(nfa, NFA_SPLIT, s1, end);
+		nfa[e1].out = start;
+		break;
+	case RE_PLUS:
+		compile(nn.left, reverse, nfa, s1, e1);
+		end = add_nfa(nfa, NFA_EMPTY);
+		s2 = add_nfa(nfa, NFA_SPLIT, s1, end);
+		nfa[e1].out = s2;
+		start = s1;
+		break;
+	case RE_QUEST:
+		compile(nn.left, reverse, nfa, s1, e1);
+		end = add_nfa(nfa, NFA_EMPTY);
+		nfa[e1].out = end;
+		start = add_nfa(nfa, NFA_SPLIT, s1, end);
+		break;
+	default:
+		ASSERT(0);
+	}
+}
+
+int byte_regex::add_nfa(std::vector<nfa_state> &nfa, int type, int out /*=-1*/, int out1 /*=-1*/, int set /*=-1*/)
+{
+	nfa_state ns;
+	ns.type = type;
+	ns.out = out;
+	ns.out1 = out1;
+	ns.set = set;
+	nfa.push_back(ns);
+	return int(nfa.size()) - 1;
+}
+
+// DFA
+
+// Adds to result the BYTES and MATCH states that can be reached from NFA state ns
+// without reading a byte (seen stops states being added twice).
+void byte_regex::closure(const dfa &dd, int ns, std::vector<int> &result, std::vector<bool> &seen) const
+{
+	std::vector<int> todo(1, ns);
+	while (!todo.empty())
+	{
+		int curr = todo.back();
+		todo.pop_back();
+		if (curr == -1 || seen[curr])
+			continue;
+		seen[curr] = true;
+		switch (dd.nfa[curr].type)
+		{
+		case NFA_SPLIT:
+			todo.push_back(dd.nfa[curr].out1);
+			// fall through
+		case NFA_EMPTY:
+			todo.push_back(dd.nfa[curr].out);
+			break;
+		default:
+			result.push_back(curr);
+			break;
+		}
+	}
+}
+
+// Returns the DFA state for a (sorted) set of NFA states, adding it if necessary,
+// or -1 if there are already too many states.
+int byte_regex::add_state(dfa &dd, const std::vector<int> &ss)
+{
+	std::map<std::vector<int>, int>::const_iterator pi = dd.index.find(ss);
+	if (pi != dd.index.end())
+		return pi->second;
+	if (dd.states.size() >= max_dfa_states)
+		return -1;
+
+	int retval = int(dd.states.size());
+	dd.index[ss] = retval;
+	dd.states.push_back(ss);
+	bool acc = false;
+	for (std::vector<int>::const_iterator pn = ss.begin(); pn != ss.end(); ++pn)
+		if (dd.nfa[*pn].type == NFA_MATCH)
+			acc = true;
+	dd.accept.push_back(acc);
+	dd.next.insert(dd.next.end(), 256, -1);
+	return retval;
+}
+
+// Discards all DFA states except the start state (which is always state 0)
+void byte_regex::clear_cache(dfa &dd)
+{
+	dd.index.clear();
+	dd.states.clear();
+	dd.accept.clear();
+	dd.next.clear();
+
+	if (dd.init.empty())
+	{
+		std::vector<bool> seen(dd.nfa.size(), false);
+		closure(dd, dd.start, dd.init, seen);
+		std::sort(dd.init.begin(), dd.init.end());
+	}
+	VERIFY(add_state(dd, dd.init) == 0);
+}
+
+// Works out the DFA state after reading cc in state (when not already known)
+int byte_regex::step(dfa &dd, int state, unsigned char cc)
+{
+	std::vector<int> ss;
+	std::vector<bool> seen(dd.nfa.size(), false);
+	const std::vector<int> &curr = dd.states[state];
+	for (std::vector<int>::const_iterator pn = curr.begin(); pn != curr.end(); ++pn)
+	{
+		const nfa_state &ns = dd.nfa[*pn];
+		if (ns.type == NFA_BYTES && in_set(sets_[ns.set], cc))
+			closure(dd, ns.out, ss, seen);
+	}
+	if (!dd.anchored)
+		closure(dd, dd.start, ss, seen);    // a new match may start at any byte
+	std::sort(ss.begin(), ss.end());
+
+	int retval = add_state(dd, ss);
+	if (retval == -1)
+	{
+		// Too many states - start again (state is no longer valid so don't remember where it goes)
+		clear_cache(dd);
+		retval = add_state(dd, ss);
+	}
+	else
+		dd.next[state*256 + cc] = retval;
+	return retval;
+}
@@ -0,0 +1,140 @@
+// ByteRegex.h : regular expressions for searching bytes (not characters)
+//
+// For implementation see: ByteRegex.cpp
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// A regular expression is compiled into an NFA (Thompson construction) which is
+// turned into a DFA as it is used ("lazy" subset construction).  Only the DFA
+// states actually reached are built so a search looks at each byte just once,
+// with a table lookup, and the setup cost does not depend on how many states
+// the full DFA would have.  If too many states are built the cache is cleared
+// and they are built again as needed, so memory use is bounded.
+//
+// Two DFAs are used to find matches in a buffer:
+// - starts() scans backwards using the reversed expression, so that it is in
+//   an accepting state just after (ie before) each byte where a match starts
+// - longest() scans forwards from a start to find the end of the longest match
+// Matches are never longer than max_length() which is limited (max_match_len)
+// for expressions with * or + so that a search only needs to read that many
+// bytes past a buffer to find all matches that start in it.
+//
+// Syntax (all of the pattern is bytes so . and [^...] match any byte incl. newline):
+//   c        a byte (other than one of the special characters: .[]()|*+?{}\^$)
+//   .        any byte
+//   [abc]    any of the bytes (ranges like a-z allowed, [^...] for bytes not in the set)
+//   \xHH     the byte with hex value HH (also \n \r \t \0 and \ before a special char)
+//   \d \w \s digit, word (alphanumeric or _) and white space bytes (\D \W \S for others)
+//   (re)     grouping ((?:re) is the same as there are no captures)
+//   re|re    either
+//   re* re+ re? re{n} re{n,} re{n,m}   repetition (n and m no more than max_repeat)
+// Anchors (^ and $) are not supported.  Matches must be at least one byte long.
+
+#ifndef BYTEREGEX_INCLUDED
+#define BYTEREGEX_INCLUDED  1
+
+#include <vector>
+#include <map>
+
+class byte_regex
+{
+public:
+	enum { max_match_len = 1024 };      // Longest match of an expression with * or +
+	enum { max_repeat = 1000 };         // Largest count in {n,m}
+
+	// Compiles the expression - if it is not valid error() says why
+	byte_regex(const char *re, bool icase);
+
+	const char *error() const { return error_.IsEmpty() ? NULL : (const char *)error_; }
+	const CString &source() const { return source_; }
+	bool icase() const { return icase_; }
+	size_t min_length() const { return min_len_; }
+	size_t max_length() const { return max_len_; }
+
+	// Appends to found the positions (from the end backwards) in pp[0..len) where a
+	// match starts that is completely within the buffer.  (If a match is longer than
+	// max_length() its start is still included but longest() then returns 0.)
+	void starts(const unsigned char *pp, size_t len, std::vector<size_t> &found);
+	// Returns the length of the longest match (no longer than len) at pp or 0 if none
+	size_t longest(const unsigned char *pp, size_t len);
+
+private:
+	// The NFA has states of these types - BYTES moves on (to out) if the next byte is in
+	// the set, SPLIT (and EMPTY) move on without a byte to out and out1 (or just out).
+	enum { NFA_EMPTY, NFA_SPLIT, NFA_BYTES, NFA_MATCH };
+	struct nfa_state
+	{
+		int type;
+		int out, out1;
+		int set;                        // Index into sets_ (BYTES only)
+	};
+
+	// The expression is parsed into a tree (repeats use a subtree more than once) before
+	// the NFA is built, as the reversed expression is also needed.
+	enum { RE_EMPTY, RE_BYTES, RE_CAT, RE_ALT, RE_STAR, RE_PLUS, RE_QUEST };
+	struct re_node
+	{
+		int type;
+		int left, right;                // Sub-trees (right only for CAT and ALT)
+		int set;                        // Index into sets_ (BYTES only)
+	};
+
+	// Parsing (return the index of the new node or -1 on error)
+	int parse_alt(const char *&ps);
+	int parse_cat(const char *&ps);
+	int parse_repeat(const char *&ps);
+	int parse_atom(const char *&ps);
+	int parse_class(const char *&ps);
+	bool parse_escape(const char *&ps, std::vector<unsigned char> &set);
+	int add_node(int type, int left = -1, int right = -1, int set = -1);
+	void fold(std::vector<unsigned char> &set) const;
+	void lengths(int node, size_t &min_len, size_t &max_len) const;
+
+	// A lazily built DFA: each state is a set of NFA states (the BYTES and MATCH states
+	// reachable without reading a byte).  next is -1 for transitions not yet worked out.
+	struct dfa
+	{
+		std::vector<nfa_state> nfa;
+		int start;                      // NFA start state
+		bool anchored;                  // false if a match may start after any byte
+		std::vector<int> init;          // NFA states of the DFA start state
+		std::map<std::vector<int>, int> index;  // DFA state of each set of NFA states
+		std::vector<std::vector<int> > states;  // NFA states of each DFA state
+		std::vector<char> accept;       // DFA state contains the NFA MATCH state
+		std::vector<int> next;          // Next DFA state for each state and byte (-1 = unknown)
+	};
+	enum { max_dfa_states = 2000 };     // Cache is cleared if more are needed
+	enum { max_nfa_states = 100000 };   // Larger expressions (eg nested repeats) are rejected
+	enum { max_depth = 200 };           // Deepest nesting of ()
+	void build(int node, bool reverse, dfa &dd);
+	void compile(int node, bool reverse, std::vector<nfa_state> &nfa, int &start, int &end);
+	int add_nfa(std::vector<nfa_state> &nfa, int type, int out = -1, int out1 = -1, int set = -1);
+	void closure(const dfa &dd, int ns, std::vector<int> &result, std::vector<bool> &seen) const;
+	int add_state(dfa &dd, const std::vector<int> &ss);
+	void clear_cache(dfa &dd);
+	int step(dfa &dd, int state, unsigned char cc);
+	int move(dfa &dd, int state, unsigned char cc)
+	{
+		int nn = dd.next[state*256 + cc];
+		return nn != -1 ? nn : step(dd, state, cc);
+	}
+
+	CString source_;
+	CString error_;
+	bool icase_;
+	size_t min_len_, max_len_;
+
+	std::vector<re_node> node_;         // Parse tree
+	std::vector<std::vector<unsigned char> > sets_;   // Byte sets (256 bits each)
+	int root_;
+	int depth_;                         // Nesting of () while parsing
+
+	dfa forw_;                          // Anchored DFA for the expression
+	dfa back_;                          // Unanchored DFA for the reversed expression
+};
+
+#endif
@@ -11,6 +11,7 @@
 
 #include "stdafx.h"
 #include "CFile64.h"
+#include "FileMap.h"
 #include "SpecialList.h"
 #include "hexedit.h"
 #include "misc.h"
@@ -267,6 +268,7 @@ CFile64::~CFile64()
       Close();
    }
 
+   EnableMapping( FALSE );
    m_Uninitialize();
 
    m_SecurityAttributes_p = (SECURITY_ATTRIBUTES *) NULL;
@@ -279,6 +281,8 @@ void CFile64::Abort( void )
 
    BOOL return_value = TRUE;
 
+   EnableMapping( FALSE );
+
    if ( m_FileHandle != INVALID_HANDLE_VALUE )
    {
       if (!::CloseHandle(m_FileHandle))
@@ -306,6 +310,8 @@ void CFile64::Close( void )
 
    BOOL return_value = TRUE;
 
+   EnableMapping( FALSE );
+
    if ( m_FileHandle != INVALID_HANDLE_VALUE )
    {
       if (!::CloseHandle(m_FileHandle))
@@ -982,6 +988,7 @@ void CFile64::m_Initialize( void )
 //   WFCLTRACEINIT( TEXT( "CFile64::m_Initialize()" ) );
 
    m_CloseOnDelete = FALSE;
+   m_Map_p = NULL;
 
    try
    {
@@ -1318,6 +1325,87 @@ DWORD CFile64::ReadHuge( void * buffer, DWORD number_of_bytes_to_read )
    return( Read( buffer, number_of_bytes_to_read ) );
 }
 
+// Reads from the file at position without using the current file position, so it is
+// safe to call from several threads at once.  If mapping is enabled (see EnableMapping)
+// the data is copied from memory mapped views of the file.
+// Note: ReadFile with an OVERLAPPED structure on a synchronous handle moves the file
+// position (to just past the bytes read) so Seek/Read must not be mixed with ReadAt
+// on a file that other threads read using ReadAt.
+DWORD CFile64::ReadAt( LONGLONG position, void * buffer, DWORD number_of_bytes_to_read )
+{
+   if ( number_of_bytes_to_read == 0 || m_FileHandle == INVALID_HANDLE_VALUE )
+   {
+      return( 0 );
+   }
+
+   size_t number_of_bytes_read = 0;
+
+   if ( m_Map_p != NULL )
+   {
+      if ( ! m_Map_p->read( position, buffer, number_of_bytes_to_read, number_of_bytes_read ) )
+      {
+#if ! defined( WFC_STL )
+         CFileException::ThrowOsError( (LONG) ::GetLastError() );
+#endif // WFC_STL
+      }
+   }
+   else
+   {
+      OVERLAPPED overlapped;
+      memset( &overlapped, 0, sizeof( overlapped ) );
+      overlapped.Offset     = (DWORD) position;
+      overlapped.OffsetHigh = (DWORD) ( position >> 32 );
+
+      DWORD actual = 0;
+
+      if ( ::ReadFile( m_FileHandle, buffer, number_of_bytes_to_read, &actual, &overlapped ) == FALSE &&
+           ::GetLastError() != ERROR_HANDLE_EOF )
+      {
+#if ! defined( WFC_STL )
+         CFileException::ThrowOsError( (LONG) ::GetLastError() );
+#endif // WFC_STL
+      }
+      number_of_bytes_read = actual;
+   }
+
+   return( (DWORD) number_of_bytes_read );
+}
+
+// Turns on (or off) reading through memory mapped views for ReadAt().  Returns FALSE
+// if the file can't be mapped (eg it's empty) in which case ReadAt() still works.
+// Note: the file must not be truncated by another process while it is mapped so this
+// should only be used if the file was opened with shareDenyWrite or shareExclusive.
+BOOL CFile64::EnableMapping( BOOL enable /*= TRUE*/ )
+{
+   if ( m_Map_p != NULL )
+   {
+      delete m_Map_p;
+      m_Map_p = NULL;
+   }
+
+   if ( ! enable )
+   {
+      return( TRUE );
+   }
+
+   if ( m_FileHandle == INVALID_HANDLE_VALUE || m_Length != -1 )
+   {
+      return( FALSE );
+   }
+
+   m_Map_p = new file_map( m_FileHandle );
+
+   if ( ! m_Map_p->mapped() )
+   {
+      delete m_Map_p;
+      m_Map_p = NULL;
+
+      return( FALSE );
+   }
+
+   return( TRUE );
+}
+
 void PASCAL CFile64::Rename( LPCTSTR old_name, LPCTSTR new_name )
 {
    if ( ::MoveFile( (LPTSTR) old_name, (LPTSTR) new_name ) == FALSE )
@@ -1415,13 +1503,30 @@ BOOL CFile64::SetEndOfFile( LONGLONG length )
       return( FALSE );
    }
 
-   if ( ::SetEndOfFile( m_FileHandle ) == FALSE )
+   // A mapped file can't be truncated so remove the mapping while we change the length
+   BOOL was_mapped = IsMapped();
+   EnableMapping( FALSE );
+
+   BOOL return_value = ::SetEndOfFile( m_FileHandle );
+
+   if ( return_value == FALSE )
    {
 //      WFCTRACEERROR( ::GetLastError() );
 //      WFCTRACE( TEXT( "Can't set end of file because of above error." ) );
+      DWORD error = ::GetLastError();
+      if ( was_mapped )
+      {
+         EnableMapping();
+      }
+      ::SetLastError( error );
       return( FALSE );
    }
 
+   if ( was_mapped )
+   {
+      EnableMapping();
+   }
+
    return( TRUE );
 }
 
@@ -1955,6 +2060,7 @@ CString CFileNC::GetFileTitle( void ) const
 
 DWORD CFileNC::Read( void * buffer, DWORD len )
 {
+	CSingleLock sl( &m_Lock, TRUE );
 	LONGLONG file_length = GetLength();                     // length of the file
 	ASSERT(file_length%m_SectorSize == 0);
 	LONGLONG end_address = m_FilePos + (LONGLONG)len;       // one past last byte to read
@@ -1974,8 +2080,21 @@ DWORD CFileNC::Read( void * buffer, DWORD len )
 	return done;
 }
 
+// Note: unlike CFile64::ReadAt this uses (and moves) the current file position since
+// reads must go through our sector buffer.  So reads are serialised using m_Lock as
+// background threads may all be reading the device at the same time (see GetData).
+// The lock is held for the Seek and the Read so that no other thread moves the position
+// in between.
+DWORD CFileNC::ReadAt( LONGLONG position, void * buffer, DWORD len )
+{
+	CSingleLock sl( &m_Lock, TRUE );
+	Seek( position, CFile::begin );
+	return Read( buffer, len );
+}
+
 void CFileNC::Write( const void * buffer, DWORD len )
 {
+	CSingleLock sl( &m_Lock, TRUE );
 	LONGLONG file_length = GetLength();                     // length of the file
 	ASSERT(file_length%m_SectorSize == 0);
 	LONGLONG end_address = m_FilePos + (LONGLONG)len;       // one past last byte to read
@@ -2194,6 +2313,7 @@ void CFileNC::make_clean()
 
 LONGLONG CFileNC::Seek( LONGLONG offset, UINT from )
 {
+	CSingleLock sl( &m_Lock, TRUE );
 	switch (from)
 	{
 	default:
@@ -2214,6 +2334,7 @@ LONGLONG CFileNC::Seek( LONGLONG offset, UINT from )
 
 void CFileNC::Close()
 {
+	CSingleLock sl( &m_Lock, TRUE );
 	if (m_dirty)
 		make_clean();  // Write out current buffer if necessary.
 	if (m_retries >= 0)
@@ -3,8 +3,11 @@
 #define FILE_64_CLASS_HEADER
 
 #include <winioctl.h>
+#include <afxmt.h>                  // CCriticalSection, CSingleLock
 #include <map>
 
+class file_map;                     // see FileMap.h
+
 #if ! defined( FILE_ATTRIBUTE_ENCRYPTED )
 #define FILE_ATTRIBUTE_ENCRYPTED (0x00000040)
 #endif
@@ -45,6 +48,8 @@ class CFile64
       DWORD m_SectorSize;
       LONGLONG m_Length;          // Length of volume/physical drive or -1 if normal file
 
+      file_map * m_Map_p;         // Memory mapped views used by ReadAt (or NULL if not enabled)
+
       void m_Initialize( void );
       void m_Uninitialize( void );
 
@@ -128,6 +133,10 @@ class CFile64
       virtual DWORD                 Read( void * buffer, DWORD number_of_bytes_to_read );
       virtual DWORD                 Read( CByteArray& buffer, DWORD number_of_bytes_to_read );
       virtual DWORD                 ReadHuge( void * buffer, DWORD number_of_bytes_to_read );
+      virtual DWORD                 ReadAt( LONGLONG position, void * buffer, DWORD number_of_bytes_to_read );
+      virtual BOOL                  EnableMapping( BOOL enable = TRUE );
+      virtual BOOL                  IsMapped( void ) const { return m_Map_p != NULL; }
+      file_map *                    GetMap( void ) const { return m_Map_p; }   // for reading mapped bytes in place (or NULL)
       virtual LONGLONG              Seek( LONGLONG offset, UINT from );
       virtual void                  SeekToBegin( void );
       virtual LONGLONG              SeekToEnd( void );
@@ -175,26 +184,31 @@ public:
 
 	virtual void Close( void );
 	virtual DWORD Read( void * buffer, DWORD len );
+	virtual DWORD ReadAt( LONGLONG position, void * buffer, DWORD len );
+	virtual BOOL EnableMapping( BOOL enable = TRUE ) { return !enable; }   // devices can't be mapped
 	virtual void Write( const void * buffer, DWORD len );
 	virtual LONGLONG Seek( LONGLONG offset, UINT from );
 
 	virtual LONGLONG GetPosition( void ) const
 	{
+		CSingleLock sl( &m_Lock, TRUE );
 		return m_FilePos;
 	}
 
 	virtual void SeekToBegin( void )
 	{
+		CSingleLock sl( &m_Lock, TRUE );
 		m_FilePos = 0;
 	}
 
 	virtual LONGLONG SeekToEnd( void )
 	{
+		CSingleLock sl( &m_Lock, TRUE );
 		return m_FilePos = GetLength();
 	}
 
-	bool HasError() { return !m_bad.empty(); }         // returns true if at least one sector had a read error
-	DWORD Error(__int64 sec) { if (m_bad.find(sec) == m_bad.end()) return 0; else return m_bad[sec]; }  // return sector error or 0 if none
+	bool HasError() { CSingleLock sl( &m_Lock, TRUE ); return !m_bad.empty(); }   // returns true if at least one sector had a read error
+	DWORD Error(__int64 sec) { CSingleLock sl( &m_Lock, TRUE ); if (m_bad.find(sec) == m_bad.end()) return 0; else return m_bad[sec]; }  // return sector error or 0 if none
 
 private:
 	void make_clean();          // Write buffer to disk (must be dirty)
@@ -210,6 +224,11 @@ private:
 
 	// Note m_retries > -1 indicates that this is a windows native API physical device
 	int m_retries;				// number of read retries on physical devices
+
+	// Protects m_FilePos, the buffer and m_bad since background threads read (ReadAt) while
+	// the main thread may also use the file (Seek/Read/Write).  Everything that uses them
+	// takes it (a thread can take it again, eg ReadAt calls Seek and Read).
+	mutable CCriticalSection m_Lock;
 };
 
 #endif // FILE_64_CLASS_HEADER
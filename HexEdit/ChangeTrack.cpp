@@ -0,0 +1,164 @@
+// ChangeTrack.cpp : implements change_tracker (see ChangeTrack.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include <algorithm>
+#include "HexEdit.h"
+#include "ChangeTrack.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Note that this does not show all the changes that have been done only the changes
+// between the current file and the file on disk.  For example, deleting 3 bytes then
+// inserting 3 bytes at the same address would appear as a replacement of 3 bytes.
+// Consequently there cannot be an insertion and deletion at the same address.
+
+void change_tracker::build(change_list &repl, change_list &ins, change_list &del) const
+{
+	ASSERT(repl.addr.empty() && ins.addr.empty() && del.addr.empty());
+	track(loc_.begin(), 0, 0, loc_.end(), repl, ins, del);
+}
+
+// Only the changes between the closest preceding and following records of the base
+// (orig file etc) can be affected, so only these are worked out again - changes after
+// that just need to be moved by delta.
+void change_tracker::update(FILE_ADDRESS address, FILE_ADDRESS inserted, FILE_ADDRESS delta,
+							change_list &repl, change_list &ins, change_list &del) const
+{
+	// Find the end of the closest base record before the change
+	FILE_ADDRESS pos;
+	loc_tree::iterator pl = loc_.find(address, pos);
+	FILE_ADDRESS last = 0;                  // Address (in base) of end of that record
+	for (;;)
+	{
+		if (pl == loc_.begin())
+		{
+			ASSERT(pos == 0);
+			break;
+		}
+		--pl;
+		FILE_ADDRESS bb = base(*pl);
+		if (bb != -1)
+		{
+			last = bb + FILE_ADDRESS(pl->dlen&doc_loc::mask);
+			++pl;                           // changes start after it (at pos)
+			break;
+		}
+		pos -= FILE_ADDRESS(pl->dlen&doc_loc::mask);
+	}
+
+	// Find the closest base record that starts after the change
+	FILE_ADDRESS end_pos;
+	loc_tree::iterator plend = loc_.find(min(address + inserted, loc_.length()), end_pos);
+	while (plend != loc_.end() && (end_pos < address + inserted || base(*plend) == -1))
+	{
+		end_pos += FILE_ADDRESS(plend->dlen&doc_loc::mask);
+		++plend;
+	}
+
+	// Work out the changes between these records and put them in place of the old ones
+	change_list rr, ii, dd;
+	track(pl, pos, last, plend, rr, ii, dd);
+	repl.splice(pos, end_pos - delta, delta, rr);
+	ins.splice(pos, end_pos - delta, delta, ii);
+	del.splice(pos, end_pos - delta, delta, dd);
+}
+
+// Returns the address in the base of the start of a location record or -1 if the
+// record is not part of the base (ie is a change).
+FILE_ADDRESS change_tracker::base(const doc_loc &dl) const
+{
+	if ((dl.dlen >> 62) == 1)  // orig file data
+	{
+		ASSERT(type_ == orig_file);
+		return dl.fileaddr;
+	}
+	else if (type_ == mem_block && (dl.dlen >> 62) == 2 &&
+			 dl.memaddr >= mem_ && dl.memaddr < mem_ + size_t(len_))
+	{
+		// Record of the first memory block insertion with no orig file
+		// (If no orig file we treat the first memory record as the base for comparison)
+		return dl.memaddr - mem_;
+	}
+	else if (type_ == temp_file && (dl.dlen >> 62) == 3 && dl.fileid == fileid_)
+	{
+		// Record of the first temp file block insertion with no orig file
+		// (If no orig file we treat the first temp file record as the base for comparison)
+		return dl.fileaddr;
+	}
+	else
+	{
+		ASSERT((dl.dlen >> 62) == 2 || (dl.dlen >> 62) == 3);  // make sure not "unknown" type
+		return -1;
+	}
+}
+
+// Adds the changes (to repl, ins and del) for the location records from pl up to plend.
+// pl is at address pos and last is the address in the base just after the previous base
+// record (or 0 if none).  plend must be a base record (or end() to compare to the end
+// of the base).
+void change_tracker::track(loc_tree::iterator pl, FILE_ADDRESS pos, FILE_ADDRESS last, loc_tree::iterator plend,
+						   change_list &repl, change_list &ins, change_list &del) const
+{
+	FILE_ADDRESS nf_bytes = 0;  // Number of non-base bytes since last base record
+	FILE_ADDRESS bb;            // Address in base of the current record
+	for (;;)
+	{
+		if (pl == plend)
+			bb = plend == loc_.end() ? len_ : base(*plend);
+		else if ((bb = base(*pl)) == -1)
+		{
+			// Non-file record - just track no of consec. bytes in nf_bytes
+			nf_bytes += (pl->dlen&doc_loc::mask);
+			++pl;
+			continue;
+		}
+		ASSERT(bb != -1);
+
+		// Next base record (or end) found
+		FILE_ADDRESS diff = bb - last;               // Amt of base skipped since last base record
+		FILE_ADDRESS rr = min(diff, nf_bytes);       // How many bytes are replaced
+		if (rr > 0)
+			repl.add(pos, rr);
+		if (diff < nf_bytes)
+			ins.add(pos + rr, nf_bytes - diff);
+		else if (diff > nf_bytes)
+			del.add(pos, diff - nf_bytes);
+		pos += nf_bytes;
+		if (pl == plend)
+			break;
+
+		// Work out curr address by adding length of current base rec
+		pos += (pl->dlen&doc_loc::mask);
+		last = bb + (pl->dlen&doc_loc::mask);   // remember last base addr
+		nf_bytes = 0;
+		++pl;
+	}
+	ASSERT(plend != loc_.end() || pos == loc_.length());
+}
+
+// Replaces the changes from lo to hi (inclusive) with those in repl and moves
+// the changes after that by delta.
+void change_list::splice(FILE_ADDRESS lo, FILE_ADDRESS hi, FILE_ADDRESS delta, const change_list &repl)
+{
+	ASSERT(addr.size() == len.size() && repl.addr.size() == repl.len.size());
+	size_t first = std::lower_bound(addr.begin(), addr.end(), lo) - addr.begin();
+	size_t last = std::upper_bound(addr.begin(), addr.end(), hi) - addr.begin();
+	for (size_t ii = last; ii < addr.size(); ++ii)
+		addr[ii] += delta;
+
+	addr.erase(addr.begin() + first, addr.begin() + last);
+	len.erase(len.begin() + first, len.begin() + last);
+	addr.insert(addr.begin() + first, repl.addr.begin(), repl.addr.end());
+	len.insert(len.begin() + first, repl.len.begin(), repl.len.end());
+}
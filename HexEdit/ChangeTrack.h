@@ -0,0 +1,66 @@
+// ChangeTrack.h : works out the changes made to a document (for change tracking)
+//
+// For implementation see: ChangeTrack.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Change tracking shows the differences between the document and its "base"
+// (normally the original file - see CHexEditDoc::base_type_) as 3 lists of
+// replacements, insertions and deletions.  These are worked out from the
+// location records (loc_tree) by change_tracker.  build() works them all out,
+// but after an edit update() only redoes the changes between the closest base
+// records before and after the edit and moves the changes after them.
+//
+// Note: this only uses LocTree.h (not the document) so can be tested separately.
+
+#ifndef CHANGETRACK_INCLUDED
+#define CHANGETRACK_INCLUDED  1
+
+#include <vector>
+#include "LocTree.h"
+
+// All the changes of one type (replacement, insertion or deletion) are stored in
+// 2 vectors (address and length) in address order, so the changes in part of the
+// file can be found with a binary search.
+struct change_list
+{
+	std::vector<FILE_ADDRESS> addr, len;
+	void clear() { addr.clear(); len.clear(); }
+	void add(FILE_ADDRESS a, FILE_ADDRESS l) { addr.push_back(a); len.push_back(l); }
+	void splice(FILE_ADDRESS lo, FILE_ADDRESS hi, FILE_ADDRESS delta, const change_list &repl);
+};
+
+class change_tracker
+{
+public:
+	enum { orig_file = 0, mem_block = 1, temp_file = 2 };   // Base types (same as CHexEditDoc::base_type_)
+
+	// The base is the original file, the memory block at mem or the data file fileid, and is len bytes long
+	change_tracker(const loc_tree &loc, int type, FILE_ADDRESS len, const unsigned char *mem = NULL, int fileid = -1)
+		: loc_(loc), type_(type), len_(len), mem_(mem), fileid_(fileid) { }
+
+	FILE_ADDRESS base(const doc_loc &dl) const;     // Address in base of a record (or -1 if a change)
+
+	// Works out all the changes (the lists must be empty)
+	void build(change_list &repl, change_list &ins, change_list &del) const;
+	// Updates the changes after an edit: the bytes from address to address+inserted are
+	// new and the length has changed by delta (loc must already include the edit)
+	void update(FILE_ADDRESS address, FILE_ADDRESS inserted, FILE_ADDRESS delta,
+	            change_list &repl, change_list &ins, change_list &del) const;
+
+private:
+	void track(loc_tree::iterator pl, FILE_ADDRESS pos, FILE_ADDRESS last, loc_tree::iterator plend,
+	           change_list &repl, change_list &ins, change_list &del) const;
+
+	const loc_tree &loc_;
+	int type_;
+	FILE_ADDRESS len_;                  // Length of the base
+	const unsigned char *mem_;          // Memory block (mem_block only)
+	int fileid_;                        // Data file (temp_file only)
+};
+
+#endif
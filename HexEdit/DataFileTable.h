@@ -0,0 +1,105 @@
+// DataFileTable.h : the data files of a document
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Some of the data of a document can be kept in "data files" rather than in
+// memory: inserted files (mod_insert_file), temp files for big changes or old
+// undo data (see CHexEditDoc::spill_undo) and repeated patterns (CPatternFile).
+// Location records (doc_loc::fileid) and undo records (doc_undo::idx) refer to
+// a data file by its index in the table.
+//
+// There is no limit on the number of data files.  The slot of a removed file is
+// used by the next file added, and empty slots at the end are discarded so that
+// the table does not keep growing.  The number of undo records that use each file
+// is counted so that it can be closed once it is not needed (eg all the changes
+// using it have been undone).
+//
+// Note: this only uses CFile64 pointers (not the document) so can be tested separately.
+
+#ifndef DATAFILETABLE_INCLUDED
+#define DATAFILETABLE_INCLUDED  1
+
+#include <vector>
+
+class CFile64;
+
+class data_file_table
+{
+public:
+	int size() const { return int(files_.size()); }
+	bool empty() const { return files_.empty(); }
+
+	CFile64 *operator[](int idx) const  // The file in slot idx (NULL if the slot is not used)
+	{
+		ASSERT(idx >= 0 && idx < size());
+		return files_[idx];
+	}
+	bool is_temp(int idx) const { return temp_[idx]; }     // Delete the file when it is closed?
+	int refs(int idx) const { return refs_[idx]; }
+	bool unused(int idx) const          // Is there a file in slot idx that can be removed?
+	{
+		// Note that idx may be past the end as removing a file discards empty slots below it
+		return idx < size() && files_[idx] != NULL && refs_[idx] == 0;
+	}
+
+	// Puts an open file in the first free slot (adding one if none) and returns its index
+	int add(CFile64 *pf, bool temp)
+	{
+		ASSERT(pf != NULL);
+		int idx;
+		for (idx = 0; idx < size(); ++idx)
+			if (files_[idx] == NULL)
+				break;
+		if (idx == size())
+		{
+			files_.push_back(NULL);
+			temp_.push_back(false);
+			refs_.push_back(0);
+		}
+		files_[idx] = pf;
+		temp_[idx] = temp;
+		refs_[idx] = 0;
+		return idx;
+	}
+
+	// Empties slot idx and returns the file that was there (for the caller to close).
+	// Empty slots at the end are discarded.
+	CFile64 *remove(int idx)
+	{
+		ASSERT(idx >= 0 && idx < size());
+		CFile64 *retval = files_[idx];
+		files_[idx] = NULL;
+		refs_[idx] = 0;
+		while (!files_.empty() && files_.back() == NULL)
+		{
+			files_.pop_back();
+			temp_.pop_back();
+			refs_.pop_back();
+		}
+		return retval;
+	}
+
+	// Counts of the undo records that use a file
+	void add_ref(int idx, int count = 1)
+	{
+		ASSERT(idx >= 0 && idx < size() && files_[idx] != NULL);
+		refs_[idx] += count;
+	}
+	bool release(int idx)               // Returns true if the file is no longer used
+	{
+		ASSERT(idx >= 0 && idx < size() && refs_[idx] > 0);
+		return --refs_[idx] == 0;
+	}
+	void clear_refs() { refs_.assign(refs_.size(), 0); }
+
+private:
+	std::vector<CFile64 *> files_;      // Ptrs to files or NULL if slot not used
+	std::vector<bool> temp_;            // Says if the file is temporary (should be deleted when removed)
+	std::vector<int> refs_;             // Number of undo records that refer to the file
+};
+
+#endif
@@ -5463,9 +5463,12 @@ void CDataFormatView::OnGridEndLabelEdit(NMHDR *pNotifyStruct, LRESULT* pResult)
 
 		if (new_size != df_size)
 		{
+			// Batch the delete and insert so that they are undone together and views only update once
+			pdoc->BeginBatch();
 			pdoc->Change(mod_delforw, pdoc->df_address_[ii], df_size, NULL, 0, phev_);
 			pdoc->Change(mod_insert, pdoc->df_address_[ii], new_size, pdata, 0, phev_);
 			pdoc->df_size_[ii] = new_size;
+			pdoc->CommitBatch();
 		}
 		else
 			pdoc->Change(mod_replace, pdoc->df_address_[ii], df_size, pdata, 0, phev_);
@@ -0,0 +1,139 @@
+// DocUndo.cpp : implements the undo record functions (see DocUndo.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include "HexEdit.h"
+#include "DocUndo.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// loc_apply modifies a location list (normally CHexEditDoc::loc_) for a change (according to type of mod)
+// uu is the undo record of the change.  Any records that are deleted or
+// replaced are saved in removed (normally uu.removed) so that loc_revert can restore them.
+// If uu.address is within a record then it is split so that the inserted/replacement
+// record can go between the two pieces.
+void loc_apply(const doc_undo &uu, loc_tree &loc, boost::shared_ptr<loc_tree> &removed)
+{
+	switch (uu.utype)
+	{
+	case mod_insert_file:
+	case mod_insert:
+		removed.reset();
+		break;
+	case mod_replace:
+	case mod_repback:
+	case mod_delforw:
+	case mod_delback:
+		removed.reset(new loc_tree);
+		loc.cut(uu.address, uu.len, *removed);  // Delete what's replaced (or deleted)
+		break;
+	default:
+		ASSERT(0);
+	}
+
+	// Add inserted or replacement bytes
+	if (uu.in_file())
+		loc.insert(uu.address, doc_loc(uu.spill, uu.len, uu.idx));
+	else if (uu.utype != mod_delforw && uu.utype != mod_delback)
+		loc.insert(uu.address, doc_loc(uu.ptr, uu.len));
+}
+
+// loc_revert undoes loc_apply - ie it does the inverse of the change.
+// uu must be the last change applied to loc (ie normally undo_.back()).
+void loc_revert(const doc_undo &uu, loc_tree &loc)
+{
+	switch (uu.utype)
+	{
+	case mod_insert_file:
+	case mod_insert:
+		loc.erase(uu.address, uu.len);  // Remove what was inserted
+		break;
+	case mod_replace:
+	case mod_repback:
+		ASSERT(uu.removed);
+		loc.erase(uu.address, uu.len);  // Remove the replacement
+		loc.paste(uu.address, *uu.removed);  // and put back what was replaced
+		break;
+	case mod_delforw:
+	case mod_delback:
+		ASSERT(uu.removed);
+		loc.paste(uu.address, *uu.removed);  // Put back what was deleted
+		break;
+	default:
+		ASSERT(0);
+	}
+}
+
+// Adds to undo the records that replace len bytes at each of the (sorted, non-overlapping)
+// addresses in found with the replen bytes at rep.  These are the same as the records of
+// calling CHexEditDoc::Change for each replacement in turn: a mod_replace if replen == len,
+// else a mod_delforw then a mod_insert (unless replen is zero), with the addresses moved
+// for the bytes inserted or deleted by the earlier replacements.  The records all share one
+// copy of the replacement bytes (see undo_arena::add_ref).
+// Note: undo should have room for the new records (else they are copied as it grows).
+void add_replace_all(std::vector<doc_undo> &undo, undo_arena *pa, const std::vector<FILE_ADDRESS> &found,
+					 FILE_ADDRESS len, const unsigned char *rep, size_t replen)
+{
+	ASSERT(len > 0);
+	size_t first = size_t(-1);          // Index of the undo record with the replacement bytes
+	FILE_ADDRESS delta = 0;             // Bytes inserted so far less bytes removed
+	std::vector<FILE_ADDRESS>::const_iterator pf;
+	for (pf = found.begin(); pf != found.end(); ++pf)
+	{
+		ASSERT(pf == found.begin() || *pf >= *(pf - 1) + len);
+		FILE_ADDRESS address = *pf + delta;
+		if (FILE_ADDRESS(replen) != len)
+		{
+			undo.push_back(doc_undo(pa, mod_delforw, address, len));
+			if (replen == 0)
+			{
+				delta -= len;
+				continue;
+			}
+		}
+
+		mod_type utype = FILE_ADDRESS(replen) == len ? mod_replace : mod_insert;
+		if (first == size_t(-1))
+		{
+			first = undo.size();
+			undo.push_back(doc_undo(pa, utype, address, replen, (unsigned char *)rep));
+		}
+		else
+			undo.push_back(doc_undo(undo[first], utype, address));
+		delta += FILE_ADDRESS(replen) - len;
+	}
+}
+
+// Rather than going through every change of a batch, CommitBatch searches again (and
+// redraws) the area from the first change to the last.  This returns true if any bytes
+// were inserted or deleted, in which case the area goes to the end (length).
+// On return lo and hi are the start and end of the area.
+bool batch_area(const std::vector<batch_change> &batch, FILE_ADDRESS length, FILE_ADDRESS &lo, FILE_ADDRESS &hi)
+{
+	lo = length;
+	hi = 0;
+	bool shift = false;                 // Were any bytes inserted or deleted?
+	std::vector<batch_change>::const_iterator pb;
+	for (pb = batch.begin(); pb != batch.end(); ++pb)
+	{
+		lo = min(lo, pb->address);
+		if (pb->utype == mod_replace || pb->utype == mod_repback)
+			hi = max(hi, pb->address + pb->len);
+		else
+			shift = true;
+	}
+	if (shift)
+		hi = length;
+	ASSERT(lo <= hi && hi <= length);
+	return shift;
+}
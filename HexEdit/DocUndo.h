@@ -0,0 +1,266 @@
+// DocUndo.h : the undo records of a document (the changes made to it)
+//
+// For implementation see: DocUndo.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Every change made to a document is kept as an undo record (doc_undo) in
+// CHexEditDoc::undo_.  The location list (see LocTree.h) is updated for a change
+// by loc_apply and put back by loc_revert.  These (and the making of the records for
+// Replace All and the working out of a batch of changes) do not use the document so
+// can be tested separately.
+
+#ifndef DOCUNDO_INCLUDED
+#define DOCUNDO_INCLUDED  1
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "LocTree.h"
+#include "UndoArena.h"
+
+// This enum is for the different modification types that can be made
+// to the document.  It is used for keeping track of changes made in the
+// undo array and for passing info about changes made to views.
+enum mod_type
+{
+	mod_unknown = '0',          // Helps bug detection
+	mod_insert  = 'I',          // Bytes inserted
+	mod_replace = 'R',          // Bytes replaced (overtyped)
+	mod_delforw = 'D',          // Bytes deleted (using DEL)
+	mod_delback = 'B',          // Bytes deleted (using back space)
+	mod_repback = '<',          // Replace back (BS in overtype mode)
+	mod_insert_file = 'F',      // Bytes inserted - requires index into data_file_[]
+};
+
+// One of the changes made in a batch (see CHexEditDoc::BeginBatch)
+struct batch_change
+{
+	batch_change(enum mod_type u, FILE_ADDRESS a, FILE_ADDRESS n) : utype(u), address(a), len(n) { }
+	enum mod_type utype;
+	FILE_ADDRESS address;
+	FILE_ADDRESS len;
+};
+
+// These structures used to be declared within class CHexEditDoc but with
+// VC++ 5 you get errors when used in <vector> and <list>
+
+// These structures are used to keep track of all changes made to the doc
+struct doc_undo
+{
+	// static const size_t limit; // replaced with theApp.undo_limit_
+	enum mod_type utype;                // Type of modification made to file
+	unsigned cap;                       // Size of buffer at ptr (0 if ptr not used) - see parena below
+	union
+	{
+		unsigned char *ptr;             // NULL if utype is del else new data
+		int idx;						// date_file_[] index if in_file()
+	};
+	FILE_ADDRESS address;               // Address in file of start of mod
+	FILE_ADDRESS len;                   // Length of mod
+	FILE_ADDRESS spill;                 // Address of the data in data_file_[idx] or -1 if not in_file()
+
+	// The data is in a data file if utype == mod_insert_file or it has been moved
+	// out of memory (see CHexEditDoc::spill_undo).
+	bool in_file() const { return spill >= 0; }
+
+	// Location records removed from loc_ when this change was applied (replace/delete only).
+	// These are put back when the change is undone. Note that copies share the same tree.
+	boost::shared_ptr<loc_tree> removed;
+
+	// The data (ptr) is allocated from the document's arena (see UndoArena.h).  The buffer
+	// (cap bytes) is bigger than len if it is small so that later changes can be merged into it.
+	undo_arena *parena;                 // Where ptr was allocated
+
+	// Normal constructor
+	doc_undo(undo_arena *pa, mod_type u, FILE_ADDRESS a, FILE_ADDRESS n, unsigned char *p = NULL, int i = -1)
+	{
+		ASSERT(u == mod_insert  || u == mod_insert_file || u == mod_replace ||
+			   u == mod_delforw || u == mod_delback     || u == mod_repback);
+		ASSERT(pa != NULL);
+
+		utype = u; len = n; address = a;
+		parena = pa; cap = 0; spill = -1;
+		if (utype == mod_insert_file)
+		{
+			ASSERT(i >= 0);
+			idx = i;
+			spill = 0;
+		}
+		else if (p != NULL)
+		{
+			ASSERT(len < 0x100000000);
+			cap = unsigned(max(FILE_ADDRESS(theApp.undo_limit_), len));
+			ptr = parena->allocate(cap);
+			memcpy(ptr, p, size_t(len));
+		}
+		else
+		{
+			ASSERT(utype == mod_delforw || utype == mod_delback);
+			ptr = NULL;
+		}
+	}
+	// Makes a change (insert or replace) of the same bytes as from at another address.
+	// The data buffer is shared (see undo_arena::add_ref) rather than copied.
+	doc_undo(const doc_undo &from, mod_type u, FILE_ADDRESS a)
+	{
+		ASSERT(u == mod_insert || u == mod_replace);
+		ASSERT(!from.in_file() && from.ptr != NULL);
+		utype = u; len = from.len; address = a;
+		parena = from.parena; spill = -1;
+		cap = from.cap;
+		ptr = parena->add_ref(from.ptr);
+	}
+	// Copy constructor
+	doc_undo(const doc_undo &from) : removed(from.removed)
+	{
+		ASSERT(from.utype != mod_unknown);
+		utype = from.utype;
+		len = from.len;
+		address = from.address;
+		parena = from.parena;
+		cap = 0;
+		spill = from.spill;
+		if (in_file())
+		{
+			ASSERT(from.idx >= 0);
+			idx = from.idx;
+		}
+		else if (from.ptr != NULL)
+		{
+			cap = from.cap;
+			ptr = parena->allocate(cap);
+			memcpy(ptr, from.ptr, size_t(len));
+		}
+		else
+			ptr = NULL;
+	}
+	// Copy assignment operator
+	doc_undo &operator=(const doc_undo &from)
+	{
+		if (&from != this)
+		{
+			ASSERT(from.utype != mod_unknown);
+			free_data();
+
+			utype = from.utype;
+			len = from.len;
+			address = from.address;
+			removed = from.removed;
+			parena = from.parena;
+			cap = 0;
+			spill = from.spill;
+
+			if (in_file())
+			{
+				ASSERT(from.idx >= 0);
+				idx = from.idx;
+			}
+			else if (from.ptr != NULL)
+			{
+				cap = from.cap;
+				ptr = parena->allocate(cap);
+				memcpy(ptr, from.ptr, size_t(len));
+			}
+			else
+				ptr = NULL;
+		}
+		return *this;
+	}
+#ifdef USE_MOVE
+	// Move constructor - takes the data so that nothing is copied when undo_ grows.
+	// Note that the data does not move so memory records in loc_ remain valid.
+	doc_undo(doc_undo &&from) throw()
+	{
+		ASSERT(from.utype != mod_unknown);
+		utype = from.utype;
+		len = from.len;
+		address = from.address;
+		removed.swap(from.removed);
+		parena = from.parena;
+		cap = from.cap;
+		spill = from.spill;
+		if (in_file())
+			idx = from.idx;
+		else
+		{
+			ptr = from.ptr;
+			from.ptr = NULL;
+			from.cap = 0;
+		}
+	}
+	// Move assignment operator
+	doc_undo &operator=(doc_undo &&from) throw()
+	{
+		if (&from != this)
+		{
+			ASSERT(from.utype != mod_unknown);
+			free_data();
+
+			utype = from.utype;
+			len = from.len;
+			address = from.address;
+			removed.swap(from.removed);
+			from.removed.reset();
+			parena = from.parena;
+			cap = from.cap;
+			spill = from.spill;
+			if (in_file())
+				idx = from.idx;
+			else
+			{
+				ptr = from.ptr;
+				from.ptr = NULL;
+				from.cap = 0;
+			}
+		}
+		return *this;
+	}
+#endif
+	~doc_undo()
+	{
+		ASSERT(utype != mod_unknown);
+		free_data();
+	}
+
+	// Moves the data to a new buffer so that it can be changed in place (when merging
+	// changes) without affecting a snapshot or another record that uses the old buffer.
+	void unshare()
+	{
+		ASSERT(!in_file() && ptr != NULL);
+		unsigned char *pp = parena->allocate(cap);
+		memcpy(pp, ptr, size_t(len));
+		parena->release(ptr, cap);
+		ptr = pp;
+	}
+
+	// vector requires a default constructor (even if not used)
+//    doc_undo() { utype = mod_unknown; }
+//    operator==(const doc_undo &) const { return false; }
+//    operator<(const doc_undo &) const { return false; }
+
+private:
+	void free_data()
+	{
+		if (!in_file() && ptr != NULL)
+			parena->release(ptr, cap);
+	}
+};
+
+// Updates a location list for a change, saving what is removed so loc_revert can put it back
+void loc_apply(const doc_undo &uu, loc_tree &loc, boost::shared_ptr<loc_tree> &removed);
+// Restores a location list to how it was before loc_apply(uu) (uu must be the last change applied)
+void loc_revert(const doc_undo &uu, loc_tree &loc);
+
+// Adds the undo records for replacing len bytes at every address in found (see CHexEditDoc::ReplaceAll)
+void add_replace_all(std::vector<doc_undo> &undo, undo_arena *pa, const std::vector<FILE_ADDRESS> &found,
+					 FILE_ADDRESS len, const unsigned char *rep, size_t replen);
+
+// Works out the area of the document affected by a batch of changes (see CHexEditDoc::CommitBatch)
+bool batch_area(const std::vector<batch_change> &batch, FILE_ADDRESS length, FILE_ADDRESS &lo, FILE_ADDRESS &hi);
+
+#endif
@@ -12,9 +12,14 @@
 //    separate to undo facilities of the view(s) which track changes in the
 //    display as well as keeping track of changes made to the document (via
 //    an index into this array).
-//  - A locations linked list which represents where every byte of the current
-//    displayed "file" comes from.  This list is rebuilt from the original data
-//    file plus the undo array everytime a change to the document is made.
+//  - A locations list which represents where every byte of the current
+//    displayed "file" comes from.  This list is updated for each change (or
+//    undo) made to the document.  Each undo record keeps the location records
+//    that its change removed so that undoing only has to put them back.
+//    It is stored in a balanced tree (see LocTree.h) so that the record for
+//    any address can be found quickly even when there are many changes.
+//    (The list can also be rebuilt from scratch from the original data file
+//    plus the undo array - see regenerate().)
 //  Note that the original data file is never modified by the user making
 //       changes until the file is saved.  When the file is saved the original
 //       file plus the locations linked list are used to create the new file.
@@ -29,6 +34,9 @@
 #include "boyer.h"
 
 #include "HexEditDoc.h"
+#include "AsyncWriter.h"
+#include "SavePlan.h"
+#include "PatternFile.h"
 #include "Mainfrm.h"
 
 #ifdef _DEBUG
@@ -53,50 +61,49 @@ IMPLEMENT_DYNAMIC(CBookmarkHint, CObject)   // A bookmark has been added/removed
 IMPLEMENT_DYNAMIC(CTrackHint, CObject)      // Need to invalidate extra things for change tracking
 IMPLEMENT_DYNAMIC(CBGPreviewHint, CObject)  // load of preview bitmap has finished
 
-size_t CHexEditDoc::GetData(unsigned char *buf, size_t len, FILE_ADDRESS address, int use_bg /*= -1*/)
+// Note: sequential readers (background threads etc) should pass their own
+// doc_cursor to avoid searching for the location record on every call.
+// All threads share the same file objects (pfile1_ and data_file_) which is OK since
+// we only use ReadAt which does not depend on the file position.  (ReadAt may move the
+// file position but nothing uses Seek/Read on these files while they are shared.)  (Devices
+// (CFileNC) use the file position but CFileNC serialises all its reads and writes itself.)
+// Only a read lock is taken so background threads can all read at the same time.
+size_t CHexEditDoc::GetData(unsigned char *buf, size_t len, FILE_ADDRESS address, doc_cursor &cursor, CFile64 *pfile /*= NULL*/)
+{
+	read_lock rl(docrw_);
+	return read_data(loc_, buf, len, address, cursor, pfile);
+}
+
+// Reads from a snapshot (see TakeSnapshot) - the snapshot's records don't change so the
+// lock is only needed to check that the files they refer to are still the same.
+size_t CHexEditDoc::GetData(unsigned char *buf, size_t len, FILE_ADDRESS address, doc_cursor &cursor,
+                            const doc_snapshot &snap, CFile64 *pfile /*= NULL*/)
+{
+	ASSERT(snap.active);
+	read_lock rl(docrw_);
+	if (snap.file_gen != file_gen_)
+		return 0;                       // stale
+	return read_data(snap.loc, buf, len, address, cursor, pfile);
+}
+
+size_t CHexEditDoc::read_data(const loc_tree &loc, unsigned char *buf, size_t len, FILE_ADDRESS address,
+                              doc_cursor &cursor, CFile64 *pfile)
 {
-	ASSERT(use_bg == -1 || use_bg == 2 || use_bg == 3 || use_bg == 4 || use_bg == 5);   // 0 and 1 are no longer used
 	ASSERT(address >= 0);
 	FILE_ADDRESS pos;           // Tracks file position of current location record
 	ploc_t pl;                  // Current location record
 
-	CFile64 *pfile;
-	switch (use_bg)
-	{
-	case 2:
-		pfile = pfile2_;        // Background search file
-		break;
-	case 3:
-		pfile = pfile3_;        // Aerial scan thread file
-		break;
-	case 4:
-		pfile = pfile4_;        // Background compare thread file
-		break;
-	case 5:
-		pfile = pfile5_;        // Stats thread file
-		break;
-	default:
-		ASSERT(0);
-		// fall through
-	case -1:
-		pfile = pfile1_;		// Normal file
-	}
-
-    CSingleLock sl(&docdata_, TRUE);
+	if (pfile == NULL)
+		pfile = pfile1_;
 
 	// Find the 1st loc record that has (some of) the data
-	for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
-	{
-		ASSERT((pl->dlen >> 62) != 0);
-		if (address < pos + FILE_ADDRESS(pl->dlen&doc_loc::mask))
-			break;
-	}
+	pl = loc.find(address, pos, cursor);
 
 	// Get the data from each loc record until buf is full
 	size_t left;                        // How much is left to copy
 	FILE_ADDRESS start = address - pos; // Where to start copy in this block
 	size_t tocopy;                      // How much to copy in this block
-	for (left = len; left > 0 && pl != loc_.end(); left -= tocopy, buf += tocopy)
+	for (left = len; left > 0 && pl != loc.end(); left -= tocopy, buf += tocopy)
 	{
 		tocopy = size_t(min(FILE_ADDRESS(left), FILE_ADDRESS(pl->dlen&doc_loc::mask) - start));
 		ASSERT(tocopy < 0x10000000);
@@ -105,8 +112,7 @@ size_t CHexEditDoc::GetData(unsigned char *buf, size_t len, FILE_ADDRESS address
 			// Read data from the original file
 			UINT actual;                // Number of bytes actually read from file
 
-			pfile->Seek(pl->fileaddr + start, CFile::begin);
-			if ((actual = pfile->Read((void *)buf, (UINT)tocopy)) < tocopy)
+			if ((actual = pfile->ReadAt(pl->fileaddr + start, (void *)buf, (UINT)tocopy)) < tocopy)
 			{
 				ASSERT(shared_);  // We should only run out of data if underlying file size has changed (should only happen if file was opened shareable)
 
@@ -125,45 +131,8 @@ size_t CHexEditDoc::GetData(unsigned char *buf, size_t len, FILE_ADDRESS address
 			// Read data from the data file
 			UINT actual;                // Number of bytes actually read from file
 
-			FILE_ADDRESS fileaddr = pl->fileaddr&doc_loc::fmask;
-			int idx = int((pl->fileaddr>>62)&0x3);   // must change when fmask/max_data_files changes
-
-			switch (use_bg)
-			{
-			case 2:
-				ASSERT(data_file2_[idx] != NULL);
-				data_file2_[idx]->Seek(fileaddr + start, CFile::begin);
-				actual = data_file2_[idx]->Read((void *)buf, (UINT)tocopy);
-				break;
-			case 3:
-				ASSERT(data_file3_[idx] != NULL);
-				data_file3_[idx]->Seek(fileaddr + start, CFile::begin);
-				actual = data_file3_[idx]->Read((void *)buf, (UINT)tocopy);
-				break;
-			case 4:
-				ASSERT(data_file4_[idx] != NULL);
-				data_file4_[idx]->Seek(fileaddr + start, CFile::begin);
-				actual = data_file4_[idx]->Read((void *)buf, (UINT)tocopy);
-				break;
-			case 5:
-				ASSERT(data_file5_[idx] != NULL);
-				data_file5_[idx]->Seek(fileaddr + start, CFile::begin);
-				actual = data_file5_[idx]->Read((void *)buf, (UINT)tocopy);
-				break;
-			case 6:
-				ASSERT(data_file6_[idx] != NULL);
-				data_file6_[idx]->Seek(fileaddr + start, CFile::begin);
-				actual = data_file6_[idx]->Read((void *)buf, (UINT)tocopy);
-				break;
-			default:
-				ASSERT(0);
-				// fall through
-			case -1:
-				ASSERT(data_file_[idx] != NULL);
-				data_file_[idx]->Seek(fileaddr + start, CFile::begin);
-				actual = data_file_[idx]->Read((void *)buf, (UINT)tocopy);
-				break;
-			}
+			ASSERT(pl->fileid < data_file_.size() && data_file_[pl->fileid] != NULL);
+			actual = data_file_[pl->fileid]->ReadAt(pl->fileaddr + start, (void *)buf, (UINT)tocopy);
 			if (actual != tocopy)
 			{
 				// If we run out of file there is something wrong with our data
@@ -179,120 +148,616 @@ size_t CHexEditDoc::GetData(unsigned char *buf, size_t len, FILE_ADDRESS address
 		++pl;
 	}
 
+	// Remember the last record we read from, for the next call
+	if (left < len)
+	{
+		if (pos >= address + FILE_ADDRESS(len - left))
+		{
+			--pl;
+			pos -= (pl->dlen&doc_loc::mask);
+		}
+		loc.remember(cursor, pl, pos);
+	}
+
 	// Return the actual number of bytes written to buf
 	return len - left;
 }
 
+// Gets a run of document bytes starting at address without copying them if possible.
+// If the bytes are in memory (inserted/replaced bytes) then ptr points straight at them.
+// Bytes of the original file or a data file are used in place in a mapped view of the
+// file if it is mapped (see CFile64::EnableMapping), otherwise they are read into scratch.
+// The run stops at the end of a location record or mapped view, at end (or EOF if end
+// is -1) and is never more than scratch_len bytes.  Returns the length (0 at EOF/end).
+// The bytes stay valid until span is released - see doc_span (which only keeps the read
+// lock if a view is pinned).
+// Note: memory records can be freed by Undo so this is only for the main thread - a
+// background thread must use a snapshot (below).
+size_t CHexEditDoc::GetSpan(const unsigned char *&ptr, unsigned char *scratch, size_t scratch_len,
+                            FILE_ADDRESS address, FILE_ADDRESS end, doc_cursor &cursor, doc_span &span,
+                            CFile64 *pfile /*= NULL*/)
+{
+	span.release();
+	docrw_.lock_shared();
+	span.plock_ = &docrw_;
+	size_t retval = read_span(loc_, ptr, scratch, scratch_len, address, end, cursor, span, pfile);
+	if (span.pview_ == NULL)
+		span.release();
+	return retval;
+}
+
+// Same as above for a snapshot.  Here memory can be used without a lock since the memory
+// the snapshot uses is not freed until it is released (see free_snapshot_data).
+size_t CHexEditDoc::GetSpan(const unsigned char *&ptr, unsigned char *scratch, size_t scratch_len,
+                            FILE_ADDRESS address, FILE_ADDRESS end, doc_cursor &cursor, doc_span &span,
+                            const doc_snapshot &snap)
+{
+	ASSERT(snap.active);
+	span.release();
+	docrw_.lock_shared();
+	span.plock_ = &docrw_;
+	size_t retval = 0;                  // (0 if stale)
+	if (snap.file_gen == file_gen_)
+		retval = read_span(snap.loc, ptr, scratch, scratch_len, address, end, cursor, span, NULL);
+	if (span.pview_ == NULL)
+		span.release();
+	return retval;
+}
+
+size_t CHexEditDoc::read_span(const loc_tree &loc, const unsigned char *&ptr, unsigned char *scratch, size_t scratch_len,
+                              FILE_ADDRESS address, FILE_ADDRESS end, doc_cursor &cursor, doc_span &span, CFile64 *pfile)
+{
+	ASSERT(address >= 0 && scratch_len > 0);
+	FILE_ADDRESS pos;                   // Address of start of record
+	ploc_t pl = loc.find(address, pos, cursor);
+	if (pl == loc.end())
+		return 0;                       // at or past EOF
+
+	FILE_ADDRESS rec_end = pos + FILE_ADDRESS(pl->dlen&doc_loc::mask);
+	if (end < 0 || end > rec_end)
+		end = rec_end;
+	if (address >= end)
+		return 0;
+	size_t len = size_t(min(end - address, FILE_ADDRESS(scratch_len)));
+
+	if ((pl->dlen >> 62) == 2)
+	{
+		// In memory so we can use it directly
+		ptr = pl->memaddr + size_t(address - pos);
+		loc.remember(cursor, pl, pos);
+		return len;
+	}
+
+	// Use the bytes in place if the file is mapped
+	CFile64 *pf;
+	if ((pl->dlen >> 62) == 1)
+		pf = pfile != NULL ? pfile : pfile1_;
+	else
+	{
+		ASSERT(pl->fileid < data_file_.size() && data_file_[pl->fileid] != NULL);
+		pf = data_file_[pl->fileid];
+	}
+	file_map *pmap = pf->GetMap();
+	const unsigned char *pp;
+	size_t avail;                       // Bytes of the view from pp
+	file_map::view *pview;
+	if (pmap != NULL && (pp = pmap->pin(pl->fileaddr + (address - pos), avail, pview)) != NULL)
+	{
+		ASSERT(span.pview_ == NULL && span.plock_ != NULL);
+		span.pmap_ = pmap;
+		span.pview_ = pview;
+		ptr = pp;
+		loc.remember(cursor, pl, pos);
+		return min(len, avail);
+	}
+
+	// Read from file (note that this does not go past the end of the record)
+	ptr = scratch;
+	return read_data(loc, scratch, len, address, cursor, pfile);
+}
+
+// Takes a snapshot of the document as it is now.  This takes O(1) time as the
+// snapshot shares the location records with loc_ (see LocTree.h).  While there
+// are snapshots every change is recorded (see note_change) and memory and data
+// files that the document no longer needs are kept until the snapshots that
+// may use them are released (see free_snapshot_data).
+// Note: the caller may have docdata_ locked (but not docrw_).
+void CHexEditDoc::TakeSnapshot(doc_snapshot &snap)
+{
+	ASSERT(!snap.active);
+	write_lock wl(docrw_);              // the node reference counts of loc_ are changed
+
+	snap.loc = loc_;
+	snap.length = length_;
+	snap.edit = edits_.count();
+	snap.file_gen = file_gen_;
+	snap.active = true;
+
+	if (snapshots_.empty())
+		edits_.clear();
+	snapshots_.insert(snap.edit);
+	undo_arena_.keep(edits_.count() + 1);
+}
+
+void CHexEditDoc::ReleaseSnapshot(doc_snapshot &snap)
+{
+	if (!snap.active)
+		return;
+
+	write_lock wl(docrw_);
+	snap.loc.clear();
+	snap.active = false;
+	std::multiset<unsigned>::iterator ps = snapshots_.find(snap.edit);
+	ASSERT(ps != snapshots_.end());
+	snapshots_.erase(ps);
+	free_snapshot_data();
+}
+
+bool CHexEditDoc::SnapshotStale(const doc_snapshot &snap) const
+{
+	ASSERT(snap.active);
+	read_lock rl(docrw_);
+	return snap.file_gen != file_gen_;
+}
+
+bool CHexEditDoc::SnapshotCurrent(const doc_snapshot &snap) const
+{
+	ASSERT(snap.active);
+	read_lock rl(docrw_);
+	return snap.edit == edits_.count();
+}
+
+unsigned CHexEditDoc::EditCount() const
+{
+	read_lock rl(docrw_);
+	return edits_.count();
+}
+
+FILE_ADDRESS CHexEditDoc::MapAddress(const doc_snapshot &snap, FILE_ADDRESS address, FILE_ADDRESS len) const
+{
+	ASSERT(snap.active);
+	read_lock rl(docrw_);
+	if (!edits_.has(snap.edit))
+		return -1;
+	return edits_.map(snap.edit, address, len);
+}
+
+bool CHexEditDoc::SnapshotDiff(const doc_snapshot &from, const doc_snapshot &to,
+                               std::vector<edit_log::range> &removed, std::vector<edit_log::range> &added) const
+{
+	ASSERT(from.active && to.active && from.edit <= to.edit);
+	read_lock rl(docrw_);
+	if (!edits_.has(from.edit))
+		return false;
+	edits_.diff(from.edit, to.edit, from.length, removed, added);
+	return true;
+}
+
+// Remembers a change (so snapshot addresses can be mapped) if there are any snapshots.
+// Must be called (with docrw_ write locked) for every change to the document contents.
+void CHexEditDoc::note_change(FILE_ADDRESS address, FILE_ADDRESS removed, FILE_ADDRESS inserted)
+{
+	if (snapshots_.empty())
+		edits_.skip();
+	else
+	{
+		edits_.add(address, removed, inserted);
+		undo_arena_.keep(edits_.count() + 1);   // anything released from now on may be used by a snapshot
+	}
+}
+
+// Frees undo memory and data files that are no longer used by any snapshot.  Anything
+// released while there were snapshots is tagged with a version number greater than any
+// snapshot then in use, so it can be freed once the oldest snapshot is that new.
+void CHexEditDoc::free_snapshot_data()
+{
+	unsigned oldest;
+	if (snapshots_.empty())
+	{
+		oldest = UINT_MAX;
+		edits_.clear();
+		undo_arena_.keep(0);
+	}
+	else
+	{
+		oldest = *snapshots_.begin();
+		edits_.trim(oldest);
+	}
+	undo_arena_.free_kept(oldest);
+
+	std::vector<pair<unsigned, int> >::iterator pp;
+	for (pp = remove_pending_.begin(); pp != remove_pending_.end(); )
+	{
+		if (pp->first <= oldest)
+		{
+			if (data_file_.unused(pp->second))
+				close_data_file(pp->second);
+			pp = remove_pending_.erase(pp);
+		}
+		else
+			++pp;
+	}
+}
+
 // Create a new temp data file so that we can save to disk rather than using lots of memory
+// Note: the file is not referenced until it is used in a change (mod_insert_file) so
+// it may be released by regenerate() if that happens first (eg Undo is called).
 int CHexEditDoc::AddDataFile(LPCTSTR name, BOOL temp /*=FALSE*/)
 {
 	int ii;
 
 	// First check if the file is already there
-	for (ii = 0; ii < doc_loc::max_data_files; ++ii)
+	for (ii = 0; ii < data_file_.size(); ++ii)
 	{
 		if (data_file_[ii] != NULL && data_file_[ii]->GetFilePath().CompareNoCase(name) == 0)
+		{
+			// Make sure it is not closed when a snapshot is released (see RemoveDataFile)
+			write_lock wl(docrw_);
+			std::vector<pair<unsigned, int> >::iterator pp;
+			for (pp = remove_pending_.begin(); pp != remove_pending_.end(); )
+				if (pp->second == ii)
+					pp = remove_pending_.erase(pp);
+				else
+					++pp;
 			return ii;
+		}
 	}
 
-	// Now find an empty slot and open the file
-	for (ii = 0; ii < doc_loc::max_data_files; ++ii)
-		if (data_file_[ii] == NULL)
-		{
-			data_file_[ii] = new CFile64(name, CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
+	CFile64 *pf = new CFile64(name, CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
+	pf->EnableMapping();                // safe since no one can write to it (shareDenyWrite)
 
-			// If background searching on also open 2nd copy of the file
-			if (pthread2_ != NULL)
-			{
-				ASSERT(data_file2_[ii] == NULL);
-				data_file2_[ii] = new CFile64(name, CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-			}
-			// If aerial scan is on also open 3rd copy of the file
-			if (pthread3_ != NULL)
-			{
-				ASSERT(data_file3_[ii] == NULL);
-				data_file3_[ii] = new CFile64(name, CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-			}
-			// If bg compare is on also open 4th copy of the file
-			if (pthread4_ != NULL)
-			{
-				ASSERT(data_file4_[ii] == NULL);
-				data_file4_[ii] = new CFile64(name, CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-			}
-			// If background stats are on also open 5th copy of the file
-			if (pthread5_ != NULL)
-			{
-				ASSERT(data_file5_[ii] == NULL);
-				data_file5_[ii] = new CFile64(name, CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-			}
-			// If preview is on also open 6th copy of the file
-			if (pthread6_ != NULL)
-			{
-				ASSERT(data_file6_[ii] == NULL);
-				data_file6_[ii] = new CFile64(name, CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
-			}
+	return add_data_file(pf, temp);
+}
 
-			temp_file_[ii] = temp;
-			return ii;
-		}
+// Create a data file that is total bytes of the pattern (len bytes at pat) repeated.
+// Nothing is written to disk - the bytes are generated when read (see CPatternFile).
+// As for AddDataFile the "file" is not referenced until used in a change (mod_insert_file).
+int CHexEditDoc::AddPattern(const unsigned char *pat, size_t len, FILE_ADDRESS total)
+{
+	return add_data_file(new CPatternFile(pat, len, total), FALSE);
+}
 
-	return -1;  // no empty slots
+int CHexEditDoc::add_data_file(CFile64 *pf, BOOL temp)
+{
+	write_lock wl(docrw_);              // Background threads may be reading data_file_
+	return data_file_.add(pf, temp != FALSE);
 }
 
+// If there are snapshots (see TakeSnapshot) they may still read from the file so
+// it is not closed until they have been released.
 void CHexEditDoc::RemoveDataFile(int idx)
 {
-	ASSERT(idx >= 0 && idx < doc_loc::max_data_files);
+	ASSERT(idx >= 0 && idx < data_file_.size());
+	write_lock wl(docrw_);              // Make sure no background thread is reading from it
+	if (!snapshots_.empty())
+		remove_pending_.push_back(make_pair(edits_.count() + 1, idx));
+	else
+		close_data_file(idx);
+}
+
+void CHexEditDoc::close_data_file(int idx)
+{
 	if (data_file_[idx] != NULL)
 	{
+		bool temp = data_file_.is_temp(idx);
+		CFile64 *pf = data_file_.remove(idx);
 		CString ss;
-		if (temp_file_[idx])
-			ss = data_file_[idx]->CFile64::GetFilePath();  // save the file name so we can delete it
-		data_file_[idx]->Close();
-		delete data_file_[idx];
-		data_file_[idx] = NULL;
-		if (pthread2_ != NULL)
+		if (temp)
+			ss = pf->CFile64::GetFilePath();  // save the file name so we can delete it
+		pf->Close();
+		delete pf;
+		// If the data file was a temp file remove it now it is closed
+		if (temp)
+			remove(ss);
+	}
+}
+
+// Closes all data files (deleting temp ones) - only used once there are no undo records
+void CHexEditDoc::close_data_files()
+{
+	data_file_.clear_refs();
+	for (int ii = data_file_.size() - 1; ii >= 0; --ii)
+		if (ii < data_file_.size())     // (removing a file may also discard empty slots below it)
+			RemoveDataFile(ii);
+	ASSERT(data_file_.empty() || !snapshots_.empty());
+}
+
+// Biggest block of new data that a command should create in memory - see UseTempFile
+static const FILE_ADDRESS max_in_memory = 16*1024*1024;
+
+// This is the part of the memory governor used by commands that generate a lot of data (eg
+// DoConversion, OnCompress).  Big results are always put in a temp file and smaller ones are
+// too if keeping them in memory would take the undo data over budget.
+bool CHexEditDoc::UseTempFile(FILE_ADDRESS len) const
+{
+	return len > max_in_memory || FILE_ADDRESS(undo_arena_.bytes()) + len > FILE_ADDRESS(undo_budget_);
+}
+
+// If the undo data in memory is over budget (undo_budget_) this moves the data of the oldest
+// undo records to a new temp data file.  The records are then read from the file just
+// like an inserted file (mod_insert_file) so GetData, Undo etc work the same.  The most recent
+// changes are left in memory as they are the most likely to be undone.
+// This is called when idle (see CheckBGProcessing) and also after a change if memory used
+// is well over budget (so that a long macro can't use unlimited memory) but does nothing
+// until usage has grown by a good amount since it last tried.
+// The new location list is built (as regenerate would) without locking the doc so that
+// background threads are only held up while it is swapped in.
+// The temp file is only deleted once all records using it are undone or discarded (saved).
+// Nothing is done during a save, as WriteInPlace (which allows idle processing to update
+// its progress bar) writes straight from the memory, or in a batch (see BeginBatch).
+void CHexEditDoc::spill_undo()
+{
+	const unsigned spill_min = 4096;    // Don't bother with records smaller than this
+	const size_t keep_recent = 4;       // Number of recent changes always left in memory
+
+	if (saving_ || batch_level_ > 0)
+		return;
+
+	size_t used = undo_arena_.bytes();
+	if (used < spill_tried_)
+		spill_tried_ = used;            // memory has been freed (undo, save etc) since we last tried
+	if (used <= undo_budget_ || used < spill_tried_ + undo_budget_/8 || undo_.size() <= keep_recent)
+		return;
+	spill_tried_ = used;
+
+	// Work out which records to move (oldest first) to get well under budget.  If there
+	// is no orig. file the first record is the base for change tracking so it is left.
+	size_t to_free = used - undo_budget_/4*3;
+	std::vector<size_t> todo;
+	size_t ii;
+	for (ii = (base_type_ == 1 ? 1 : 0); ii < undo_.size() - keep_recent && to_free > 0; ++ii)
+	{
+		// (Shared data is skipped as moving one record's copy would not free anything.)
+		if (!undo_[ii].in_file() && undo_[ii].ptr != NULL && undo_[ii].cap >= spill_min &&
+			!undo_arena_.shared(undo_[ii].ptr))
 		{
-			ASSERT(data_file2_[idx] != NULL);
-			data_file2_[idx]->Close();
-			delete data_file2_[idx];
-			data_file2_[idx] = NULL;
+			todo.push_back(ii);
+			to_free -= min(to_free, size_t(undo_[ii].cap));
 		}
-		if (pthread3_ != NULL)
+	}
+	if (todo.empty())
+		return;
+
+	// Write the data to the temp file (background threads only read undo_ so no lock is needed)
+	char temp_dir[_MAX_PATH];
+	char temp_file[_MAX_PATH];
+	::GetTempPath(sizeof(temp_dir), temp_dir);
+	::GetTempFileName(temp_dir, _T("_HE"), 0, temp_file);
+
+	std::vector<FILE_ADDRESS> spill(todo.size());  // Where each record's data is in the file
+	int idx;
+	try
+	{
+		CFile64 ff(temp_file, CFile::modeCreate|CFile::modeWrite|CFile::shareExclusive|CFile::typeBinary);
+		FILE_ADDRESS addr = 0;
+		for (ii = 0; ii < todo.size(); ++ii)
 		{
-			ASSERT(data_file3_[idx] != NULL);
-			data_file3_[idx]->Close();
-			delete data_file3_[idx];
-			data_file3_[idx] = NULL;
+			const doc_undo &uu = undo_[todo[ii]];
+			ff.Write(uu.ptr, UINT(uu.len));
+			spill[ii] = addr;
+			addr += uu.len;
 		}
-		if (pthread4_ != NULL)
+		ff.Close();
+
+		idx = AddDataFile(temp_file, TRUE);
+	}
+	catch (CFileException *pfe)
+	{
+		// Not fatal - we just keep using the memory
+		TRACE1("Could not move undo data to temp file: %d\n", pfe->m_cause);
+		pfe->Delete();
+		remove(temp_file);
+		return;
+	}
+
+	// Point the records at the temp file.  (Only this thread uses undo_ so this does not need
+	// the lock, but the memory is not released until loc_ no longer points to it.)
+	std::vector<pair<unsigned char *, unsigned> > mem(todo.size());
+	for (ii = 0; ii < todo.size(); ++ii)
+	{
+		doc_undo &uu = undo_[todo[ii]];
+		mem[ii] = make_pair(uu.ptr, uu.cap);
+		uu.idx = idx;
+		uu.spill = spill[ii];
+		uu.cap = 0;
+	}
+
+	// Build the new location list from the last checkpoint before the first record moved.
+	// This is copied record by record so that it shares no nodes with loc_ (node reference
+	// counts are protected by docrw_) and so can be built without the lock.
+	size_t start = min(todo.front()/checkpoint_every, checkpoint_.size());
+	loc_tree loc;
+	if (start > 0)
+	{
+		const loc_tree &cp = checkpoint_[start - 1];
+		for (ploc_t pl = cp.begin(); pl != cp.end(); ++pl)
+			loc.push_back(*pl);
+	}
+	else if (pfile1_ != NULL && pfile1_->GetLength() > 0)
+		loc.push_back(doc_loc(FILE_ADDRESS(0), pfile1_->GetLength()));
+	start *= checkpoint_every;
+
+	std::vector<boost::shared_ptr<loc_tree> > removed(undo_.size() - start);
+	std::vector<loc_tree> checkpoints;
+	for (ii = start; ii < undo_.size(); ++ii)
+	{
+		::loc_apply(undo_[ii], loc, removed[ii - start]);
+		if ((ii + 1) % checkpoint_every == 0)
+			checkpoints.push_back(loc);
+	}
+	ASSERT(loc.length() == length_ || shared_);
+
+	// Now swap them in
+	{
+		CSingleLock sl(&docdata_, TRUE);
+		write_lock wl(docrw_);
+		loc_.swap(loc);
+		loc.clear();                    // (old nodes may be shared with snapshots so free them with the lock)
+		for (ii = start; ii < undo_.size(); ++ii)
+			undo_[ii].removed.swap(removed[ii - start]);
+		removed.clear();
+		checkpoint_.erase(checkpoint_.begin() + start/checkpoint_every, checkpoint_.end());
+		checkpoint_.insert(checkpoint_.end(), checkpoints.begin(), checkpoints.end());
+		checkpoints.clear();
+		data_file_.add_ref(idx, int(todo.size()));
+
+		// Note: if a snapshot may still be using the memory the arena keeps it (see note_change)
+		for (ii = 0; ii < mem.size(); ++ii)
+			undo_arena_.release(mem[ii].first, mem[ii].second);
+	}
+	spill_tried_ = undo_arena_.bytes();
+}
+
+// Adds undo record idx (just added, or merged into if merged is true) to the journal (see
+// EditJournal.h).  The journal is only started with the first change so that it always
+// has all the changes.
+// Note: this is called without docdata_ and docrw_ locked as it may copy a lot of data
+// (eg an inserted file) so that background threads are not held up.  This is OK since
+// only the main thread changes the undo records.
+void CHexEditDoc::journal_change(size_t idx, bool merged)
+{
+	ASSERT(idx < undo_.size());
+	if (!journal_.is_open())
+	{
+		BY_HANDLE_FILE_INFORMATION info;
+		if (!theApp.journal_edits_ || merged || idx != 0 ||
+			pfile1_ == NULL || IsDevice() || shared_ || base_type_ != 0 ||
+			!pfile1_->GetInformation(info) ||
+			!journal_.create(pfile1_->GetFilePath(), pfile1_->GetLength(), info.ftLastWriteTime))
 		{
-			ASSERT(data_file4_[idx] != NULL);
-			data_file4_[idx]->Close();
-			delete data_file4_[idx];
-			data_file4_[idx] = NULL;
+			return;
 		}
-		if (pthread5_ != NULL)
+	}
+
+	const doc_undo &uu = undo_[idx];
+	int op = merged ? edit_journal::rec_merge : edit_journal::rec_new;
+	CPatternFile *ppf;
+	bool ok;
+	if (uu.utype == mod_delforw || uu.utype == mod_delback)
+		ok = journal_.add(op, uu.utype, uu.address, uu.len, NULL);
+	else if (!uu.in_file())
+		ok = journal_.add(op, uu.utype, uu.address, uu.len, uu.ptr);
+	else if ((ppf = dynamic_cast<CPatternFile *>(data_file_[uu.idx])) != NULL && uu.spill == 0)
+		ok = journal_.add_pattern(uu.utype, uu.address, uu.len, ppf->Pattern(), ppf->PatternLength());
+	else
+		ok = journal_.add(op, uu.utype, uu.address, uu.len, data_file_[uu.idx], uu.spill);
+
+	if (!ok)
+	{
+		// Don't keep a journal that is missing changes
+		TRACE1("Error writing edit journal %s\n", (LPCTSTR)journal_.name());
+		journal_.remove();
+	}
+}
+
+void CHexEditDoc::journal_undo()
+{
+	if (journal_.is_open() && !journal_.add_undo())
+		journal_.remove();
+}
+
+// If there is a journal of unsaved changes from a previous session (see EditJournal.h)
+// this asks the user whether to restore them.  The undo records are rebuilt from the
+// journal, which then becomes the data file for their data (like spilled undo records -
+// see spill_undo) so no data has to be copied.  This must be called when the file has
+// just been opened (before the background threads are started).
+void CHexEditDoc::replay_journal()
+{
+	ASSERT(pthread2_ == NULL && undo_.empty() && !journal_.is_open());
+	BY_HANDLE_FILE_INFORMATION info;
+	if (!theApp.journal_edits_ || pfile1_ == NULL || IsDevice() || shared_ || readonly_ ||
+		!pfile1_->GetInformation(info))
+	{
+		return;
+	}
+
+	CString path = pfile1_->GetFilePath();
+	CString name = edit_journal::file_name(path);
+	std::vector<edit_journal::entry> entries;
+	FILE_ADDRESS valid_len;
+	int status = edit_journal::read(path, length_, info.ftLastWriteTime, entries, valid_len);
+	if (status == -1)
+		return;                         // no journal
+	else if (status == 0)
+	{
+		TaskMessageBox("Unsaved Changes Not Restored",
+			"There were unsaved changes to this file from a previous session, "
+			"but they can't be restored as the file has been modified since.");
+		::remove(name);
+		return;
+	}
+
+	// Work out the undo records and check them
+	std::vector<edit_journal::entry> recs;
+	FILE_ADDRESS new_length;
+	if (!edit_journal::replay(entries, length_, recs, new_length))
+	{
+		TaskMessageBox("Unsaved Changes Not Restored",
+			"There were unsaved changes to this file from a previous session, "
+			"but they can't be restored as the journal is not valid.");
+		::remove(name);
+		return;
+	}
+	if (recs.empty())
+	{
+		::remove(name);                 // all the changes were undone
+		return;
+	}
+
+	CString mess;
+	mess.Format("There are unsaved changes to this file (%d) from a previous session.\n\n"
+				"Do you want to restore them?", int(recs.size()));
+	if (TaskMessageBox("Restore Unsaved Changes", mess, MB_YESNO) != IDYES)
+	{
+		::remove(name);
+		return;
+	}
+
+	// The journal is used as the data file for the changes
+	int jidx;
+	try
+	{
+		jidx = add_data_file(new CFile64(name, CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary), FALSE);
+	}
+	catch (CFileException *pfe)
+	{
+		TaskMessageBox("Unsaved Changes Not Restored", ::FileErrorMessage(pfe, CFile::modeRead));
+		pfe->Delete();
+		return;
+	}
+
+	std::vector<edit_journal::entry>::const_iterator pe;
+	for (pe = recs.begin(); pe != recs.end(); ++pe)
+	{
+		enum mod_type utype = (enum mod_type)pe->utype;
+		if (pe->op == edit_journal::rec_pattern)
 		{
-			ASSERT(data_file5_[idx] != NULL);
-			data_file5_[idx]->Close();
-			delete data_file5_[idx];
-			data_file5_[idx] = NULL;
+			std::vector<unsigned char> pat(size_t(pe->size));
+			data_file_[jidx]->ReadAt(pe->data, &pat[0], DWORD(pat.size()));
+			int idx = AddPattern(&pat[0], pat.size(), pe->len);
+			undo_.push_back(doc_undo(&undo_arena_, utype, pe->address, pe->len, NULL, idx));
 		}
-		if (pthread6_ != NULL)
+		else if (utype == mod_delforw || utype == mod_delback)
+			undo_.push_back(doc_undo(&undo_arena_, utype, pe->address, pe->len));
+		else
 		{
-			ASSERT(data_file6_[idx] != NULL);
-			data_file6_[idx]->Close();
-			delete data_file6_[idx];
-			data_file6_[idx] = NULL;
+			// Make a record with no data then point it at the data in the journal
+			undo_.push_back(doc_undo(&undo_arena_, mod_delforw, pe->address, pe->len));
+			undo_.back().utype = utype;
+			undo_.back().idx = jidx;
+			undo_.back().spill = pe->data;
 		}
-		// If the data file was a temp file remove it now it is closed
-		if (temp_file_[idx])
-			remove(ss);
 	}
+	length_ = new_length;
+	regenerate();
+	SetModifiedFlag(TRUE);
+
+	// Keep adding to the same journal
+	(void)journal_.reopen(path, valid_len);
 }
 
 // Change allows the document to be modified.  After adding it to the undo
-// array it regenerates the loc list and sends update notices to all views.
+// array it updates the loc list and sends update notices to all views.
 //   utype indicates the type of change
 //   address is the byte within the document for the start of the change
 //   clen is the number of bytes inserted/deleted or replaced (64 bit eg if whole file deleted)
@@ -306,8 +771,9 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 						 unsigned char *buf, 
 						 int num_done, CView *pview, BOOL ptoo /*=FALSE*/)
 {
-	// Lock the doc data (automatically releases the lock when it goes out of scope)
-	CSingleLock sl(&docdata_, TRUE);
+	// Lock the doc data (automatically releases the locks when they go out of scope)
+	CSingleLock sl(&docdata_, TRUE);    // for bg search/compare etc data (found_, to_search_ etc)
+	write_lock wl(docrw_);              // wait for readers then stop them while we change loc_/undo_
 
 	int index;          // index into undo array
 	ASSERT(utype == mod_insert  || utype == mod_insert_file || utype == mod_replace ||
@@ -315,6 +781,11 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 	ASSERT(address <= length_);
 	ASSERT(clen > 0);
 
+#ifndef USE_MOVE
+	bool undo_moved = false; // Was undo_ reallocated (so that loc_ memory records are now invalid)?
+#endif
+	bool nybble = false;     // Was the last byte of the previous change replaced (2nd nybble of hex edit)?
+
 	// Can this change be merged with the previous change?
 	// Note: if num_done is odd then we must merge this change
 	// since it is the 2nd nybble of a hex edit change
@@ -326,7 +797,14 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 		// This allows (up to 8) multiple consecutive changes in the same
 		// view of the same type to be merged together.
 		ASSERT(pview == last_view_ || num_done == 1);  // num_done may be 1 for first bottom nybble in vert_display mode
-		ASSERT(utype == undo_.back().utype);
+		ASSERT(utype == undo_.back().utype && !undo_.back().in_file());
+
+		// Take the previous change out of the locations list - it's added back (with the new bits) below
+		loc_revert(undo_.back());
+
+		// A snapshot (or other undo records - see ReplaceAll) may be using the bytes that we are about to change in place
+		if (undo_.back().ptr != NULL && (!snapshots_.empty() || undo_arena_.shared(undo_.back().ptr)))
+			undo_.back().unshare();
 
 		if (utype == mod_delforw)
 		{
@@ -349,6 +827,7 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 			ASSERT(buf != NULL);
 			ASSERT(undo_.back().address == address + clen);
 			ASSERT(clen < 0x100000000);
+			ASSERT(undo_.back().len + clen <= FILE_ADDRESS(undo_.back().cap));
 			memmove(undo_.back().ptr + size_t(clen),
 					undo_.back().ptr, size_t(undo_.back().len));
 			memcpy(undo_.back().ptr, buf, size_t(clen));
@@ -359,6 +838,7 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 		{
 			// mod_insert/mod_replace - add to end of current insert/replace
 			ASSERT(buf != NULL);
+			ASSERT(undo_.back().len + clen <= FILE_ADDRESS(undo_.back().cap));
 			memcpy(undo_.back().ptr + size_t(undo_.back().len), buf, size_t(clen));
 			undo_.back().len += clen;
 		}
@@ -370,26 +850,249 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 			memcpy(undo_.back().ptr+undo_.back().len - 1, buf, size_t(clen));
 			clen -= 1;                   // Fix for later calcs of length_
 			undo_.back().len += clen;
+			nybble = true;
 		}
 		index = -1;             // Signal that this is not a new undo
 	}
-	else
+	else
+	{
+#ifndef USE_MOVE
+		size_t capacity = undo_.capacity();
+#endif
+
+		// Add a new elt to undo array
+		if (utype == mod_insert_file)
+		{
+			ASSERT(num_done > -1 && num_done < data_file_.size() && data_file_[num_done] != NULL);
+			undo_.push_back(doc_undo(&undo_arena_, utype, address, clen, NULL, num_done));
+			data_file_.add_ref(num_done);  // released (see Undo) when no longer referenced
+		}
+		else if (utype == mod_insert || utype == mod_replace || utype == mod_repback)
+			undo_.push_back(doc_undo(&undo_arena_, utype, address, clen, buf));
+		else
+			undo_.push_back(doc_undo(&undo_arena_, utype, address, clen));
+		index = undo_.size() - 1;
+
+#ifndef USE_MOVE
+		// If the vector was reallocated the data of all undo records has been copied
+		// (With move constructors the data stays where it is so loc_ is still valid.)
+		undo_moved = undo_.capacity() != capacity;
+#endif
+	}
+
+	last_view_ = pview;
+
+	if (batch_level_ > 0)
+	{
+		// Just remember the change - bg search etc are updated for the whole batch in CommitBatch
+		if (batch_.empty())
+		{
+			batch_view_ = pview;
+			batch_ptoo_ = ptoo;
+		}
+		if (utype == mod_insert && clen == 0)
+			batch_.push_back(batch_change(mod_replace, address, 1));  // hex edit changed low nybble (see below)
+		else
+			batch_.push_back(batch_change(utype, address, clen));
+	}
+	else
+		bg_search_change(utype, address, clen);
+
+	// Remember the change for snapshot users (must be done before length_ is updated)
+	if (utype == mod_delforw || utype == mod_delback)
+		note_change(address, clen, 0);
+	else if (utype == mod_insert || utype == mod_insert_file)
+		note_change(address, nybble ? 1 : 0, nybble ? clen + 1 : clen);
+	else
+		note_change(address, min(nybble ? clen + 1 : clen, length_ - address), nybble ? clen + 1 : clen);
+
+	// Adjust file length according to bytes added or removed
+	FILE_ADDRESS prev_length = length_;
+	if (utype == mod_delforw || utype == mod_delback)
+		length_ -= clen;
+	else if (utype == mod_insert || utype == mod_insert_file)
+		length_ += clen;
+	else if (utype == mod_replace && address + clen > length_)
+		length_ = address + clen;
+	else
+		ASSERT(utype == mod_replace || utype == mod_repback);
+
+	// Update bookmarks
+	if (utype == mod_delforw || utype == mod_delback)
+		bm_posn_.remove(address, clen);
+	else if (utype == mod_insert || utype == mod_insert_file)
+		bm_posn_.insert(address, clen);
+
+	// Update the location list
+#ifndef USE_MOVE
+	if (undo_moved)
+		regenerate();           // memory records point to old (freed) copies of the data so rebuild
+	else
+#endif
+	{
+		loc_apply(undo_.back());
+		set_checkpoint(undo_.size());
+		update_change_tracking(address, (utype == mod_delforw || utype == mod_delback) ? 0 : (nybble ? clen + 1 : clen),
+							   length_ - prev_length);
+	}
+#ifdef _DEBUG
+	loc_check();
+#endif
+
+	update_needed_ = true;
+	if (batch_level_ == 0)
+		send_change_hint(address);
+
+	// Unlock now since nothing below is protected by the locks
+	wl.unlock();
+	sl.Unlock();
+
+	journal_change(undo_.size() - 1, index == -1);
+	if (batch_level_ > 0)
+		return;                 // Views etc are updated when the batch is committed
+
+	// Undo data is moved to disk when idle (see CheckBGProcessing) but don't wait if well over budget
+	if (undo_arena_.bytes() > undo_budget_*2)
+		spill_undo();
+
+	doc_changed_ = true;        // Remember to restart bg scans when we get a chance
+
+	// Update views to show changed doc
+	CHexHint hh(utype, clen, address, pview, index, FALSE, ptoo);
+	if (utype == mod_insert && clen == 0)
+	{
+		// Insert hex changed low nybble without inserting
+		hh.utype = mod_replace;
+		hh.len = 1;
+	}
+	SetModifiedFlag(TRUE);
+	UpdateAllViews(NULL, 0, &hh);
+}
+
+// ReplaceAll makes the same changes as calling Change for each replacement (in a batch) but
+// the locks are only obtained once and the location list is updated directly without all
+// the per-change work of Change (merging, views, checks etc).  Replacements of the same length
+// are a mod_replace, else a mod_delforw followed by a mod_insert (unless replen is zero).
+// All the replacements share the same copy of the replacement bytes (see add_replace_all).
+void CHexEditDoc::ReplaceAll(const std::vector<FILE_ADDRESS> &found, FILE_ADDRESS len,
+							 const unsigned char *rep, size_t replen, CView *pview)
+{
+	ASSERT(len > 0);
+	if (found.empty())
+		return;
+
+	BeginBatch();
+	size_t first_new = undo_.size();    // First undo record added (added to the journal below without the locks)
+	{
+		CSingleLock sl(&docdata_, TRUE);
+		write_lock wl(docrw_);
+
+		// Make room for all the undo records now so that undo_ is not reallocated in the loop
+		size_t per = FILE_ADDRESS(replen) == len ? 1 : (replen > 0 ? 2 : 1);
+#ifndef USE_MOVE
+		size_t capacity = undo_.capacity();
+#endif
+		undo_.reserve(undo_.size() + found.size()*per);
+#ifndef USE_MOVE
+		// If the vector was reallocated the data of all undo records has been copied (see Change)
+		if (undo_.capacity() != capacity)
+			regenerate();
+#endif
+
+		// Add the undo records then update everything else for each one as Change does
+		add_replace_all(undo_, &undo_arena_, found, len, rep, replen);
+		for (size_t ii = first_new; ii < undo_.size(); ++ii)
+		{
+			FILE_ADDRESS address = undo_[ii].address, clen = undo_[ii].len;
+			batch_.push_back(batch_change(undo_[ii].utype, address, clen));
+			if (undo_[ii].utype == mod_delforw)
+			{
+				ASSERT(address + clen <= length_);
+				note_change(address, clen, 0);
+				length_ -= clen;
+				bm_posn_.remove(address, clen);
+			}
+			else if (undo_[ii].utype == mod_insert)
+			{
+				ASSERT(address <= length_);
+				note_change(address, 0, clen);
+				length_ += clen;
+				bm_posn_.insert(address, clen);
+			}
+			else
+			{
+				ASSERT(undo_[ii].utype == mod_replace && address + clen <= length_);
+				note_change(address, clen, clen);
+			}
+			loc_apply(undo_[ii]);
+			set_checkpoint(ii + 1);
+		}
+#ifdef _DEBUG
+		loc_check();
+#endif
+		if (batch_view_ == NULL)
+			batch_view_ = pview;
+		last_view_ = pview;
+		need_change_track_ = true;      // cheaper to rebuild once than update for every change
+		update_needed_ = true;
+	}
+	for (size_t ii = first_new; ii < undo_.size(); ++ii)
+		journal_change(ii, false);
+	CommitBatch();
+}
+
+void CHexEditDoc::BeginBatch()
+{
+	if (batch_level_++ == 0)
+	{
+		batch_first_ = undo_.size();
+		batch_.clear();
+		batch_view_ = NULL;
+		batch_ptoo_ = FALSE;
+	}
+}
+
+// Tells bg search, views etc about all the changes made since BeginBatch.  Rather than
+// going through every change, the area from the first change to the last (or to EOF if
+// bytes were inserted or deleted) is searched again and the views get one hint.
+void CHexEditDoc::CommitBatch()
+{
+	ASSERT(batch_level_ > 0);
+	if (--batch_level_ > 0 || batch_.empty())
+		return;
+
+	FILE_ADDRESS lo, hi;                // Area affected
+	bool shift = batch_area(batch_, length_, lo, hi);  // Were any bytes inserted or deleted?
+
 	{
-		// Add a new elt to undo array
-		if (utype == mod_insert_file)
-		{
-			ASSERT(num_done > -1 && data_file_[num_done] != NULL);
-			undo_.push_back(doc_undo(utype, address, clen, NULL, num_done));
-		}
-		else if (utype == mod_insert || utype == mod_replace || utype == mod_repback)
-			undo_.push_back(doc_undo(utype, address, clen, buf));
-		else
-			undo_.push_back(doc_undo(utype, address, clen));
-		index = undo_.size() - 1;
+		CSingleLock sl(&docdata_, TRUE);
+		write_lock wl(docrw_);
+		bg_search_change(mod_replace, lo, hi - lo, shift);
+		send_change_hint(lo);
 	}
 
-	last_view_ = pview;
+	// Undo data is moved to disk when idle (see CheckBGProcessing) but don't wait if well over budget
+	if (undo_arena_.bytes() > undo_budget_*2)
+		spill_undo();
+
+	doc_changed_ = true;        // Remember to restart bg scans when we get a chance
+
+	// Update views to show changed doc
+	int count = int(undo_.size() - batch_first_);  // New undo records (first change may have been merged)
+	CHexHint hh(mod_replace, hi - lo, lo, batch_view_, count > 0 ? int(batch_first_) : -1, FALSE, batch_ptoo_);
+	hh.pbatch = &batch_;
+	hh.count = count;
+	SetModifiedFlag(TRUE);
+	UpdateAllViews(NULL, 0, &hh);
+	batch_.clear();
+}
 
+// Updates the background search for a change: pending searches and found occurrences are
+// adjusted for bytes inserted/deleted and the changed area is searched again.  If rescan is
+// true everything from address to EOF is searched again (eg for a batch of changes).
+// Note: this is called before length_ is updated for the change.
+void CHexEditDoc::bg_search_change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS clen, bool rescan /*=false*/)
+{
 	CHexEditApp *aa = dynamic_cast<CHexEditApp *>(AfxGetApp());
 
 	// If there is a current search string and background searches are on
@@ -398,10 +1101,10 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 		ASSERT(CanDoSearch());
 		FILE_ADDRESS adjust;
 
-		if (aa->alignment_ > 1 && (utype == mod_delforw ||
-								   utype == mod_delback ||
-								   utype == mod_insert  ||
-								   utype == mod_insert_file) )
+		if (rescan || (aa->alignment_ > 1 && (utype == mod_delforw ||
+											  utype == mod_delback ||
+											  utype == mod_insert  ||
+											  utype == mod_insert_file)) )
 		{
 			// Remove pending searches after current address (to avoid double search)
 			std::list<pair<FILE_ADDRESS, FILE_ADDRESS> >::iterator pcurr, pend;
@@ -413,8 +1116,8 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 					pcurr->second = address;           // truncate at address
 			}
 
-			// Remove all found occurrences to EOF
-			found_.erase(found_.lower_bound(address), found_.lower_bound(length_));
+			// Remove all found occurrences to EOF (including any that overlap the change)
+			found_.erase(found_.lower_bound(address - (aa->pboyer_->length() - 1)), found_.end());
 
 			// Invalidate area of change (rest towards EOF is invalidated below)
 			CBGSearchHint bgsh(address - aa->pboyer_->length() + 1, address + clen);
@@ -449,20 +1152,8 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 				}
 			}
 
-			// Remove invalidated found_ occurrences and adjust those for insertions/deletions
-			if (!to_search_.empty())
-			{
-				// Ask bg thread to do it so that changes are kept consistent
-				ASSERT(!search_fin_);
-				to_adjust_.push_back(adjustment(address - (aa->pboyer_->length() - 1),
-												(utype == mod_insert || utype == mod_insert_file) ? address : address + clen,
-												address,
-												adjust));
-				// Tell views to remove currently displayed occurrences
-				CBGSearchHint bgsh(FALSE);
-				UpdateAllViews(NULL, 0, &bgsh);
-			}
-			else
+			// Remove invalidated found_ occurrences and adjust those for insertions/deletions.
+			// (The bg thread moves what it finds to allow for this change - see RunSearchThread.)
 			{
 				FixFound(address - (aa->pboyer_->length() - 1),
 						(utype == mod_insert || utype == mod_insert_file) ? address : address + clen,
@@ -501,10 +1192,10 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 			find_done_ = 0.0;           // Clear amount searched before adding a new search
 
 		// Add new area to be searched
-		if (aa->alignment_ > 1 && (utype == mod_delforw ||
-								   utype == mod_delback ||
-								   utype == mod_insert  ||
-								   utype == mod_insert_file) )
+		if (rescan || (aa->alignment_ > 1 && (utype == mod_delforw ||
+											  utype == mod_delback ||
+											  utype == mod_insert  ||
+											  utype == mod_insert_file)) )
 		{
 			to_search_.push_back(pair<FILE_ADDRESS, FILE_ADDRESS>(address - (aa->pboyer_->length() - 1), length_));
 			find_total_ += length_ - (address - (aa->pboyer_->length() - 1));
@@ -525,60 +1216,6 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 		TRACE1("Restarting bg search (change) for %p\n", this);
 		start_search_event_.SetEvent();
 	}
-
-	// Adjust file length according to bytes added or removed
-	if (utype == mod_delforw || utype == mod_delback)
-		length_ -= clen;
-	else if (utype == mod_insert || utype == mod_insert_file)
-		length_ += clen;
-	else if (utype == mod_replace && address + clen > length_)
-		length_ = address + clen;
-	else
-		ASSERT(utype == mod_replace || utype == mod_repback);
-
-	// Update bookmarks
-	if (utype == mod_delforw || utype == mod_delback)
-	{
-		for (std::vector<FILE_ADDRESS>::iterator pp = bm_posn_.begin();
-			 pp != bm_posn_.end(); ++pp)
-		{
-			if (*pp > address + clen)
-				*pp -= clen;
-			else if (*pp > address)
-				*pp = address;
-		}
-	}
-	else if (utype == mod_insert || utype == mod_insert_file)
-	{
-		for (std::vector<FILE_ADDRESS>::iterator pp = bm_posn_.begin();
-			 pp != bm_posn_.end(); ++pp)
-		{
-			if (*pp >= address)
-				*pp += clen;
-		}
-	}
-
-	// Rebuild the location list
-	regenerate();
-
-	update_needed_ = true;
-	send_change_hint(address);
-
-	// Unlock now since nothing below is protected by the docdata_
-	sl.Unlock();
-
-	doc_changed_ = true;        // Remember to restart bg scans when we get a chance
-
-	// Update views to show changed doc
-	CHexHint hh(utype, clen, address, pview, index, FALSE, ptoo);
-	if (utype == mod_insert && clen == 0)
-	{
-		// Insert hex changed low nybble without inserting
-		hh.utype = mod_replace;
-		hh.len = 1;
-	}
-	SetModifiedFlag(TRUE);
-	UpdateAllViews(NULL, 0, &hh);
 }
 
 // Undo removes the last change made by calling Change() [above]
@@ -588,6 +1225,7 @@ void CHexEditDoc::Change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS
 BOOL CHexEditDoc::Undo(CView *pview, int index, BOOL same_view)
 {
 	ASSERT(index == undo_.size() - 1);
+	ASSERT(batch_level_ == 0);          // Can't undo part of a batch
 	ASSERT(undo_.back().utype == mod_insert  ||
 		   undo_.back().utype == mod_insert_file  ||
 		   undo_.back().utype == mod_replace ||
@@ -629,8 +1267,9 @@ BOOL CHexEditDoc::Undo(CView *pview, int index, BOOL same_view)
 	{
 		CHexEditApp *aa = dynamic_cast<CHexEditApp *>(AfxGetApp());
 
-		// Lock the doc data (automatically releases the lock when it goes out of scope)
+		// Lock the doc data (automatically releases the locks when they go out of scope)
 		CSingleLock sl(&docdata_, TRUE);
+		write_lock wl(docrw_);
 
 		// If there is a current search string and background searches are on
 		if (aa->pboyer_ != NULL && pthread2_ != NULL)
@@ -690,22 +1329,7 @@ BOOL CHexEditDoc::Undo(CView *pview, int index, BOOL same_view)
 					}
 				}
 
-				// Remove invalidated found_ occurrences and adjust those for insertiosn deletions
-				if (!to_search_.empty())
-				{
-					// Ask bg thread to do it so that changes are kept consistent
-					ASSERT(!search_fin_);
-					to_adjust_.push_back(adjustment(undo_.back().address - (aa->pboyer_->length() - 1),
-													undo_.back().utype == mod_delforw || undo_.back().utype == mod_delback ?
-														undo_.back().address : undo_.back().address + undo_.back().len,
-													undo_.back().address,
-													adjust));
-
-					// Tell views to remove currently displayed occurrences
-					CBGSearchHint bgsh(FALSE);
-					UpdateAllViews(NULL, 0, &bgsh);
-				}
-				else
+				// Remove invalidated found_ occurrences and adjust those for insertions/deletions
 				{
 					FixFound(undo_.back().address - (aa->pboyer_->length() - 1),
 							undo_.back().utype == mod_delforw || undo_.back().utype == mod_delback ? 
@@ -775,7 +1399,16 @@ BOOL CHexEditDoc::Undo(CView *pview, int index, BOOL same_view)
 			start_search_event_.SetEvent();
 		}
 
+		// Remember the change for snapshot users
+		if (undo_.back().utype == mod_delforw || undo_.back().utype == mod_delback)
+			note_change(undo_.back().address, 0, undo_.back().len);
+		else if (undo_.back().utype == mod_insert || undo_.back().utype == mod_insert_file)
+			note_change(undo_.back().address, undo_.back().len, 0);
+		else
+			note_change(undo_.back().address, undo_.back().len, undo_.back().len);
+
 		// Recalc doc size if nec.
+		FILE_ADDRESS prev_length = length_;
 		if (undo_.back().utype == mod_delforw || undo_.back().utype == mod_delback)
 			length_ += undo_.back().len;
 		else if (undo_.back().utype == mod_insert || undo_.back().utype == mod_insert_file)
@@ -786,35 +1419,36 @@ BOOL CHexEditDoc::Undo(CView *pview, int index, BOOL same_view)
 
 		// Update bookmarks
 		if (undo_.back().utype == mod_delforw || undo_.back().utype == mod_delback)
-		{
-			for (std::vector<FILE_ADDRESS>::iterator pp = bm_posn_.begin();
-				 pp != bm_posn_.end(); ++pp)
-			{
-				if (*pp > undo_.back().address)
-					*pp += undo_.back().len;
-			}
-		}
+			bm_posn_.insert(undo_.back().address + 1, undo_.back().len);  // bookmark at address stays put
 		else if (undo_.back().utype == mod_insert || undo_.back().utype == mod_insert_file)
-		{
-			for (std::vector<FILE_ADDRESS>::iterator pp = bm_posn_.begin();
-				 pp != bm_posn_.end(); ++pp)
-			{
-				if (*pp > undo_.back().address + undo_.back().len)
-					*pp -= undo_.back().len;
-				else if (*pp > undo_.back().address)
-					*pp = undo_.back().address;
-			}
-		}
+			bm_posn_.remove(undo_.back().address, undo_.back().len);
 
 		change_address = undo_.back().address;
+		FILE_ADDRESS change_len = (undo_.back().utype == mod_insert || undo_.back().utype == mod_insert_file) ? 0 : undo_.back().len;
+
+		// Put the locations list back to how it was before the change
+		loc_revert(undo_.back());
+
+		// If the data was in a data file (inserted file or spilled), release the file if nothing else uses it
+		int idx = undo_.back().in_file() ? undo_.back().idx : -1;
 
 		// Remove the change from the undo array since it has now been undone
 		undo_.pop_back();
+		journal_undo();
+		if (checkpoint_.size() > undo_.size()/checkpoint_every)
+			checkpoint_.pop_back();     // Last checkpoint included the undone change
 		if (undo_.size() == 0)
 			SetModifiedFlag(FALSE);     // Undid everything so clear changed flag
 
-		// Rebuild locations list as undo array has changed
-		regenerate();
+		if (idx != -1)
+		{
+			if (data_file_.release(idx))
+				RemoveDataFile(idx);
+		}
+		update_change_tracking(change_address, change_len, length_ - prev_length);
+#ifdef _DEBUG
+		loc_check();
+#endif
 	}
 
 	doc_changed_ = true;        // Remember to restart bg scans when we get a chance
@@ -834,15 +1468,8 @@ BOOL CHexEditDoc::Undo(CView *pview, int index, BOOL same_view)
 void CHexEditDoc::fix_address(FILE_ADDRESS start, FILE_ADDRESS end,
 							  FILE_ADDRESS address, FILE_ADDRESS adjust)
 {
-	// Remove invalidated found_ occurrences and adjust those for insertiosn deletions
-	if (!to_search_.empty())
-	{
-		// Ask bg thread to do it so that changes are kept consistent
-		ASSERT(!search_fin_);
-		to_adjust_.push_back(adjustment(start, end, address, adjust));
-	}
-	else
-		FixFound(start, end, address, adjust);
+	// Remove invalidated found_ occurrences and adjust those for insertions/deletions
+	FixFound(start, end, address, adjust);
 
 	// Adjust pending search addresses
 	std::list<pair<FILE_ADDRESS, FILE_ADDRESS> >::iterator pcurr, pend;
@@ -892,28 +1519,38 @@ void CHexEditDoc::WriteInPlace()
 {
 	ASSERT(pfile1_ != NULL);
 
-	FILE_ADDRESS pos;
-	ploc_t pl;          // Current location record
-	ploc_t plprev;      // Record before this one
-
-	// Lock the doc data (automatically releases the lock when it goes out of scope)
+	// Lock the doc data (automatically releases the locks when they go out of scope)
 	CSingleLock sl(&docdata_, TRUE);
+	write_lock wl(docrw_);
+	++file_gen_;                        // file data is moved so snapshots can't read it any more
 
-	const size_t copy_buf_len = 16384;
-	unsigned char *buf = new unsigned char[copy_buf_len];   // Where we store data
+	// The plan points into the undo data so stop spill_undo moving it (OnIdle is called below)
+	struct save_flag
+	{
+		bool &flag;
+		save_flag(bool &ff) : flag(ff) { flag = true; }
+		~save_flag() { flag = false; }
+	} sf(saving_);
+
+	// Work out what has to be written (only the bytes that are different)
+	save_plan plan(loc_);
+	ASSERT(plan.length() == length_);
+	std::vector<save_plan::extent>::const_iterator pe;
+
+	// Reading the next block overlaps writing the last (except for devices - see AsyncWriter.h)
+	async_writer aw(pfile1_, async_writer::default_size, !IsDevice());
+	const size_t copy_buf_len = aw.size();
+	unsigned char *buf;                                     // Where we store data
 #ifdef INPLACE_MOVE
 	FILE_ADDRESS previous_length = pfile1_->GetLength();
-	FILE_ADDRESS total_todo = 0;                            // Number of bytes to be moved in file or copied in
+	FILE_ADDRESS total_todo = plan.total();                 // Number of bytes to be moved in file or copied in
 	FILE_ADDRESS total_done = 0;                            // Number of bytes done so far
-	for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
-	{
-		if ((pl->dlen >> 62) > 1 || pos != pl->fileaddr)
-			total_todo += (pl->dlen&doc_loc::mask);
-	}
 
 	CMainFrame *mm = (CMainFrame *)AfxGetMainWnd();
 	mm->m_wndStatusBar.EnablePaneProgressBar(0);
 	clock_t last_checked = clock();
+#else
+	ASSERT(plan.moves().empty());
 #endif
 
 	try
@@ -925,31 +1562,24 @@ void CHexEditDoc::WriteInPlace()
 		// 2. move blocks that have moved backward starting from the beginning of the file
 		// 3. do nothing for blocks that have not moved
 		// 4. write memory blocks to the file (as before)
-		for (pos = length_, pl = loc_.end(); pl != loc_.begin(); pos -= (plprev->dlen&doc_loc::mask), pl--)
+		// The plan has the moves (1 and 2) in the right order - see SavePlan.h.
+		for (pe = plan.moves().begin(); pe != plan.moves().end(); ++pe)
 		{
-			plprev = pl;
-			plprev--;
-
-			if ((plprev->dlen >> 62) == 1 && pos - FILE_ADDRESS(plprev->dlen&doc_loc::mask) > plprev->fileaddr)
+			if (pe->address > pe->src)
 			{
 				// Copy the block in chunks (copy_buf_len) starting at the end
-				FILE_ADDRESS src = plprev->fileaddr + (plprev->dlen&doc_loc::mask);
-				FILE_ADDRESS dst = pos;
+				FILE_ADDRESS src = pe->src + pe->len;
+				FILE_ADDRESS dst = pe->address + pe->len;
 
-				while (src > plprev->fileaddr)
+				while (src > pe->src)
 				{
-					UINT count;
-					if (src - copy_buf_len > plprev->fileaddr)
-						count = copy_buf_len;
-					else
-						count = UINT(src - plprev->fileaddr);
+					UINT count = UINT(min(src - pe->src, FILE_ADDRESS(copy_buf_len)));
 					src -= count;
 					dst -= count;
 
-					VERIFY(pfile1_->Seek(src, CFile::begin) == src);
-					VERIFY(pfile1_->Read(buf, count) == count);
-					VERIFY(pfile1_->Seek(dst, CFile::begin) == dst);
-					pfile1_->Write(buf, count);
+					buf = aw.buffer();
+					VERIFY(pfile1_->ReadAt(src, buf, count) == count);
+					aw.write(dst, count);
 
 					// Update progress
 					total_done += count;
@@ -960,29 +1590,21 @@ void CHexEditDoc::WriteInPlace()
 						AfxGetApp()->OnIdle(0);
 					}
 				}
-				ASSERT(src == plprev->fileaddr);
-				ASSERT(dst == pos - (plprev->dlen&doc_loc::mask));
+				ASSERT(dst == pe->address);
 			}
-		}
-		for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
-		{
-			if ((pl->dlen >> 62) == 1 && pos < pl->fileaddr)
+			else
 			{
-				FILE_ADDRESS src = pl->fileaddr;
-				FILE_ADDRESS dst = pos;
+				// Copy the block in chunks starting at the start
+				FILE_ADDRESS src = pe->src;
+				FILE_ADDRESS dst = pe->address;
 
-				while (src < pl->fileaddr + FILE_ADDRESS(pl->dlen&doc_loc::mask))
+				while (src < pe->src + pe->len)
 				{
-					UINT count;
-					if (src + copy_buf_len <= pl->fileaddr + FILE_ADDRESS(pl->dlen&doc_loc::mask))
-						count = copy_buf_len;
-					else
-						count = UINT(pl->fileaddr + (pl->dlen&doc_loc::mask) - src);
+					UINT count = UINT(min(pe->src + pe->len - src, FILE_ADDRESS(copy_buf_len)));
 
-					VERIFY(pfile1_->Seek(src, CFile::begin) == src);
-					VERIFY(pfile1_->Read(buf, count) == count);
-					VERIFY(pfile1_->Seek(dst, CFile::begin) == dst);
-					pfile1_->Write(buf, count);
+					buf = aw.buffer();
+					VERIFY(pfile1_->ReadAt(src, buf, count) == count);
+					aw.write(dst, count);
 
 					src += count;
 					dst += count;
@@ -996,22 +1618,48 @@ void CHexEditDoc::WriteInPlace()
 						AfxGetApp()->OnIdle(0);
 					}
 				}
-				ASSERT(src == pl->fileaddr + (pl->dlen&doc_loc::mask));
-				ASSERT(dst == pos + (pl->dlen&doc_loc::mask));
-
+				ASSERT(dst == pe->address + pe->len);
 			}
 		}
 #endif
-		for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
+		for (pe = plan.writes().begin(); pe != plan.writes().end(); ++pe)
 		{
-			if ((pl->dlen >> 62) == 2)
+			if (pe->type == save_plan::memory)
 			{
 				// Write in memory bits at appropriate places in file
-				VERIFY(pfile1_->Seek(pos, CFile::begin) == pos);
-				pfile1_->Write(pl->memaddr, DWORD(pl->dlen&doc_loc::mask));
+				if (pe->count == 1)
+					aw.write(pe->address, plan.piece(pe->first).first, pe->len);
+				else
+				{
+					// Gather adjacent memory records into the buffer so they are written together
+					FILE_ADDRESS dst = pe->address;
+					size_t used = 0;            // Bytes of buf filled so far
+					buf = aw.buffer();
+					for (size_t ii = pe->first; ii < pe->first + pe->count; ++ii)
+					{
+						const unsigned char *pp = plan.piece(ii).first;
+						size_t left = plan.piece(ii).second;
+						while (left > 0)
+						{
+							size_t tocopy = min(left, copy_buf_len - used);
+							memcpy(buf + used, pp, tocopy);
+							pp += tocopy;
+							left -= tocopy;
+							if ((used += tocopy) == copy_buf_len)
+							{
+								aw.write(dst, used);
+								dst += used;
+								used = 0;
+								buf = aw.buffer();
+							}
+						}
+					}
+					aw.write(dst, used);
+					ASSERT(dst + FILE_ADDRESS(used) == pe->address + pe->len);
+				}
 #ifdef INPLACE_MOVE
 				// Update progress bar
-				total_done += (pl->dlen&doc_loc::mask);
+				total_done += pe->len;
 				if ((clock() - last_checked)/CLOCKS_PER_SEC > 2)
 				{
 					mm->m_wndStatusBar.SetPaneProgress(0, long(total_done*100/total_todo));
@@ -1020,26 +1668,25 @@ void CHexEditDoc::WriteInPlace()
 				}
 #endif
 			}
-			else if ((pl->dlen >> 62) == 3)
+			else
 			{
 				// Copy data file into original file
-				ASSERT((pl->dlen >> 62) == 3);
-				FILE_ADDRESS fileaddr = pl->fileaddr&doc_loc::fmask;
-				int idx = int((pl->fileaddr>>62)&0x3);   // 62 must change when fmask/max_data_files changes
-
-				// Move to position in file that we are copying from
-				ASSERT(data_file_[idx] != NULL);
-				data_file_[idx]->Seek(fileaddr, CFile::begin);
+				ASSERT(pe->type == save_plan::data_file);
+				FILE_ADDRESS fileaddr = pe->src;
+				int idx = pe->fileid;
+				ASSERT(idx >= 0 && idx < data_file_.size() && data_file_[idx] != NULL);
 
-				// Move to position to copy to
-				VERIFY(pfile1_->Seek(pos, CFile::begin) == pos);
+				FILE_ADDRESS dst = pe->address;   // Where to copy to
 				UINT tocopy;                      // How much to copy in this block
-				for (FILE_ADDRESS left = FILE_ADDRESS(pl->dlen&doc_loc::mask); left > 0; left -= tocopy)
+				for (FILE_ADDRESS left = pe->len; left > 0; left -= tocopy)
 				{
-					tocopy = size_t(min(left, FILE_ADDRESS(copy_buf_len)));
-					UINT actual = data_file_[idx]->Read((void *)buf, tocopy);
+					tocopy = UINT(min(left, FILE_ADDRESS(copy_buf_len)));
+					buf = aw.buffer();
+					UINT actual = data_file_[idx]->ReadAt(fileaddr, (void *)buf, tocopy);
 					ASSERT(actual == tocopy);
-					pfile1_->Write(buf, tocopy);
+					fileaddr += tocopy;
+					aw.write(dst, tocopy);
+					dst += tocopy;
 #ifdef INPLACE_MOVE
 					// Update progress bar
 					total_done += tocopy;
@@ -1051,10 +1698,9 @@ void CHexEditDoc::WriteInPlace()
 					}
 #endif
 				}
-
 			}
-
 		}
+		aw.finish();                    // wait for the last writes (and check they worked)
 #ifdef INPLACE_MOVE
 		ASSERT(total_done == total_todo);
 		// Truncate the file if it is now shorter
@@ -1072,7 +1718,6 @@ void CHexEditDoc::WriteInPlace()
 		pfe->Delete();
 
 #ifdef INPLACE_MOVE
-		delete[] buf;
 		mm->m_wndStatusBar.EnablePaneProgressBar(0, -1);  // disable progress bar
 #endif
 
@@ -1081,13 +1726,30 @@ void CHexEditDoc::WriteInPlace()
 	}
 
 #ifdef INPLACE_MOVE
-	delete[] buf;
 	mm->m_wndStatusBar.EnablePaneProgressBar(0, -1);  // disable progress bar
 #endif
 }
 
+// Returns the number of bytes from address (up to end) that are zero because they come
+// from a zero-filled pattern (see AddPattern), or 0 if the byte at address is not.
+FILE_ADDRESS CHexEditDoc::zero_run(FILE_ADDRESS address, FILE_ADDRESS end)
+{
+	read_lock rl(docrw_);
+	FILE_ADDRESS pos;
+	ploc_t pl = loc_.find(address, pos);
+	if (pl == loc_.end() || (pl->dlen >> 62) != 3)
+		return 0;
+
+	CPatternFile *pp = dynamic_cast<CPatternFile *>(data_file_[pl->fileid]);
+	if (pp == NULL || !pp->IsZero())
+		return 0;
+	return min(pos + FILE_ADDRESS(pl->dlen&doc_loc::mask), end) - address;
+}
+
 // Write the document (or part thereof) to file with name 'filename'.
 // The range to write is given by 'start' and 'end'.
+// Long runs of zero bytes from a pattern are not written but left as "holes" in a
+// sparse file (if the file system does not support sparse files they are zero-filled).
 BOOL CHexEditDoc::WriteData(const CString filename, FILE_ADDRESS start, FILE_ADDRESS end, BOOL append /*=FALSE*/)
 {
 	// First warn if there may not be enough disk space
@@ -1121,10 +1783,10 @@ BOOL CHexEditDoc::WriteData(const CString filename, FILE_ADDRESS start, FILE_ADD
 	if (append)
 		start_pos = ff.GetLength();
 
-	// Get memory for a buffer
-	const size_t copy_buf_len = 16384;
-	unsigned char *buf = new unsigned char[copy_buf_len];   // Where we store data
 	size_t got;                                 // How much we got from GetData
+	doc_cursor cursor;
+	FILE_ADDRESS zeroes;                        // Length of run of zero bytes we don't have to write
+	bool sparse = false;                        // Has the file been marked as sparse?
 
 	// Copy the range to file catching exceptions (probably disk full)
 	CMainFrame *mm = (CMainFrame *)AfxGetMainWnd();
@@ -1132,16 +1794,31 @@ BOOL CHexEditDoc::WriteData(const CString filename, FILE_ADDRESS start, FILE_ADD
 	clock_t last_checked = clock();
 	try
 	{
-		if (append)
-			ff.SeekToEnd();
+		// Fill one buffer while the last one is written (see AsyncWriter.h)
+		async_writer aw(&ff);
 
 		FILE_ADDRESS address;
 		for (address = start; address < end; address += FILE_ADDRESS(got))
 		{
-			got = GetData(buf, size_t(min(end-address, FILE_ADDRESS(copy_buf_len))), address);
+			if ((zeroes = zero_run(address, end)) >= FILE_ADDRESS(aw.size()))
+			{
+				// Skip the zeroes (leaving a hole in the file)
+				if (!sparse)
+				{
+					DWORD dummy;
+					::DeviceIoControl(ff.GetHandle(), FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &dummy, NULL);
+					sparse = true;
+				}
+				address += zeroes;
+				got = 0;
+				continue;
+			}
+
+			unsigned char *buf = aw.buffer();
+			got = GetData(buf, size_t(min(end - address, FILE_ADDRESS(aw.size()))), address, cursor);
 			ASSERT(got > 0);
 
-			ff.Write(buf, got);
+			aw.write(start_pos + (address - start), got);
 			// Update save progress no more than once every 5 seconds
 			if ((clock() - last_checked)/CLOCKS_PER_SEC > 5)
 			{
@@ -1153,6 +1830,9 @@ BOOL CHexEditDoc::WriteData(const CString filename, FILE_ADDRESS start, FILE_ADD
 			}
 		}
 		ASSERT(address == end);
+		aw.finish();
+		if (ff.GetLength() < start_pos + (end - start))
+			ff.SetLength(start_pos + (end - start));  // file ends in a hole
 	}
 	catch (CFileException *pfe)
 	{
@@ -1167,7 +1847,6 @@ BOOL CHexEditDoc::WriteData(const CString filename, FILE_ADDRESS start, FILE_ADD
 		ff.Close();
 		if (!append)
 			remove(filename);
-		delete[] buf;
 
 		theApp.mac_error_ = 10;
 		return FALSE;
@@ -1176,369 +1855,223 @@ BOOL CHexEditDoc::WriteData(const CString filename, FILE_ADDRESS start, FILE_ADD
 	mm->Progress(-1);
 
 	ff.Close();
-	delete[] buf;
 	return TRUE;
 }
 
-void CHexEditDoc::regenerate()
+// Rebuilds the locations list (and the removed records of each undo record) from
+// scratch.  Normally loc_ is just updated for each change (see loc_apply) but
+// this is needed if the undo records' data has moved or the orig. file has changed.
+// If only undo records from index "from" on have changed then we start from the
+// last checkpoint before that rather than replaying them all (see also spill_undo).
+void CHexEditDoc::regenerate(size_t from /*=0*/)
 {
-	pundo_t pu;         // Current modification (undo record) being checked
-	FILE_ADDRESS pos;   // Tracks file position of current location record
-	ploc_t pl;          // Current location record
-
-	// This is used to track which data files are still in use - so we can release them when no longer needed
-	std::vector<bool> file_used(doc_loc::max_data_files);
+	std::vector<doc_undo>::iterator pu;  // Current modification (undo record) being checked
 
-	// Rebuild locations list starting with original file as only loc record
-	loc_.clear();
-	if (pfile1_ != NULL && pfile1_->GetLength() > 0)
-		loc_.push_back(doc_loc(FILE_ADDRESS(0), pfile1_->GetLength()));
-
-	// Now check each modification in order to build up location list
+	// Recount the references to each data file - so we can release them when no longer needed
+	data_file_.clear_refs();
 	for (pu = undo_.begin(); pu != undo_.end(); ++pu)
 	{
-		// Find loc record where this modification starts
-		for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
-			if (pu->address < pos + FILE_ADDRESS(pl->dlen&doc_loc::mask))
-				break;
+		if (pu->in_file())
+			data_file_.add_ref(pu->idx);  // remember that this data file is still in use
+	}
 
-		// Modify locations list here (according to type of mod)
-		// Note: loc_add & loc_del may modify pos and pl (passed by reference)
-		switch (pu->utype)
-		{
-		case mod_insert_file:
-			ASSERT(pu->idx < doc_loc::max_data_files);
-			file_used[pu->idx] = true;  // remember that this data file is still in use
-			// fall through
-		case mod_insert:
-			loc_add(pu, pos, pl);       // Insert record into list
-			break;
-		case mod_replace:
-		case mod_repback:
-			loc_del(pu->address, pu->len, pos, pl); // Delete what's replaced
-			loc_add(pu, pos, pl);       // Add replacement before next record
-			break;
-		case mod_delforw:
-		case mod_delback:
-			loc_del(pu->address, pu->len, pos, pl); // Just delete them
-			break;
-		default:
-			ASSERT(0);
-		}
-	} /* for */
+	// Discard checkpoints that include changed records and start from the last one left
+	size_t start = min(from/checkpoint_every, checkpoint_.size());
+	checkpoint_.erase(checkpoint_.begin() + start, checkpoint_.end());
+	start *= checkpoint_every;
+	if (start > 0)
+		loc_ = checkpoint_.back();
+	else
+	{
+		// Rebuild locations list starting with original file as only loc record
+		loc_.clear();
+		if (pfile1_ != NULL && pfile1_->GetLength() > 0)
+			loc_.push_back(doc_loc(FILE_ADDRESS(0), pfile1_->GetLength()));
+	}
+
+	// Now apply each modification in order to build up location list
+	for (pu = undo_.begin() + start; pu != undo_.end(); ++pu)
+	{
+		loc_apply(*pu);
+		set_checkpoint(size_t(pu - undo_.begin()) + 1);
+	}
 
 	// Signal that change tracking structures need rebuilding
 	need_change_track_ = true;
 
 	// If file is open shared then the underlying file length may change which could affect length_
 	if (shared_)
-	{
-		// Zip through all the bits of the file adding up the length (in pos)
-		for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
-			;
-
-		length_ = pos;
-	}
-#ifdef _DEBUG
+		length_ = loc_.length();
 	else
-	{
-		// Check that the length of all the records gels with stored doc length
-		for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
-			;
-		ASSERT(pos == length_);
-	}
-#endif
+		ASSERT(loc_.length() == length_);  // Check that the length of all the records gels with stored doc length
 
 	// Release any data files that are no longer used (presumably after an undo)
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-		if (!file_used[ii])
+	for (int ii = data_file_.size() - 1; ii >= 0; --ii)
+		if (data_file_.unused(ii))
 			RemoveDataFile(ii);
 }
 
-// loc_add inserts a record into the location list
-// pu describes the record to insert
-// pos is the location in the doc of "pl"
-// - on return is the new location of pl (the rec after the one inserted)
-// pl is the record before or in which the insertion is to take place
-// - on return is the rec after one inserted (!= entry value if rec split)
-// (if pl is the end of the list then we just append)
-void CHexEditDoc::loc_add(pundo_t pu, FILE_ADDRESS &pos, ploc_t &pl)
+// Called after loc_apply of the undo record before index "count" (ie the first count changes
+// have been applied to loc_).  Any checkpoints that include the record are discarded (it
+// may have been changed by merging) and a new checkpoint made if it is time for one.
+void CHexEditDoc::set_checkpoint(size_t count)
 {
-	if (pu->address != pos)
-	{
-		// We need to split a block into 2 to insert between the two pieces
-		loc_split(pu->address, pos, pl);
-		pos += (pl->dlen&doc_loc::mask);
-		++pl;
-	}
-	if (pu->utype == mod_insert_file)
-		loc_.insert(pl, doc_loc(0, pu->len, pu->idx));
-	else
-		loc_.insert(pl, doc_loc(pu->ptr, pu->len));
-	pos += pu->len;
+	ASSERT(count > 0 && count <= undo_.size());
+	size_t keep = (count - 1)/checkpoint_every;  // Number of checkpoints still valid
+	if (checkpoint_.size() > keep)
+		checkpoint_.erase(checkpoint_.begin() + keep, checkpoint_.end());
+	if (count % checkpoint_every == 0)
+		checkpoint_.push_back(loc_);    // O(1) as it shares the nodes of loc_
 }
 
 // loc_del deletes record(s) or part(s) thereof from the location list
-// It returns the next undeleted record [which may be loc_.end()]
 // address is where the deletions are to commence
 // len is the number of bytes to be deleted
-// pos is the location in the doc of "pl"
-// - on return it's the loc of "pl" which may be different if a record was split
-// pl is the record from or in which the deletion is to start
-// - on return points to the record after the deletion [may be loc_.end()]
+// removed, if not NULL, is an empty tree that gets the deleted records
+// Records that are only partly deleted are split (see loc_split) first.
 // Note: loc_del can be called for a mod_replace modification.  Replacements
 // can go past EOF so deleting past EOF is also required to be handled here.
-void CHexEditDoc::loc_del(FILE_ADDRESS address, FILE_ADDRESS len, FILE_ADDRESS &pos, ploc_t &pl)
+void CHexEditDoc::loc_del(FILE_ADDRESS address, FILE_ADDRESS len, loc_tree *removed /*=NULL*/)
 {
-	ploc_t byebye;              // Saved current record to be deleted
-
-	if (address != pos)
-	{
-		ASSERT(pl != loc_.end());
-
-		// We need to split this block so we can erase just the 2nd bit of it
-		loc_split(address, pos, pl);
-		pos += (pl->dlen&doc_loc::mask);
-		++pl;
-	}
-
-	// Erase all the blocks until we get a block or part thereof to keep
-	// or we hit end of document location list (EOF)
-	FILE_ADDRESS deleted = 0;
-	while (pl != loc_.end() && len >= deleted + FILE_ADDRESS(pl->dlen&doc_loc::mask))
-	{
-		byebye = pl;            // Save current record to delete later
-		deleted += (pl->dlen&doc_loc::mask);   // Keep track of how much we've seen
-		++pl;                   // Advance to next rec before deleting current
-		loc_.erase(byebye);
-	}
-
-	if (pl != loc_.end() && len > deleted)
-	{
-		// We need to split this block and erase the 1st bit
-		loc_split(address + len, address + deleted, pl);
-		byebye = pl;
-		deleted += (pl->dlen&doc_loc::mask);
-		++pl;
-		loc_.erase(byebye);
-	}
-//    ASSERT(deleted == len);
+	if (removed != NULL)
+		loc_.cut(address, len, *removed);
+	else
+		loc_.erase(address, len);
 }
 
 // address is where split takes place in the file
-// pos is the file address of pl
-// pl is a ptr to the doc_loc that needs to be split
-void CHexEditDoc::loc_split(FILE_ADDRESS address, FILE_ADDRESS pos, ploc_t pl)
+// If address is already at the start of a record nothing is done.
+void CHexEditDoc::loc_split(FILE_ADDRESS address)
 {
-	ASSERT(pl != loc_.end());
-	ASSERT(address > pos && address < pos + FILE_ADDRESS(pl->dlen&doc_loc::mask));
+	loc_.split(address);
+}
 
-	// Work out exactly where to split the record
-	FILE_ADDRESS split = pos + (pl->dlen&doc_loc::mask) - address;
+#ifdef _DEBUG
+// Rebuilds the locations list from the undo array (as regenerate does) and checks
+// that it gives the same data as loc_.  Records may be split at different places
+// (eg undoing a deletion leaves a split where the deletion started) so we compare
+// where each byte comes from rather than the records themselves.
+void CHexEditDoc::loc_check()
+{
+	if (shared_)
+		return;                         // orig file may have changed length
 
-	// Insert a new record before the next one and store location and length
-	ploc_t plnext = pl; ++plnext;
-	if ((pl->dlen >> 62) == 1)
-	{
-		loc_.insert(plnext, doc_loc(pl->fileaddr + (pl->dlen&doc_loc::mask) - split, split));
-		pl->dlen = ((pl->dlen&doc_loc::mask) - split) | (unsigned __int64(1) << 62);
-	}
-	else if ((pl->dlen >> 62) == 2)
+	loc_tree locs;
+	if (pfile1_ != NULL && pfile1_->GetLength() > 0)
+		locs.push_back(doc_loc(FILE_ADDRESS(0), pfile1_->GetLength()));
+	for (pundo_t pu = undo_.begin(); pu != undo_.end(); ++pu)
 	{
-		loc_.insert(plnext, doc_loc(pl->memaddr + (pl->dlen&doc_loc::mask) - split, split));
-		pl->dlen = ((pl->dlen&doc_loc::mask) - split) | (unsigned __int64(2) << 62);
+		if (pu->utype != mod_insert && pu->utype != mod_insert_file)
+			locs.erase(pu->address, pu->len);
+		if (pu->in_file())
+			locs.insert(pu->address, doc_loc(pu->spill, pu->len, pu->idx));
+		else if (pu->utype != mod_delforw && pu->utype != mod_delback)
+			locs.insert(pu->address, doc_loc(pu->ptr, pu->len));
 	}
-	else
+	ASSERT(locs.length() == loc_.length() && loc_.length() == length_);
+
+	ploc_t pl1 = locs.begin(), pl2 = loc_.begin();
+	FILE_ADDRESS off1 = 0, off2 = 0;    // How far we are into the current record of each
+	while (pl1 != locs.end() && pl2 != loc_.end())
 	{
-		ASSERT((pl->dlen >> 62) == 3);
-		FILE_ADDRESS fileaddr = pl->fileaddr&doc_loc::fmask;
-		int idx = int((pl->fileaddr>>62)&0x3);   // 62 must change when fmask/max_data_files changes
-		loc_.insert(plnext, doc_loc(fileaddr + (pl->dlen&doc_loc::mask) - split, split, idx));
-		pl->dlen = ((pl->dlen&doc_loc::mask) - split) | (unsigned __int64(3) << 62);
+		FILE_ADDRESS len1 = FILE_ADDRESS(pl1->dlen&doc_loc::mask);
+		FILE_ADDRESS len2 = FILE_ADDRESS(pl2->dlen&doc_loc::mask);
+		ASSERT((pl1->dlen >> 62) == (pl2->dlen >> 62) && pl1->fileid == pl2->fileid);
+		if ((pl1->dlen >> 62) == 2)
+			ASSERT(pl1->memaddr + size_t(off1) == pl2->memaddr + size_t(off2));
+		else
+			ASSERT(pl1->fileaddr + off1 == pl2->fileaddr + off2);
+
+		FILE_ADDRESS len = min(len1 - off1, len2 - off2);
+		if ((off1 += len) == len1)
+		{
+			++pl1;
+			off1 = 0;
+		}
+		if ((off2 += len) == len2)
+		{
+			++pl2;
+			off2 = 0;
+		}
 	}
+	ASSERT(pl1 == locs.end() && pl2 == loc_.end());
 }
+#endif
 
-// The following is for change tracking.  This builds three vectors of replacements,
-// insertions and deletions. Each vector element is a pair storing the address of the
-// change and the length (ie no of bytes replaced, inserted or deleted).
-// Note that this does not show all the changes that have been done only the changes
-// between the current file and the file on disk.  For example, deleting 3 bytes then
-// inserting 3 bytes at the same address would appear as a replacement of 3 bytes.
-// Consequently there cannot be an insertion and deletion at the same address.
+// The following is for change tracking.  This builds three lists of replacements,
+// insertions and deletions (see ChangeTrack.h). Each list stores the address of
+// each change and the length (ie no of bytes replaced, inserted or deleted).
 
 void CHexEditDoc::rebuild_change_tracking()
 {
 	// Clear the info before rebuild
 	clear_change_tracking();
 
-	FILE_ADDRESS pos = 0;       // Tracks position in current (displayed file)
-	FILE_ADDRESS last_fileaddr = 0; // Tracks last byte used from orig file
-	ploc_t pl = loc_.begin();   // Current location record
-	FILE_ADDRESS nf_bytes = 0;  // Number of non-file bytes since last file record
+	tracker().build(replace_, insert_, delete_);
+	need_change_track_ = false;            // Signal that they have been rebuilt
+}
+
+// Updates the change tracking info after a change.  The bytes from address to
+// address+inserted are new and the file length has changed by delta.  If the info
+// has not been built (or needs rebuilding anyway) it is left to be done (if needed)
+// by rebuild_change_tracking.
+void CHexEditDoc::update_change_tracking(FILE_ADDRESS address, FILE_ADDRESS inserted, FILE_ADDRESS delta)
+{
+	if (need_change_track_ || (base_type_ != 0 && undo_.size() < 2))
+	{
+		need_change_track_ = true;
+		return;
+	}
+	tracker().update(address, inserted, delta, replace_, insert_, delete_);
+}
 
-	FILE_ADDRESS diff;          // Amt of orig file skipped since last file record
-	FILE_ADDRESS repl;          // How many bytes are replaced
-	FILE_ADDRESS orig_length = 0; // Length of file on which changes are based
+void CHexEditDoc::clear_change_tracking()
+{
+	replace_.clear();
+	insert_.clear();
+	delete_.clear();
+}
 
+// Returns a change_tracker that compares loc_ with the base (see base_type_): the
+// original file, or if there is none the first memory block or temp file inserted.
+change_tracker CHexEditDoc::tracker()
+{
 	switch (base_type_)
 	{
 	case 0:
-		if (pfile1_ != NULL)
-			orig_length = pfile1_->GetLength();
-		break;
+		return change_tracker(loc_, change_tracker::orig_file, pfile1_ != NULL ? pfile1_->GetLength() : 0);
 	case 1:
+		if (!undo_.empty())
+			return change_tracker(loc_, change_tracker::mem_block, undo_[0].len, undo_[0].ptr);
+		break;
 	case 2:
-		orig_length = undo_[0].len;
+		if (!undo_.empty())
+			return change_tracker(loc_, change_tracker::temp_file, undo_[0].len, NULL,
+								  undo_[0].utype == mod_insert_file ? undo_[0].idx : -1);
 		break;
 	default:
 		ASSERT(0);
 	}
-
-	while (pl != loc_.end())
-	{
-		// Check if file record
-		if ((pl->dlen >> 62) == 1)  // orig file data
-		{
-			ASSERT(base_type_ == 0);
-
-			// Next orig file record found
-			diff = pl->fileaddr - last_fileaddr;
-			repl = min(diff, nf_bytes);
-			if (repl > 0)
-			{
-				replace_addr_.push_back(pos);
-				replace_len_.push_back(repl);
-			}
-			if (diff < nf_bytes)
-			{
-				insert_addr_.push_back(pos + repl);
-				insert_len_.push_back(nf_bytes - diff);
-			}
-			else if (diff > nf_bytes)
-			{
-				delete_addr_.push_back(pos);
-				delete_len_.push_back(diff - nf_bytes);
-			}
-
-			// Work out curr address by adding length of non-file recs skipped + current file rec
-			pos += nf_bytes + (pl->dlen&doc_loc::mask);
-			last_fileaddr = pl->fileaddr + (pl->dlen&doc_loc::mask); // remember last orig file addr
-			nf_bytes = 0;
-		}
-		else if (base_type_ == 1 && (pl->dlen >> 62) == 2 &&
-				 pl->memaddr >= undo_[0].ptr &&
-				 pl->memaddr < undo_[0].ptr + size_t(undo_[0].len) )
-		{
-			// Record of the first memory block insertion with no orig file
-			// (If no orig file we treat the first memory record as the base for comparison)
-			diff = (pl->memaddr - undo_[0].ptr) - last_fileaddr;
-			repl = min(diff, nf_bytes);
-
-			if (repl > 0)
-			{
-				replace_addr_.push_back(pos);
-				replace_len_.push_back(repl);
-			}
-			if (diff < nf_bytes)
-			{
-				insert_addr_.push_back(pos + repl);
-				insert_len_.push_back(nf_bytes - diff);
-			}
-			else if (diff > nf_bytes)
-			{
-				delete_addr_.push_back(pos);
-				delete_len_.push_back(diff - nf_bytes);
-			}
-
-			// Work out curr address by adding length of non-file recs skipped + current file rec
-			pos += nf_bytes + (pl->dlen&doc_loc::mask);
-			last_fileaddr = (pl->memaddr - undo_[0].ptr) + (pl->dlen&doc_loc::mask); // remember last mem addr
-			nf_bytes = 0;
-		}
-		else if (base_type_ == 2 && (pl->dlen >> 62) == 3 &&
-				 pl->memaddr >= undo_[0].ptr &&
-				 pl->memaddr < undo_[0].ptr + size_t(undo_[0].len) )
-		{
-			// Record of the first temp file block insertion with no orig file
-			// (If no orig file we treat the first temp file record as the base for comparison)
-			diff = pl->fileaddr - last_fileaddr;
-			repl = min(diff, nf_bytes);
-			if (repl > 0)
-			{
-				replace_addr_.push_back(pos);
-				replace_len_.push_back(repl);
-			}
-			if (diff < nf_bytes)
-			{
-				insert_addr_.push_back(pos + repl);
-				insert_len_.push_back(nf_bytes - diff);
-			}
-			else if (diff > nf_bytes)
-			{
-				delete_addr_.push_back(pos);
-				delete_len_.push_back(diff - nf_bytes);
-			}
-
-			// Work out curr address by adding length of non-file recs skipped + current file rec
-			pos += nf_bytes + (pl->dlen&doc_loc::mask);
-			last_fileaddr = pl->fileaddr + (pl->dlen&doc_loc::mask); // remember last mem addr
-			nf_bytes = 0;
-		}
-		else
-		{
-			ASSERT((pl->dlen >> 62) == 2 || (pl->dlen >> 62) == 3);  // make sure not "unknown" type
-			// Non-file record - just track no of consec. bytes in nf_bytes
-			nf_bytes += (pl->dlen&doc_loc::mask);
-		}
-		++pl;
-	}
-	// Handle any unfinished business
-	diff = orig_length - last_fileaddr;
-	repl = min(diff, nf_bytes);
-	if (repl > 0)
-	{
-		replace_addr_.push_back(pos);
-		replace_len_.push_back(repl);
-	}
-	if (diff < nf_bytes)
-	{
-		insert_addr_.push_back(pos + repl);
-		insert_len_.push_back(nf_bytes - diff);
-	}
-	else if (diff > nf_bytes)
-	{
-		delete_addr_.push_back(pos);
-		delete_len_.push_back(diff - nf_bytes);
-	}
-	pos += nf_bytes;
-
-	ASSERT(pos == length_);
-	need_change_track_ = false;            // Signal that they have been rebuilt
-}
-
-void CHexEditDoc::clear_change_tracking()
-{
-	replace_addr_.clear();
-	replace_len_.clear();
-	insert_addr_.clear();
-	insert_len_.clear();
-	delete_addr_.clear();
-	delete_len_.clear();
+	return change_tracker(loc_, base_type_, 0);   // no base yet so everything is a change
 }
 
 void CHexEditDoc::send_change_hint(FILE_ADDRESS address)
 {
-	FILE_ADDRESS pos = 0;         // Tracks position in current (displayed file)
+	FILE_ADDRESS pos;             // Tracks position in current (displayed file)
 	FILE_ADDRESS prev_change = 0; // Address of previous change in the file
-	for (ploc_t pl = loc_.begin(); pl != loc_.end(); ++pl)
+
+	// Work backwards from the record containing address to the end of the
+	// closest preceding orig. file record (all records in between are changes).
+	ploc_t pl = loc_.find(address, pos);
+	while (pl != loc_.begin())
 	{
-		pos += (pl->dlen&doc_loc::mask);
-		if (pos > address)
-			break;
+		--pl;
 		if ((pl->dlen >> 62) == 1)
 		{
 			prev_change = pos;
+			break;
 		}
+		pos -= (pl->dlen&doc_loc::mask);
 	}
 	// Everything from start of previous change to current change needs invalidating
 	CTrackHint th(prev_change, address);
@@ -0,0 +1,369 @@
+// EditJournal.cpp : implements edit_journal (see EditJournal.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include <io.h>                         // for _access()
+#include "HexEdit.h"
+#include "CFile64.h"
+#include "DocUndo.h"                    // for enum mod_type
+#include "EditJournal.h"
+#include "Misc.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+static const char journal_magic[8] = { 'H', 'E', 'J', 'R', 'N', 'L', '0', '1' };
+
+// Start of each entry in the journal (followed by size bytes of data then entry_end)
+struct journal_head
+{
+	unsigned char op;
+	unsigned char utype;
+	unsigned char reserved[6];
+	FILE_ADDRESS address;
+	FILE_ADDRESS len;
+	FILE_ADDRESS size;
+};
+static const unsigned long entry_end = 0x454A4548;  // "HEJE"
+
+// The journal is kept in the same place as other HexEdit data, with a name made
+// from a hash of the file name (the header has the full name to make sure).
+CString edit_journal::file_name(LPCTSTR doc_path)
+{
+	CString retval;
+	if (!::GetDataPath(retval))
+		return CString();
+	retval += DIRNAME_JOURNAL;
+	::CreateDirectory(retval, NULL);    // Make sure the folder is there (does nothing if it is)
+
+	// FNV-1a hash of the full (lower-case) path name
+	CString ss(doc_path);
+	ss.MakeLower();
+	unsigned long hash = 2166136261UL;
+	for (int ii = 0; ii < ss.GetLength(); ++ii)
+		hash = (hash ^ (unsigned char)ss[ii]) * 16777619UL;
+
+	CString name;
+	name.Format(_T("HEJ%08lX.dat"), hash);
+	return retval + name;
+}
+
+bool edit_journal::create(LPCTSTR doc_path, FILE_ADDRESS doc_len, const FILETIME &doc_time)
+{
+	ASSERT(pfile_ == NULL);
+	name_ = file_name(doc_path);
+	if (name_.IsEmpty())
+		return false;
+
+	CString path(doc_path);
+	int path_len = path.GetLength();
+	CFileException fe;
+	pfile_ = new CFile64();
+	if (!pfile_->Open(name_, CFile::modeCreate|CFile::modeWrite|CFile::shareDenyNone|CFile::typeBinary, &fe))
+	{
+		delete pfile_;
+		pfile_ = NULL;
+		return false;
+	}
+
+	try
+	{
+		pfile_->Write(journal_magic, sizeof(journal_magic));
+		pfile_->Write(&doc_len, sizeof(doc_len));
+		pfile_->Write(&doc_time, sizeof(doc_time));
+		pfile_->Write(&path_len, sizeof(path_len));
+		pfile_->Write((LPCTSTR)path, path_len*sizeof(TCHAR));
+	}
+	catch (CFileException *pfe)
+	{
+		pfe->Delete();
+		remove();
+		return false;
+	}
+	return true;
+}
+
+bool edit_journal::reopen(LPCTSTR doc_path, FILE_ADDRESS valid_len)
+{
+	ASSERT(pfile_ == NULL);
+	name_ = file_name(doc_path);
+	if (name_.IsEmpty())
+		return false;
+
+	CFileException fe;
+	pfile_ = new CFile64();
+	if (!pfile_->Open(name_, CFile::modeWrite|CFile::shareDenyNone|CFile::typeBinary, &fe))
+	{
+		delete pfile_;
+		pfile_ = NULL;
+		return false;
+	}
+
+	try
+	{
+		pfile_->SetLength(valid_len);   // discard any incomplete entry
+		pfile_->SeekToEnd();
+	}
+	catch (CFileException *pfe)
+	{
+		pfe->Delete();
+		delete pfile_;
+		pfile_ = NULL;                  // keep name_ so that remove() still deletes it
+		return false;
+	}
+	return true;
+}
+
+void edit_journal::close()
+{
+	if (pfile_ != NULL)
+	{
+		pfile_->Close();
+		delete pfile_;
+		pfile_ = NULL;
+	}
+	name_.Empty();                      // the journal is kept (remove() no longer affects it)
+}
+
+void edit_journal::remove()
+{
+	if (pfile_ != NULL)
+	{
+		// Spoil the header first in case it can't be deleted (eg still open as a data file)
+		try
+		{
+			char zero[sizeof(journal_magic)] = { 0 };
+			pfile_->Seek(0, CFile::begin);
+			pfile_->Write(zero, sizeof(zero));
+		}
+		catch (CFileException *pfe)
+		{
+			pfe->Delete();
+		}
+		pfile_->Close();
+		delete pfile_;
+		pfile_ = NULL;
+	}
+	if (!name_.IsEmpty())
+		::remove(name_);
+	name_.Empty();
+}
+
+bool edit_journal::add(int op, int utype, FILE_ADDRESS address, FILE_ADDRESS len, const unsigned char *data)
+{
+	ASSERT(pfile_ != NULL && (op == rec_new || op == rec_merge));
+	try
+	{
+		write_head(op, utype, address, len, data != NULL ? len : 0);
+		for (FILE_ADDRESS done = 0; data != NULL && done < len; )
+		{
+			DWORD towrite = DWORD(min(len - done, FILE_ADDRESS(0x10000000)));
+			pfile_->Write(data + size_t(done), towrite);
+			done += towrite;
+		}
+		write_end();
+	}
+	catch (CFileException *pfe)
+	{
+		pfe->Delete();
+		return false;
+	}
+	return true;
+}
+
+// Adds an entry where the data is copied from a (data) file
+bool edit_journal::add(int op, int utype, FILE_ADDRESS address, FILE_ADDRESS len, CFile64 *src, FILE_ADDRESS src_addr)
+{
+	ASSERT(pfile_ != NULL && (op == rec_new || op == rec_merge));
+	const size_t buf_len = 1024*1024;
+	unsigned char *buf = new unsigned char[buf_len];
+	try
+	{
+		write_head(op, utype, address, len, len);
+		for (FILE_ADDRESS done = 0; done < len; )
+		{
+			DWORD tocopy = DWORD(min(len - done, FILE_ADDRESS(buf_len)));
+			if (src->ReadAt(src_addr + done, buf, tocopy) != tocopy)
+				AfxThrowFileException(CFileException::endOfFile);
+			pfile_->Write(buf, tocopy);
+			done += tocopy;
+		}
+		write_end();
+	}
+	catch (CFileException *pfe)
+	{
+		pfe->Delete();
+		delete[] buf;
+		return false;
+	}
+	delete[] buf;
+	return true;
+}
+
+bool edit_journal::add_pattern(int utype, FILE_ADDRESS address, FILE_ADDRESS len, const unsigned char *pat, size_t plen)
+{
+	ASSERT(pfile_ != NULL && plen > 0);
+	try
+	{
+		write_head(rec_pattern, utype, address, len, plen);
+		pfile_->Write(pat, DWORD(plen));
+		write_end();
+	}
+	catch (CFileException *pfe)
+	{
+		pfe->Delete();
+		return false;
+	}
+	return true;
+}
+
+bool edit_journal::add_undo()
+{
+	ASSERT(pfile_ != NULL);
+	try
+	{
+		write_head(rec_undo, 0, 0, 0, 0);
+		write_end();
+	}
+	catch (CFileException *pfe)
+	{
+		pfe->Delete();
+		return false;
+	}
+	return true;
+}
+
+void edit_journal::write_head(int op, int utype, FILE_ADDRESS address, FILE_ADDRESS len, FILE_ADDRESS size)
+{
+	journal_head hh;
+	memset(&hh, '\0', sizeof(hh));
+	hh.op = (unsigned char)op;
+	hh.utype = (unsigned char)utype;
+	hh.address = address;
+	hh.len = len;
+	hh.size = size;
+	pfile_->Write(&hh, sizeof(hh));
+}
+
+void edit_journal::write_end()
+{
+	pfile_->Write(&entry_end, sizeof(entry_end));
+}
+
+int edit_journal::read(LPCTSTR doc_path, FILE_ADDRESS doc_len, const FILETIME &doc_time,
+                       std::vector<entry> &entries, FILE_ADDRESS &valid_len)
+{
+	entries.clear();
+	valid_len = 0;
+
+	CString name = file_name(doc_path);
+	if (name.IsEmpty() || _access(name, 0) == -1)
+		return -1;
+
+	CFile64 ff;
+	CFileException fe;
+	if (!ff.Open(name, CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary, &fe))
+		return -1;
+
+	try
+	{
+		FILE_ADDRESS file_len = ff.GetLength();
+
+		// Check the header
+		char magic[sizeof(journal_magic)];
+		FILE_ADDRESS len;
+		FILETIME time;
+		int path_len;
+		if (ff.Read(magic, sizeof(magic)) != sizeof(magic) ||
+			memcmp(magic, journal_magic, sizeof(magic)) != 0 ||
+			ff.Read(&len, sizeof(len)) != sizeof(len) ||
+			ff.Read(&time, sizeof(time)) != sizeof(time) ||
+			ff.Read(&path_len, sizeof(path_len)) != sizeof(path_len) ||
+			path_len < 0 || path_len > 32767)
+		{
+			return -1;
+		}
+		CString path;
+		UINT path_bytes = path_len*sizeof(TCHAR);
+		UINT got = ff.Read(path.GetBuffer(path_len + 1), path_bytes);
+		path.ReleaseBuffer(got == path_bytes ? path_len : 0);
+		if (got != path_bytes || path.CompareNoCase(doc_path) != 0)
+			return -1;                  // another file with the same hash
+		if (len != doc_len || CompareFileTime(&time, &doc_time) != 0)
+			return 0;                   // the file has been changed since the journal was started
+
+		// Read the entries until we get to EOF or an incomplete entry
+		valid_len = ff.GetPosition();
+		journal_head hh;
+		unsigned long end;
+		while (ff.ReadAt(valid_len, &hh, sizeof(hh)) == sizeof(hh) &&
+			   hh.size >= 0 && hh.size <= file_len - valid_len - FILE_ADDRESS(sizeof(hh) + sizeof(end)) &&
+			   ff.ReadAt(valid_len + sizeof(hh) + hh.size, &end, sizeof(end)) == sizeof(end) &&
+			   end == entry_end)
+		{
+			entry ee;
+			ee.op = hh.op;
+			ee.utype = hh.utype;
+			ee.address = hh.address;
+			ee.len = hh.len;
+			ee.data = hh.size > 0 ? valid_len + sizeof(hh) : -1;
+			ee.size = hh.size;
+			entries.push_back(ee);
+			valid_len += sizeof(hh) + hh.size + sizeof(end);
+		}
+	}
+	catch (CFileException *pfe)
+	{
+		pfe->Delete();
+		entries.clear();
+		return -1;
+	}
+	return 1;
+}
+
+bool edit_journal::replay(const std::vector<entry> &entries, FILE_ADDRESS doc_len,
+                          std::vector<entry> &recs, FILE_ADDRESS &new_len)
+{
+	recs.clear();
+	std::vector<entry>::const_iterator pe;
+	for (pe = entries.begin(); pe != entries.end(); ++pe)
+	{
+		if (pe->op == rec_undo)
+		{
+			if (!recs.empty())
+				recs.pop_back();
+		}
+		else if (pe->op == rec_merge && !recs.empty())
+			recs.back() = *pe;
+		else
+			recs.push_back(*pe);
+	}
+
+	new_len = doc_len;
+	for (pe = recs.begin(); pe != recs.end(); ++pe)
+	{
+		bool del = pe->utype == mod_delforw || pe->utype == mod_delback;
+		if (pe->address < 0 || pe->address > new_len || pe->len <= 0 ||
+			(del && pe->address + pe->len > new_len) ||
+			(!del && pe->data == -1))
+		{
+			return false;
+		}
+		if (del)
+			new_len -= pe->len;
+		else if (pe->utype == mod_insert || pe->utype == mod_insert_file)
+			new_len += pe->len;
+		else if (pe->address + pe->len > new_len)
+			new_len = pe->address + pe->len;
+	}
+	return true;
+}
@@ -0,0 +1,97 @@
+// EditJournal.h : keeps the unsaved changes of a document in a file
+//
+// For implementation see: EditJournal.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// The changes made to a document are only kept in memory (the undo records)
+// and temp data files, which are all discarded when the document is closed.
+// Saving a very big file can take a long time so users often put it off, but
+// then all the changes are lost if HexEdit crashes.
+//
+// If the EditJournal option is on, every undo record (including its data) is
+// appended to a journal file as it is made (see CHexEditDoc::journal_change).
+// When the file is next opened after a crash the user can restore the changes
+// (see CHexEditDoc::replay_journal).
+// The journal is then used as a data file for the restored undo records so the
+// changes are restored quickly (even many GBytes of them) and the original
+// file is not touched.  The journal is deleted when the file is saved or closed.
+//
+// The journal starts with a header that says which file it is for and the
+// length and modification time of the file when the journal was started.
+// This is followed by an entry for each:
+//   rec_new     - new undo record (followed by its data, if any)
+//   rec_merge   - a change merged into the last undo record (replaces it)
+//   rec_pattern - new undo record of a repeated pattern (see CPatternFile)
+//   rec_undo    - the last undo record was undone
+// Each entry ends with a marker so that an incomplete entry (eg HexEdit
+// crashed while it was being written) and anything after it are ignored.
+
+#ifndef EDITJOURNAL_INCLUDED
+#define EDITJOURNAL_INCLUDED  1
+
+#include <vector>
+
+class CFile64;
+
+class edit_journal
+{
+public:
+	enum { rec_new = 'N', rec_merge = 'M', rec_pattern = 'P', rec_undo = 'U' };
+
+	// An entry read from a journal
+	struct entry
+	{
+		int op;                         // rec_new, rec_merge, etc
+		int utype;                      // Type of change (see enum mod_type)
+		FILE_ADDRESS address;           // Where the change was made
+		FILE_ADDRESS len;               // Number of bytes changed
+		FILE_ADDRESS data;              // Where the data (or pattern) is in the journal (-1 if none)
+		FILE_ADDRESS size;              // Bytes of data (length of pattern for rec_pattern)
+	};
+
+	edit_journal() : pfile_(NULL) { }
+	~edit_journal() { close(); }
+
+	static CString file_name(LPCTSTR doc_path); // Name of the journal for a file (empty if none)
+
+	bool is_open() const { return pfile_ != NULL; }
+	const CString &name() const { return name_; }
+
+	bool create(LPCTSTR doc_path, FILE_ADDRESS doc_len, const FILETIME &doc_time);  // Start a new journal
+	bool reopen(LPCTSTR doc_path, FILE_ADDRESS valid_len);  // Add to a journal that was read (see read)
+	void close();                       // Stop adding entries (but keep the file)
+	void remove();                      // Stop adding entries and delete the file
+
+	// Add an entry.  These return false if there was an error (the journal should then be removed).
+	bool add(int op, int utype, FILE_ADDRESS address, FILE_ADDRESS len, const unsigned char *data);
+	bool add(int op, int utype, FILE_ADDRESS address, FILE_ADDRESS len, CFile64 *src, FILE_ADDRESS src_addr);
+	bool add_pattern(int utype, FILE_ADDRESS address, FILE_ADDRESS len, const unsigned char *pat, size_t plen);
+	bool add_undo();
+
+	// Reads the (complete) entries of the journal for a file which is now doc_len bytes long
+	// and was last modified at doc_time.  valid_len is set to the length of the journal up to
+	// the end of the last complete entry.  Returns 1 if OK, 0 if the journal is for a different
+	// version of the file, or -1 if there is no journal for the file (or it is not valid).
+	static int read(LPCTSTR doc_path, FILE_ADDRESS doc_len, const FILETIME &doc_time,
+	                std::vector<entry> &entries, FILE_ADDRESS &valid_len);
+
+	// Works out the undo records from the entries read (allowing for merged and undone
+	// changes) and the length of the file after they are applied to a file of doc_len bytes.
+	// Returns false if a record is not valid for the file (eg deletes past the end).
+	static bool replay(const std::vector<entry> &entries, FILE_ADDRESS doc_len,
+	                   std::vector<entry> &recs, FILE_ADDRESS &new_len);
+
+private:
+	void write_head(int op, int utype, FILE_ADDRESS address, FILE_ADDRESS len, FILE_ADDRESS size);
+	void write_end();
+
+	CFile64 *pfile_;                    // Journal file being added to (or NULL)
+	CString name_;                      // Name of the journal file
+};
+
+#endif
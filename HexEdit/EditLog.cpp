@@ -0,0 +1,143 @@
+// EditLog.cpp : implements edit_log (see EditLog.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include "HexEdit.h"
+#include "EditLog.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+void edit_log::add(FILE_ADDRESS address, FILE_ADDRESS removed, FILE_ADDRESS inserted)
+{
+	ASSERT(address >= 0 && removed >= 0 && inserted >= 0);
+	deltas_.push_back(delta(address, removed, inserted));
+	++count_;
+}
+
+void edit_log::trim(unsigned edit)
+{
+	ASSERT(edit <= count_);
+	size_t keep = count_ - edit;
+	if (keep < deltas_.size())
+		deltas_.erase(deltas_.begin(), deltas_.end() - keep);
+}
+
+FILE_ADDRESS edit_log::map(unsigned edit, FILE_ADDRESS address, FILE_ADDRESS len) const
+{
+	ASSERT(has(edit) && len > 0);
+	for (unsigned ee = edit; ee < count_; ++ee)
+	{
+		const delta &dd = get(ee);
+		if (address + len <= dd.address)
+			continue;                   // all before the change
+		else if (address >= dd.address + dd.removed)
+			address += dd.inserted - dd.removed;    // all after the change
+		else
+			return -1;                  // (some of) the bytes have changed
+	}
+	return address;
+}
+
+// This keeps a list of the pieces of the to version, where each piece is either a
+// run of bytes from the from version or new bytes, then applies each change to it.
+void edit_log::diff(unsigned from, unsigned to, FILE_ADDRESS from_len,
+                    std::vector<range> &removed, std::vector<range> &added) const
+{
+	ASSERT(has(from) && from <= to && to <= count_);
+	removed.clear();
+	added.clear();
+
+	struct piece
+	{
+		piece(FILE_ADDRESS l, FILE_ADDRESS s) : len(l), src(s) { }
+		FILE_ADDRESS len;               // Number of bytes
+		FILE_ADDRESS src;               // Address in the from version or -1 if new bytes
+	};
+	std::vector<piece> pp;
+	if (from_len > 0)
+		pp.push_back(piece(from_len, 0));
+
+	for (unsigned ee = from; ee < to; ++ee)
+	{
+		const delta &dd = get(ee);
+		FILE_ADDRESS pos = 0;           // Address of current piece
+		size_t ii;
+		// Skip pieces before the change (splitting the one that it starts in)
+		for (ii = 0; ii < pp.size() && pos + pp[ii].len <= dd.address; ++ii)
+			pos += pp[ii].len;
+		if (ii < pp.size() && pos < dd.address)
+		{
+			FILE_ADDRESS split = dd.address - pos;
+			pp.insert(pp.begin() + ii + 1, piece(pp[ii].len - split, pp[ii].src < 0 ? -1 : pp[ii].src + split));
+			pp[ii].len = split;
+			pos += split;
+			++ii;
+		}
+		ASSERT(pos == dd.address);
+
+		// Remove the deleted/replaced bytes (trimming the piece that they end in)
+		FILE_ADDRESS left = dd.removed;
+		while (left > 0 && ii < pp.size())
+		{
+			if (pp[ii].len <= left)
+			{
+				left -= pp[ii].len;
+				pp.erase(pp.begin() + ii);
+			}
+			else
+			{
+				pp[ii].len -= left;
+				if (pp[ii].src >= 0)
+					pp[ii].src += left;
+				left = 0;
+			}
+		}
+
+		// Add the new bytes (joined to any new bytes either side)
+		if (dd.inserted > 0)
+		{
+			if (ii > 0 && pp[ii-1].src < 0)
+				pp[ii-1].len += dd.inserted;
+			else if (ii < pp.size() && pp[ii].src < 0)
+				pp[ii].len += dd.inserted;
+			else
+				pp.insert(pp.begin() + ii, piece(dd.inserted, -1));
+		}
+		if (ii > 0 && ii < pp.size() && pp[ii-1].src < 0 && pp[ii].src < 0)
+		{
+			pp[ii-1].len += pp[ii].len;
+			pp.erase(pp.begin() + ii);
+		}
+	}
+
+	// Now find the gaps in the from version and the new bytes in the to version
+	FILE_ADDRESS pos = 0;               // Address in to version
+	FILE_ADDRESS next = 0;              // Address in from version past the last piece from it
+	for (size_t ii = 0; ii < pp.size(); ++ii)
+	{
+		if (pp[ii].src < 0)
+		{
+			added.push_back(range(pos, pos + pp[ii].len));
+		}
+		else
+		{
+			ASSERT(pp[ii].src >= next);
+			if (pp[ii].src > next)
+				removed.push_back(range(next, pp[ii].src));
+			next = pp[ii].src + pp[ii].len;
+		}
+		pos += pp[ii].len;
+	}
+	if (next < from_len)
+		removed.push_back(range(next, from_len));
+}
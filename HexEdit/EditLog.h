@@ -0,0 +1,68 @@
+// EditLog.h : remembers recent changes to a document so addresses can be mapped
+//
+// For implementation see: EditLog.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Background threads scan a snapshot of the document (see CHexEditDoc::TakeSnapshot)
+// while the user may be changing it.  Every change (insertion, deletion or
+// replacement) made while a snapshot exists is recorded in an edit_log so that:
+// - an address in the snapshot can be mapped to where the same byte is now
+//   (eg background search occurrences) - see map()
+// - the parts of the document that are different between two versions can be
+//   found so that only they need to be rescanned - see diff()
+// Each change is given a number (0 for the first change) and a version of the
+// document is identified by count() at the time (number of changes made so far).
+
+#ifndef EDITLOG_INCLUDED
+#define EDITLOG_INCLUDED  1
+
+#include <vector>
+#include <utility>
+
+class edit_log
+{
+public:
+	typedef std::pair<FILE_ADDRESS, FILE_ADDRESS> range;   // first = start, second = byte past end
+
+	edit_log() : count_(0) { }
+
+	unsigned count() const { return count_; }   // Number of changes made so far
+	// Returns true if all changes made since version edit are remembered
+	bool has(unsigned edit) const { return edit <= count_ && count_ - edit <= deltas_.size(); }
+
+	// Record a change at address where removed bytes were deleted/replaced by inserted bytes
+	void add(FILE_ADDRESS address, FILE_ADDRESS removed, FILE_ADDRESS inserted);
+	void skip() { ++count_; deltas_.clear(); } // Count a change that is not remembered
+	void clear() { deltas_.clear(); }           // Forget the changes made so far
+	void trim(unsigned edit);                   // Forget changes made before version edit
+
+	// Returns the current address of the len (> 0) bytes at address in version edit,
+	// or -1 if any of them have since been changed or deleted (or split by an insertion).
+	FILE_ADDRESS map(unsigned edit, FILE_ADDRESS address, FILE_ADDRESS len) const;
+
+	// Works out which bytes are different between version from (which was from_len
+	// bytes long) and version to: removed gets the ranges of from that have been
+	// deleted/replaced and added gets the ranges of to that were inserted/replaced.
+	void diff(unsigned from, unsigned to, FILE_ADDRESS from_len,
+	          std::vector<range> &removed, std::vector<range> &added) const;
+
+private:
+	struct delta
+	{
+		delta(FILE_ADDRESS a, FILE_ADDRESS r, FILE_ADDRESS i) : address(a), removed(r), inserted(i) { }
+		FILE_ADDRESS address;           // Where the change was made
+		FILE_ADDRESS removed;           // Number of bytes deleted (or replaced)
+		FILE_ADDRESS inserted;          // Number of bytes inserted (or replacements)
+	};
+	std::vector<delta> deltas_;         // Changes remembered, the last is number count_-1
+	unsigned count_;                    // Number of changes made
+
+	const delta &get(unsigned edit) const { return deltas_[deltas_.size() - (count_ - edit)]; }
+};
+
+#endif
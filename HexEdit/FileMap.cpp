@@ -0,0 +1,346 @@
+// FileMap.cpp : implements file_map (see FileMap.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include <algorithm>
+#include "FileMap.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+struct file_map::view
+{
+	__int64 start;                      // File address of 1st byte of the view
+	size_t len;                         // Number of bytes mapped
+	unsigned char *addr;                // Where the view is in memory
+	unsigned last_used;                 // Value of clock_ when last used (for discarding least recently used)
+	int pins;                           // Number of readers currently using the view
+};
+
+// Locks a file_map's views for the life of the object
+class file_map_lock
+{
+public:
+#ifdef _WIN32
+	file_map_lock(CRITICAL_SECTION &cs) : cs_(cs) { ::EnterCriticalSection(&cs_); }
+	~file_map_lock() { ::LeaveCriticalSection(&cs_); }
+private:
+	CRITICAL_SECTION &cs_;
+#else
+	file_map_lock(pthread_mutex_t &mm) : mm_(mm) { pthread_mutex_lock(&mm_); }
+	~file_map_lock() { pthread_mutex_unlock(&mm_); }
+private:
+	pthread_mutex_t &mm_;
+#endif
+};
+
+#ifdef _WIN32
+// Copies from a mapped view.  If the read of the underlying file fails Windows raises
+// an "in page" exception which we catch and return false (the caller then uses pread
+// which reports the error properly).  This is in a separate function as __try can't
+// be used in a function with objects that need unwinding.
+static bool copy_view(void *dest, const void *src, size_t len)
+{
+	__try
+	{
+		memcpy(dest, src, len);
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+	{
+		return false;
+	}
+	return true;
+}
+#else
+static bool copy_view(void *dest, const void *src, size_t len)
+{
+	memcpy(dest, src, len);
+	return true;
+}
+#endif
+
+file_map::file_map(handle_t hh, size_t window_size /*= default_window_size*/, int max_views /*= default_max_views*/)
+	: hh_(hh), length_(0), max_views_(max_views), clock_(0)
+{
+	ASSERT(max_views > 0 && window_size > 0);
+
+	// Views must start on a multiple of the allocation granularity (or page size)
+	size_t granularity;
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	::GetSystemInfo(&si);
+	granularity = si.dwAllocationGranularity;
+	::InitializeCriticalSection(&lock_);
+	hmap_ = NULL;
+#else
+	granularity = size_t(sysconf(_SC_PAGESIZE));
+	pthread_mutex_init(&lock_, NULL);
+	ok_ = false;
+#endif
+	window_size_ = ((window_size + granularity - 1)/granularity) * granularity;
+
+	open_map();
+}
+
+file_map::~file_map()
+{
+	close_map();
+	ASSERT(retired_.empty());           // nobody should be reading while we are destroyed
+#ifdef _WIN32
+	::DeleteCriticalSection(&lock_);
+#else
+	pthread_mutex_destroy(&lock_);
+#endif
+}
+
+bool file_map::mapped() const
+{
+#ifdef _WIN32
+	return hmap_ != NULL;
+#else
+	return ok_;
+#endif
+}
+
+void file_map::reset()
+{
+	file_map_lock fml(lock_);
+	close_map();
+	open_map();
+}
+
+bool file_map::read(__int64 pos, void *buf, size_t len, size_t &got)
+{
+	ASSERT(pos >= 0);
+	unsigned char *pp = (unsigned char *)buf;
+
+	got = 0;
+
+	// Copy from the views until we get all the data or are past the end of the mapped file
+	while (got < len)
+	{
+		view *pv;
+		size_t avail;                   // Bytes of the view from pos + got
+		const unsigned char *src = pin(pos + got, avail, pv);
+		if (src == NULL)
+			break;                      // not mapped or past end of map so use pread below
+
+		size_t tocopy = len - got;
+		if (tocopy > avail)
+			tocopy = avail;
+		bool ok = copy_view(pp + got, src, tocopy);    // (without the lock)
+		unpin(pv);
+		if (!ok)
+			break;                      // I/O error - let pread below report it
+		got += tocopy;
+	}
+
+	// Read anything we did not get from the map
+	if (got < len)
+	{
+		size_t extra;
+		bool retval = pread(pos + got, pp + got, len - got, extra);
+		got += extra;
+		return retval;
+	}
+	return true;
+}
+
+void file_map::open_map()
+{
+	ASSERT(views_.empty());
+#ifdef _WIN32
+	ASSERT(hmap_ == NULL);
+	LARGE_INTEGER sz;
+	if (!::GetFileSizeEx(hh_, &sz))
+		return;
+	length_ = sz.QuadPart;
+	if (length_ > 0)                    // can't map an empty file
+		hmap_ = ::CreateFileMapping(hh_, NULL, PAGE_READONLY, 0, 0, NULL);
+#else
+	struct stat st;
+	if (fstat(hh_, &st) != 0)
+		return;
+	length_ = st.st_size;
+	ok_ = length_ > 0 && S_ISREG(st.st_mode);
+#endif
+}
+
+// Note: lock_ must be held (or no other thread using the file_map)
+void file_map::close_map()
+{
+	for (std::vector<view *>::const_iterator pv = views_.begin(); pv != views_.end(); ++pv)
+	{
+		if ((*pv)->pins > 0)
+			retired_.push_back(*pv);    // unmapped when the last reader unpins it
+		else
+			unmap(*pv);
+	}
+	views_.clear();
+
+#ifdef _WIN32
+	if (hmap_ != NULL)
+	{
+		::CloseHandle(hmap_);
+		hmap_ = NULL;
+	}
+#else
+	ok_ = false;
+#endif
+}
+
+// Returns a pointer to the mapped byte at file address pos (and the number of bytes of
+// the view from there in avail) or NULL if it is not mapped.  The view (returned in pv)
+// is pinned so that it stays mapped until unpin(pv) is called.
+const unsigned char *file_map::pin(__int64 pos, size_t &avail, view *&pv)
+{
+	file_map_lock fml(lock_);
+	if (!mapped() || pos >= length_ || (pv = get_view(pos)) == NULL)
+		return NULL;
+
+	++pv->pins;
+	size_t offset = size_t(pos - pv->start);    // Where we start in the view
+	avail = pv->len - offset;
+	return pv->addr + offset;
+}
+
+void file_map::unpin(view *pv)
+{
+	file_map_lock fml(lock_);
+	ASSERT(pv->pins > 0);
+	if (--pv->pins == 0)
+	{
+		// If it was discarded while we were using it we have to unmap it now
+		std::vector<view *>::iterator pr = std::find(retired_.begin(), retired_.end(), pv);
+		if (pr != retired_.end())
+		{
+			retired_.erase(pr);
+			unmap(pv);
+		}
+	}
+}
+
+size_t file_map::view_count()
+{
+	file_map_lock fml(lock_);
+	return views_.size() + retired_.size();
+}
+
+void file_map::unmap(view *pv)
+{
+	ASSERT(pv->pins == 0);
+#ifdef _WIN32
+	::UnmapViewOfFile(pv->addr);
+#else
+	munmap(pv->addr, pv->len);
+#endif
+	delete pv;
+}
+
+// Returns the view containing file address pos, mapping a new window if necessary.
+// Note: lock_ must be held, and the view must be pinned if it is used after lock_
+// is released as it may then be discarded by another reader.
+file_map::view *file_map::get_view(__int64 pos)
+{
+	ASSERT(pos >= 0 && pos < length_);
+	++clock_;
+
+	// Check if it's already mapped
+	std::vector<view *>::iterator pv;
+	for (pv = views_.begin(); pv != views_.end(); ++pv)
+	{
+		if (pos >= (*pv)->start && pos < (*pv)->start + __int64((*pv)->len))
+		{
+			(*pv)->last_used = clock_;
+			return *pv;
+		}
+	}
+
+	// Discard the least recently used views (that are not being read) if we have too many.
+	// (If they are all pinned we go over max_views_ for a while, so there may be more than
+	// one to discard.)
+	while (int(views_.size()) >= max_views_)
+	{
+		std::vector<view *>::iterator plru = views_.end();
+		for (pv = views_.begin(); pv != views_.end(); ++pv)
+			if ((*pv)->pins == 0 && (plru == views_.end() || clock_ - (*pv)->last_used > clock_ - (*plru)->last_used))
+				plru = pv;
+		if (plru == views_.end())
+			break;                      // all pinned
+		unmap(*plru);
+		views_.erase(plru);
+	}
+
+	view vv;
+	vv.start = pos - pos % window_size_;
+	vv.len = length_ - vv.start < __int64(window_size_) ? size_t(length_ - vv.start) : window_size_;
+	vv.last_used = clock_;
+	vv.pins = 0;
+#ifdef _WIN32
+	vv.addr = (unsigned char *)::MapViewOfFile(hmap_, FILE_MAP_READ, DWORD(vv.start >> 32), DWORD(vv.start), vv.len);
+	if (vv.addr == NULL)
+		return NULL;
+#else
+	void *addr = mmap(NULL, vv.len, PROT_READ, MAP_SHARED, hh_, vv.start);
+	if (addr == MAP_FAILED)
+		return NULL;
+	madvise(addr, vv.len, MADV_SEQUENTIAL);    // Most reading (bg scans, saves) is sequential
+	vv.addr = (unsigned char *)addr;
+#endif
+	views_.push_back(new view(vv));
+	return views_.back();
+}
+
+// Read from the file using positional reads.  Note that on Windows ReadFile with an
+// OVERLAPPED structure on a synchronous handle still moves the file position (to just
+// past the bytes read) so the position of hh_ can't be relied on by anyone else.
+bool file_map::pread(__int64 pos, void *buf, size_t len, size_t &got)
+{
+	unsigned char *pp = (unsigned char *)buf;
+
+	got = 0;
+	while (got < len)
+	{
+#ifdef _WIN32
+		OVERLAPPED ov;
+		memset(&ov, '\0', sizeof(ov));
+		ov.Offset = DWORD(pos + got);
+		ov.OffsetHigh = DWORD((pos + got) >> 32);
+
+		DWORD toread = len - got > 0x40000000 ? 0x40000000 : DWORD(len - got);
+		DWORD actual;
+		if (!::ReadFile(hh_, pp + got, toread, &actual, &ov))
+			return ::GetLastError() == ERROR_HANDLE_EOF;
+#else
+		ssize_t actual = ::pread(hh_, pp + got, len - got, off_t(pos + got));
+		if (actual < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+#endif
+		if (actual == 0)
+			break;                      // EOF
+		got += actual;
+	}
+	return true;
+}
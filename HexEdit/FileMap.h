@@ -0,0 +1,106 @@
+// FileMap.h : read-only memory mapped access to a file
+//
+// For implementation see: FileMap.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// A file_map reads from a file by copying from memory mapped views rather than
+// using Seek() and Read().  This means there is no file position so any number
+// of threads can read at the same time, and all readers share the OS page cache
+// rather than each handle doing its own buffered reads.
+//
+// Since a 32-bit process can't map a large file in one go, the file is mapped
+// in windows (of window_size bytes) and the most recently used windows are kept
+// mapped.  If mapping fails (or a read is past the length of the file when the
+// map was created) then we fall back to positional reads (pread).
+//
+// The lock is only held while finding (or mapping) a view.  The view is "pinned"
+// (its count of readers is incremented) so that it is not unmapped while the bytes
+// are copied without the lock, so readers of the same file don't wait for each
+// other's copies (or the page faults they cause).  A pinned view that is no longer
+// wanted (eg after reset) is unmapped by the last reader to unpin it.
+//
+// pin() and unpin() are also used directly to work on the bytes without copying
+// them at all (see CHexEditDoc::GetSpan).
+//
+// Note: this only uses Win32 or POSIX calls (no MFC) so it can be built on other
+// systems (eg to build and test the document code on Linux).
+
+#ifndef FILEMAP_INCLUDED
+#define FILEMAP_INCLUDED  1
+
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+class file_map
+{
+public:
+#ifdef _WIN32
+	typedef HANDLE handle_t;
+#else
+	typedef int handle_t;               // file descriptor
+#endif
+	// Note: keep the total small (default 4 MB per file) as HexEdit is a 32-bit program and
+	// several files (doc file and temp data files) can be mapped for every open document.
+	enum { default_window_size = 1024*1024, default_max_views = 4 };
+
+	// Note: the handle must stay open (and be readable) for the life of the file_map
+	// and the file must not be made shorter (eg by another process) while mapped.
+	explicit file_map(handle_t hh, size_t window_size = default_window_size, int max_views = default_max_views);
+	~file_map();
+
+	bool mapped() const;                // false if the file could not be mapped
+	__int64 length() const { return length_; }   // file length when mapped
+
+	// Reads len bytes at pos into buf, setting got to the number read (less than len at EOF).
+	// Returns false if there was an OS error (see GetLastError() or errno).
+	// This is thread-safe.  Note that it may change the file position of the handle (see
+	// pread) so the position should not be relied on by other users of the handle.
+	bool read(__int64 pos, void *buf, size_t len, size_t &got);
+
+	void reset();                       // Unmap all views and remap the file (eg if length has changed)
+
+	// Returns a pointer to the mapped byte at pos and the number of bytes of the view from
+	// there (in avail), or NULL if pos is not mapped.  The bytes stay mapped until unpin(pv).
+	// Note: an I/O error reading the bytes raises an exception on Windows (see copy_view).
+	struct view;                        // (see FileMap.cpp)
+	const unsigned char *pin(__int64 pos, size_t &avail, view *&pv);
+	void unpin(view *pv);
+
+	size_t view_count();                // Views mapped (including discarded ones still pinned)
+
+private:
+	file_map(const file_map &);         // not copyable
+	file_map &operator=(const file_map &);
+
+	void open_map();
+	void close_map();
+	view *get_view(__int64 pos);        // Find/create view containing pos (returns NULL on error)
+	void unmap(view *pv);
+	bool pread(__int64 pos, void *buf, size_t len, size_t &got);
+
+	handle_t hh_;                       // Handle of file we are reading
+	__int64 length_;                    // Length of file when map created
+	size_t window_size_;                // Size of views (multiple of allocation granularity)
+	int max_views_;                     // Max number of views to keep mapped
+	std::vector<view *> views_;         // Views currently mapped
+	std::vector<view *> retired_;       // Discarded views that are still pinned
+	unsigned clock_;                    // Incremented every time a view is used
+
+#ifdef _WIN32
+	HANDLE hmap_;                       // File mapping object (or NULL)
+	CRITICAL_SECTION lock_;             // Protects views_, retired_, pins and clock_
+#else
+	bool ok_;                           // Mapping is possible
+	pthread_mutex_t lock_;
+#endif
+};
+
+#endif
@@ -68,6 +68,7 @@ CFindSheet::CFindSheet(UINT iSelectPage /*=0*/)
 	buf[0] = theApp.GetProfileInt("Find-Settings", "Wildcard", '?');
 	buf[1] = '\0';
 	wildcard_char_ = buf;
+	regex_ = theApp.GetProfileInt("Find-Settings", "RegularExpression", FALSE);
 
 	big_endian_ = FALSE;  // May be confusing to save/restore this - default to little-endian (Intel)
 	number_format_ = theApp.GetProfileInt("Find-Settings", "NumberFormat", 0);
@@ -86,6 +87,7 @@ CFindSheet::~CFindSheet()
 	theApp.WriteProfileInt("Find-Settings", "UseWildcards", wildcards_allowed_);
 	ASSERT(wildcard_char_.GetLength() == 1);
 	theApp.WriteProfileInt("Find-Settings", "Wildcard", wildcard_char_[0]);
+	theApp.WriteProfileInt("Find-Settings", "RegularExpression", regex_);
 
 	theApp.WriteProfileInt("Find-Settings", "NumberFormat", number_format_);
 	theApp.WriteProfileInt("Find-Settings", "NumberSize", number_size_);
@@ -139,7 +141,7 @@ CFindSheet::string_t CFindSheet::StringType(LPCTSTR ss)
 
 	for (pp = ss; *pp != '\0'; ++pp)
 	{
-		if (isspace(*pp))
+		if (isspace(*pp) || *pp == '|')     // (| separates byte sequences - see GetPatternList)
 		{
 			if ((consec_count % 2) != 0)
 				return STRING_TEXT;
@@ -156,6 +158,8 @@ CFindSheet::string_t CFindSheet::StringType(LPCTSTR ss)
 
 	if ((consec_count % 2) != 0)
 		return STRING_TEXT;
+	else if (retval == STRING_UNKNOWN && strchr(ss, '|') != NULL)
+		return STRING_TEXT;             // | on its own is text
 	else
 		return retval;
 }
@@ -855,6 +859,57 @@ void CFindSheet::GetSearch(const unsigned char **pps, const unsigned char **ppma
 	}
 }
 
+// Gets the byte sequences to search for if several (separated by |) were entered
+// in the Basic page.  They are all searched for at once - see CMainFrame::DoFindList.
+// Returns false if there are not several.
+bool CFindSheet::GetPatternList(std::vector<std::vector<unsigned char> > &pats)
+{
+	CPropertyPage *pp = GetActivePage();
+	ASSERT(pp != NULL);
+	pp->UpdateData();
+
+	pats.clear();
+	if (pp != p_page_simple_ || StringType(combined_string_) != STRING_HEX || combined_string_.Find('|') == -1)
+		return false;
+
+	std::vector<unsigned char> curr;
+	unsigned char cc = '\0';
+	int ndigits = 0;
+	for (const char *ps = combined_string_; ; ++ps)
+	{
+		if (*ps == '|' || *ps == '\0')
+		{
+			// End of one sequence (ignore empty ones)
+			if (!curr.empty())
+				pats.push_back(curr);
+			curr.clear();
+			if (*ps == '\0')
+				break;
+		}
+		else if (isxdigit(*ps))
+		{
+			cc = (unsigned char)((cc<<4) + (isdigit(*ps) ? *ps - '0' : toupper(*ps) - 'A' + 10));
+			if ((++ndigits % 2) == 0)
+				curr.push_back(cc);
+		}
+	}
+	return pats.size() > 1;
+}
+
+// Gets the regular expression to search for if "Regular expression" is on in the Text
+// page (see CMainFrame::DoFindList).  Returns false if it is not a regex search.
+bool CFindSheet::GetRegex(CString &re)
+{
+	CPropertyPage *pp = GetActivePage();
+	ASSERT(pp != NULL);
+	pp->UpdateData();
+
+	if (pp != p_page_text_ || !regex_ || text_string_.IsEmpty())
+		return false;
+	re = text_string_;
+	return true;
+}
+
 static union
 {
 	_int64 as_int;
@@ -1685,9 +1740,14 @@ void CSimplePage::FixType(BOOL fix_strings /*=FALSE*/)
 		break;
 	case CFindSheet::STRING_HEX:
 		GetDlgItem(IDC_FIND_DESC)->SetWindowText("Hex find:");
-		GetDlgItem(IDC_FIND_MESSAGE)->SetWindowText(
-			"Press Enter or click the \"Find Next\" button to search for the bytes.\n"
-			"Select the \"Hex\" page for advanced hex search options.");
+		if (pparent_->combined_string_.Find('|') != -1)
+			GetDlgItem(IDC_FIND_MESSAGE)->SetWindowText(
+				"Press Enter or click the \"Find Next\" button to search this file for\n"
+				"any of the byte sequences (separated by |).");
+		else
+			GetDlgItem(IDC_FIND_MESSAGE)->SetWindowText(
+				"Press Enter or click the \"Find Next\" button to search for the bytes.\n"
+				"Select the \"Hex\" page for advanced hex search options.");
 		GetDlgItem(IDC_FIND_WHOLE_WORD)->EnableWindow(FALSE);
 		GetDlgItem(IDC_FIND_MATCH_CASE)->EnableWindow(FALSE);
 
@@ -2260,6 +2320,7 @@ void CTextPage::DoDataExchange(CDataExchange* pDX)
 	DDX_Radio(pDX, IDC_FIND_SCOPE_TOMARK, *(int *)(&pparent_->scope_));
 	DDX_Check(pDX, IDC_FIND_ALLOW_WILDCARD, pparent_->wildcards_allowed_);
 	DDX_Text(pDX, IDC_FIND_WILDCARD_CHAR, pparent_->wildcard_char_);
+	DDX_Check(pDX, IDC_FIND_REGEX, pparent_->regex_);
 	DDX_Radio(pDX, IDC_FIND_TYPE_ASCII, *(int *)(&pparent_->charset_));
 	DDX_Text(pDX, IDC_FIND_BOOKMARK_PREFIX, pparent_->bookmark_prefix_);
 }
@@ -2268,6 +2329,7 @@ BEGIN_MESSAGE_MAP(CTextPage, CFindPage)
 	//{{AFX_MSG_MAP(CTextPage)
 	ON_BN_CLICKED(IDC_FIND_NEXT, OnFindNext)
 	ON_BN_CLICKED(IDC_FIND_ALLOW_WILDCARD, OnAllowWildcard)
+	ON_BN_CLICKED(IDC_FIND_REGEX, OnRegex)
 	ON_BN_CLICKED(IDC_FIND_DIRN_DOWN, OnChangeDirn)
 	ON_BN_CLICKED(IDC_FIND_TYPE_ASCII, OnChangeType)
 	ON_BN_CLICKED(IDC_FIND_HELP, OnHelp)
@@ -2308,7 +2370,9 @@ void CTextPage::FixStrings()
 void CTextPage::FixWildcard()
 {
 	ASSERT(GetDlgItem(IDC_FIND_WILDCARD_CHAR) != NULL);
-	GetDlgItem(IDC_FIND_WILDCARD_CHAR)->EnableWindow(pparent_->wildcards_allowed_);
+	// Wildcards are not used in regular expressions (. matches any byte)
+	GetDlgItem(IDC_FIND_ALLOW_WILDCARD)->EnableWindow(!pparent_->regex_);
+	GetDlgItem(IDC_FIND_WILDCARD_CHAR)->EnableWindow(pparent_->wildcards_allowed_ && !pparent_->regex_);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -2359,6 +2423,7 @@ static DWORD id_pairs3[100] = {
 	IDC_FIND_TEXT_STRING, HIDC_FIND_TEXT_STRING,
 	IDC_FIND_ALLOW_WILDCARD, HIDC_FIND_ALLOW_WILDCARD,
 	IDC_FIND_WILDCARD_CHAR, HIDC_FIND_ALLOW_WILDCARD,
+	IDC_FIND_REGEX, HIDC_FIND_TEXT_STRING,
 	IDC_FIND_NEXT, HIDC_FIND_NEXT,
 	IDC_FIND_BOOKMARK_ALL, HIDC_FIND_BOOKMARK_ALL,
 	IDC_FIND_BOOKMARK_PREFIX, HIDC_FIND_BOOKMARK_PREFIX,
@@ -2422,6 +2487,12 @@ void CTextPage::OnAllowWildcard()
 	FixStrings();
 }
 
+void CTextPage::OnRegex()
+{
+	UpdateData();
+	FixWildcard();
+}
+
 void CTextPage::OnChangeDirn()
 {
 	UpdateData();
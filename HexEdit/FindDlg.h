@@ -8,6 +8,7 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
+#include <vector>
 #include "ResizeCtrl.h"
 
 // Classes that handle each page (derived from CFindPage -> CPropertyPage)
@@ -96,6 +97,7 @@ public:
 
 	BOOL wildcards_allowed_;            // are wildcards allowed in a text search
 	CString wildcard_char_;             // Character to use as a wildcard (usually "?")
+	BOOL regex_;                        // text search is for a regular expression (see byte_regex)
 	enum charset_t { RB_CHARSET_UNKNOWN = -1, RB_CHARSET_ASCII = 0, RB_CHARSET_UNICODE, RB_CHARSET_EBCDIC }; // Matches order of char set radios in text search page
 	charset_t charset_;
 
@@ -152,6 +154,8 @@ public:
 	bool AlignRel();                // Align relative to current cursor position
 
 	void GetSearch(const unsigned char **pps, const unsigned char **mask, size_t *plen);
+	bool GetPatternList(std::vector<std::vector<unsigned char> > &pats);
+	bool GetRegex(CString &re);
 	void GetReplace(unsigned char **pps, size_t *plen);
 	bool HexReplace() const;
 
@@ -327,6 +331,7 @@ protected:
 	virtual BOOL OnInitDialog();
 	afx_msg void OnFindNext();
 	afx_msg void OnAllowWildcard();
+	afx_msg void OnRegex();
 	afx_msg void OnChangeDirn();
 	afx_msg void OnChangeType();
 	afx_msg void OnHelp();
@@ -1988,6 +1988,23 @@ void CHexEditApp::NewSearch(const unsigned char *pat, const unsigned char *mask,
 	align_rel_ = align_rel;
 }
 
+// Search for any of several patterns or a regex
+void CHexEditApp::NewSearch(const boyer &bb, BOOL icase, int tt, BOOL ww,
+							int aa, int offset, bool align_rel)
+{
+	CSingleLock s2(&appdata_, TRUE);
+
+	if (pboyer_ != NULL) delete pboyer_;
+	pboyer_ = new boyer(bb);
+
+	text_type_ = tt;
+	icase_ = icase;
+	wholeword_ = ww;
+	alignment_ = aa;
+	offset_ = offset;
+	align_rel_ = align_rel;
+}
+
 // Get new encryption algorithm
 void CHexEditApp::OnEncryptAlg()
 {
@@ -2249,6 +2266,8 @@ void CHexEditApp::LoadOptions()
 
 	intelligent_undo_ = GetProfileInt("Options", "UndoIntelligent", 0) ? TRUE : FALSE;
 	undo_limit_ = GetProfileInt("Options", "UndoMerge", 5);
+	undo_memory_ = GetProfileInt("Options", "UndoMemory", 256);
+	journal_edits_ = GetProfileInt("Options", "EditJournal", 0) ? TRUE : FALSE;
 	cb_text_type_ = GetProfileInt("Options", "TextToClipboardAs", INT_MAX);
 
 	char buf[2];
@@ -2750,6 +2769,8 @@ void CHexEditApp::SaveOptions()
 
 	WriteProfileInt("Options", "UndoIntelligent", intelligent_undo_ ? 1 : 0);
 	WriteProfileInt("Options", "UndoMerge", undo_limit_);
+	WriteProfileInt("Options", "UndoMemory", undo_memory_);
+	WriteProfileInt("Options", "EditJournal", journal_edits_ ? 1 : 0);
 	WriteProfileInt("Options", "TextToClipboardAs", cb_text_type_);
 
 	WriteProfileInt("Printer", "Border", print_box_ ? 1 : 0);
@@ -54,6 +54,9 @@ typedef __int64 FILE_ADDRESS;
 #if _MSC_VER >= 1600        // SSE2 registers (__m128i) only added in VS2010
 #define USE_SSE2         1  // Use SSE2 (SIMD) instructions to speed up some operations
 #endif
+#if _MSC_VER >= 1600        // Rvalue references only added in VS2010
+#define USE_MOVE         1  // Use move constructors (eg so undo records are not copied when undo_ grows)
+#endif
 #define USE_OWN_PRINTDLG 1  // Replace the standard print dialog with our own derived dialog
 #define INPLACE_MOVE 1      // Writes all changes to the file in place - even when bytes inserted/deleted (so a temp file is not required)
 #define SYS_SOUNDS      1   // Use system sounds - make an option for system sounds vs internal spkr
@@ -77,6 +80,7 @@ typedef __int64 FILE_ADDRESS;
 #define FILENAME_RECENTFILES _T("RecentFiles")
 #define FILENAME_BACKGROUND  _T("Backgrnd.bmp")
 #define DIRNAME_PREVIEW      _T("PreviewThumbnails\\")
+#define DIRNAME_JOURNAL      _T("Journal\\")
 #define FILENAME_ABOUTBG     _T("About.jpg")
 #define FILENAME_SPLASH      _T("Splash.bmp")
 #define FILENAME_DTD         _T("BinaryFileFormat.DTD")
@@ -319,6 +323,7 @@ public:
 	void StopSearches();
 	void NewSearch(const unsigned char *pat, const unsigned char *mask, size_t len,
 				   BOOL icase, int tt, BOOL ww, int aa, int offset, bool align_rel);
+	void NewSearch(const boyer &bb, BOOL icase, int tt, BOOL ww, int aa, int offset, bool align_rel);
 
 	//{{AFX_MSG(CHexEditApp)
 	afx_msg void OnAppAbout();
@@ -761,6 +766,8 @@ public:
 
 	BOOL intelligent_undo_;             // Do op then reverse op does not change undo stack
 	int undo_limit_;                    // How many bytes of consec. undo info can be merged before starting a new undo
+	int undo_memory_;                   // MBytes of undo data kept in memory per file before moving some to a temp file
+	BOOL journal_edits_;                // Keep unsaved changes in a journal file so they can be restored (see EditJournal.h)
 	int cb_text_type_;                  // Says how Edit/Cut+Copy+Paste behave
 
 	// Info (tip) window options
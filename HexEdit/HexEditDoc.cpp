@@ -42,8 +42,6 @@ extern CHexEditApp theApp;
 
 // I can't work out how to get constants into a header file
 const FILE_ADDRESS doc_loc::mask  = 0x3fffFFFFffffFFFF;       // Masks top bits of dlen
-const FILE_ADDRESS doc_loc::fmask = 0x3fffFFFFffffFFFF;       // Masks off the top bits of fileaddr
-const int doc_loc::max_data_files = 4;
 
 /////////////////////////////////////////////////////////////////////////////
 // CHexEditDoc
@@ -97,22 +95,12 @@ CHexEditDoc::CHexEditDoc()
 {
 	doc_changed_ = false;
 
-	pfile1_ = pfile2_ = pfile3_ = pfile5_ = pfile6_ = NULL;
+	pfile1_ = NULL;
 	pfile1_compare_ = pfile4_ = pfile4_compare_ = NULL;  // Files used for compares
 
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		data_file_[ii] = NULL;
-		data_file2_[ii] = NULL;
-		data_file3_[ii] = NULL;
-		data_file4_[ii] = NULL;
-		data_file5_[ii] = NULL;
-		data_file6_[ii] = NULL;
-		temp_file_[ii] = FALSE;
-	}
-
 	keep_times_ = theApp.open_keep_times_;
 	length_ = 0L;
+	file_gen_ = 0;
 
 	dffd_edit_mode_ = 0;
 
@@ -124,6 +112,7 @@ CHexEditDoc::CHexEditDoc()
 	av_count_ = 0;
 	dib_ = NULL;
 	bpe_ = -1;
+	aerial_rescan_ = true;
 
 	// BG compare thread
 	TRACE1("+++ Setting compare thread to NULL for %p\n", this);
@@ -134,6 +123,10 @@ CHexEditDoc::CHexEditDoc()
 
 	// BG stats thread
 	pthread5_ = NULL;
+	stats_fin_ = digests_fin_ = false;
+	stats_rescan_ = true;
+	stats_edit_ = 0;
+	stats_done_ = false;
 
 	// Preview thread
 	pthread6_ = NULL;
@@ -163,6 +156,13 @@ CHexEditDoc::CHexEditDoc()
 	xml_file_num_ = -1;
 	need_change_track_ = false;
 	base_type_ = 0;
+	undo_budget_ = size_t(max(theApp.undo_memory_, 1)) * 1024 * 1024;
+	spill_tried_ = 0;
+	saving_ = false;
+	batch_level_ = 0;
+	batch_first_ = 0;
+	batch_view_ = NULL;
+	batch_ptoo_ = FALSE;
 
 	base_addr_ = 0;
 }
@@ -223,7 +223,7 @@ void CHexEditDoc::Dump(CDumpContext& dc) const
 	}
 
 	dc << "\nLOCATION INFO";
-		std::list <doc_loc>::const_iterator pl;
+		loc_tree::const_iterator pl;
 	for (pl = loc_.begin(); pl != loc_.end(); ++pl)
 	{
 		dc << "\n  ";
@@ -372,16 +372,7 @@ BOOL CHexEditDoc::OnOpenDocument(LPCTSTR lpszPathName)
 	DeleteContents();
 	SetModifiedFlag(FALSE);
 
-#ifdef _DEBUG
-	// Make sure no data files are open yet
-	for (ii = 0; ii < doc_loc::max_data_files; ++ii)
-		ASSERT(data_file2_[ii] == NULL &&
-		       data_file3_[ii] == NULL &&
-		       data_file4_[ii] == NULL &&
-			   data_file5_[ii] == NULL &&
-			   data_file6_[ii] == NULL &&
-			   data_file_[ii] == NULL );
-#endif
+	ASSERT(data_file_.empty());         // Make sure no data files are open yet
 
 	// Get read-only and shareable flags from app (this was the only way to pass them here)
 	readonly_ = theApp.open_current_readonly_ == -1 ? FALSE : theApp.open_current_readonly_;
@@ -396,8 +387,9 @@ BOOL CHexEditDoc::OnOpenDocument(LPCTSTR lpszPathName)
 	last_view_ = NULL;
 
 	// Init locations list with all of original file as only loc record
-	ASSERT(pthread2_ == NULL);       // Must modify loc_ before creating thread (else docdata_ needs to be locked)
+	ASSERT(pthread2_ == NULL);       // Must modify loc_ before creating thread (else docrw_ needs to be locked)
 	loc_.push_back(doc_loc(FILE_ADDRESS(0), pfile1_->GetLength()));
+	replay_journal();                // Restore unsaved changes from last time (if any)
 
 	load_icon(lpszPathName);
 	show_icon();
@@ -444,7 +436,9 @@ BOOL CHexEditDoc::OnOpenDocument(LPCTSTR lpszPathName)
 	// Get all bookmarks for this file
 	ASSERT(pfile1_ != NULL);
 	CBookmarkList *pbl = theApp.GetBookmarkList();
-	pbl->GetAll(pfile1_->GetFilePath(), bm_index_, bm_posn_);
+	std::vector<FILE_ADDRESS> posn;
+	pbl->GetAll(pfile1_->GetFilePath(), bm_index_, posn);
+	bm_posn_.assign(posn);
 
 	// Check that the bookmarks are valid
 	CString mess;
@@ -455,7 +449,7 @@ BOOL CHexEditDoc::OnOpenDocument(LPCTSTR lpszPathName)
 		{
 			ASSERT(bm_index_[ii] < (int)pbl->file_.size());
 			mess += pbl->name_[bm_index_[ii]] + CString("\n");
-			bm_posn_[ii] = length_;
+			bm_posn_.set(ii, length_);
 			pbl->filepos_[bm_index_[ii]] = length_;
 			++bad_count;
 		}
@@ -705,8 +699,9 @@ BOOL CHexEditDoc::OnSaveDocument(LPCTSTR lpszPathName)
 		int path_len;                           // Length of path part of file name
 
 		// Since we may change the file being accessed and the location data (loc_) we need to stop
-		// the bg search from accessing it during this time.  (Auto Unlock when it goes out of scope)
+		// the bg threads from accessing it during this time.  (Auto Unlock when it goes out of scope)
 		CSingleLock sl(&docdata_, TRUE);
+		write_lock wl(docrw_);
 
 		// Create temp file name
 		if ( (path_len = temp_name.ReverseFind('\\')) != -1 ||
@@ -849,8 +844,11 @@ BOOL CHexEditDoc::OnSaveDocument(LPCTSTR lpszPathName)
 				CRemoveHint rh(undo_.size() - 1);
 				UpdateAllViews(NULL, 0, &rh);
 				undo_.clear();
+				checkpoint_.clear();
 				loc_.clear();
 				loc_.push_back(doc_loc(FILE_ADDRESS(0), length_));
+				close_data_files();                    // No undo records refer to them now
+				journal_.remove();                     // Changes are now saved
 				// Reset change tracking
 				clear_change_tracking();
 				need_change_track_ = false;            // Signal that rebuild not required
@@ -877,67 +875,25 @@ BOOL CHexEditDoc::OnSaveDocument(LPCTSTR lpszPathName)
 			return FALSE;                       // already done: mac_error_ = 10
 	}
 
-	length_ = pfile1_->GetLength();
+	{
+		CSingleLock sl(&docdata_, TRUE);    // always locked before docrw_ (see HexEditDoc.h)
+		write_lock wl(docrw_);              // bg threads may be reading loc_
 
-	// Notify views to remove undo info up to the last doc undo
-	CRemoveHint rh(undo_.size() - 1);
-	UpdateAllViews(NULL, 0, &rh);
+		length_ = pfile1_->GetLength();
 
-	// Remove all undo info and just use all of new file as only loc record
-	undo_.clear();
-	loc_.clear();
-	loc_.push_back(doc_loc(FILE_ADDRESS(0), length_));
+		// Notify views to remove undo info up to the last doc undo
+		CRemoveHint rh(undo_.size() - 1);
+		UpdateAllViews(NULL, 0, &rh);
 
-	int ii;
-	// If we have data files open then close them
-	for (ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		if (data_file_[ii] != NULL)
-		{
-			CString ss = data_file_[ii]->CFile64::GetFilePath();  // save the file name in case we need to delete it
-			data_file_[ii]->Close();
-			delete data_file_[ii];
-			data_file_[ii] = NULL;
-			if (pthread2_ != NULL)
-			{
-				ASSERT(data_file2_[ii] != NULL);
-				data_file2_[ii]->Close();
-				delete data_file2_[ii];
-				data_file2_[ii] = NULL;
-			}
-			if (pthread3_ != NULL)
-			{
-				ASSERT(data_file3_[ii] != NULL);
-				data_file3_[ii]->Close();
-				delete data_file3_[ii];
-				data_file3_[ii] = NULL;
-			}
-			if (pthread4_ != NULL)
-			{
-				ASSERT(data_file4_[ii] != NULL);
-				data_file4_[ii]->Close();
-				delete data_file4_[ii];
-				data_file4_[ii] = NULL;
-			}
-			if (pthread5_ != NULL)
-			{
-				ASSERT(data_file5_[ii] != NULL);
-				data_file5_[ii]->Close();
-				delete data_file5_[ii];
-				data_file5_[ii] = NULL;
-			}
-			if (pthread6_ != NULL)
-			{
-				ASSERT(data_file6_[ii] != NULL);
-				data_file6_[ii]->Close();
-				delete data_file6_[ii];
-				data_file6_[ii] = NULL;
-			}
+		// Remove all undo info and just use all of new file as only loc record
+		undo_.clear();
+		checkpoint_.clear();
+		loc_.clear();
+		loc_.push_back(doc_loc(FILE_ADDRESS(0), length_));
 
-			// If the data file was a temp file remove it now it is closed
-			if (temp_file_[ii])
-				remove(ss);
-		}
+		// If we have data files open then close them
+		close_data_files();
+		journal_.remove();                  // Changes are now saved
 	}
 
 	// Reset change tracking
@@ -952,7 +908,7 @@ BOOL CHexEditDoc::OnSaveDocument(LPCTSTR lpszPathName)
 	// Update bookmarks
 	ASSERT(bm_index_.size() == bm_posn_.size());
 	CBookmarkList *pbl = theApp.GetBookmarkList();
-	for (ii = 0; ii < (int)bm_index_.size(); ++ii)
+	for (int ii = 0; ii < (int)bm_index_.size(); ++ii)
 	{
 		ASSERT(bm_index_[ii] < (int)pbl->filepos_.size());
 		pbl->filepos_[bm_index_[ii]] = bm_posn_[ii];
@@ -991,7 +947,7 @@ void CHexEditDoc::AddBookmark(int index, FILE_ADDRESS pos)
 	if (pp != bm_index_.end())
 	{
 		// We already have this bookmark so just update it
-		bm_posn_[pp-bm_index_.begin()] = pos;
+		bm_posn_.set(pp-bm_index_.begin(), pos);
 	}
 	else
 	{
@@ -1014,7 +970,7 @@ void CHexEditDoc::RemoveBookmark(int index)
 		// Remove from the doc's bookmark vectors
 		ASSERT(bm_index_.size() == bm_posn_.size());
 		bm_index_.erase(bm_index_.begin() + idx);
-		bm_posn_.erase(bm_posn_.begin() + idx);
+		bm_posn_.erase(idx);
 
 		// Invalidate bookmark rect in all views of this doc (redraws without the bookmark colour background)
 		CBookmarkHint bmh(address);
@@ -1029,9 +985,9 @@ void CHexEditDoc::RemoveBookmark(int index)
 // Returns bookmark index or -1 if no bookmark there
 int CHexEditDoc::GetBookmarkAt(FILE_ADDRESS pos)
 {
-	std::vector<FILE_ADDRESS>::const_iterator pp = std::find(bm_posn_.begin(), bm_posn_.end(), pos);
-	if (pp != bm_posn_.end())
-		return bm_index_[pp-bm_posn_.begin()];
+	int ii = bm_posn_.find(pos);
+	if (ii != -1)
+		return bm_index_[ii];
 	else
 		return -1;
 }
@@ -1055,6 +1011,10 @@ void CHexEditDoc::ClearBookmarks()
 // Temporarily close the file so we can do something with it
 void CHexEditDoc::close_file()
 {
+	// pfile1_ is also used by the background threads (see GetData)
+	CSingleLock sl(&docdata_, TRUE);
+	write_lock wl(docrw_);
+
 	// Close file if it was opened successfully
 	if (pfile1_ != NULL)
 	{
@@ -1062,35 +1022,12 @@ void CHexEditDoc::close_file()
 		delete pfile1_;
 		pfile1_ = NULL;
 	}
+	++file_gen_;                        // snapshots can't read from the file now
 
-	if (pthread2_ != NULL && pfile2_ != NULL)
-	{
-		pfile2_->Close();
-		delete pfile2_;
-		pfile2_ = NULL;
-	}
-	if (pthread3_ != NULL && pfile3_ != NULL)
-	{
-		pfile3_->Close();
-		delete pfile3_;
-		pfile3_ = NULL;
-	}
-	if (pthread4_ != NULL && pfile4_ != NULL)
+	if (pthread4_ != NULL && pfile1_compare_ != NULL)
 	{
 		CloseCompFile();
 	}
-	if (pthread5_ != NULL && pfile5_ != NULL)
-	{
-		pfile5_->Close();
-		delete pfile5_;
-		pfile5_ = NULL;
-	}
-	if (pthread6_ != NULL && pfile6_ != NULL)
-	{
-		pfile6_->Close();
-		delete pfile6_;
-		pfile6_ = NULL;
-	}
 }
 
 BOOL CHexEditDoc::open_file(LPCTSTR lpszPathName)
@@ -1233,96 +1170,17 @@ BOOL CHexEditDoc::open_file(LPCTSTR lpszPathName)
 		return FALSE;
 	}
 
-	// If doing background searches and the newly opened file is not the same
-	// as pfile2_ then close pfile2_ and open it as the new file.
-	if (pthread2_ != NULL && 
-		(pfile2_ == NULL || pfile1_->GetFilePath() != pfile2_->GetFilePath()) )
-	{
-		if (pfile2_ != NULL)
-		{
-			pfile2_->Close();
-			delete pfile2_;
-			pfile2_ = NULL;
-		}
+	// Read through memory mapped views unless another process can change the file
+	// (a mapped file can't be truncated) - see CFile64::EnableMapping
+	if (!shared_)
+		pfile1_->EnableMapping();
 
-		if (IsDevice())
-			pfile2_ = new CFileNC();
-		else
-			pfile2_ = new CFile64();
-		if (!pfile2_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE1("BG search file open failed for %p\n", this);
-			return FALSE;
-		}
-	}
-	if (pthread3_ != NULL && 
-		(pfile3_ == NULL || pfile1_->GetFilePath() != pfile3_->GetFilePath()) )
-	{
-		if (pfile3_ != NULL)
-		{
-			pfile3_->Close();
-			delete pfile3_;
-			pfile3_ = NULL;
-		}
-
-		if (IsDevice())
-			pfile3_ = new CFileNC();
-		else
-			pfile3_ = new CFile64();
-		if (!pfile3_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE1("BG aerial scan file open failed for %p\n", this);
-			return FALSE;
-		}
-	}
+	// Note: the background threads read from pfile1_ too (see GetData) except for the
+	// compare thread which has its own file(s) to compare with
 	if (pthread4_ != NULL)
 	{
 		OpenCompFile();
 	}
-	if (pthread5_ != NULL && 
-		(pfile5_ == NULL || pfile1_->GetFilePath() != pfile5_->GetFilePath()) )
-	{
-		if (pfile5_ != NULL)
-		{
-			pfile5_->Close();
-			delete pfile5_;
-			pfile5_ = NULL;
-		}
-
-		if (IsDevice())
-			pfile5_ = new CFileNC();
-		else
-			pfile5_ = new CFile64();
-		if (!pfile5_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE1("BG Stats file open failed for %p\n", this);
-			return FALSE;
-		}
-	}
-	if (pthread6_ != NULL && 
-		(pfile6_ == NULL || pfile1_->GetFilePath() != pfile6_->GetFilePath()) )
-	{
-		if (pfile6_ != NULL)
-		{
-			pfile6_->Close();
-			delete pfile6_;
-			pfile6_ = NULL;
-		}
-
-		if (IsDevice())
-			pfile6_ = new CFileNC();
-		else
-			pfile6_ = new CFile64();
-		if (!pfile6_->Open(pfile1_->GetFilePath(),
-					CFile::modeRead|CFile::shareDenyNone|CFile::typeBinary) )
-		{
-			TRACE1("BG preview scan file open failed for %p\n", this);
-			return FALSE;
-		}
-	}
 
 	GetInitialStatus();
 
@@ -1331,16 +1189,8 @@ BOOL CHexEditDoc::open_file(LPCTSTR lpszPathName)
 
 void CHexEditDoc::DeleteContents()
 {
-	// Close the file(s) associated with this document
-	if (pfile1_ != NULL)
-	{
-		pfile1_->Close();
-		delete pfile1_;
-		pfile1_ = NULL;
-	}
-
-	// KillAerialThread() and KillCompThread() are called here even though they are also killed when
-	// the last view is closed because we need to close the data files (data_file2_ and data_file3_).
+	// The threads are killed here (even though they are also killed when the last view is
+	// closed) since they use the file(s) we are about to close.
 	if (pthread2_ != NULL)
 		KillSearchThread();
 	if (pthread3_ != NULL)
@@ -1352,28 +1202,24 @@ void CHexEditDoc::DeleteContents()
 	if (pthread6_ != NULL)
 		KillPreviewThread();
 
+	// Close the file(s) associated with this document
+	if (pfile1_ != NULL)
+	{
+		pfile1_->Close();
+		delete pfile1_;
+		pfile1_ = NULL;
+	}
+
+	// Any changes have now been saved or the user chose not to save them, so the journal is
+	// only kept (to restore the changes when the file is next opened) if HexEdit crashes
+	journal_.remove();
+
 	undo_.clear();
-	loc_.clear();               // Done after thread killed so no docdata_ lock needed
+	checkpoint_.clear();
+	loc_.clear();               // Done after thread killed so no docrw_ lock needed
 	base_type_ = 0;
 
-	for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-	{
-		if (data_file_[ii] != NULL)
-		{
-			CString ss = data_file_[ii]->CFile64::GetFilePath();  // save the file name in case we need to delete it
-			data_file_[ii]->Close();
-			delete data_file_[ii];
-			data_file_[ii] = NULL;
-			// If the data file was a temp file remove it now it is closed
-			if (temp_file_[ii])
-				remove(ss);
-		}
-		ASSERT(data_file2_[ii] == NULL);  // should have been closed in KillSearchThread() call
-		ASSERT(data_file3_[ii] == NULL);  // should have been closed in KillAerialThread() call
-		ASSERT(data_file4_[ii] == NULL);  // should have been closed in KillCompThread() call
-		ASSERT(data_file5_[ii] == NULL);  // should have been closed in KillStatsThread() call
-		ASSERT(data_file6_[ii] == NULL);  // should have been closed in KillPreviewThread()
-	}
+	close_data_files();
 
 	// Reset change tracking
 	clear_change_tracking();
@@ -1435,8 +1281,11 @@ void CHexEditDoc::CheckBGProcessing()
 			if (status.m_size != prev_size_)
 			{
 				// Adjust file length
+				CSingleLock sl(&docdata_, TRUE);
+				write_lock wl(docrw_);
 				length_ += status.m_size - prev_size_;
 				regenerate();
+				++file_gen_;            // file data has moved so any snapshot is no longer valid
 
 				prev_size_ = status.m_size;
 			}
@@ -1447,6 +1296,8 @@ void CHexEditDoc::CheckBGProcessing()
 		}
 	}
 
+	spill_undo();               // Keep memory used for undo data within budget
+
 	// First check if bg processing needs to be restarted due to file changes
 	if (doc_changed_)
 	{
@@ -1702,6 +1553,7 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 
 	// Work out if data is stored on disk (or in memory) and what the file name is
 	bool write_file = false;        // Write to file (user wants to or too big for memory)
+	bool use_pattern = false;       // Nothing is written - bytes are generated as needed (see CPatternFile)
 	CString file_name;
 
 	if (pview == NULL)
@@ -1731,6 +1583,13 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 		ASSERT(pview == NULL);          // create_on_disk option can only be on for new file
 		base_type_ = 0;					// base is the file
 	}
+	else if (file_len > 8*1024*1024 && fill_bits.type != CNewFile::FILL_RANDOM)
+	{
+		// Big block of a repeated pattern (or zeroes) - no need to store it anywhere
+		use_pattern = true;
+		if (pview == NULL)
+			base_type_ = 2;					// base is pattern "file"
+	}
 	else if (file_len > 8*1024*1024)
 	{
 		// Create a temp file
@@ -1769,6 +1628,10 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 		if (num_copies < 1) num_copies = 1;
 		buf_len = data_len*num_copies;
 	}
+	else if (use_pattern)
+	{
+		buf_len = data_len;             // just one copy of the pattern
+	}
 	else
 	{
 		// allocate a block big enough for all the data (to be kept in memory)
@@ -1920,6 +1783,7 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 	}
 	ASSERT(psrc != NULL || fill_bits.type == CNewFile::FILL_RANDOM);
 
+	bool zero = false;              // Are all the bytes zero?
 	if (psrc != NULL)
 	{
 		if (data_len == 1)
@@ -1927,6 +1791,7 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 		else
 			for (pout = buf; pout < buf + buf_len; pout += data_len)
 				memcpy(pout, psrc, std::min(data_len, buf_len - (pout - buf)));
+		zero = size_t(std::count(psrc, psrc + data_len, '\0')) == data_len;
 	}
 
 	// Tidy up temp buffers etc
@@ -1958,7 +1823,15 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 			// Write out the file
 			FILE_ADDRESS num_out;
 			FILE_ADDRESS towrite;
-			for (num_out = 0; num_out < file_len; num_out += towrite)
+			if (zero)
+			{
+				// Rather than writing all the zeroes just make a sparse file of the right length
+				// (if the file system can't do sparse files it fills it with zeroes for us)
+				DWORD dummy;
+				::DeviceIoControl(pfile->GetHandle(), FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &dummy, NULL);
+				pfile->SetLength(file_len);
+			}
+			for (num_out = zero ? file_len : 0; num_out < file_len; num_out += towrite)
 			{
 				towrite = std::min((FILE_ADDRESS)buf_len, file_len - num_out);
 				if (fill_bits.type == CNewFile::FILL_RANDOM)
@@ -1998,7 +1871,7 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 				return -1;              // open_file has already set mac_error_ = 10
 
 			length_ = file_len;
-			ASSERT(pthread2_ == NULL && pthread3_ == NULL && pthread4_ == NULL && pthread5_ == NULL && pthread6_ == NULL);   // Must modify loc_ before creating threads (else docdata_ needs to be locked)
+			ASSERT(pthread2_ == NULL && pthread3_ == NULL && pthread4_ == NULL && pthread5_ == NULL && pthread6_ == NULL);   // Must modify loc_ before creating threads (else docrw_ needs to be locked)
 			loc_.push_back(doc_loc(FILE_ADDRESS(0), file_len));
 
 			// Get status as when the file was created on disk
@@ -2015,19 +1888,15 @@ FILE_ADDRESS CHexEditDoc::insert_block(FILE_ADDRESS addr, _int64 params, const c
 		{
 			// Set up the file as a temp data file
 			int idx = AddDataFile(file_name, TRUE);
-			if (idx == -1)
-			{
-				TaskMessageBox("Too Many Temporary Files",
-					"To insert a large file HexEdit needs to create a temporary "
-					"file but has run out of temporary file handles.\n\n"
-					"Please save the file to deallocate "
-					"temporary file handles and try again.");
-				theApp.mac_error_ = 10;
-				return -1;
-			}
 			Change(mod_insert_file, addr, file_len, NULL, idx, pview);
 		}
 	}
+	else if (use_pattern)
+	{
+		// Add pattern "file"
+		int idx = AddPattern((const unsigned char *)buf, data_len, file_len);
+		Change(mod_insert_file, addr, file_len, NULL, idx, pview);
+	}
 	else
 	{
 		// Add memory block
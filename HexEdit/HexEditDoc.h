@@ -19,11 +19,23 @@
 #include <deque>
 #include <list>
 #include <set>
+#include <map>
 #include <algorithm>
 #include <afxmt.h>              // For MFC IPC (CEvent etc)
 #include <boost/tuple/tuple.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "CFile64.h"
+#include "FileMap.h"
+#include "DataFileTable.h"
+#include "LocTree.h"
+#include "UndoArena.h"
+#include "DocUndo.h"
+#include "EditLog.h"
+#include "EditJournal.h"
+#include "BookmarkPosns.h"
+#include "ChangeTrack.h"
+#include "RWLock.h"
 #include <FreeImage.h>
 #include "xmltree.h"
 #include "expr.h"
@@ -31,21 +43,6 @@
 
 using namespace std;
 
-// This enum is for the different modification types that can be made
-// to the document.  It is used for keeping track of changes made in the
-// undo array and for passing info about changes made to views.
-enum mod_type
-{
-	mod_unknown = '0',          // Helps bug detection
-	mod_insert  = 'I',          // Bytes inserted
-	mod_replace = 'R',          // Bytes replaced (overtyped)
-	mod_delforw = 'D',          // Bytes deleted (using DEL)
-	mod_delback = 'B',          // Bytes deleted (using back space)
-	mod_repback = '<',          // Replace back (BS in overtype mode)
-	mod_insert_file = 'F',      // Bytes inserted - requires index into data_file_[]
-};
-
-
 enum view_t { none, splitter, tabbed };
 
 // Hint objects (passed to views via OnUpdate)
@@ -77,13 +74,20 @@ public:
 	BOOL is_undo;               // True if undoing
 	BOOL ptoo;                  // Merge with previous op on undo stack (if not undoing)
 
+	// For a batch of changes (see CHexEditDoc::CommitBatch) there is one hint for all of them.
+	// Then utype/address/len just give the area affected, pbatch has the individual changes,
+	// and count undo records (from index) were added which are undone together.
+	const std::vector<batch_change> *pbatch;
+	int count;
+
 	// Default and proper constructor
-	CHexHint() { utype = mod_unknown; }
+	CHexHint() { utype = mod_unknown; pbatch = NULL; count = 1; }
 	CHexHint(enum mod_type u, FILE_ADDRESS n, FILE_ADDRESS a, CView *v, int i, BOOL f = FALSE, BOOL p = FALSE)
 	{
 		ASSERT(u == mod_insert  || u == mod_insert_file || u == mod_replace ||
 			   u == mod_delforw || u == mod_delback     || u == mod_repback);
 		utype = u; len = n; address = a; pview = v; index = i; is_undo = f; ptoo = p;
+		pbatch = NULL; count = 1;
 	}
 
 protected:
@@ -232,158 +236,63 @@ protected:
 };
 
 
-// These structures used to be declared within class CHexEditDoc but with
-// VC++ 5 you get errors when used in <vector> and <list>
-
-// These structures are used to easily access the current doc data
-struct doc_loc
+// A version of the document contents that does not change when the document is
+// edited - see CHexEditDoc::TakeSnapshot.  Background threads scan a snapshot so
+// that the user can keep making changes while they finish what they are doing.
+struct doc_snapshot
 {
-	static const FILE_ADDRESS mask;      // masks off the top 2 bits of dlen
-	static const FILE_ADDRESS fmask;     // masks off the top bits of fileaddr
-	static const int max_data_files;     // must match fmask (eg if fmask removes 3 bits should be <= 8)
+	doc_snapshot() : length(0), edit(0), file_gen(0), active(false) { }
 
-	// Location type is now stored in the top 2 bits of dlen (0=unknown, 1=orig file, 2=memory, 3=other file)
-	unsigned __int64 dlen;               // Data block len - needs to be as big as a file can be
-	union
-	{
-		// If location type == 3 then the top bits store the file number (index into data_file_ etc)
-		FILE_ADDRESS fileaddr;  // File location (if file) + top 2 bits = data_file_ idx if location == 3
-		unsigned char *memaddr; // Ptr to data (if mem)
-	};
-	doc_loc(FILE_ADDRESS f, unsigned __int64 n)
-	{
-//        location = loc_file;
-		ASSERT(FILE_ADDRESS(n) <= mask);
-		dlen = n | (unsigned __int64(1) << 62);  // 1 = orig file
-		fileaddr = f;
-	}
-	doc_loc(unsigned char *m, unsigned __int64 n)
-	{
-//        location = loc_mem;
-		ASSERT(FILE_ADDRESS(n) <= mask);
-		dlen = n | (unsigned __int64(2) << 62); // 2 = memory
-		memaddr = m;
-	}
-	doc_loc(FILE_ADDRESS f, unsigned __int64 n, int idx)
+	loc_tree loc;                       // Location records (shares nodes with CHexEditDoc::loc_)
+	FILE_ADDRESS length;                // Length of the document
+	unsigned edit;                      // Version of the document (number of changes - see edit_log)
+	unsigned file_gen;                  // Value of CHexEditDoc::file_gen_ (to check the file is still the same)
+	bool active;                        // Taken and not yet released?
+
+	void swap(doc_snapshot &other)
 	{
-		ASSERT(FILE_ADDRESS(n) <= mask);
-		ASSERT(FILE_ADDRESS(f) <= fmask);
-		ASSERT(idx >= 0 && idx < max_data_files);
-		dlen = n | (unsigned __int64(3) << 62);  // 3 = data file
-		fileaddr = f | (FILE_ADDRESS(idx) << 62);  // Note: must change when fmask/max_data_files change
+		loc.swap(other.loc);
+		std::swap(length, other.length);
+		std::swap(edit, other.edit);
+		std::swap(file_gen, other.file_gen);
+		std::swap(active, other.active);
 	}
 
 private:
-	doc_loc();                          // Default constructor (not used)
+	doc_snapshot(const doc_snapshot &);     // not copyable (use TakeSnapshot)
+	doc_snapshot &operator=(const doc_snapshot &);
 };
 
-// These structures are used to keep track of all changes made to the doc
-struct doc_undo
+// Keeps the bytes that CHexEditDoc::GetSpan points to valid until it is released (or
+// passed to GetSpan again).  Bytes of a file are used in place in a mapped view of the
+// file, so the view is pinned (see file_map::pin) and a read lock is kept on the
+// document so that the file is not written or remapped (eg by WriteInPlace).
+// Since it may hold the read lock a span must be released before the thread locks
+// docdata_ (which is locked before docrw_) or changes the document.
+class doc_span
 {
-	// static const size_t limit; // replaced with theApp.undo_limit_
-	enum mod_type utype;                // Type of modification made to file
-	union
-	{
-		unsigned char *ptr;             // NULL if utype is del else new data
-		int idx;						// date_file_[] index if utype == mod_insert_file
-	};
-	FILE_ADDRESS address;               // Address in file of start of mod
-	FILE_ADDRESS len;                   // Length of mod
-
-	// Normal constructor
-	doc_undo(mod_type u, FILE_ADDRESS a, FILE_ADDRESS n, unsigned char *p = NULL, int i = -1)
-	{
-		ASSERT(u == mod_insert  || u == mod_insert_file || u == mod_replace ||
-			   u == mod_delforw || u == mod_delback     || u == mod_repback);
-
-		utype = u; len = n; address = a;
-		if (utype == mod_insert_file)
-		{
-			ASSERT(i >= 0 && i < doc_loc::max_data_files);
-			idx = i;
-		}
-		else if (p != NULL)
-		{
-			ASSERT(len < 0x100000000);
-			ptr = new unsigned char[max(theApp.undo_limit_, int(len))];
-			memcpy(ptr, p, size_t(len));
-		}
-		else
-		{
-			ASSERT(utype == mod_delforw || utype == mod_delback);
-			ptr = NULL;
-		}
-	}
-	// Copy constructor
-	doc_undo(const doc_undo &from)
-	{
-		ASSERT(from.utype != mod_unknown);
-		utype = from.utype;
-		len = from.len;
-		address = from.address;
-		if (utype == mod_insert_file)
-		{
-			ASSERT(from.idx >= 0 && from.idx < doc_loc::max_data_files);
-			idx = from.idx;
-		}
-		else if (from.ptr != NULL)
-		{
-			ASSERT(len < 0x100000000);
-			ptr = new unsigned char[max(theApp.undo_limit_, int(len))];
-			memcpy(ptr, from.ptr, size_t(len));
-		}
-		else
-			ptr = NULL;
-	}
-	// Copy assignment operator
-	doc_undo &operator=(const doc_undo &from)
-	{
-		if (&from != this)
-		{
-			ASSERT(from.utype != mod_unknown);
-			if (ptr != NULL)
-				delete[] ptr;
-
-			utype = from.utype;
-			len = from.len;
-			address = from.address;
-
-			if (utype == mod_insert_file)
-			{
-				ASSERT(from.idx >= 0 && from.idx < doc_loc::max_data_files);
-				idx = from.idx;
-			}
-			else if (from.ptr != NULL)
-			{
-				ASSERT(len < 0x100000000);
-				ptr = new unsigned char[max(theApp.undo_limit_, int(len))];
-				memcpy(ptr, from.ptr, size_t(len));
-			}
-			else
-				ptr = NULL;
-		}
-		return *this;
-	}
-	~doc_undo()
+public:
+	doc_span() : plock_(NULL), pmap_(NULL), pview_(NULL) { }
+	~doc_span() { release(); }
+	void release()
 	{
-		ASSERT(utype != mod_unknown);
-		if (utype != mod_insert_file && ptr != NULL)
-			delete[] ptr;
+		if (pview_ != NULL)
+			pmap_->unpin(pview_);
+		if (plock_ != NULL)
+			plock_->unlock_shared();
+		plock_ = NULL;
+		pmap_ = NULL;
+		pview_ = NULL;
 	}
 
-	// vector requires a default constructor (even if not used)
-//    doc_undo() { utype = mod_unknown; }
-//    operator==(const doc_undo &) const { return false; }
-//    operator<(const doc_undo &) const { return false; }
-};
+private:
+	friend class CHexEditDoc;
+	doc_span(const doc_span &);         // not copyable
+	doc_span &operator=(const doc_span &);
 
-struct adjustment
-{
-	adjustment(FILE_ADDRESS ss, FILE_ADDRESS ee, FILE_ADDRESS address, FILE_ADDRESS aa)
-	{ start_ = ss; end_ = ee; address_ = address; adjust_ = aa; }
-	FILE_ADDRESS start_, end_;
-	FILE_ADDRESS address_;
-	FILE_ADDRESS adjust_;
+	rw_lock *plock_;                    // Read lock held (or NULL)
+	file_map *pmap_;                    // Map of the file that the bytes are in
+	file_map::view *pview_;             // Pinned view (or NULL if the bytes are not from a file)
 };
 
 // Class derived from expr_eval so we can supply our own symbols (by overriding find_symbol)
@@ -431,17 +340,17 @@ public:
 	pair<std::vector<FILE_ADDRESS> *, std::vector<FILE_ADDRESS> *> Replacements()
 	{
 		if (need_change_track_) rebuild_change_tracking();
-		return make_pair(&replace_addr_, &replace_len_);
+		return make_pair(&replace_.addr, &replace_.len);
 	}
 	pair<std::vector<FILE_ADDRESS> *, std::vector<FILE_ADDRESS> *> Insertions()
 	{
 		if (need_change_track_) rebuild_change_tracking();
-		return make_pair(&insert_addr_, &insert_len_);
+		return make_pair(&insert_.addr, &insert_.len);
 	}
 	pair<std::vector<FILE_ADDRESS> *, std::vector<FILE_ADDRESS> *> Deletions()
 	{
 		if (need_change_track_) rebuild_change_tracking();
-		return make_pair(&delete_addr_, &delete_len_);
+		return make_pair(&delete_.addr, &delete_.len);
 	}
 
 	const char *why0() const
@@ -480,28 +389,68 @@ public:
 			return bm_posn_[pp - bm_index_.begin()];
 	}
 	std::vector<int> bm_index_;             // Handle for all bookmarks in this file
-	std::vector<FILE_ADDRESS> bm_posn_;     // File positions of the bookmarks
+	bookmark_posns bm_posn_;                // File positions of the bookmarks
 
 	CXmlTree *ptree_;
 	int xml_file_num_;                      // Index into theApp.xml_file_name_ of current XML file or -1
 
 // Operations
-	size_t GetData(unsigned char *buf, size_t len, FILE_ADDRESS loc, int use_bg = -1);
+	// GetData etc can be used from any thread.  pfile is only needed to read the
+	// original file data from a different copy of the file (see pfile4_).
+	size_t GetData(unsigned char *buf, size_t len, FILE_ADDRESS loc)
+	{
+		doc_cursor cursor;
+		return GetData(buf, len, loc, cursor);
+	}
+	size_t GetData(unsigned char *buf, size_t len, FILE_ADDRESS loc, doc_cursor &cursor, CFile64 *pfile = NULL);
+	size_t GetSpan(const unsigned char *&ptr, unsigned char *scratch, size_t scratch_len,
+	               FILE_ADDRESS start, FILE_ADDRESS end, doc_cursor &cursor, doc_span &span, CFile64 *pfile = NULL);
+
+	// Background threads read a snapshot of the document so they see the same version
+	// for the whole of a scan, even though the user may be changing the document.  Reading
+	// a snapshot returns 0 bytes if it is stale (the file it uses has been closed or changed
+	// eg when the document is saved).  Memory returned by GetSpan stays valid until the
+	// span is released (and the snapshot must not be released before then).  Snapshots should be released as soon as they are not needed.
+	// MapAddress gives where len bytes at address in the snapshot now are (-1 if changed)
+	// and SnapshotDiff works out which bytes are different between two snapshots (returns
+	// false if that is no longer known).
+	void TakeSnapshot(doc_snapshot &snap);
+	void ReleaseSnapshot(doc_snapshot &snap);
+	bool SnapshotStale(const doc_snapshot &snap) const;
+	bool SnapshotCurrent(const doc_snapshot &snap) const;  // No changes made since the snapshot?
+	unsigned EditCount() const;         // Current version of the document (see edit_log::count)
+	size_t GetData(unsigned char *buf, size_t len, FILE_ADDRESS loc, doc_cursor &cursor,
+	               const doc_snapshot &snap, CFile64 *pfile = NULL);
+	size_t GetSpan(const unsigned char *&ptr, unsigned char *scratch, size_t scratch_len,
+	               FILE_ADDRESS start, FILE_ADDRESS end, doc_cursor &cursor, doc_span &span,
+	               const doc_snapshot &snap);
+	FILE_ADDRESS MapAddress(const doc_snapshot &snap, FILE_ADDRESS address, FILE_ADDRESS len) const;
+	bool SnapshotDiff(const doc_snapshot &from, const doc_snapshot &to,
+	                  std::vector<edit_log::range> &removed, std::vector<edit_log::range> &added) const;
+
 	BOOL WriteData(const CString fname, FILE_ADDRESS start, FILE_ADDRESS end, BOOL append = FALSE);
 	void WriteInPlace();
 	void Change(enum mod_type, FILE_ADDRESS address, FILE_ADDRESS len,
 				unsigned char *buf, int, CView *pview, BOOL ptoo=FALSE);
 	BOOL Undo(CView *pview, int index, BOOL same_view);
 
-	int AddDataFile(LPCTSTR name, BOOL temp = FALSE); // returns index where file is or -1 if no more slots available
-	BOOL DataFileSlotFree()
-	{
-		for (int ii = 0; ii < doc_loc::max_data_files; ++ii)
-			if (data_file_[ii] == NULL)
-				return TRUE;  // found a free slot
-		return FALSE;
-	}
+	// Many changes (eg Replace All) can be made as a batch: between BeginBatch and CommitBatch each
+	// Change updates the data but views, bg search etc are only told when the batch is committed.
+	// The changes are then undone as one operation.  Note that views do not see the changes until
+	// then so the caller must not use view positions etc until the batch is committed.
+	void BeginBatch();
+	void CommitBatch();
+	bool InBatch() const { return batch_level_ > 0; }
+
+	// Replaces len bytes at every address in found (ascending, not overlapping, addresses before
+	// any replacement is made) with the replen bytes at rep, as one batch (see BeginBatch).
+	void ReplaceAll(const std::vector<FILE_ADDRESS> &found, FILE_ADDRESS len,
+					const unsigned char *rep, size_t replen, CView *pview);
+
+	int AddDataFile(LPCTSTR name, BOOL temp = FALSE); // returns index where file is (there is no limit on the number of files)
+	int AddPattern(const unsigned char *pat, size_t len, FILE_ADDRESS total); // data file of a repeated pattern (see PatternFile.h)
 	void RemoveDataFile(int idx);                     // frees a slot when file no longer used (and deletes temp file)
+	bool UseTempFile(FILE_ADDRESS len) const;         // should len bytes of new data go in a temp file (not memory)?
 
 	HICON GetIcon() { return hicon_; }
 
@@ -583,7 +532,7 @@ public:  // These really should be private but are called from SendEmail
 
 private:
 // Private member functions
-	void regenerate();      // Rebuild loc_ list from undo_ array
+	void regenerate(size_t from = 0);   // Rebuild loc_ list using the undo_ array (only records from "from" on have changed)
 	BOOL only_over();       // Check if file can be saved in place
 
 	bool ask_insert();      // Allow the user to insert a block
@@ -591,32 +540,71 @@ private:
 
 	// The following are used to modify the locations list (loc_)
 	typedef std::vector <doc_undo>::const_iterator pundo_t;
-	typedef std::list <doc_loc>::iterator ploc_t;
-	void loc_add(pundo_t pu, FILE_ADDRESS &pos, ploc_t &pl);
-	void loc_del(FILE_ADDRESS address, FILE_ADDRESS len, FILE_ADDRESS &pos, ploc_t &pl);
-	void loc_split(FILE_ADDRESS address, FILE_ADDRESS pos, ploc_t pl);
-
-	// We allow up to 4 external files to hold some of the file data (if too big for memory)
-	CFile64 *data_file_[4 /*doc_loc::max_data_files*/];     // Ptrs to files or NULL if not (yet) used
-	CFile64 *data_file2_[4 /*doc_loc::max_data_files*/];    // Ptrs to dupes for use by background search thread
-	CFile64 *data_file3_[4 /*doc_loc::max_data_files*/];    // Ptrs to dupes for use by background aerial thread
-	CFile64 *data_file4_[4 /*doc_loc::max_data_files*/];    // Ptrs to dupes for use by background compare thread
-	CFile64 *data_file5_[4 /*doc_loc::max_data_files*/];    // Ptrs to dupes for use by background stats thread
-	CFile64 *data_file6_[4 /*doc_loc::max_data_files*/];    // Ptrs to dupes for use by preview thread
-	BOOL temp_file_[4 /*doc_loc::max_data_files*/];         // Says if the file is temporary (should be deleted when doc closed)
+	typedef loc_tree::iterator ploc_t;
+	size_t read_data(const loc_tree &loc, unsigned char *buf, size_t len, FILE_ADDRESS address,
+	                 doc_cursor &cursor, CFile64 *pfile);  // Read from loc (docrw_ must be locked)
+	size_t read_span(const loc_tree &loc, const unsigned char *&ptr, unsigned char *scratch, size_t scratch_len,
+	                 FILE_ADDRESS address, FILE_ADDRESS end, doc_cursor &cursor, doc_span &span, CFile64 *pfile);
+	void loc_del(FILE_ADDRESS address, FILE_ADDRESS len, loc_tree *removed = NULL);
+	void loc_split(FILE_ADDRESS address);
+	void loc_apply(doc_undo &uu) { ::loc_apply(uu, loc_, uu.removed); }  // Update loc_ for a new change (see DocUndo.h)
+	void set_checkpoint(size_t count);  // Update checkpoint_ after loc_apply of undo_[count-1]
+	void loc_revert(doc_undo &uu) { ::loc_revert(uu, loc_); }  // Restore loc_ to how it was before loc_apply(uu)
+#ifdef _DEBUG
+	void loc_check();                   // Check that loc_ matches what regenerate() would build
+#endif
+
+	// External files that hold some of the file data (if too big for memory) - see DataFileTable.h.
+	// A file is released once no undo record (in_file()) refers to it - see Undo and regenerate.
+	// Note: these are shared by all threads (see GetData) so only read them using ReadAt()
+	data_file_table data_file_;
+	void close_data_files();            // Close (and delete temp) data files when all undo info is discarded
+	void close_data_file(int idx);      // Does the work of RemoveDataFile (docrw_ must be write locked)
+	int add_data_file(CFile64 *pf, BOOL temp);  // Puts an open data file in a free slot of data_file_
+	FILE_ADDRESS zero_run(FILE_ADDRESS address, FILE_ADDRESS end);  // Zero bytes from a pattern (see WriteData)
+
+	// Batch of changes (see BeginBatch)
+	int batch_level_;                   // Nesting of BeginBatch calls (0 = not in a batch)
+	size_t batch_first_;                // Number of undo records before the batch
+	std::vector<batch_change> batch_;   // Changes made so far
+	CView *batch_view_;                 // View that made the first change
+	BOOL batch_ptoo_;                   // Is the batch merged with the previous op (ptoo of first change)
+	void bg_search_change(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS clen, bool rescan = false);
+
+	// Memory governor: the undo data (which all memory records of loc_ point into) is kept to
+	// about undo_budget_ bytes by moving the data of the oldest undo records to a temp data
+	// file (see spill_undo).  Commands that create a lot of data ask UseTempFile() first.
+	size_t undo_budget_;                // Memory that undo data may use before spilling
+	size_t spill_tried_;                // Memory used after the last spill (so we don't keep trying)
+	bool saving_;                       // WriteInPlace is using the undo data (which must not be moved)
+	void spill_undo();                  // Move old undo data to a temp file if over budget (called when idle)
+
+	// Unsaved changes are kept in a journal file if the EditJournal option is on (see EditJournal.h)
+	edit_journal journal_;
+	void journal_change(size_t idx, bool merged);  // Add an undo record to the journal
+	void journal_undo();                // Note that the last undo record was undone
+	void replay_journal();              // Restore changes from a previous session
+
+	// Snapshots (see TakeSnapshot) - these are protected by docrw_
+	std::multiset<unsigned> snapshots_; // Versions (see edit_log::count) of snapshots in use
+	edit_log edits_;                    // Changes made while there are snapshots (to map their addresses)
+	unsigned file_gen_;                 // Incremented when file data is no longer where loc_ records said
+	std::vector<pair<unsigned, int> > remove_pending_;  // Data files to close once older snapshots are released (first = tag)
+	void note_change(FILE_ADDRESS address, FILE_ADDRESS removed, FILE_ADDRESS inserted);
+	void free_snapshot_data();          // Free things that only released snapshots used
+
+	// There are 3 types of changes we track: insertions, deletions and replacements.
+	// All the changes of a certain type are stored in a change_list (see ChangeTrack.h).
+	change_list replace_, insert_, delete_;
 
 	// The following are used for change tracking
 	bool need_change_track_;               // Do change tracking structures need rebuilding
-	void rebuild_change_tracking();        // Rebuilds replace_addr_, replace_len_, insert_addr_, etc
+	void rebuild_change_tracking();        // Rebuilds replace_, insert_ and delete_
+	void update_change_tracking(FILE_ADDRESS address, FILE_ADDRESS inserted, FILE_ADDRESS delta);
 	void clear_change_tracking();          // Clears the same vectors
 	void send_change_hint(FILE_ADDRESS address); // Invalidate change tracking areas of display
 	int base_type_;  // Determines what we compare against 0=orig file, 1=mem blk, 2=temp file
-
-	// There are 3 types of changes we track: insertions, deletions and replacements.
-	// All the changes of a certain type are stored in 2 vectors (address and length)
-	std::vector<FILE_ADDRESS> replace_addr_, replace_len_;
-	std::vector<FILE_ADDRESS> insert_addr_, insert_len_;
-	std::vector<FILE_ADDRESS> delete_addr_, delete_len_;
+	change_tracker tracker();              // Works out changes from loc_ compared to the base
 
 	void load_icon(LPCTSTR lpszPathName); // Load icon based on file ext. into hicon_
 	void show_icon();           // Show icon in child frame windows of views
@@ -648,10 +636,17 @@ private:
 	CView *last_view_;          // Last view that caused change to document
 
 	// Array of changes made to file (last change at end)
+	undo_arena undo_arena_;     // Memory for undo data (must be declared before undo_)
 	std::vector <doc_undo> undo_;
 
 	// List of locations of where to find doc data (disk file/memory)
-	std::list <doc_loc> loc_;
+	loc_tree loc_;
+
+	// Copies of loc_ made as changes are applied so that regenerate() can start part way
+	// through undo_.  checkpoint_[k] is loc_ after the first (k+1)*checkpoint_every changes.
+	// These are cheap since they share nodes with loc_ (see LocTree.h).
+	enum { checkpoint_every = 256 };
+	std::vector<loc_tree> checkpoint_;
 
 public:
 	void CheckBGProcessing();   // check if bg searching or bg scan has finished
@@ -672,7 +667,7 @@ public:
 							  BOOL icase, int tt, BOOL wholeword,
 							  int alignment, int offset, bool align_rel, FILE_ADDRESS base_addr,
 							  FILE_ADDRESS from);
-	std::vector<FILE_ADDRESS> SearchAddresses(FILE_ADDRESS start, FILE_ADDRESS end);
+	std::vector<FILE_ADDRESS> SearchAddresses(FILE_ADDRESS start, FILE_ADDRESS end, std::vector<int> *pids = NULL);
 	int SearchProgress(int &occurrences);  // How far are we through the background search now (0 to 100)
 
 	FILE_ADDRESS base_addr_;    // Base address for alignment tests. It is not stored in app (with alignment_ et al as it is per doc - set from mark or SOF in active view)
@@ -680,7 +675,7 @@ public:
 	// Background scan (for aerial views etc)
 	void AddAerialView(CHexEditView *pview);
 	void RemoveAerialView();
-	void AerialChange(CHexEditView *pview = NULL);  // Signal bg thread to re-scan
+	void AerialChange(CHexEditView *pview = NULL);  // Signal bg thread to update the bitmap
 	UINT RunAerialThread();     // Main func in bg thread
 	int AerialProgress();       // 0 to 100 (or -1 if not scanning)
 
@@ -784,7 +779,7 @@ public:
 	// Background stats thread (BGstats.cpp)
 	void AlohaStats();        // create/kill stats thread as appropriate
 	bool CanDoStats();        // Check several conditions to decide if we can do background stats scan
-	void StatsChange();       // Signal stats thread to rescan (eg when doc changed)
+	void StatsChange();       // Signal stats thread to update (eg when doc changed)
 	UINT RunStatsThread();    // Main func in bg thread (needs to be public so it can be called from bg_func)
 	void StartStats();
 	void StopStats();
@@ -921,12 +916,11 @@ private:
 
 	CEvent start_search_event_; // Signal to bg thread to start a new search, or check for termination
 
-	mutable CCriticalSection docdata_;  // Protects access in threads to document data (loc_) file and find data below.
-								// Note that this is used for read access of the document from the bg
-								// threads or write (but not read) access from the primary thread. This
-								// stops the bg thread accessing the data while it is being updated.
-	CFile64 *pfile2_;           // We need a copy of file_ so we can access the same file for searching
-	// Also see data_file2_ (above)
+	mutable CCriticalSection docdata_;  // Protects access in threads to the find data etc below
+	mutable rw_lock docrw_;     // Protects the document data (loc_, undo_, pfile1_, data_file_, snapshots_ etc)
+								// Any number of threads can read the document (GetData etc take a
+								// read lock) but the primary thread takes a write lock to change it.
+								// If both are needed docdata_ must be locked first (else deadlock).
 	enum BG_COMMAND search_command_; // signals search thread to do something
 	enum BG_STATE   search_state_;   // indicates what the search thread is doing
 	bool search_fin_;           // Flags that the bg search is finished and the view need updating
@@ -935,9 +929,8 @@ private:
 
 	// List of ranges to search in background (first = start, second = byte past end)
 	std::list<pair<FILE_ADDRESS, FILE_ADDRESS> > to_search_;
-	std::set<FILE_ADDRESS> found_;      // Addresses where current search text was found
-	// List of adjustments pending due to insertions/deletions (first = address, second = adjustment amount)
-	std::list<adjustment> to_adjust_;
+	std::map<FILE_ADDRESS, int> found_; // Addresses where current search text was found (with the pattern id - see boyer::patterns())
+	doc_snapshot search_snap_;          // Version of the doc being searched (for the front of to_search_)
 
 	FILE_ADDRESS find_total_;   // Total number of bytes for background search (so that progress bar is drawn properly)
 	double find_done_;          // This is how far the bg search has progressed in searching the top entry of to_search_ list
@@ -952,6 +945,8 @@ private:
 	enum BG_COMMAND aerial_command_;
 	enum BG_STATE   aerial_state_;
 	bool aerial_fin_;           // Flags that the bg scan is finished and the view needs updating
+	bool aerial_rescan_;        // Scan the whole doc (else only what has changed since aerial_snap_)
+	doc_snapshot aerial_snap_;  // Version of the doc that the bitmap shows (or is being built from)
 	unsigned char *aerial_buf_; // Buffer used for holding file data for scan
 
 	FILE_ADDRESS aerial_addr_;  // Current address we are processing (used to show progress)
@@ -959,8 +954,6 @@ private:
 	// NOTE: kala must not be modified while the bg thread is running!
 	std::vector<COLORREF> kala_;// 256 colours from the first hex view for use in aerial view
 
-	CFile64 *pfile3_;           // Using a copy of the file avoids synchronising access problems
-	// Also see data_file3_ (above)
 	int av_count_;              // Number of aerial views of this document
 	int bpe_;                   // Bytes per bitmap pixel (1 to 65536)
 	FIBITMAP *dib_;             // The FreeImage bitmap
@@ -996,8 +989,6 @@ private:
 	unsigned preview_file_width_;
 	unsigned preview_file_height_;
 
-	CFile64 *pfile6_;            // Using a copy of the file avoids synchronising access problems
-	// Also see data_file6_ (above)
 	int preview_count_;          // Number of preview views of this document
 	FIBITMAP *preview_dib_;      // The FreeImage bitmap used for the preview
 
@@ -1006,8 +997,7 @@ private:
 	bool PreviewProcessStop();   // Check if the scanning should stop
 
 	// -------------- file compare (see BGCompare.cpp) -----------------
-	CFile64 *pfile4_;           // Copy of the original file (avoids synchronising access)
-	// Also see data_file4_ (above)
+	CFile64 *pfile4_;           // Copy of the original file when doing a self-compare (else NULL)
 	CFile64 *pfile1_compare_, *pfile4_compare_;   // The file we are comparing with (for fg + bg threads)
 	CString compFileName_;      // Name of file comparing with (or last compare file)
 	int compMinMatch_;          // Min number of match bytes when searching for insertions/deletions (min 7, or 0 if insertions/deletions not allowed)
@@ -1027,6 +1017,7 @@ private:
 	enum BG_STATE   comp_state_;
 	enum BG_COMMAND comp_command_;
 	bool comp_fin_;             // Flags that the bg scan is finished and the view needs updating
+	doc_snapshot comp_snap_;    // Version of the doc being compared
 	clock_t comp_clock_;        // Remember when the last compare finished so we don't update the compare list unnecessarily
 	unsigned char *comp_bufa_, *comp_bufb_; // Buffers used for holding data from both files (only used by background thread)
 
@@ -1090,18 +1081,23 @@ private:
 	CEvent start_stats_event_;  // Signal to bg thread to start scan, or check for termination
 	enum BG_COMMAND stats_command_; // signals thread to do something
 	enum BG_STATE   stats_state_;   // indicates what the thread is doing
-	bool stats_fin_;            // Flags that the scan is finished
+	bool stats_fin_;            // Flags that the byte counts are up to date
+	bool digests_fin_;          // Flags that the CRC/digests are up to date
+	bool stats_rescan_;         // Scan the whole doc (else the counts can be updated from what has changed)
 	int stats_progress_;        // Ho much has been done (if stats_fin_ == false) in range: 0 to 100
+	doc_snapshot stats_snap_;   // Version of the doc being scanned (released when the scan finishes)
+	unsigned stats_edit_;       // Version of the doc (see EditCount) that count_ etc are for
+	bool stats_done_;           // Last scan finished (so count_ etc are for version stats_edit_)
 	unsigned char * stats_buf_; // Buffer for holding file data to search (only used in bg thread)
 	long * c32_;                // Keeps stats when using 32-bit numbers (only used in bg thread)
 	__int64 * c64_;             // Keeps stats when using 64-bit numbers (only used in bg thread)
 
-	CFile64 *pfile5_;           // We need a copy of file_ so we can access the same file for scanning
-	// Also see data_file5_ (above)
-
 	void CreateStatsThread();   // Create background thread which scans the file
 	void KillStatsThread();     // Kill background thread ASAP
 	bool StatsProcessStop();    // Check if the scanning should stop (called in the thread)
+	bool stats_update_counts(); // Update count_ for changes made during the scan of stats_snap_ (called in the thread)
+	bool stats_rebase(FILE_ADDRESS addr);  // Move scan to a new snapshot if bytes before addr are unchanged
+	bool stats_count(const doc_snapshot &snap, const std::vector<edit_log::range> &rr, __int64 *cnt, int sign);
 
 	__int64 count_[256];        // What we are calculating - how many times each byte value appears in the file
 	unsigned long  crc32_;      // CRC32 if theApp.bg_stats_crc32_ is TRUE
@@ -58,8 +58,6 @@
 #include "timer.h"
 #endif
 
-#define MEM_WARNING_SIZE (256*1024*1024)
-
 // This #define allows checking that the drawing code does clipping properly for
 // efficiency.  For example for very long lines we don't want to draw a huge no
 // of byte values to the right and/or left of the display area.  It does this by
@@ -1945,6 +1943,110 @@ struct segment_compare
 	}
 };
 
+// Adjusts a selection (start_addr to end_addr) and the mark for a change to the document
+static void adjust_sel(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS len,
+					   FILE_ADDRESS &start_addr, FILE_ADDRESS &end_addr, FILE_ADDRESS &mark)
+{
+	if (utype == mod_insert || utype == mod_insert_file)
+	{
+		if (end_addr > address)
+		{
+			end_addr += len;
+			if (start_addr >= address)
+				start_addr += len;
+		}
+
+		if (mark >= address)
+			mark += len;
+	}
+	else if (utype == mod_delback || utype == mod_delforw)
+	{
+		// Check if current selection and the deletion intersect
+		if (start_addr < address + len && end_addr > address)
+		{
+			if (start_addr >= address)     // If sel start within deletion ...
+				start_addr = address;      // ... move it to where chars deleted
+			if (end_addr <= address + len) // If sel end within deletion ...
+				end_addr = address;        // ... move it to where chars deleted
+			else
+				end_addr -= len;           // past deletion so just move it back
+		}
+		else if (address + len <= start_addr)
+		{
+			// Deletion is before selection - just move selection backwards
+			start_addr -= len;
+			end_addr -= len;
+		}
+
+		if (mark > address + len)
+			mark -= len;
+		else if (mark > address)
+			mark = address;
+	}
+}
+
+// Moves highlights for a change to the document (removing any that were deleted)
+static void adjust_highlights(enum mod_type utype, FILE_ADDRESS address, FILE_ADDRESS len,
+							  range_set<FILE_ADDRESS> &hl_set)
+{
+	if (utype == mod_insert || utype == mod_insert_file)
+	{
+		range_set<FILE_ADDRESS>::range_t::iterator pp =
+			lower_bound(hl_set.range_.begin(),
+						hl_set.range_.end(),
+						range_set<FILE_ADDRESS>::segment(address+1, address+1),
+						segment_compare());
+		// If there is a highlight before insert posn check if insert is within it
+		if (pp != hl_set.range_.begin())
+		{
+			pp --;
+			// If bytes inserted within highlight move end
+			if (pp->slast > address)
+				pp->slast += len;
+			++pp;
+		}
+		// Move up all the following highlights
+		for ( ; pp != hl_set.range_.end(); ++pp)
+		{
+			ASSERT(pp->sfirst > address);
+			pp->sfirst += len;
+			pp->slast += len;
+		}
+	}
+	else if (utype == mod_delback || utype == mod_delforw)
+	{
+		// Remove highlights for deleted bytes (if any)
+		hl_set.erase_range(address, address+len);
+		range_set<FILE_ADDRESS>::range_t::iterator pp =
+			lower_bound(hl_set.range_.begin(),
+						hl_set.range_.end(),
+						range_set<FILE_ADDRESS>::segment(address, address),
+						segment_compare());
+		if (pp != hl_set.range_.begin() && pp != hl_set.range_.end())
+		{
+			range_set<FILE_ADDRESS>::range_t::iterator tmp = pp;
+			tmp--;
+			// If previous abuts current then join them together
+			if (pp->sfirst - len <= tmp->slast)
+			{
+				ASSERT(pp->sfirst - len == tmp->slast);
+				tmp->slast = pp->slast - len;
+				// Remove extra list elt (and leave pp pointing to next)
+				tmp = pp;
+				pp++;
+				hl_set.range_.erase(tmp);
+			}
+		}
+		// Move all the following highlights down
+		for ( ; pp != hl_set.range_.end(); ++pp)
+		{
+			ASSERT(pp->sfirst > address);
+			pp->sfirst -= len;
+			pp->slast -= len;
+		}
+	}
+}
+
 // OnUpdate is invoked by the document to indicate something has changed (UpdateAllViews)
 // These update hints are handled:
 // CRemoveHint: removes undo info (without undoing anything) - for when document saved
@@ -2037,104 +2139,44 @@ void CHexEditView::OnUpdate(CView* pSender, LPARAM lHint, CObject* pHint)
 #ifndef NDEBUG
 			undo_.back().index = phh->index;
 #endif
-		}
-
-		// Move positions of the caret and the mark if address shifted
-		if (!phh->is_undo && (phh->utype == mod_insert || phh->utype == mod_insert_file))
-		{
-			if (end_addr > phh->address)
-			{
-				end_addr += phh->len;
-				if (start_addr >= phh->address)
-					start_addr += phh->len;
-				SetSel(addr2pos(start_addr, row), addr2pos(end_addr, row));
-			}
-
-			if (mark_ >= phh->address)
-				mark_ += phh->len;
-		}
-		else if (!phh->is_undo &&
-				 (phh->utype == mod_delback || phh->utype == mod_delforw))
-		{
-			// Check if current selection and the deletion intersect
-			if (start_addr < phh->address + phh->len && end_addr > phh->address)
+			// A batch (see CHexEditDoc::CommitBatch) has a doc undo record for each change but they
+			// are all undone together.  Only the top one has the real flag so the user is asked once.
+			for (int ii = 1; ii < phh->count; ++ii)
 			{
-				if (start_addr >= phh->address)     // If sel start within deletion ...
-					start_addr = phh->address;      // ... move it to where chars deleted
-				if (end_addr <= phh->address + phh->len) // If sel end within deletion ...
-					end_addr = phh->address;        // ... move it to where chars deleted
-				else
-					end_addr -= phh->len;           // past deletion so just move it back
-				SetSel(addr2pos(start_addr, row), addr2pos(end_addr, row));
-			}
-			else if (phh->address + phh->len <= start_addr)
-			{
-				// Deletion is before selection - just move selection backwards
-				SetSel(addr2pos(start_addr - phh->len, row), addr2pos(end_addr - phh->len, row));
+				BOOL flag = undo_.back().flag;
+				undo_.back().flag = TRUE;
+				undo_.push_back(view_undo(undo_change, TRUE));
+				undo_.back().flag = flag;
+#ifndef NDEBUG
+				undo_.back().index = phh->index + ii;
+#endif
 			}
-
-			if (mark_ > phh->address + phh->len)
-				mark_ -= phh->len;
-			else if (mark_ > phh->address)
-				mark_ = phh->address;
 		}
 
-		// Fix highlights
-		if (phh->utype == mod_insert || phh->utype == mod_insert_file)
+		// Move positions of the caret, the mark and highlights if addresses shifted
+		if (phh->pbatch != NULL)
 		{
-			range_set<FILE_ADDRESS>::range_t::iterator pp =
-				lower_bound(hl_set_.range_.begin(),
-							hl_set_.range_.end(),
-							range_set<FILE_ADDRESS>::segment(phh->address+1, phh->address+1),
-							segment_compare());
-			// If there is a highlight before insert posn check if insert is within it
-			if (pp != hl_set_.range_.begin())
+			// Batch of changes (see CHexEditDoc::CommitBatch) - adjust for each one
+			FILE_ADDRESS new_start = start_addr, new_end = end_addr;
+			std::vector<batch_change>::const_iterator pb;
+			for (pb = phh->pbatch->begin(); pb != phh->pbatch->end(); ++pb)
 			{
-				pp --;
-				// If bytes inserted within highlight move end
-				if (pp->slast > phh->address)
-					pp->slast += phh->len;
-				++pp;
-			}
-			// Move up all the following highlights
-			for ( ; pp != hl_set_.range_.end(); ++pp)
-			{
-				ASSERT(pp->sfirst > phh->address);
-				pp->sfirst += phh->len;
-				pp->slast += phh->len;
+				adjust_sel(pb->utype, pb->address, pb->len, new_start, new_end, mark_);
+				adjust_highlights(pb->utype, pb->address, pb->len, hl_set_);
 			}
+			if (new_start != start_addr || new_end != end_addr)
+				SetSel(addr2pos(new_start, row), addr2pos(new_end, row));
 		}
-		else if (phh->utype == mod_delback || phh->utype == mod_delforw)
+		else
 		{
-			// Remove highlights for deleted bytes (if any)
-			hl_set_.erase_range(phh->address, phh->address+phh->len);
-			range_set<FILE_ADDRESS>::range_t::iterator pp =
-				lower_bound(hl_set_.range_.begin(),
-							hl_set_.range_.end(),
-							range_set<FILE_ADDRESS>::segment(phh->address, phh->address),
-							segment_compare());
-			if (pp != hl_set_.range_.begin() && pp != hl_set_.range_.end())
+			if (!phh->is_undo)
 			{
-				range_set<FILE_ADDRESS>::range_t::iterator tmp = pp;
-				tmp--;
-				// If previous abuts current then join them together
-				if (pp->sfirst - phh->len <= tmp->slast)
-				{
-					ASSERT(pp->sfirst - phh->len == tmp->slast);
-					tmp->slast = pp->slast - phh->len;
-					// Remove extra list elt (and leave pp pointing to next)
-					tmp = pp;
-					pp++;
-					hl_set_.range_.erase(tmp);
-				}
-			}
-			// Move all the following highlights down
-			for ( ; pp != hl_set_.range_.end(); ++pp)
-			{
-				ASSERT(pp->sfirst > phh->address);
-				pp->sfirst -= phh->len;
-				pp->slast -= phh->len;
+				FILE_ADDRESS new_start = start_addr, new_end = end_addr;
+				adjust_sel(phh->utype, phh->address, phh->len, new_start, new_end, mark_);
+				if (new_start != start_addr || new_end != end_addr)
+					SetSel(addr2pos(new_start, row), addr2pos(new_end, row));
 			}
+			adjust_highlights(phh->utype, phh->address, phh->len, hl_set_);
 		}
 
 		// Work out the addresses of the first and last line displayed
@@ -2150,9 +2192,9 @@ void CHexEditView::OnUpdate(CView* pSender, LPARAM lHint, CObject* pHint)
 		FILE_ADDRESS addr_top = (clip_rect.top/line_height_)*rowsize_ - offset_;
 		FILE_ADDRESS addr_bot = (clip_rect.bottom/line_height_ + 1)*rowsize_ - offset_;
 
-		if (addr_width_ != prev_addr_width)
+		if (addr_width_ != prev_addr_width || phh->pbatch != NULL)
 		{
-			// Addresses on left side are now different width so redraw everything
+			// Addresses on left side are now different width (or many changes) so redraw everything
 			DoInvalidate();
 		}
 		else if (phh->address >= addr_bot ||
@@ -3205,24 +3247,27 @@ void CHexEditView::get_search_in_range(CPointAp &pos)
 		if (start < 0) start = 0;                           // Just in case (prob not nec.)
 		end = ((pos.y+rct.Height())/line_height_ + 1)*rowsize_ - offset_;
 
-		std::vector<FILE_ADDRESS> sf = pdoc->SearchAddresses(start, end);
+		std::vector<int> ids;               // Which pattern is at each address (if searching for several)
+		std::vector<FILE_ADDRESS> sf = pdoc->SearchAddresses(start, end, &ids);
 		search_length_ = theApp.pboyer_->length();
 		std::vector<FILE_ADDRESS>::const_iterator pp = sf.begin();
 		std::vector<FILE_ADDRESS>::const_iterator pend = sf.end();
+		std::vector<int>::const_iterator pid = ids.begin();
 		pair<FILE_ADDRESS, FILE_ADDRESS> good_pair;
 
 		if (pp != pend)
 		{
 			good_pair.first = *pp;
-			good_pair.second = *pp + search_length_;
+			good_pair.second = *pp + theApp.pboyer_->pattern_length(*pid);
 			while (++pp != pend)
 			{
+				++pid;
 				if (*pp >= good_pair.second)
 				{
 					search_pair_.push_back(good_pair);
 					good_pair.first = *pp;
 				}
-				good_pair.second = *pp + search_length_;
+				good_pair.second = max(good_pair.second, *pp + FILE_ADDRESS(theApp.pboyer_->pattern_length(*pid)));
 			}
 			search_pair_.push_back(good_pair);
 		}
@@ -4850,7 +4895,7 @@ void CHexEditView::OnLButtonDblClk(UINT nFlags, CPoint point)
 		//    theApp.OnViewDoubleClick(this, IDR_CONTEXT_SELECTION);
 		//else
 		if (!display_.hide_bookmarks &&
-				 std::find(GetDocument()->bm_posn_.begin(), GetDocument()->bm_posn_.end(), addr) != GetDocument()->bm_posn_.end())
+				 GetDocument()->bm_posn_.find(addr) != -1)
 			theApp.OnViewDoubleClick(this, IDR_CONTEXT_BOOKMARKS);  // click on bookmark
 		else if (!display_.hide_highlight && hl_set_.find(addr) != hl_set_.end())
 			theApp.OnViewDoubleClick(this, IDR_CONTEXT_HIGHLIGHT);  // click on highlight
@@ -4873,7 +4918,7 @@ void CHexEditView::OnLButtonDblClk(UINT nFlags, CPoint point)
 		//    theApp.OnViewDoubleClick(this, IDR_CONTEXT_SELECTION);
 		//else
 		if (!display_.hide_bookmarks &&
-				 std::find(GetDocument()->bm_posn_.begin(), GetDocument()->bm_posn_.end(), addr) != GetDocument()->bm_posn_.end())
+				 GetDocument()->bm_posn_.find(addr) != -1)
 			theApp.OnViewDoubleClick(this, IDR_CONTEXT_BOOKMARKS);
 		else if (!display_.hide_highlight && hl_set_.find(addr) != hl_set_.end())
 			theApp.OnViewDoubleClick(this, IDR_CONTEXT_HIGHLIGHT);  // click on highlight
@@ -4894,7 +4939,7 @@ void CHexEditView::OnLButtonDblClk(UINT nFlags, CPoint point)
 		//    theApp.OnViewDoubleClick(this, IDR_CONTEXT_SELECTION);
 		//else
 		if (!display_.hide_bookmarks &&
-				 std::find(GetDocument()->bm_posn_.begin(), GetDocument()->bm_posn_.end(), addr) != GetDocument()->bm_posn_.end())
+				 GetDocument()->bm_posn_.find(addr) != -1)
 			theApp.OnViewDoubleClick(this, IDR_CONTEXT_BOOKMARKS);
 		else if (!display_.hide_highlight && hl_set_.find(addr) != hl_set_.end())
 			theApp.OnViewDoubleClick(this, IDR_CONTEXT_HIGHLIGHT);  // click on highlight
@@ -5209,7 +5254,7 @@ void CHexEditView::OnLButtonUp(UINT nFlags, CPoint point)
 			CBookmarkList *pbl = theApp.GetBookmarkList();
 			ASSERT(pbl != NULL);
 			pbl->Move(GetDocument()->bm_index_[drag_bookmark_], int(drag_address_ - prev)); // move bm in global list
-			GetDocument()->bm_posn_[drag_bookmark_] = drag_address_;   // move in doc's bm list
+			GetDocument()->bm_posn_.set(drag_bookmark_, drag_address_); // move in doc's bm list
 			((CMainFrame *)AfxGetMainWnd())->m_wndBookmarks.UpdateBookmark(GetDocument()->bm_index_[drag_bookmark_]);
 
 			invalidate_addr_range(prev, prev+1);                     // force redraw to remove bookmark at old position
@@ -5725,12 +5770,7 @@ FILE_ADDRESS CHexEditView::address_at(CPoint pt)
 // Returns the bookmark at file address or -1 if none
 int CHexEditView::bookmark_at(FILE_ADDRESS addr)
 {
-	std::vector<FILE_ADDRESS>::const_iterator pp =
-		std::find(GetDocument()->bm_posn_.begin(), GetDocument()->bm_posn_.end(), addr);
-	if (pp != GetDocument()->bm_posn_.end())
-		return pp - GetDocument()->bm_posn_.begin();
-	else
-		return -1;
+	return GetDocument()->bm_posn_.find(addr);
 }
 
 void CHexEditView::OnHighlight()
@@ -5923,26 +5963,19 @@ void CHexEditView::OnUpdateHighlightHide(CCmdUI* pCmdUI)
 // We will try returning the bookmark above or -1 if there is none
 int CHexEditView::ClosestBookmark(FILE_ADDRESS &diff)
 {
-	std::vector<FILE_ADDRESS>::const_iterator prev_bm = GetDocument()->bm_posn_.end();
-	diff = GetDocument()->length()+1;  // Bigger than any possible difference between current & bookmark
 	FILE_ADDRESS start_addr, end_addr;
 
 	GetSelAddr(start_addr, end_addr);
 
-	// Find the bookmark that is closest but after the current address
-	for (std::vector<FILE_ADDRESS>::const_iterator pbm = GetDocument()->bm_posn_.begin();
-		 pbm != GetDocument()->bm_posn_.end(); ++pbm)
+	// Find the bookmark that is closest at or before the current address
+	int prev_bm = GetDocument()->bm_posn_.before(start_addr + 1);
+	if (prev_bm == -1)
 	{
-		if (*pbm <= start_addr && start_addr - *pbm < diff)
-		{
-			diff = start_addr - *pbm;
-			prev_bm = pbm;
-		}
-	}
-	if (prev_bm == GetDocument()->bm_posn_.end())
+		diff = GetDocument()->length()+1;  // Bigger than any possible difference between current & bookmark
 		return -1;
-	else
-		return GetDocument()->bm_index_[prev_bm - GetDocument()->bm_posn_.begin()];
+	}
+	diff = start_addr - GetDocument()->bm_posn_[prev_bm];
+	return GetDocument()->bm_index_[prev_bm];
 }
 
 void CHexEditView::OnBookmarksClear()
@@ -5958,23 +5991,13 @@ void CHexEditView::OnUpdateBookmarksClear(CCmdUI* pCmdUI)
 
 void CHexEditView::OnBookmarksPrev()
 {
-	std::vector<FILE_ADDRESS>::const_iterator prev_bm = GetDocument()->bm_posn_.end();
-	FILE_ADDRESS diff = GetDocument()->length()+1;  // Bigger than any possible difference between current & bookmark
 	FILE_ADDRESS start_addr, end_addr;
 
 	GetSelAddr(start_addr, end_addr);
 
-	// Find the bookmark that is closest but after the current address
-	for (std::vector<FILE_ADDRESS>::const_iterator pbm = GetDocument()->bm_posn_.begin();
-		 pbm != GetDocument()->bm_posn_.end(); ++pbm)
-	{
-		if (*pbm < start_addr && start_addr - *pbm < diff)
-		{
-			diff = start_addr - *pbm;
-			prev_bm = pbm;
-		}
-	}
-	if (prev_bm == GetDocument()->bm_posn_.end())
+	// Find the bookmark that is closest but before the current address
+	int prev_bm = GetDocument()->bm_posn_.before(start_addr);
+	if (prev_bm == -1)
 	{
 		// No bookmarks found (presumably in macro playback)
 		TaskMessageBox("No Previous Bookmark", "There is no previous bookmark at this position.");
@@ -5982,50 +6005,28 @@ void CHexEditView::OnBookmarksPrev()
 		return;
 	}
 
-	MoveWithDesc("Previous Bookmark ", *prev_bm, *prev_bm);
+	FILE_ADDRESS addr = GetDocument()->bm_posn_[prev_bm];
+	MoveWithDesc("Previous Bookmark ", addr, addr);
 	theApp.SaveToMacro(km_bookmarks, (unsigned __int64)2);
 }
 
 void CHexEditView::OnUpdateBookmarksPrev(CCmdUI* pCmdUI)
 {
-	std::vector<FILE_ADDRESS>::const_iterator prev_bm = GetDocument()->bm_posn_.end();
-	FILE_ADDRESS diff = GetDocument()->length()+1;  // Bigger than any possible difference between current & bookmark
 	FILE_ADDRESS start_addr, end_addr;
 
 	GetSelAddr(start_addr, end_addr);
-
-	// Find the bookmark that is closest but after the current address
-	for (std::vector<FILE_ADDRESS>::const_iterator pbm = GetDocument()->bm_posn_.begin();
-		 pbm != GetDocument()->bm_posn_.end(); ++pbm)
-	{
-		if (*pbm < start_addr && start_addr - *pbm < diff)
-		{
-			diff = start_addr - *pbm;
-			prev_bm = pbm;
-		}
-	}
-	pCmdUI->Enable(prev_bm != GetDocument()->bm_posn_.end());
+	pCmdUI->Enable(GetDocument()->bm_posn_.before(start_addr) != -1);
 }
 
 void CHexEditView::OnBookmarksNext()
 {
-	std::vector<FILE_ADDRESS>::const_iterator next_bm = GetDocument()->bm_posn_.end();
-	FILE_ADDRESS diff = GetDocument()->length()+1;  // Bigger than any possible difference between current & bookmark
 	FILE_ADDRESS start_addr, end_addr;
 
 	GetSelAddr(start_addr, end_addr);
 
 	// Find the bookmark that is closest but after the current address
-	for (std::vector<FILE_ADDRESS>::const_iterator pbm = GetDocument()->bm_posn_.begin();
-		 pbm != GetDocument()->bm_posn_.end(); ++pbm)
-	{
-		if (*pbm > start_addr && *pbm - start_addr < diff)
-		{
-			diff = *pbm - start_addr;
-			next_bm = pbm;
-		}
-	}
-	if (next_bm == GetDocument()->bm_posn_.end())
+	int next_bm = GetDocument()->bm_posn_.after(start_addr);
+	if (next_bm == -1)
 	{
 		// No bookmarks found (presumably in macro playback)
 		TaskMessageBox("No Next Bookmark", "There are no bookmarks after the current address.");
@@ -6033,29 +6034,17 @@ void CHexEditView::OnBookmarksNext()
 		return;
 	}
 
-	MoveWithDesc("Next Bookmark ", *next_bm, *next_bm);
+	FILE_ADDRESS addr = GetDocument()->bm_posn_[next_bm];
+	MoveWithDesc("Next Bookmark ", addr, addr);
 	theApp.SaveToMacro(km_bookmarks, (unsigned __int64)3);
 }
 
 void CHexEditView::OnUpdateBookmarksNext(CCmdUI* pCmdUI)
 {
-	std::vector<FILE_ADDRESS>::const_iterator next_bm = GetDocument()->bm_posn_.end();
-	FILE_ADDRESS diff = GetDocument()->length()+1;  // Bigger than any possible difference between current & bookmark
 	FILE_ADDRESS start_addr, end_addr;
 
 	GetSelAddr(start_addr, end_addr);
-
-	// Find the bookmark that is closest but after the current address
-	for (std::vector<FILE_ADDRESS>::const_iterator pbm = GetDocument()->bm_posn_.begin();
-		 pbm != GetDocument()->bm_posn_.end(); ++pbm)
-	{
-		if (*pbm > end_addr && *pbm - end_addr < diff)
-		{
-			diff = *pbm - end_addr;
-			next_bm = pbm;
-		}
-	}
-	pCmdUI->Enable(next_bm != GetDocument()->bm_posn_.end());
+	pCmdUI->Enable(GetDocument()->bm_posn_.after(end_addr) != -1);
 }
 
 void CHexEditView::OnBookmarksHide()
@@ -6618,7 +6607,7 @@ void CHexEditView::view_context(CPoint point)
 		if (addr >= start_addr && addr < end_addr)
 			pCMM->ShowPopupMenu(IDR_CONTEXT_SELECTION, point.x, point.y, this);
 		else if (!display_.hide_bookmarks &&
-				 std::find(GetDocument()->bm_posn_.begin(), GetDocument()->bm_posn_.end(), addr) != GetDocument()->bm_posn_.end())
+				 GetDocument()->bm_posn_.find(addr) != -1)
 			pCMM->ShowPopupMenu(IDR_CONTEXT_BOOKMARKS, point.x, point.y, this);
 		else if (!display_.hide_highlight && hl_set_.find(addr) != hl_set_.end())
 			pCMM->ShowPopupMenu(IDR_CONTEXT_HIGHLIGHT, point.x, point.y, this);
@@ -6640,7 +6629,7 @@ void CHexEditView::view_context(CPoint point)
 		if (addr >= start_addr && addr < end_addr)
 			pCMM->ShowPopupMenu(IDR_CONTEXT_SELECTION, point.x, point.y, this);
 		else if (!display_.hide_bookmarks &&
-				 std::find(GetDocument()->bm_posn_.begin(), GetDocument()->bm_posn_.end(), addr) != GetDocument()->bm_posn_.end())
+				 GetDocument()->bm_posn_.find(addr) != -1)
 			pCMM->ShowPopupMenu(IDR_CONTEXT_BOOKMARKS, point.x, point.y, this);
 		else if (!display_.hide_highlight && hl_set_.find(addr) != hl_set_.end())
 			pCMM->ShowPopupMenu(IDR_CONTEXT_HIGHLIGHT, point.x, point.y, this);
@@ -6660,7 +6649,7 @@ void CHexEditView::view_context(CPoint point)
 		if (addr >= start_addr && addr < end_addr)
 			pCMM->ShowPopupMenu(IDR_CONTEXT_SELECTION, point.x, point.y, this);
 		else if (!display_.hide_bookmarks &&
-				 std::find(GetDocument()->bm_posn_.begin(), GetDocument()->bm_posn_.end(), addr) != GetDocument()->bm_posn_.end())
+				 GetDocument()->bm_posn_.find(addr) != -1)
 			pCMM->ShowPopupMenu(IDR_CONTEXT_BOOKMARKS, point.x, point.y, this);
 		else if (!display_.hide_highlight && hl_set_.find(addr) != hl_set_.end())
 			pCMM->ShowPopupMenu(IDR_CONTEXT_HIGHLIGHT, point.x, point.y, this);
@@ -6988,37 +6977,14 @@ void CHexEditView::do_read(CString file_name)
 		return;
 	}
 
-	int idx = -1;                       // Index into docs data_file_ array (or -1 if no slots avail.)
-	if (data_len > (16*1024*1024) && (idx = GetDocument()->AddDataFile(file_name)) != -1)
+	if (GetDocument()->UseTempFile(data_len))
 	{
 		// Use the file in situ
+		int idx = GetDocument()->AddDataFile(file_name);
 		GetDocument()->Change(mod_insert_file, addr, data_len, NULL, idx, this);
 	}
 	else
 	{
-		if (data_len > UINT_MAX)  // why is there no SIZE_T_MAX?
-		{
-			TaskMessageBox("Large File Error",
-						  "HexEdit is out of temporary files "
-						  "and cannot open such a large file.  "
-						  "Please save the file to free "
-						  "temporary file handles and try again.",
-						  MB_OK);
-			return;
-		}
-
-		if (data_len > MEM_WARNING_SIZE)  // file may be too big
-		{
-			if (TaskMessageBox("Large File Warning",
-							  "HexEdit is out of temporary file "
-							  "handles and opening such a large file may "
-							  "cause memory exhaustion.  Please select "
-							  "\"No\" and save the file to free handles. "
-							  "Or, select \"Yes\" to continue.\n\n"
-							  "Do you want to continue?", MB_YESNO) != IDYES)
-				return;
-		}
-
 		// Open the file for reading
 		CFile ff;                   // Don't make this CFile64 as we don't want to read > 2Gbytes into memory
 		CFileException fe;          // Used to receive file error information
@@ -7948,7 +7914,7 @@ void CHexEditView::do_hex_text(CString file_name)
 	char temp_file[_MAX_PATH]; temp_file[0] = '\0';
 
 	// Test if the file is very big
-	if (file_len > (3*16*1024*1024) && GetDocument()->DataFileSlotFree())  // assuming 3 chars/byte ~= 16 Mb
+	if (GetDocument()->UseTempFile(file_len/3))  // assuming 3 chars/byte
 	{
 		// Create a file to store the bytes
 		char temp_dir[_MAX_PATH];
@@ -8172,18 +8138,15 @@ end_file:
 		FILE_ADDRESS fout_len = fout.GetLength();
 		fout.Close();      // close the file so we can use it
 
-		// Add the temp file to the document
-		int idx = GetDocument()->AddDataFile(temp_file, TRUE);
-		ASSERT(idx != -1);
-
+		// Delete current selection (if any)
+		// Note: this must be done before AddDataFile otherwise Change() (via regenerate()) may delete the temp file.
 		if (start_addr < end_addr)
-		{
-			// Delete current selection and insert new data
 			GetDocument()->Change(mod_delforw, start_addr, end_addr-start_addr, NULL, 0, this);
-			GetDocument()->Change(mod_insert_file, start_addr, fout_len, NULL, idx, this, TRUE);
-		}
-		else
-			GetDocument()->Change(mod_insert_file, start_addr, fout_len, NULL, idx, this);
+
+		// Add the temp file to the document and insert the new data
+		int idx = GetDocument()->AddDataFile(temp_file, TRUE);
+		ASSERT(idx != -1);
+		GetDocument()->Change(mod_insert_file, start_addr, fout_len, NULL, idx, this, start_addr < end_addr);
 
 		// NOTE: curr_data is not used when writing to temp file except below (in selecting
 		// the inserted data) - so we have to set it here.
@@ -9158,6 +9121,9 @@ void CHexEditView::do_replace(FILE_ADDRESS start, FILE_ADDRESS end, unsigned cha
 		if (len > 0)
 			GetDocument()->Change(mod_insert, start, len, pp, 0, this, TRUE);
 	}
+	if (GetDocument()->InBatch())
+		return;                             // the view is updated when the batch is committed
+
 	int row = 0;
 	if (display_.vert_display) row = pos2row(GetCaret());
 	SetSel(addr2pos(start+len, row), addr2pos(start+len, row));
@@ -9166,6 +9132,36 @@ void CHexEditView::do_replace(FILE_ADDRESS start, FILE_ADDRESS end, unsigned cha
 	show_pos();                             // Update tool bar
 }
 
+// Replaces len bytes at every address in found (see CHexEditDoc::ReplaceAll) for Replace All.
+// Returns false if the replacements could not be made (read only or user cancelled).
+bool CHexEditView::do_replace_all(const std::vector<FILE_ADDRESS> &found, FILE_ADDRESS len, unsigned char *pp, size_t replen)
+{
+	// Can't replace if view is read only
+	if (check_ro("replace bytes"))
+		return false;
+
+	num_entered_ = num_del_ = num_bs_ = 0;      // Stop any editing
+
+	if (display_.overtype && len != FILE_ADDRESS(replen))
+	{
+		if (AvoidableTaskDialog(IDS_REPLACE_OVERTYPE,
+								"The Replace operation requires replacing bytes with data of a "
+								   "different length.  This requires the window to be in insert mode."
+								   "\n\nDo you want to turn off overtype mode?",
+								NULL, NULL, 
+								TDCBF_OK_BUTTON | TDCBF_CANCEL_BUTTON) != IDOK)
+		{
+			theApp.mac_error_ = 10;
+			return false;
+		}
+		else if (!do_insert())
+			return false;
+	}
+
+	GetDocument()->ReplaceAll(found, len, pp, replen, this);
+	return true;
+}
+
 void CHexEditView::OnEditPaste()
 {
 	CHexEditApp *aa = dynamic_cast<CHexEditApp *>(AfxGetApp());
@@ -9290,21 +9286,6 @@ void CHexEditView::OnEditPaste()
 				strTemp.ReleaseBuffer(*pl);  // adds null byte at end
 				::CloseClipboard();          // We have got everything from the cb memory
 
-				// Make sure there is a temp file handle available. (We are going to
-				// use mod_insert_file to access data directly from the temp file
-				// as we don't want to read the whole (large} file into memory.)
-				int idx = GetDocument()->AddDataFile(strTemp);
-				if (idx == -1)
-				{
-					TaskMessageBox("Paste Error",
-								  "HexEdit is out of temporary files and "
-								  "cannot paste from a temporary clipboard file.\n\n"
-								  "Please save your file to free "
-								  "temporary file handles and try again.");
-					aa->mac_error_ = 10;
-					return;
-				}
-
 				// Get the file's length so we know how much is being pasted
 				CFileStatus fs;
 				VERIFY(CFile64::GetStatus(strTemp, fs));
@@ -9353,19 +9334,16 @@ void CHexEditView::OnEditPaste()
 				}
 
 				// Insert/replace with temp data file
+				// Note: deletions must be done before AddDataFile otherwise Change() (via regenerate()) may delete the temp file.
 				if (display_.overtype)
-				{
-					// Effectively replace using the file length
-					GetDocument()->Change(mod_delforw, start_addr, fs.m_size, NULL, 0, this);
-					GetDocument()->Change(mod_insert_file, start_addr, fs.m_size, NULL, idx, this, TRUE);
-				}
-				else
-				{
-					// Wipe out any current selection then insert the data
-					if (start_addr < end_addr)
-						GetDocument()->Change(mod_delforw, start_addr, end_addr-start_addr, NULL, 0, this);
-					GetDocument()->Change(mod_insert_file, start_addr, fs.m_size, NULL, idx, this, TRUE);
-				}
+					GetDocument()->Change(mod_delforw, start_addr, fs.m_size, NULL, 0, this);  // Effectively replace using the file length
+				else if (start_addr < end_addr)
+					GetDocument()->Change(mod_delforw, start_addr, end_addr-start_addr, NULL, 0, this);  // Wipe out any current selection
+
+				// We use mod_insert_file to access data directly from the temp file
+				// as we don't want to read the whole (large} file into memory.
+				int idx = GetDocument()->AddDataFile(strTemp);
+				GetDocument()->Change(mod_insert_file, start_addr, fs.m_size, NULL, idx, this, TRUE);
 				// Restore caret and update everything due to possible new data at the caret
 				SetSel(addr2pos(start_addr+fs.m_size, row), addr2pos(start_addr+fs.m_size, row));
 				DisplayCaret();
@@ -13214,9 +13192,9 @@ void CHexEditView::DoConversion(convert_type op, LPCSTR desc)
 	ASSERT(start_addr < end_addr && end_addr <= GetDocument()->length());
 
 	// Test if selection is too big to do in memory
-	if (end_addr - start_addr > (16*1024*1024) && GetDocument()->DataFileSlotFree())
+	if (GetDocument()->UseTempFile(end_addr - start_addr))
 	{
-		int idx = -1;                       // Index into docs data_file_ array (or -1 if no slots avail.)
+		int idx = -1;                       // Index into docs data_file_ array
 
 		// Create a file to store the resultant data
 		// (Temp file used by the document until it is closed or written to disk.)
@@ -13293,35 +13271,6 @@ void CHexEditView::DoConversion(convert_type op, LPCSTR desc)
 	{
 		// Allocate memory block and process it
 
-		// Error if ran out of temp file handles and file is too big
-		if (end_addr - start_addr > UINT_MAX)  // why is there no SIZE_T_MAX?
-		{
-			TaskMessageBox("Conversion Error",
-						  "HexEdit is out of temporary files and "
-						  "cannot convert such a large selection.\n\n"
-						  "Please save the file to deallocate "
-						  "temporary file handles and try again.");
-			theApp.mac_error_ = 10;
-			return;
-		}
-
-		// Warn if we might cause memory exhaustion
-		if (end_addr - start_addr > MEM_WARNING_SIZE)  // buffer may be too big
-		{
-			if (TaskMessageBox("Conversion Warning",
-				"HexEdit is out of temporary file "
-				"handles and converting such a large selection "
-				"may cause memory exhaustion.  Please click "
-				"\"No\" and save the file to free handles "
-				"or click \"Yes\" to continue.\n\n"
-				"Do you want to continue?",
-				MB_YESNO) != IDYES)
-			{
-				theApp.mac_error_ = 5;
-				return;
-			}
-		}
-
 		CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
 		try
@@ -13458,7 +13407,7 @@ void CHexEditView::DoTransform(CryptoPP::BufferedTransformation *pTrx, int trans
 		outlen = size_t(outlen * mem_factor) + 512;   // Allow a bit extra (eg block encryptio may increase the length slightly)
 
 	// Create "sink" that is used to store the result of the trasnformation
-	if (outlen > (64 * 1024 * 1024) && GetDocument()->DataFileSlotFree())
+	if (GetDocument()->UseTempFile(outlen))
 	{
 		// Too big for memory so create a "temp" file to store the transformed data
 		// (This file stores the data until the document is closed or written to disk.)
@@ -13471,23 +13420,6 @@ void CHexEditView::DoTransform(CryptoPP::BufferedTransformation *pTrx, int trans
 	}
 	else if (outlen < UINT_MAX)
 	{
-		// We need to allocate a buffer in memory so warn if we might cause memory exhaustion
-		if (outlen > MEM_WARNING_SIZE)  // More than 256 Mb may be too big
-		{
-			if (TaskMessageBox(strDesc + " Warning",
-				"HexEdit is out of temporary file "
-				"handles and such a large selection "
-				"may cause memory exhaustion.  Please click "
-				"\"No\" and save the file to free handles "
-				"or click \"Yes\" to continue.\n\n"
-				"Do you want to continue?",
-				MB_YESNO) != IDYES)
-			{
-				theApp.mac_error_ = 5;
-				return;
-			}
-		}
-
 		// Get memory for selection and create Crypto++ buffer sink
 		try
 		{
@@ -13690,7 +13622,7 @@ void CHexEditView::OnEncrypt()
 		}
 
 		// Test if selection is too big to do in memory
-		if (end_addr - start_addr > (16*1024*1024) && GetDocument()->DataFileSlotFree())
+		if (GetDocument()->UseTempFile(end_addr - start_addr))
 		{
 			CWaitCursor wait;                                  // Turn on wait cursor (hourglass)
 
@@ -13780,35 +13712,6 @@ void CHexEditView::OnEncrypt()
 		}
 		else
 		{
-			// Error if ran out of temp file handles and file is too big
-			if (end_addr - start_addr > UINT_MAX)  // why is there no SIZE_T_MAX?
-			{
-				TaskMessageBox("Encryption Error",
-					"HexEdit is out of temporary files and "
-					"cannot encrypt such a large selection.\n\n"
-					"Please save the file to deallocate "
-					"temporary file handles and try again.");
-				theApp.mac_error_ = 10;
-				return;
-			}
-
-			// Warn if we might cause memory exhaustion
-			if (end_addr - start_addr > MEM_WARNING_SIZE)  // More than 256 Mb may be too big
-			{
-				if (TaskMessageBox("Encryption Warning",
-					"HexEdit is out of temporary file "
-					"handles and encrypting such a large selection "
-					"may cause memory exhaustion.  Please click "
-					"\"No\" and save the file to free handles "
-					"or click \"Yes\" to continue.\n\n"
-					"Do you want to continue?",
-					MB_YESNO) != IDYES)
-				{
-					theApp.mac_error_ = 5;
-					return;
-				}
-			}
-
 			CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
 			size_t len = size_t(end_addr - start_addr); // Length of selection
@@ -14008,7 +13911,7 @@ void CHexEditView::OnDecrypt()
 		}
 
 		// Test if selection is too big to do in memory
-		if (end_addr - start_addr > (16*1024*1024) && GetDocument()->DataFileSlotFree())
+		if (GetDocument()->UseTempFile(end_addr - start_addr))
 		{
 			CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
@@ -14104,35 +14007,6 @@ void CHexEditView::OnDecrypt()
 		}
 		else
 		{
-			// Error if ran out of temp file handles and file is too big
-			if (end_addr - start_addr > UINT_MAX)  // why is there no SIZE_T_MAX?
-			{
-				TaskMessageBox("Decryption Error",
-					"HexEdit is out of temporary files and "
-					"cannot decrypt such a large selection.\n\n"
-					"Please save the file to deallocate "
-					"temporary file handles and try again.");
-				theApp.mac_error_ = 10;
-				return;
-			}
-
-			// Warn if we might cause memory exhaustion
-			if (end_addr - start_addr > MEM_WARNING_SIZE)  // buffer may be too big
-			{
-				if (TaskMessageBox("Decryption Warning",
-					"HexEdit is out of temporary file "
-					"handles and decrypting such a large selection "
-					"may cause memory exhaustion.  Please click "
-					"\"No\" and save the file to free handles "
-					"or click \"Yes\" to continue.\n\n"
-					"Do you want to continue?",
-					MB_YESNO) != IDYES)
-				{
-					theApp.mac_error_ = 5;
-					return;
-				}
-			}
-
 			size_t len = size_t(end_addr - start_addr); // Length of selection
 			size_t outlen;          // Size of decrypted text (may be less than encrypted)
 
@@ -14322,11 +14196,11 @@ void CHexEditView::OnCompress()
 					   ) == Z_OK);
 
 	// Test if selection is too big to do in memory
-	if (end_addr - start_addr > (16*1024*1024) && GetDocument()->DataFileSlotFree())
+	if (GetDocument()->UseTempFile(end_addr - start_addr))
 	{
 		CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
-		int idx = -1;                       // Index into docs data_file_ array (or -1 if no slots avail.)
+		int idx = -1;                       // Index into docs data_file_ array
 
 		// Create a "temp" file to store the compressed data
 		// (This file stores the compressed data until the document is closed or written to disk.)
@@ -14445,35 +14319,6 @@ void CHexEditView::OnCompress()
 	{
 		// Allocate memory block and compress into it
 
-		// Error if ran out of temp file handles and file is too big
-		if (end_addr - start_addr > UINT_MAX)  // why is there no SIZE_T_MAX?
-		{
-			TaskMessageBox("Compression Error",
-				"HexEdit is out of temporary files and "
-				"cannot compress such a large selection.\n\n"
-				"Please save the file to deallocate "
-				"temporary file handles and try again.");
-			theApp.mac_error_ = 10;
-			return;
-		}
-
-		// Warn if we might cause memory exhaustion
-		if (end_addr - start_addr > MEM_WARNING_SIZE)  // buffer may be too big
-		{
-			if (TaskMessageBox("Compression Warning",
-				"HexEdit is out of temporary file "
-				"handles and compressing such a large selection "
-				"may cause memory exhaustion.  Please click "
-				"\"No\" and save the file to free handles "
-				"or click \"Yes\" to continue.\n\n"
-				"Do you want to continue?",
-				MB_YESNO) != IDYES)
-			{
-				theApp.mac_error_ = 5;
-				return;
-			}
-		}
-
 		CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
 		try
@@ -14597,12 +14442,12 @@ void CHexEditView::OnDecompress()
 						windowBits
 					   ) == Z_OK);
 
-	// Test if selection is too big to do in memory (Note that even a small selection can expand greatly)
-	if (end_addr - start_addr > (2*1024*1024) && GetDocument()->DataFileSlotFree())
+	// Test if selection is too big to do in memory (allowing for it to expand greatly)
+	if (GetDocument()->UseTempFile(8*(end_addr - start_addr)))
 	{
 		CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
-		int idx = -1;                       // Index into docs data_file_ array (or -1 if no slots avail.)
+		int idx = -1;                       // Index into docs data_file_ array
 
 		// Create a "temp" file to store the compressed data
 		// (This file stores the compressed data until the document is closed or written to disk.)
@@ -14742,35 +14587,6 @@ void CHexEditView::OnDecompress()
 	{
 		// Allocate memory block and decompress into it
 
-		// Error if ran out of temp file handles and file is too big
-		if (end_addr - start_addr > UINT_MAX)  // why is there no SIZE_T_MAX?
-		{
-			TaskMessageBox("Decompression Error",
-				"HexEdit is out of temporary files and "
-				"cannot decompress such a large selection.\n\n"
-				"Please save the file to deallocate "
-				"temporary file handles and try again.");
-			theApp.mac_error_ = 10;
-			return;
-		}
-
-		// Warn if we might cause memory exhaustion
-		if (end_addr - start_addr > MEM_WARNING_SIZE)  // 256 Mb file may be too big
-		{
-			if (TaskMessageBox("Decompression Warning",
-				"HexEdit is out of temporary file "
-				"handles and decompressing such a large selection "
-				"may cause memory exhaustion.  Please click "
-				"\"No\" and save the file to free handles "
-				"or click \"Yes\" to continue.\n\n"
-				"Do you want to continue?",
-				MB_YESNO) != IDYES)
-			{
-				theApp.mac_error_ = 5;
-				return;
-			}
-		}
-
 		CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
 		try
@@ -15398,14 +15214,18 @@ void CHexEditView::DoDigest(CryptoPP::HashTransformation * digest, int mac_id)
 	}
 	ASSERT(buf != NULL);
 
-	// Process the selection in "buflen" chunks
+	// Process the selection in chunks of up to "buflen" bytes
+	doc_cursor cursor;
+	doc_span span;
 	for (FILE_ADDRESS curr = start_addr; curr < end_addr; curr += len)
 	{
-		// Get the next buffer full from the document
-		len = size_t(min(buflen, end_addr - curr));
-		VERIFY(GetDocument()->GetData(buf, len, curr) == len);
+		// Get the next chunk from the document (without copying if possible)
+		const unsigned char *pbuf;
+		len = GetDocument()->GetSpan(pbuf, buf, buflen, curr, end_addr, cursor, span);
+		ASSERT(len > 0);
 
-		digest->Update(buf, len);  // update digest
+		digest->Update(pbuf, len);  // update digest
+		span.release();             // (before any message box etc below)
 
 		// Allow for abort + update progress
 		if (AbortKeyPress() &&
@@ -15710,9 +15530,9 @@ template<class T> void OnOperateBinary(CHexEditView *pv, binop_type op, LPCSTR d
 	int div0 = 0;   // Count of divide by zero errors (for binop_divide_x and binop_mod_x)
 
 	// Test if selection is too big to do in memory
-	if (end_addr - start_addr > (16*1024*1024) && pv->GetDocument()->DataFileSlotFree())
+	if (pv->GetDocument()->UseTempFile(end_addr - start_addr))
 	{
-		int idx = -1;                       // Index into docs data_file_ array (or -1 if no slots avail.)
+		int idx = -1;                       // Index into docs data_file_ array
 
 		// Create a file to store the resultant data
 		// (Temp file used by the document until it is closed or written to disk.)
@@ -15789,35 +15609,6 @@ template<class T> void OnOperateBinary(CHexEditView *pv, binop_type op, LPCSTR d
 	{
 		// Allocate memory block and process it
 
-		// Error if ran out of temp file handles and file is too big
-		if (end_addr - start_addr > UINT_MAX)  // why is there no SIZE_T_MAX?
-		{
-			TaskMessageBox("Large Selection Error",
-				"HexEdit is out of temporary files and "
-				"cannot operate on such a large selection.\n\n"
-				"Please save the file to deallocate "
-				"temporary file handles and try again.");
-			theApp.mac_error_ = 10;
-			return;
-		}
-
-		// Warn if we might cause memory exhaustion
-		if (end_addr - start_addr > MEM_WARNING_SIZE)  // buffer may be too big
-		{
-			if (TaskMessageBox("Warning",
-				"HexEdit is out of temporary file "
-				"handles and operating on such a large selection "
-				"may cause memory exhaustion.  Please click "
-				"\"No\" and save the file to free handles "
-				"or click \"Yes\" to continue.\n\n"
-				"Do you want to continue?",
-				MB_YESNO) != IDYES)
-			{
-				theApp.mac_error_ = 5;
-				return;
-			}
-		}
-
 		CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
 		try
@@ -16421,9 +16212,9 @@ template<class T> void OnOperateUnary(CHexEditView *pv, unary_type op, LPCSTR de
 	ASSERT(start_addr < end_addr && end_addr <= pv->GetDocument()->length());
 
 	// Test if selection is too big to do in memory
-	if (end_addr - start_addr > (16*1024*1024) && pv->GetDocument()->DataFileSlotFree())
+	if (pv->GetDocument()->UseTempFile(end_addr - start_addr))
 	{
-		int idx = -1;                       // Index into docs data_file_ array (or -1 if no slots avail.)
+		int idx = -1;                       // Index into docs data_file_ array
 
 		// Create a file to store the resultant data
 		// (Temp file used by the document until it is closed or written to disk.)
@@ -16507,35 +16298,6 @@ template<class T> void OnOperateUnary(CHexEditView *pv, unary_type op, LPCSTR de
 	{
 		// Allocate memory block and process it
 
-		// Error if ran out of temp file handles and file is too big
-		if (end_addr - start_addr > UINT_MAX)  // why is there no SIZE_T_MAX?
-		{
-			TaskMessageBox("Large Selection Error",
-				"HexEdit is out of temporary files and "
-				"cannot operate on such a large selection.\n\n"
-				"Please save the file to deallocate "
-				"temporary file handles and try again.");
-			theApp.mac_error_ = 10;
-			return;
-		}
-
-		// Warn if we might cause memory exhaustion
-		if (end_addr - start_addr > MEM_WARNING_SIZE)  // buffer may be too big
-		{
-			if (TaskMessageBox("Warning",
-				"HexEdit is out of temporary file "
-				"handles and operating on such a large selection "
-				"may cause memory exhaustion.  Please click "
-				"\"No\" and save the file to free handles "
-				"or click \"Yes\" to continue.\n\n"
-				"Do you want to continue?",
-				MB_YESNO) != IDYES)
-			{
-				theApp.mac_error_ = 5;
-				return;
-			}
-		}
-
 		CWaitCursor wait;                           // Turn on wait cursor (hourglass)
 
 #ifdef USE_SSE2
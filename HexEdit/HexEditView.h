@@ -305,6 +305,7 @@ public:
 	void do_hex_text(CString file_name);
 	void do_font(LOGFONT *plf);
 	void do_replace(FILE_ADDRESS start, FILE_ADDRESS end, unsigned char *pp, size_t len);
+	bool do_replace_all(const std::vector<FILE_ADDRESS> &found, FILE_ADDRESS len, unsigned char *pp, size_t replen);
 	void do_insert_block(_int64 params, const char *data_str);
 
 	void DoConversion(convert_type op, LPCSTR desc);  // byte-size conversions
@@ -11,6 +11,7 @@
 #include "HexEdit.h"
 #include "HexEditDoc.h"
 #include "HexEditView.h"
+#include "Boyer.h"
 
 /////////////////////////////////////////////////////////////////////////////
 // CHexEditView drawing
@@ -774,52 +775,52 @@ void CHexEditView::OnDraw(CDC* pDC)
 	// [Don't print bookmarks if hide_bookmarks is on OR printing and print_bookmarks_ is off]
 	if (!(display_.hide_bookmarks || pDC->IsPrinting() && !theApp.print_bookmarks_))
 	{
-		// Draw bookmarks
-		for (std::vector<FILE_ADDRESS>::const_iterator pbm = pDoc->bm_posn_.begin();
-			 pbm != pDoc->bm_posn_.end(); ++pbm)
+		// Draw bookmarks (just those in the display area)
+		for (size_t rr = pDoc->bm_posn_.lower(first_addr); rr < pDoc->bm_posn_.size(); ++rr)
 		{
-			if (*pbm >= first_addr && *pbm <= last_addr)
-			{
-				CRect mark_rect;
+			FILE_ADDRESS bm_addr = pDoc->bm_posn_.sorted(rr);
+			if (bm_addr > last_addr)
+				break;
 
-				mark_rect.top = int(((*pbm + offset_)/rowsize_) * line_height - 
-									doc_rect.top + bdr_top_ + 1);
+			CRect mark_rect;
+
+			mark_rect.top = int(((bm_addr + offset_)/rowsize_) * line_height - 
+								doc_rect.top + bdr_top_ + 1);
 //                mark_rect.bottom = mark_rect.top + line_height - 3;
-				mark_rect.bottom = mark_rect.top + line_height - 1;
-				if (neg_y)
-				{
-					mark_rect.top = -mark_rect.top;
-					mark_rect.bottom = -mark_rect.bottom;
-				}
+			mark_rect.bottom = mark_rect.top + line_height - 1;
+			if (neg_y)
+			{
+				mark_rect.top = -mark_rect.top;
+				mark_rect.bottom = -mark_rect.bottom;
+			}
 
-				if (!display_.vert_display && display_.hex_area)
-				{
-					mark_rect.left = hex_pos(int((*pbm + offset_)%rowsize_), char_width) - 
-									doc_rect.left + bdr_left_;
+			if (!display_.vert_display && display_.hex_area)
+			{
+				mark_rect.left = hex_pos(int((bm_addr + offset_)%rowsize_), char_width) - 
+								doc_rect.left + bdr_left_;
 //                        mark_rect.right = mark_rect.left + 2*char_width;
-					mark_rect.right = mark_rect.left + 2*char_width + 2;
-					if (neg_x)
-					{
-						mark_rect.left = -mark_rect.left;
-						mark_rect.right = -mark_rect.right;
-					}
-
-					pDC->FillSolidRect(&mark_rect, bm_col_);
+				mark_rect.right = mark_rect.left + 2*char_width + 2;
+				if (neg_x)
+				{
+					mark_rect.left = -mark_rect.left;
+					mark_rect.right = -mark_rect.right;
 				}
 
-				if (display_.vert_display || display_.char_area)
-				{
-					mark_rect.left = char_pos(int((*pbm + offset_)%rowsize_), char_width, char_width_w) - 
-									doc_rect.left  + bdr_left_ + 1;
+				pDC->FillSolidRect(&mark_rect, bm_col_);
+			}
+
+			if (display_.vert_display || display_.char_area)
+			{
+				mark_rect.left = char_pos(int((bm_addr + offset_)%rowsize_), char_width, char_width_w) - 
+								doc_rect.left  + bdr_left_ + 1;
 //                        mark_rect.right = mark_rect.left + char_width_w - 2;
-					mark_rect.right = mark_rect.left + char_width_w;
-					if (neg_x)
-					{
-						mark_rect.left = -mark_rect.left;
-						mark_rect.right = -mark_rect.right;
-					}
-					pDC->FillSolidRect(&mark_rect, bm_col_);
+				mark_rect.right = mark_rect.left + char_width_w;
+				if (neg_x)
+				{
+					mark_rect.left = -mark_rect.left;
+					mark_rect.right = -mark_rect.right;
 				}
+				pDC->FillSolidRect(&mark_rect, bm_col_);
 			}
 		}
 	}
@@ -1074,20 +1075,22 @@ void CHexEditView::OnDraw(CDC* pDC)
 	if (pDC->IsPrinting())
 	{
 		// Only print search occurrences if print_search_ is on
-		if (theApp.print_search_)
+		if (theApp.print_search_ && theApp.pboyer_ != NULL)
 		{
 			// Draw search string occurrences
 			// Note this goes through all search occurrences (since search_pair_ is
 			// calculated for the current window) which may be slow but then so is printing.
-			std::vector<FILE_ADDRESS> sf = GetDocument()->SearchAddresses(first_addr-search_length_, last_addr+search_length_);
+			std::vector<int> ids;
+			std::vector<FILE_ADDRESS> sf = GetDocument()->SearchAddresses(first_addr-search_length_, last_addr+search_length_, &ids);
 			std::vector<FILE_ADDRESS>::const_iterator pp;
+			std::vector<int>::const_iterator pid;
 
-			for (pp = sf.begin(); pp != sf.end(); ++pp)
+			for (pp = sf.begin(), pid = ids.begin(); pp != sf.end(); ++pp, ++pid)
 			{
 				draw_bg(pDC, doc_rect, neg_x, neg_y,
 						line_height, char_width, char_width_w, search_col_,
 						max(*pp, first_addr), 
-						min(*pp + search_length_, last_addr));
+						min(*pp + FILE_ADDRESS(theApp.pboyer_->pattern_length(*pid)), last_addr));
 			}
 		}
 	}
@@ -1170,6 +1173,7 @@ end_of_background_drawing:
 	// THIS IS WHERE THE ACTUAL LINES ARE DRAWN
 	// Note: we use != (line != last_line) since we may be drawing from bottom or top
 	FILE_ADDRESS line;
+	doc_cursor cursor;                       // Avoids searching for every line's data
 	for (line = first_line; line != last_line;
 							line += line_inc, norm_rect += rect_inc)
 	{
@@ -1202,14 +1206,14 @@ end_of_background_drawing:
 
 		if (line*rowsize_ - offset_ < first_addr)
 		{
-			last_col = pDoc->GetData(buf + offset_, rowsize_ - offset_ + extra_bytes, line*rowsize_) +
+			last_col = pDoc->GetData(buf + offset_, rowsize_ - offset_ + extra_bytes, line*rowsize_, cursor) +
 						offset_;
 			ii = size_t(first_addr - (line*rowsize_ - offset_));
 			ASSERT(int(ii) < rowsize_);
 		}
 		else
 		{
-			last_col = pDoc->GetData(buf, rowsize_ + extra_bytes, line*rowsize_ - offset_);
+			last_col = pDoc->GetData(buf, rowsize_ + extra_bytes, line*rowsize_ - offset_, cursor);
 			ii = 0;
 		}
 		if (last_col > rowsize_) last_col = rowsize_;  // Don't let extra_bytes affect number of columns to display
@@ -2414,12 +2418,8 @@ void CHexEditView::draw_deletions(CDC* pDC, const vector<FILE_ADDRESS> & addr, c
 
 	COLORREF prev_col = pDC->SetTextColor(bg_col_);
 
-	int ii;
-	// Skip blocks above the top of the display area
-	// [This needs to be a binary search in case we get a large number of compare diffs]
-	for (ii = 0; ii < addr.size(); ++ii)
-		if (addr[ii] >= first_virt)
-			break;
+	// Skip blocks above the top of the display area (binary search as there may be a lot of them)
+	int ii = int(std::lower_bound(addr.begin(), addr.end(), first_virt) - addr.begin());
 
 	for ( ; ii < addr.size(); ++ii)
 	{
@@ -2483,11 +2483,11 @@ void CHexEditView::draw_backgrounds(CDC* pDC,
 	int ii;
 	if (!ScrollUp())
 	{
-		// Skip blocks above the top of the display area
-		// [This needs to be a binary search in case we get a large number of compare diffs]
-		for (ii = 0; ii < addr.size(); ++ii)
-			if (addr[ii] + len[ii] > first_virt)
-				break;
+		// Skip blocks above the top of the display area (binary search as there may be a lot
+		// of them) then go back to the block that first_virt is in (if any)
+		ii = int(std::lower_bound(addr.begin(), addr.end(), first_virt) - addr.begin());
+		while (ii > 0 && addr[ii-1] + len[ii-1] > first_virt)
+			--ii;
 
 		for ( ; ii < addr.size(); ++ii)
 		{
@@ -2505,10 +2505,7 @@ void CHexEditView::draw_backgrounds(CDC* pDC,
 	else
 	{
 		// Starting at end skip blocks below the display area
-		// [This needs to be a binary search in case we get a large number of compare diffs]
-		for (ii = addr.size() - 1; ii >= 0; ii--)
-			if (addr[ii] < last_virt)
-				break;
+		ii = int(std::lower_bound(addr.begin(), addr.end(), last_virt) - addr.begin()) - 1;
 
 		for ( ; ii >= 0; ii--)
 		{
@@ -0,0 +1,365 @@
+// LocTree.cpp : implements loc_tree (see LocTree.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// The tree is a treap: nodes are in document order (left to right) and each
+// node has a random priority which is never less than that of its children.
+// All changes are done using just two operations:
+//  - split_node() which divides a tree into the bytes before an address and
+//    the bytes from the address on (splitting a record in two if necessary)
+//  - merge_node() which joins two trees where all of the 1st comes first
+// Both of these take O(log n) time (expected) where n is the number of records.
+//
+// Nodes may be shared between trees (see the copy constructor) so before a node
+// is changed own() is used to get a copy of it if anything else points to it.
+
+#include "stdafx.h"
+#include "HexEdit.h"
+#include "LocTree.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+loc_tree::iterator &loc_tree::iterator::operator++()
+{
+	ASSERT(!path_.empty());             // can't increment end()
+	node *nn = path_.back();
+	if (nn->right != NULL)
+	{
+		// Next is the leftmost node of the right subtree
+		for (nn = nn->right; nn != NULL; nn = nn->left)
+			path_.push_back(nn);
+	}
+	else
+	{
+		// Go up until we come up from a left subtree (if we never do we are at end())
+		node *child;
+		do
+		{
+			child = path_.back();
+			path_.pop_back();
+		} while (!path_.empty() && path_.back()->right == child);
+	}
+	return *this;
+}
+
+loc_tree::iterator &loc_tree::iterator::operator--()
+{
+	ASSERT(ptree_ != NULL);
+	if (path_.empty())
+	{
+		// Go back from end() to the last node
+		for (node *nn = ptree_->root_; nn != NULL; nn = nn->right)
+			path_.push_back(nn);
+		ASSERT(!path_.empty());         // can't decrement begin()
+	}
+	else if (path_.back()->left != NULL)
+	{
+		// Previous is the rightmost node of the left subtree
+		for (node *nn = path_.back()->left; nn != NULL; nn = nn->right)
+			path_.push_back(nn);
+	}
+	else
+	{
+		// Go up until we come up from a right subtree
+		node *child;
+		do
+		{
+			child = path_.back();
+			path_.pop_back();
+		} while (!path_.empty() && path_.back()->left == child);
+		ASSERT(!path_.empty());         // can't decrement begin()
+	}
+	return *this;
+}
+
+loc_tree::iterator loc_tree::begin() const
+{
+	iterator retval;
+	retval.ptree_ = this;
+	for (node *nn = root_; nn != NULL; nn = nn->left)
+		retval.path_.push_back(nn);
+	return retval;
+}
+
+loc_tree::iterator loc_tree::find(FILE_ADDRESS address, FILE_ADDRESS &pos) const
+{
+	ASSERT(address >= 0);
+	iterator retval;
+	retval.ptree_ = this;
+
+	pos = 0;
+	node *nn = root_;
+	while (nn != NULL)
+	{
+		retval.path_.push_back(nn);
+		FILE_ADDRESS left_len = nn->left == NULL ? 0 : nn->left->total;
+		if (address < pos + left_len)
+			nn = nn->left;
+		else if (address < pos + left_len + FILE_ADDRESS(nn->loc.dlen&doc_loc::mask))
+		{
+			pos += left_len;
+			return retval;              // found it
+		}
+		else
+		{
+			pos += left_len + FILE_ADDRESS(nn->loc.dlen&doc_loc::mask);
+			nn = nn->right;
+		}
+	}
+
+	// Past EOF
+	ASSERT(pos == length());
+	retval.path_.clear();
+	return retval;
+}
+
+loc_tree::iterator loc_tree::find(FILE_ADDRESS address, FILE_ADDRESS &pos, const doc_cursor &cursor) const
+{
+	ASSERT(address >= 0);
+	if (cursor.ptree_ == this && cursor.version_ == version_ && cursor.pl_ != end())
+	{
+		FILE_ADDRESS len = FILE_ADDRESS(cursor.pl_->dlen&doc_loc::mask);
+		if (address >= cursor.pos_ && address < cursor.pos_ + len)
+		{
+			pos = cursor.pos_;
+			return cursor.pl_;              // still in the same record
+		}
+		else if (address >= cursor.pos_ + len)
+		{
+			// Check if it's in the next record
+			iterator retval(cursor.pl_);
+			pos = cursor.pos_ + len;
+			if (++retval == end())
+				return retval;              // past EOF
+			if (address < pos + FILE_ADDRESS(retval->dlen&doc_loc::mask))
+				return retval;
+		}
+		else
+		{
+			// Check if it's in the previous record (eg overlapping reads)
+			iterator retval(cursor.pl_);
+			--retval;
+			pos = cursor.pos_ - FILE_ADDRESS(retval->dlen&doc_loc::mask);
+			if (address >= pos)
+				return retval;
+		}
+	}
+	return find(address, pos);
+}
+
+void loc_tree::remember(doc_cursor &cursor, const iterator &pl, FILE_ADDRESS pos) const
+{
+	ASSERT(pl.ptree_ == this);
+	cursor.ptree_ = this;
+	cursor.version_ = version_;
+	cursor.pl_ = pl;
+	cursor.pos_ = pos;
+}
+
+// Versions of all trees come from the one counter so that a cursor can't match a
+// different tree that is at the same address (eg a snapshot that is taken again).
+unsigned loc_tree::new_version()
+{
+	static volatile LONG last = 0;
+	return unsigned(::InterlockedIncrement(&last));
+}
+
+loc_tree::loc_tree(const loc_tree &other) : root_(other.root_), seed_(other.seed_), version_(new_version())
+{
+	if (root_ != NULL)
+		++root_->refs;
+}
+
+loc_tree &loc_tree::operator=(const loc_tree &other)
+{
+	node *nn = other.root_;
+	if (nn != NULL)
+		++nn->refs;                     // before clear() in case other is this tree
+	clear();
+	root_ = nn;
+	return *this;
+}
+
+void loc_tree::clear()
+{
+	version_ = new_version();
+	destroy(root_);
+	root_ = NULL;
+}
+
+void loc_tree::push_back(const doc_loc &dl)
+{
+	version_ = new_version();
+	root_ = merge_node(root_, new_node(dl));
+}
+
+void loc_tree::split(FILE_ADDRESS address)
+{
+	version_ = new_version();
+	node *ll, *rr;
+	split_node(root_, address, ll, rr);
+	root_ = merge_node(ll, rr);
+}
+
+void loc_tree::insert(FILE_ADDRESS address, const doc_loc &dl)
+{
+	version_ = new_version();
+	ASSERT(address <= length());
+	node *ll, *rr;
+	split_node(root_, address, ll, rr);
+	root_ = merge_node(merge_node(ll, new_node(dl)), rr);
+}
+
+void loc_tree::erase(FILE_ADDRESS address, FILE_ADDRESS len)
+{
+	version_ = new_version();
+	node *ll, *mm, *rr;
+	split_node(root_, address, ll, rr);
+	split_node(rr, len, mm, rr);
+	root_ = merge_node(ll, rr);
+	destroy(mm);
+}
+
+void loc_tree::cut(FILE_ADDRESS address, FILE_ADDRESS len, loc_tree &removed)
+{
+	ASSERT(&removed != this && removed.root_ == NULL);
+	version_ = new_version();
+	removed.version_ = new_version();
+	node *ll, *rr;
+	split_node(root_, address, ll, rr);
+	split_node(rr, len, removed.root_, rr);
+	root_ = merge_node(ll, rr);
+}
+
+void loc_tree::paste(FILE_ADDRESS address, loc_tree &from)
+{
+	ASSERT(&from != this && address <= length());
+	version_ = new_version();
+	from.version_ = new_version();
+	node *ll, *rr;
+	split_node(root_, address, ll, rr);
+	root_ = merge_node(merge_node(ll, from.root_), rr);
+	from.root_ = NULL;
+}
+
+loc_tree::node *loc_tree::new_node(const doc_loc &dl)
+{
+	// Simple xorshift generator is plenty random enough to keep the tree balanced
+	seed_ ^= seed_ << 13;
+	seed_ ^= seed_ >> 17;
+	seed_ ^= seed_ << 5;
+	return new node(dl, seed_);
+}
+
+// Returns a node that can be modified: nn itself if it is not shared, else a copy of it
+// (the caller's reference to nn is transferred to the copy).
+loc_tree::node *loc_tree::own(node *nn)
+{
+	ASSERT(nn != NULL && nn->refs > 0);
+	if (nn->refs == 1)
+		return nn;
+
+	node *retval = new node(*nn);
+	retval->refs = 1;
+	if (retval->left != NULL)
+		++retval->left->refs;
+	if (retval->right != NULL)
+		++retval->right->refs;
+	--nn->refs;
+	return retval;
+}
+
+// Releases a reference to a tree, freeing the nodes that are no longer used
+void loc_tree::destroy(node *nn)
+{
+	if (nn != NULL && --nn->refs == 0)
+	{
+		destroy(nn->left);
+		destroy(nn->right);
+		delete nn;
+	}
+}
+
+// Splits the tree nn so that ll gets all bytes before address and rr the rest.
+// If address is within a record then the record is split into two records.
+void loc_tree::split_node(node *nn, FILE_ADDRESS address, node *&ll, node *&rr)
+{
+	if (nn == NULL)
+	{
+		ll = rr = NULL;
+		return;
+	}
+
+	nn = own(nn);
+	FILE_ADDRESS left_len = nn->left == NULL ? 0 : nn->left->total;
+	FILE_ADDRESS len = FILE_ADDRESS(nn->loc.dlen&doc_loc::mask);
+	if (address <= left_len)
+	{
+		split_node(nn->left, address, ll, nn->left);
+		nn->fix();
+		rr = nn;
+	}
+	else if (address >= left_len + len)
+	{
+		split_node(nn->right, address - left_len - len, nn->right, rr);
+		nn->fix();
+		ll = nn;
+	}
+	else
+	{
+		// The address is within this record - make a new record for the 2nd bit
+		FILE_ADDRESS split = address - left_len;        // Length of 1st bit
+		node *tail;
+		switch (nn->loc.dlen >> 62)
+		{
+		case 1:
+			tail = new_node(doc_loc(nn->loc.fileaddr + split, len - split));
+			break;
+		case 2:
+			tail = new_node(doc_loc(nn->loc.memaddr + size_t(split), len - split));
+			break;
+		default:
+			ASSERT((nn->loc.dlen >> 62) == 3);
+			tail = new_node(doc_loc(nn->loc.fileaddr + split, len - split, nn->loc.fileid));
+			break;
+		}
+		nn->loc.dlen = split | (nn->loc.dlen & ~doc_loc::mask);   // keep the type bits
+
+		rr = merge_node(tail, nn->right);
+		nn->right = NULL;
+		nn->fix();
+		ll = nn;
+	}
+}
+
+// Joins 2 trees where all records of ll come before all records of rr
+loc_tree::node *loc_tree::merge_node(node *ll, node *rr)
+{
+	if (ll == NULL)
+		return rr;
+	if (rr == NULL)
+		return ll;
+
+	if (ll->prio > rr->prio)
+	{
+		ll = own(ll);
+		ll->right = merge_node(ll->right, rr);
+		ll->fix();
+		return ll;
+	}
+	else
+	{
+		rr = own(rr);
+		rr->left = merge_node(ll, rr->left);
+		rr->fix();
+		return rr;
+	}
+}
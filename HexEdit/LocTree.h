@@ -0,0 +1,210 @@
+// LocTree.h : location records (doc_loc) and the balanced tree that holds them
+//
+// For implementation see: LocTree.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// The document (see CHexEditDoc) is represented as a sequence of pieces, each
+// of which says where a run of consecutive bytes comes from (the original file,
+// memory or a temp data file).  This used to be kept in a std::list<doc_loc>
+// but finding the piece containing an address meant walking the list from
+// the start, which gets slow once there are thousands of edits.
+//
+// loc_tree stores the pieces (in document order) in a randomised balanced
+// binary tree (a treap) where each node also stores the total number of bytes
+// in its subtree.  This allows finding the piece at an address, splitting a
+// piece and inserting/deleting a range of bytes all in O(log n) time.
+//
+// The tree is persistent: copying a loc_tree takes O(1) time as the copy shares
+// all the nodes of the original.  Shared nodes are never modified - a change
+// copies the nodes (only O(log n) of them) on the path to what it changes.  This
+// is used to give background threads a snapshot of the document that does not
+// change as the document is edited (see CHexEditDoc::TakeSnapshot).
+// Note: the node reference counts are not thread-safe so copying and changing
+// trees that share nodes must be done with a lock (see CHexEditDoc::docrw_).
+// Reading a tree while another tree sharing its nodes is changed is safe.
+
+#ifndef LOCTREE_INCLUDED
+#define LOCTREE_INCLUDED  1
+
+#include <vector>
+#include <algorithm>
+
+class doc_cursor;
+
+// These structures are used to easily access the current doc data
+struct doc_loc
+{
+	static const FILE_ADDRESS mask;      // masks off the top 2 bits of dlen
+
+	// Location type is now stored in the top 2 bits of dlen (0=unknown, 1=orig file, 2=memory, 3=other file)
+	unsigned __int64 dlen;               // Data block len - needs to be as big as a file can be
+	union
+	{
+		FILE_ADDRESS fileaddr;  // File location (if file)
+		unsigned char *memaddr; // Ptr to data (if mem)
+	};
+	int fileid;                 // Data file number (index into data_file_) if location == 3, else -1
+
+	doc_loc(FILE_ADDRESS f, unsigned __int64 n)
+	{
+//        location = loc_file;
+		ASSERT(FILE_ADDRESS(n) <= mask);
+		dlen = n | ((unsigned __int64)1 << 62);  // 1 = orig file
+		fileaddr = f;
+		fileid = -1;
+	}
+	doc_loc(unsigned char *m, unsigned __int64 n)
+	{
+//        location = loc_mem;
+		ASSERT(FILE_ADDRESS(n) <= mask);
+		dlen = n | ((unsigned __int64)2 << 62); // 2 = memory
+		memaddr = m;
+		fileid = -1;
+	}
+	doc_loc(FILE_ADDRESS f, unsigned __int64 n, int idx)
+	{
+		ASSERT(FILE_ADDRESS(n) <= mask);
+		ASSERT(idx >= 0);
+		dlen = n | ((unsigned __int64)3 << 62);  // 3 = data file
+		fileaddr = f;
+		fileid = idx;
+	}
+
+private:
+	doc_loc();                          // Default constructor (not used)
+};
+
+// loc_tree holds all the doc_loc records of a document in document order.
+// The interface is similar to the std::list that it replaced (begin(), end(),
+// push_back(), clear() and bidirectional iterators) but records can only be
+// modified using the address based functions split(), insert() and erase().
+class loc_tree
+{
+	struct node
+	{
+		node(const doc_loc &dl, unsigned pr) : loc(dl), left(NULL), right(NULL), prio(pr), refs(1) { fix(); }
+
+		doc_loc loc;                    // The location record
+		node *left, *right;             // Children (left = earlier in doc, right = later)
+		FILE_ADDRESS total;             // Number of bytes in this subtree
+		size_t count;                   // Number of records in this subtree
+		unsigned prio;                  // Random heap priority (higher is closer to root)
+		unsigned refs;                  // Number of trees/nodes that point to this node
+
+		// Recalculate total and count after the node or its children have changed
+		void fix()
+		{
+			total = FILE_ADDRESS(loc.dlen&doc_loc::mask);
+			count = 1;
+			if (left != NULL)  { total += left->total;  count += left->count; }
+			if (right != NULL) { total += right->total; count += right->count; }
+		}
+	};
+
+public:
+	// Iterators only give read access to the records (see split() etc to change them).
+	// An iterator is invalidated by any change to the tree.
+	class iterator
+	{
+		friend class loc_tree;
+	public:
+		iterator() : ptree_(NULL) { }
+
+		const doc_loc &operator*() const { ASSERT(!path_.empty()); return path_.back()->loc; }
+		const doc_loc *operator->() const { ASSERT(!path_.empty()); return &path_.back()->loc; }
+
+		iterator &operator++();
+		iterator &operator--();
+		iterator operator++(int) { iterator tmp(*this); ++*this; return tmp; }
+		iterator operator--(int) { iterator tmp(*this); --*this; return tmp; }
+
+		bool operator==(const iterator &other) const { return curr() == other.curr(); }
+		bool operator!=(const iterator &other) const { return curr() != other.curr(); }
+
+	private:
+		node *curr() const { return path_.empty() ? NULL : path_.back(); }
+
+		const loc_tree *ptree_;         // Tree we are iterating (needed to go backwards from end())
+		std::vector<node *> path_;      // Nodes from root down to current node (empty for end())
+	};
+	typedef iterator const_iterator;
+
+	loc_tree() : root_(NULL), seed_(0x2545F491), version_(new_version()) { }
+	loc_tree(const loc_tree &other);                // O(1) - shares all nodes
+	loc_tree &operator=(const loc_tree &other);
+	~loc_tree() { clear(); }
+	void swap(loc_tree &other)          // O(1) - exchanges the records (invalidates cursors of both)
+	{
+		std::swap(root_, other.root_);
+		std::swap(seed_, other.seed_);
+		version_ = new_version();
+		other.version_ = new_version();
+	}
+
+	bool empty() const { return root_ == NULL; }
+	size_t size() const { return root_ == NULL ? 0 : root_->count; }
+	FILE_ADDRESS length() const { return root_ == NULL ? 0 : root_->total; }
+	unsigned version() const { return version_; }  // Changes whenever the records change
+
+	iterator begin() const;
+	iterator end() const { iterator retval; retval.ptree_ = this; return retval; }
+
+	// Returns the record containing address (or end() if address is past EOF)
+	// and sets pos to the address of the start of that record (or length() if end()).
+	iterator find(FILE_ADDRESS address, FILE_ADDRESS &pos) const;
+
+	// Same as above but first tries the record remembered in the cursor (and its
+	// neighbours) which avoids searching the tree when reading sequentially.
+	iterator find(FILE_ADDRESS address, FILE_ADDRESS &pos, const doc_cursor &cursor) const;
+	// Remember a record (pl starts at address pos) for the next call of find()
+	void remember(doc_cursor &cursor, const iterator &pl, FILE_ADDRESS pos) const;
+
+	void clear();                       // Remove all records
+	void push_back(const doc_loc &dl);  // Add record at end of the document
+	void split(FILE_ADDRESS address);   // Make sure a record starts at address
+	void insert(FILE_ADDRESS address, const doc_loc &dl);  // Insert new record at address
+	void erase(FILE_ADDRESS address, FILE_ADDRESS len);    // Remove bytes (len can go past EOF)
+
+	// cut() is like erase() but moves the removed records into another (empty) tree.
+	// paste() puts them back (at the same or another address) leaving from empty.
+	// These are used to undo a change without rebuilding the whole tree.
+	void cut(FILE_ADDRESS address, FILE_ADDRESS len, loc_tree &removed);
+	void paste(FILE_ADDRESS address, loc_tree &from);
+
+private:
+	node *new_node(const doc_loc &dl);
+	static node *own(node *nn);
+	static void destroy(node *nn);
+	void split_node(node *nn, FILE_ADDRESS address, node *&ll, node *&rr);
+	static node *merge_node(node *ll, node *rr);
+	static unsigned new_version();
+
+	node *root_;                        // Root of tree or NULL if no records
+	unsigned seed_;                     // Used to generate node priorities
+	unsigned version_;                  // Changed on every change (invalidates cursors) - see new_version
+};
+
+// A doc_cursor remembers the record last read by one reader of a document, so
+// that the next read (usually just past the last one) can avoid searching the
+// tree.  It is ignored if the tree has changed since it was last used, so the
+// same cursor can safely be kept across edits.  Each thread should use its own.
+class doc_cursor
+{
+	friend class loc_tree;
+public:
+	doc_cursor() : ptree_(NULL), version_(0), pos_(0) { }
+	void reset() { ptree_ = NULL; version_ = 0; }
+
+private:
+	const loc_tree *ptree_;             // Tree that pl_ is in (NULL if not set)
+	unsigned version_;                  // Value of loc_tree::version() when pl_ was set
+	loc_tree::iterator pl_;             // Last record used
+	FILE_ADDRESS pos_;                  // Address of start of pl_
+};
+
+#endif
@@ -269,6 +269,9 @@ public:
 
 public:
 	BOOL DoFind();
+	BOOL DoFindList(CHexEditView *pview, const boyer &bb,
+					CFindSheet::dirn_t dirn, CFindSheet::scope_t scope, BOOL icase, int tt, BOOL ww,
+					int aa, int offset, bool align_rel, FILE_ADDRESS base_addr);
 
 	void show_calc();  // Make sure the calculator is displayed
 	void move_bars(const CRect &rct)
@@ -290,6 +293,13 @@ public:
 	FILE_ADDRESS search_back(CHexEditDoc *pdoc, FILE_ADDRESS start_addr, FILE_ADDRESS end_addr,
 							 const unsigned char *ss, const unsigned char *mask, size_t length,
 							 BOOL icase, int tt, BOOL ww, int aa, int offset, bool align_rel, FILE_ADDRESS base_addr);
+	FILE_ADDRESS search_all_forw(CHexEditDoc *pdoc, FILE_ADDRESS start_addr, FILE_ADDRESS end_addr,
+							 const unsigned char *ss, const unsigned char *mask, size_t length,
+							 BOOL icase, int tt, BOOL ww, int aa, int offset, bool align_rel, FILE_ADDRESS base_addr,
+							 const unsigned char *repl, size_t replen, std::vector<FILE_ADDRESS> &found);
+	FILE_ADDRESS search_list(CHexEditDoc *pdoc, FILE_ADDRESS start_addr, FILE_ADDRESS end_addr,
+							 const boyer &bb, bool forward, BOOL icase, int tt, BOOL ww,
+							 int aa, int offset, FILE_ADDRESS base_addr, size_t &found_len);
 //    CString GetSearchString() const { return current_search_string_; }
 	void SetSearchString(CString ss) { current_search_string_ = ss; }
 	void SetReplaceString(CString ss) { current_replace_string_ = ss; }
@@ -2724,6 +2724,31 @@ BOOL CMainFrame::DoFind()
 	else
 		base_addr = 0;
 
+	// Several byte sequences (separated by |) and regular expressions are searched for differently
+	std::vector<std::vector<unsigned char> > pats;
+	CString regex;
+	if (m_wndFind.GetPatternList(pats))
+		return DoFindList(pview, boyer(pats, icase, tt), dirn, scope, icase, tt, wholeword,
+						  alignment, offset, align_rel, base_addr);
+	else if (m_wndFind.GetRegex(regex))
+	{
+		if (tt != 1)
+		{
+			TaskMessageBox("Regular Expression", "Regular expressions can only be used with the ASCII character set.");
+			theApp.mac_error_ = 10;
+			return FALSE;
+		}
+		boyer bb(regex, icase);
+		if (bb.regex_error() != NULL)
+		{
+			TaskMessageBox("Regular Expression", bb.regex_error());
+			theApp.mac_error_ = 10;
+			return FALSE;
+		}
+		return DoFindList(pview, bb, dirn, scope, icase, tt, wholeword,
+						  alignment, offset, align_rel, base_addr);
+	}
+
 	FILE_ADDRESS start, end;            // Range of bytes in the current file to search
 	FILE_ADDRESS found_addr;            // The address where the search text was found (or -1, -2)
 
@@ -3246,7 +3271,6 @@ void CMainFrame::OnReplaceAll()
 	bool align_rel = m_wndFind.AlignRel();
 
 	FILE_ADDRESS start, end;            // Range of bytes in the current file to search
-	FILE_ADDRESS found_addr;            // The address where the search text was found (or -1, -2)
 
 	switch (scope)
 	{
@@ -3310,8 +3334,20 @@ void CMainFrame::OnReplaceAll()
 
 	for (;;)
 	{
-		// Do the search
-		if ((found_addr = search_forw(pdoc2, curr, end, ss, mask, length, icase, tt, wholeword, alignment, offset, align_rel, base_addr)) == -2)
+		// Find all occurrences (in one pass) then replace them all as one change
+		std::vector<FILE_ADDRESS> found;
+		FILE_ADDRESS status = search_all_forw(pdoc2, curr, end, ss, mask, length, icase, tt, wholeword,
+											  alignment, offset, align_rel, base_addr, pp, replen, found);
+		if (!found.empty())
+		{
+			// Keep the replacements found even if the search was aborted
+			if (pv2->do_replace_all(found, length, pp, replen))
+				replace_count += int(found.size());
+			else
+				status = -2;
+		}
+
+		if (status == -2)
 		{
 			// User abort or some error
 #ifdef REFRESH_OFF
@@ -3326,56 +3362,45 @@ void CMainFrame::OnReplaceAll()
 			pview->show_pos();
 			return;
 		}
-		else if (found_addr == -1)
+
+		if (scope == CFindSheet::SCOPE_ALL && (pdoc2=GetPrevDoc(pdoc2)) != pdoc)
 		{
-			if (scope == CFindSheet::SCOPE_ALL && (pdoc2=GetPrevDoc(pdoc2)) != pdoc)
-			{
-				++file_count;
-				curr = 0;
-				end = pdoc2->length();
-				pv2 = pdoc2->GetBestView();
-				if (align_rel)
-					base_addr = pv2->GetSearchBase();
-				else
-					base_addr = 0;
+			++file_count;
+			curr = 0;
+			end = pdoc2->length();
+			pv2 = pdoc2->GetBestView();
+			if (align_rel)
+				base_addr = pv2->GetSearchBase();
+			else
+				base_addr = 0;
 
-				byte_count += pdoc2->length();
-			}
-			else if (scope == CFindSheet::SCOPE_EOF && start > 0)
+			byte_count += pdoc2->length();
+		}
+		else if (scope == CFindSheet::SCOPE_EOF && start > 0)
+		{
+			CString mess = CString("The end of file was reached.\n") +
+						   not_found_mess(TRUE, icase, tt, wholeword, alignment) +
+						   CString("\n\nDo you want to continue from the start of file?");
+
+			// Give the user the option to search the top bit of the file that has not been searched
+			SetAddress(end + FILE_ADDRESS(found.size())*(FILE_ADDRESS(replen) - FILE_ADDRESS(length)));
+			theApp.OnIdle(0);             // Force display of updated address
+			if (AvoidableTaskDialog(IDS_CONT_SEARCH, mess, NULL, NULL, TDCBF_YES_BUTTON | TDCBF_NO_BUTTON) == IDYES)
 			{
-				CString mess = CString("The end of file was reached.\n") +
-							   not_found_mess(TRUE, icase, tt, wholeword, alignment) +
-							   CString("\n\nDo you want to continue from the start of file?");
-
-				// Give the user the option to search the top bit of the file that has not been searched
-				SetAddress(end);
-				theApp.OnIdle(0);             // Force display of updated address
-				if (AvoidableTaskDialog(IDS_CONT_SEARCH, mess, NULL, NULL, TDCBF_YES_BUTTON | TDCBF_NO_BUTTON) == IDYES)
-				{
-					wc.Restore();
-					curr = 0;
-					end = start + length - 1;
-					byte_count = end;         // Whole file will now be searched
-					start = 0;                // Stop asking of above question again
-				}
-				else
-				{
-					break;                    // EOF and user chose not to continue from other end
-				}
+				wc.Restore();
+				curr = 0;
+				end = start + length - 1;
+				byte_count = end;         // Whole file will now be searched
+				start = 0;                // Stop asking of above question again
 			}
 			else
 			{
-				break;                        // search finished
+				break;                    // EOF and user chose not to continue from other end
 			}
 		}
 		else
 		{
-			// Found
-			pv2->do_replace(found_addr, found_addr+length, pp, replen);
-			++replace_count;
-			curr = found_addr + replen;   // Don't do replacements within subst. text as we could get into infinite loop
-			if (dirn == CFindSheet::DIRN_DOWN)
-				end += int(replen) - int(length);
+			break;                        // search finished
 		}
 	} // for (;;)
 
@@ -3427,6 +3452,14 @@ void CMainFrame::OnBookmarkAll()
 		theApp.mac_error_ = 2;
 		return;
 	}
+	CString regex;
+	if (m_wndFind.GetRegex(regex))
+	{
+		TaskMessageBox("Regular Expression", "Bookmark All cannot be used with a regular expression.");
+		theApp.mac_error_ = 2;
+		return;
+	}
+
 	// Get current view thence (first) document to search
 	CHexEditView *pview = GetView();
 
@@ -3906,6 +3939,181 @@ FILE_ADDRESS CMainFrame::search_forw(CHexEditDoc *pdoc, FILE_ADDRESS start_addr,
 	return -1;                          // not found
 }
 
+// Is the character before addr alphabetic (for whole word searches)?  It is taken from
+// buf (which holds the bytes from addr_buf on) if there, else read from the file.
+static BOOL alpha_before_addr(CHexEditDoc *pdoc, const unsigned char *buf, FILE_ADDRESS addr_buf,
+							  FILE_ADDRESS addr, int tt)
+{
+	FILE_ADDRESS back = tt == 2 ? 2 : 1;    // For Unicode check low byte of the previous char
+	if (addr < back)
+		return FALSE;
+
+	unsigned char cc[2];
+	const unsigned char *pc;
+	if (addr - back >= addr_buf)
+		pc = buf + size_t(addr - back - addr_buf);
+	else
+	{
+		VERIFY(pdoc->GetData(cc, size_t(back), addr - back) == size_t(back));
+		pc = cc;
+	}
+	return tt == 3 ? isalnum(e2a_tab[*pc]) != 0 : isalnum(*pc) != 0;
+}
+
+// search_all_forw finds all occurrences of the search bytes from start_addr to end_addr
+// for Replace All, reading the file just once.  The addresses are added to found.  As
+// for repeated searches, the search continues after each occurrence so they do not
+// overlap.  Whole word and alignment checks allow for the replacement bytes (repl)
+// that will be put in place of the earlier occurrences, so the same occurrences are
+// found as by searching again after each replacement.
+// Returns -1 when finished or -2 if aborted (found has the occurrences found so far).
+FILE_ADDRESS CMainFrame::search_all_forw(CHexEditDoc *pdoc, FILE_ADDRESS start_addr, FILE_ADDRESS end_addr,
+										 const unsigned char *ss, const unsigned char *mask, size_t length,
+										 BOOL icase, int tt, BOOL ww, int aa, int offset, bool align_rel, FILE_ADDRESS base_addr,
+										 const unsigned char *repl, size_t replen, std::vector<FILE_ADDRESS> &found)
+{
+	ASSERT(start_addr <= end_addr && end_addr <= pdoc->length());
+
+	if (length == 0)
+	{
+		AfxMessageBox("Empty search sequence");
+		return -2;
+	}
+	FILE_ADDRESS delta = FILE_ADDRESS(replen) - FILE_ADDRESS(length);  // Address change per replacement
+
+	FILE_ADDRESS bg_next = pdoc->GetNextFound(ss, mask, length, icase, tt, ww,
+											  aa, offset, align_rel, base_addr, start_addr);
+
+	// If the background search has finished we can just use what it found, unless the
+	// replacements affect what is found (whole word or alignment checks)
+	if (bg_next >= -1 && !ww && (aa <= 1 || delta == 0))
+	{
+		while (bg_next > -1 && bg_next + FILE_ADDRESS(length) <= end_addr)
+		{
+			found.push_back(bg_next);
+			bg_next = pdoc->GetNextFound(ss, mask, length, icase, tt, ww,
+										 aa, offset, align_rel, base_addr, bg_next + length);
+		}
+		return -1;
+	}
+
+	if (bg_next == -3)
+		theApp.StopSearches();  // we must abort all bg searches here (see search_forw)
+
+	FILE_ADDRESS retval = -1;
+	if (start_addr + FILE_ADDRESS(length) <= end_addr)
+	{
+		size_t buf_len = size_t(min(end_addr-start_addr, FILE_ADDRESS(search_buf_len + length - 1)));
+		unsigned char *buf = new unsigned char[buf_len];
+		boyer bb(ss, length, mask);         // Boyer-Moore searcher
+		FILE_ADDRESS addr_buf = start_addr; // Current location in doc of start of buf
+		FILE_ADDRESS next_from = start_addr;// Where the next occurrence may start (after the last one)
+		BOOL alpha_prev = FALSE;            // Is the char before next_from alphabetic (after replacement)?
+		FILE_ADDRESS show_inc = 0x100000;   // How far between showing addresses
+		FILE_ADDRESS next_show = (addr_buf/show_inc + 1)*show_inc;
+		FILE_ADDRESS slow_show = ((addr_buf+0x1000000)/0x1000000 + 1)*0x1000000;
+		size_t got;                         // How many bytes just read
+
+		got = pdoc->GetData(buf, length - 1, addr_buf);
+		ASSERT(got == length - 1);
+		for (;;)
+		{
+			if (addr_buf > next_show)
+			{
+				if (AbortKeyPress() &&
+					TaskMessageBox("Abort search?", 
+						"You have interrupted the search.  "
+						"You may abort or continue the search.\n\n"
+						"Do you want to abort the search?",MB_YESNO) == IDYES)
+				{
+					StatusBarText("Search aborted");
+					theApp.mac_error_ = 10;
+					retval = -2;
+					break;
+				}
+
+				// Show search progress
+				SetAddress(next_show);
+				if (next_show >= slow_show)
+				{
+					Progress(int(((next_show-start_addr)*100)/(end_addr-start_addr)));
+					show_inc = 0x1000000;
+				}
+				theApp.OnIdle(0);         // Force display of updated address
+				next_show += show_inc;
+			}
+
+			// Get the next buffer full (not past end_addr)
+			got = pdoc->GetData(buf + length - 1,
+								size_t(min(FILE_ADDRESS(buf_len - (length - 1)), end_addr - (addr_buf + length - 1))),
+								addr_buf + length - 1);
+			size_t blen = length - 1 + got;     // Bytes in buf
+
+			BOOL alpha_after = FALSE;
+			if (ww && addr_buf + FILE_ADDRESS(blen) < pdoc->length())
+			{
+				unsigned char cc;
+				VERIFY(pdoc->GetData(&cc, 1, addr_buf + blen) == 1);
+				alpha_after = tt == 3 ? isalnum(e2a_tab[cc]) != 0 : isalnum(cc) != 0;
+			}
+
+			// Find all occurrences in the buffer
+			size_t pos = size_t(max(next_from - addr_buf, FILE_ADDRESS(0)));
+			while (pos + length <= blen)
+			{
+				FILE_ADDRESS from = addr_buf + pos;
+				BOOL alpha_before = FALSE;
+				if (ww)
+					alpha_before = !found.empty() && from == next_from ? alpha_prev :
+								   alpha_before_addr(pdoc, buf, addr_buf, from, tt);
+
+				// Alignment is checked where the occurrence will be after the earlier replacements
+				unsigned char *pp = bb.findforw(buf + pos, blen - pos, icase, tt, ww, alpha_before, alpha_after,
+												aa, offset, base_addr - FILE_ADDRESS(found.size())*delta, from);
+				if (pp == NULL)
+					break;
+
+				FILE_ADDRESS addr = addr_buf + (pp - buf);
+				if (ww)
+				{
+					// Work out if the char before the end of the replacement will be alphabetic
+					size_t back = tt == 2 ? 2 : 1;
+					if (replen >= back)
+						alpha_prev = tt == 3 ? isalnum(e2a_tab[repl[replen - back]]) != 0 : isalnum(repl[replen - back]) != 0;
+					else if (found.empty() || addr != next_from)
+						alpha_prev = alpha_before_addr(pdoc, buf, addr_buf, addr, tt);
+				}
+				found.push_back(addr);
+				next_from = addr + length;
+				pos = size_t(next_from - addr_buf);
+			}
+
+			addr_buf += got;
+
+			// Check if we're at the end yet
+			if (addr_buf + FILE_ADDRESS(length) - 1 >= end_addr)
+				break;
+
+			// Move a little bit from the end to the start of the buffer
+			// so that we don't miss sequences that overlap the pieces read
+			memmove(buf, buf + blen - (length - 1), length - 1);
+		}
+		Progress(-1);
+		delete[] buf;
+	}
+
+	// Start bg search to search the whole file (it will be changed by the replacements)
+	theApp.NewSearch(ss, mask, length, icase, tt, ww, aa, offset, align_rel);
+	if (bg_next == -3)
+	{
+		pdoc->base_addr_ = base_addr;
+		pdoc->StartSearch();
+		theApp.StartSearches(pdoc);
+	}
+
+	return retval;
+}
+
 // search_back returns the address if the search text was found or
 // -1 if it was not found, or -2 on some error (message already shown)
 FILE_ADDRESS CMainFrame::search_back(CHexEditDoc *pdoc, FILE_ADDRESS start_addr, FILE_ADDRESS end_addr,
@@ -4140,6 +4348,183 @@ FILE_ADDRESS CMainFrame::search_back(CHexEditDoc *pdoc, FILE_ADDRESS start_addr,
 	return -1;                          // not found
 }
 
+// search_list finds the first (or last if !forward) occurrence of any of the patterns of bb
+// (or match of its regex) that is completely within start_addr to end_addr, reading the file
+// just once however many patterns there are.  Returns the address (and the length of the
+// pattern or match found in found_len), -1 if none was found or -2 if the user aborted.
+// Only occurrences that start at offset (modulo aa) from base_addr are found.
+// (Unlike search_forw/search_back the occurrences found may have different lengths.)
+FILE_ADDRESS CMainFrame::search_list(CHexEditDoc *pdoc, FILE_ADDRESS start_addr, FILE_ADDRESS end_addr,
+									 const boyer &bb, bool forward, BOOL icase, int tt, BOOL ww,
+									 int aa, int offset, FILE_ADDRESS base_addr, size_t &found_len)
+{
+	ASSERT(start_addr <= end_addr && end_addr <= pdoc->length());
+
+	size_t overlap = bb.length() - 1;   // Bytes read twice so that occurrences across reads are not missed
+	size_t buf_len = search_buf_len + overlap;
+	if (end_addr - start_addr < FILE_ADDRESS(buf_len))
+		buf_len = size_t(end_addr - start_addr);
+	if (buf_len < bb.min_length())
+		return -1;
+
+	unsigned char *buf = new unsigned char[buf_len];
+	FILE_ADDRESS addr_buf = forward ? start_addr : end_addr - buf_len;  // Current location in doc of start of buf
+	FILE_ADDRESS show_inc = 0x200000;   // How far between showing addresses
+	FILE_ADDRESS next_show = forward ? start_addr + show_inc : end_addr - show_inc;
+	FILE_ADDRESS retval = -1;
+	for (;;)
+	{
+		if (forward ? addr_buf > next_show : addr_buf < next_show)
+		{
+			if (AbortKeyPress() &&
+				TaskMessageBox("Abort search?", 
+					"You have interrupted the search.  "
+					"You may abort or continue the search.\n\n"
+					"Do you want to abort the search?",MB_YESNO) == IDYES)
+			{
+				StatusBarText("Search aborted");
+				theApp.mac_error_ = 10;
+				retval = -2;
+				break;
+			}
+
+			// Show search progress
+			SetAddress(next_show);
+			theApp.OnIdle(0);         // Force display of updated address
+			next_show += forward ? show_inc : -show_inc;
+		}
+
+		size_t got = pdoc->GetData(buf, buf_len, addr_buf);
+		ASSERT(got == buf_len);
+
+		BOOL alpha_before = FALSE;
+		BOOL alpha_after = FALSE;
+		if (ww)
+		{
+			alpha_before = alpha_before_addr(pdoc, buf, addr_buf, addr_buf, tt);
+			if (addr_buf + got < pdoc->length())
+			{
+				unsigned char cc;
+				VERIFY(pdoc->GetData(&cc, 1, addr_buf + got) == 1);
+				alpha_after = tt == 3 ? isalnum(e2a_tab[cc]) != 0 : isalnum(cc) != 0;
+			}
+		}
+
+		int id;
+		unsigned char *pp;
+		if (forward)
+			pp = bb.findforw(buf, got, icase, tt, ww, alpha_before, alpha_after, aa, offset, base_addr, addr_buf, &id);
+		else
+			pp = bb.findback(buf, got, icase, tt, ww, alpha_before, alpha_after, aa, offset, base_addr, addr_buf, &id);
+		bool last = forward ? addr_buf + got >= end_addr : addr_buf <= start_addr;
+
+		// When searching forward a shorter pattern (or match) found in the overlap at the end of
+		// the buffer may not be the first, as a longer one may start before it, so leave it until
+		// next time
+		if (pp != NULL && (!forward || last || size_t(pp - buf) < got - overlap))
+		{
+			retval = addr_buf + (pp - buf);
+			found_len = bb.pattern_length(id);
+			break;
+		}
+		if (last)
+			break;
+
+		// Move to the next part of the file (overlapping the part just searched)
+		if (forward)
+			addr_buf = min(addr_buf + FILE_ADDRESS(got - overlap), end_addr - FILE_ADDRESS(buf_len));
+		else
+			addr_buf = max(addr_buf - FILE_ADDRESS(got - overlap), start_addr);
+	}
+	delete[] buf;
+	return retval;
+}
+
+// Finds the next (or previous) occurrence of any of several byte sequences, or a match of
+// a regular expression, in the active file (bb is not a simple search - see boyer::simple).
+// The search is also passed on to the background search (if on) so that all occurrences
+// are highlighted in all open files.  Unlike DoFind, only the active file is searched
+// (SCOPE_ALL is the same as SCOPE_EOF).
+BOOL CMainFrame::DoFindList(CHexEditView *pview, const boyer &bb,
+							CFindSheet::dirn_t dirn, CFindSheet::scope_t scope, BOOL icase, int tt, BOOL ww,
+							int aa, int offset, bool align_rel, FILE_ADDRESS base_addr)
+{
+	ASSERT(!bb.simple() && bb.regex_error() == NULL);
+	CHexEditDoc *pdoc = pview->GetDocument();
+
+	// Start background searches for the patterns if not already done
+	bool same;
+	{
+		CSingleLock s2(&theApp.appdata_, TRUE);
+		same = theApp.pboyer_ != NULL && theApp.pboyer_->same_search(bb) &&
+			   icase == theApp.icase_ && tt == theApp.text_type_ && ww == theApp.wholeword_ &&
+			   aa == theApp.alignment_ && offset == theApp.offset_ && align_rel == theApp.align_rel_ &&
+			   (!align_rel || base_addr == pdoc->base_addr_);
+	}
+	if (!same)
+	{
+		theApp.StopSearches();
+		theApp.NewSearch(bb, icase, tt, ww, aa, offset, align_rel);
+		pdoc->base_addr_ = base_addr;
+		pdoc->StartSearch();
+		theApp.StartSearches(pdoc);
+	}
+
+	// Work out what part of the file to search (same as DoFind)
+	bool forward = dirn == CFindSheet::DIRN_DOWN;
+	FILE_ADDRESS start, end;
+	pview->GetSelAddr(start, end);
+	if (forward)
+	{
+		if (start < end)
+			++start;                    // Change to start search at byte after start of selection
+		end = scope == CFindSheet::SCOPE_TOMARK ? pview->GetMark() : pdoc->length();
+		if (scope == CFindSheet::SCOPE_FILE)
+			start = 0;
+	}
+	else
+	{
+		if (start < end)
+			end--;
+		start = scope == CFindSheet::SCOPE_TOMARK ? pview->GetMark() : 0;
+		if (scope == CFindSheet::SCOPE_FILE)
+			end = pdoc->length();
+	}
+	if (end < start)
+		end = start;
+
+	// Do the search
+	size_t found_len;
+	FILE_ADDRESS found_addr = search_list(pdoc, start, end, bb, forward, icase, tt, ww, aa, offset, base_addr, found_len);
+	if (found_addr == -2)
+	{
+		// User abort - just restore original display pos
+		pview->show_pos();
+		theApp.mac_error_ = 10;
+		return FALSE;
+	}
+	else if (found_addr == -1)
+	{
+		SetAddress(forward ? end : start);
+		theApp.OnIdle(0);             // Force display of updated address
+		AvoidableTaskDialog(IDS_SEARCH_NOT_FOUND, not_found_mess(forward, icase, tt, ww, aa));
+		pview->show_pos();                         // Restore display of orig address
+		theApp.mac_error_ = 10;
+		return FALSE;
+	}
+
+	pview->MoveWithDesc("Search Text Found ", found_addr, found_addr + found_len);  // space at end means significant nav pt
+	if (scope == CFindSheet::SCOPE_FILE)
+	{
+		// Change to SCOPE_EOF so that next search does not find the same thing
+		m_wndFind.SetScope(CFindSheet::SCOPE_EOF);
+	}
+#ifdef SYS_SOUNDS
+	CSystemSound::Play("Search Text Found");
+#endif
+	return TRUE;
+}
+
 CString CMainFrame::not_found_mess(BOOL forward, BOOL icase, int tt, BOOL ww, int aa)
 {
 #ifdef SYS_SOUNDS
@@ -0,0 +1,62 @@
+// PatternFile.cpp : implements CPatternFile (see PatternFile.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include "HexEdit.h"
+#include "PatternFile.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+CPatternFile::CPatternFile(const unsigned char *pat, size_t len, FILE_ADDRESS total)
+	: len_(len), total_(total)
+{
+	ASSERT(pat != NULL && len > 0 && total >= 0);
+
+	zero_ = true;
+	for (size_t ii = 0; ii < len; ++ii)
+		if (pat[ii] != 0)
+			zero_ = false;
+
+	// Repeat the pattern so that ReadAt can copy big blocks at a time
+	size_t copies = len < 4096 ? 4096/len : 1;
+	buf_.reserve(len*copies);
+	for (size_t ii = 0; ii < copies; ++ii)
+		buf_.insert(buf_.end(), pat, pat + len);
+}
+
+// This does not use or change the file position so can be used by several threads at once
+DWORD CPatternFile::ReadAt(LONGLONG position, void * buffer, DWORD len)
+{
+	if (position >= total_)
+		return 0;
+	if (FILE_ADDRESS(len) > total_ - position)
+		len = DWORD(total_ - position);
+
+	if (zero_)
+	{
+		memset(buffer, '\0', len);
+		return len;
+	}
+
+	unsigned char *pp = (unsigned char *)buffer;
+	size_t off = size_t(position % len_);   // Where we are in the pattern
+	for (size_t left = len; left > 0; )
+	{
+		size_t tocopy = min(left, buf_.size() - off);
+		memcpy(pp, &buf_[off], tocopy);
+		pp += tocopy;
+		left -= tocopy;
+		off = 0;                            // buf_ holds whole patterns so continue from the start
+	}
+	return len;
+}
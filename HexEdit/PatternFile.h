@@ -0,0 +1,47 @@
+// PatternFile.h : a read-only "file" of a repeated pattern of bytes
+//
+// For implementation see: PatternFile.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Creating a big file (or inserting a big block) filled with zeroes or a
+// repeated pattern used to write every byte to a temp file first, so that a
+// 64 GB zero-filled file took a long time and needed 64 GB of temp space.
+//
+// A CPatternFile is used as a document data file (see CHexEditDoc::AddPattern)
+// but nothing is stored on disk - ReadAt just generates the bytes.  Since it is
+// a data file, the location records, undo, change tracking etc work as for any
+// other data file.  The bytes are only written out when the document is saved,
+// when runs of zero bytes are left as holes in a sparse file (see WriteData).
+
+#ifndef PATTERNFILE_INCLUDED
+#define PATTERNFILE_INCLUDED  1
+
+#include <vector>
+#include "CFile64.h"
+
+class CPatternFile : public CFile64
+{
+public:
+	CPatternFile(const unsigned char *pat, size_t len, FILE_ADDRESS total);
+
+	virtual DWORD ReadAt(LONGLONG position, void * buffer, DWORD len);
+	virtual BOOL EnableMapping(BOOL enable = TRUE) { return !enable; }  // nothing to map
+	virtual LONGLONG GetLength(void) const { return total_; }
+
+	bool IsZero() const { return zero_; }  // All bytes are zero?
+	const unsigned char *Pattern() const { return &buf_[0]; }
+	size_t PatternLength() const { return size_t(len_); }
+
+private:
+	std::vector<unsigned char> buf_;    // The pattern repeated (a whole number of times) to fill a block
+	FILE_ADDRESS len_;                  // Length of the pattern
+	FILE_ADDRESS total_;                // Length of the "file"
+	bool zero_;
+};
+
+#endif
@@ -0,0 +1,187 @@
+// RWLock.cpp : implements rw_lock (see RWLock.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include "RWLock.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+rw_lock::rw_lock() : write_count_(0), writers_waiting_(0)
+{
+#ifdef _WIN32
+	::InitializeCriticalSection(&cs_);
+	read_ok_ = ::CreateEvent(NULL, TRUE, TRUE, NULL);    // manual reset, initially set (no writers)
+	write_ok_ = ::CreateEvent(NULL, FALSE, FALSE, NULL); // auto reset
+	ASSERT(read_ok_ != NULL && write_ok_ != NULL);
+#else
+	pthread_mutex_init(&mm_, NULL);
+	pthread_cond_init(&read_ok_, NULL);
+	pthread_cond_init(&write_ok_, NULL);
+#endif
+}
+
+rw_lock::~rw_lock()
+{
+	ASSERT(readers_.empty() && write_count_ == 0 && writers_waiting_ == 0);
+#ifdef _WIN32
+	::CloseHandle(read_ok_);
+	::CloseHandle(write_ok_);
+	::DeleteCriticalSection(&cs_);
+#else
+	pthread_cond_destroy(&read_ok_);
+	pthread_cond_destroy(&write_ok_);
+	pthread_mutex_destroy(&mm_);
+#endif
+}
+
+void rw_lock::lock_shared()
+{
+	thread_t id = current_thread();
+	enter();
+	for (;;)
+	{
+		// The writer can read what it is writing
+		if (write_count_ > 0 && writer_ == id)
+		{
+			++write_count_;
+			break;
+		}
+
+		// If this thread is already reading let it in even if a writer is waiting (else deadlock)
+		std::vector<reader>::iterator pr = find_reader(id);
+		if (pr != readers_.end())
+		{
+			++pr->count;
+			break;
+		}
+
+		if (write_count_ == 0 && writers_waiting_ == 0)
+		{
+			reader rr;
+			rr.id = id;
+			rr.count = 1;
+			readers_.push_back(rr);
+			break;
+		}
+
+		wait_read();
+	}
+	leave();
+}
+
+void rw_lock::unlock_shared()
+{
+	thread_t id = current_thread();
+	enter();
+	if (write_count_ > 0 && writer_ == id)
+	{
+		--write_count_;
+		ASSERT(write_count_ > 0);       // read lock should be released before the write lock
+	}
+	else
+	{
+		std::vector<reader>::iterator pr = find_reader(id);
+		ASSERT(pr != readers_.end());   // unlock without lock?
+		if (--pr->count == 0)
+		{
+			readers_.erase(pr);
+			if (readers_.empty() && writers_waiting_ > 0)
+				allow_write();
+		}
+	}
+	leave();
+}
+
+void rw_lock::lock()
+{
+	thread_t id = current_thread();
+	enter();
+	if (write_count_ > 0 && writer_ == id)
+	{
+		++write_count_;                 // already the writer
+		leave();
+		return;
+	}
+	ASSERT(find_reader(id) == readers_.end());  // can't upgrade a read lock (deadlocks if 2 threads try)
+
+	// Stop new readers getting in then wait for current readers (and any writer) to finish
+	if (++writers_waiting_ == 1)
+		block_read();
+	while (write_count_ > 0 || !readers_.empty())
+		wait_write();
+	--writers_waiting_;
+
+	writer_ = id;
+	write_count_ = 1;
+	leave();
+}
+
+void rw_lock::unlock()
+{
+	enter();
+	ASSERT(write_count_ > 0 && writer_ == current_thread());
+	if (--write_count_ == 0)
+	{
+		// Writers have priority over readers
+		if (writers_waiting_ > 0)
+			allow_write();
+		else
+			allow_read();
+	}
+	leave();
+}
+
+std::vector<rw_lock::reader>::iterator rw_lock::find_reader(thread_t id)
+{
+	std::vector<reader>::iterator pr;
+	for (pr = readers_.begin(); pr != readers_.end(); ++pr)
+#ifdef _WIN32
+		if (pr->id == id)
+#else
+		if (pthread_equal(pr->id, id))
+#endif
+			break;
+	return pr;
+}
+
+#ifdef _WIN32
+rw_lock::thread_t rw_lock::current_thread() { return ::GetCurrentThreadId(); }
+void rw_lock::enter() { ::EnterCriticalSection(&cs_); }
+void rw_lock::leave() { ::LeaveCriticalSection(&cs_); }
+
+// Note: the events may be set when there is nothing to wait for so callers always check again
+void rw_lock::wait_read()
+{
+	::LeaveCriticalSection(&cs_);
+	::WaitForSingleObject(read_ok_, INFINITE);
+	::EnterCriticalSection(&cs_);
+}
+void rw_lock::wait_write()
+{
+	::LeaveCriticalSection(&cs_);
+	::WaitForSingleObject(write_ok_, INFINITE);
+	::EnterCriticalSection(&cs_);
+}
+void rw_lock::allow_read() { ::SetEvent(read_ok_); }
+void rw_lock::allow_write() { ::SetEvent(write_ok_); }
+void rw_lock::block_read() { ::ResetEvent(read_ok_); }
+#else
+rw_lock::thread_t rw_lock::current_thread() { return pthread_self(); }
+void rw_lock::enter() { pthread_mutex_lock(&mm_); }
+void rw_lock::leave() { pthread_mutex_unlock(&mm_); }
+void rw_lock::wait_read() { pthread_cond_wait(&read_ok_, &mm_); }
+void rw_lock::wait_write() { pthread_cond_wait(&write_ok_, &mm_); }
+void rw_lock::allow_read() { pthread_cond_broadcast(&read_ok_); }
+void rw_lock::allow_write() { pthread_cond_broadcast(&write_ok_); }
+void rw_lock::block_read() { }
+#endif
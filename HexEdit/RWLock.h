@@ -0,0 +1,120 @@
+// RWLock.h : a lock that allows many readers or one writer
+//
+// For implementation see: RWLock.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// The document data (see CHexEditDoc::GetData) is read by up to 5 background
+// threads as well as the main thread, but only the main thread changes it.
+// Using a critical section meant the readers waited for each other even
+// though they can safely read at the same time.  An rw_lock lets any number
+// of threads have a shared (read) lock, or one thread have an exclusive
+// (write) lock.
+//
+// - Writers have priority: once a thread is waiting for the write lock no
+//   new readers are let in, so continuous reading can't hold up an edit.
+// - Both locks are recursive.  A thread that has the write lock can also
+//   take the read lock.  A thread that has the read lock can take it again
+//   (even when a writer is waiting) but must not ask for the write lock.
+//
+// Note: this only uses Win32 or POSIX calls (not SRW locks which need Vista)
+// so it can also be built on other systems (eg to test the document code).
+
+#ifndef RWLOCK_INCLUDED
+#define RWLOCK_INCLUDED  1
+
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+class rw_lock
+{
+public:
+	rw_lock();
+	~rw_lock();
+
+	void lock_shared();                 // Get read lock (wait for any writer to finish)
+	void unlock_shared();
+	void lock();                        // Get write lock (wait for all readers to finish)
+	void unlock();
+
+private:
+	rw_lock(const rw_lock &);           // not copyable
+	rw_lock &operator=(const rw_lock &);
+
+#ifdef _WIN32
+	typedef DWORD thread_t;
+#else
+	typedef pthread_t thread_t;
+#endif
+	static thread_t current_thread();
+
+	struct reader
+	{
+		thread_t id;                    // Thread that has the read lock
+		int count;                      // Number of times it has locked it
+	};
+	std::vector<reader> readers_;       // Threads that have the read lock (usually only a few)
+	thread_t writer_;                   // Thread that has the write lock (only valid if write_count_ > 0)
+	int write_count_;                   // Number of times the writer has locked (includes read locks by the writer)
+	int writers_waiting_;               // Threads waiting for the write lock
+
+	std::vector<reader>::iterator find_reader(thread_t id);
+
+	// These hide the differences between Win32 and POSIX
+	void enter();                       // Lock our members
+	void leave();
+	void wait_read();                   // Wait until readers may be able to enter (members must be locked)
+	void wait_write();                  // Wait until a writer may be able to enter (members must be locked)
+	void allow_read();                  // Wake threads waiting in wait_read()
+	void allow_write();                 // Wake a thread waiting in wait_write()
+	void block_read();                  // Make readers wait (a writer is waiting)
+
+#ifdef _WIN32
+	CRITICAL_SECTION cs_;               // Protects the above
+	HANDLE read_ok_;                    // Manual reset event: set when readers may enter
+	HANDLE write_ok_;                   // Auto reset event: set when a waiting writer may be able to enter
+#else
+	pthread_mutex_t mm_;
+	pthread_cond_t read_ok_;
+	pthread_cond_t write_ok_;
+#endif
+};
+
+// Holds a read lock for the life of the object (or until unlock() is called)
+class read_lock
+{
+public:
+	explicit read_lock(rw_lock &ll) : ll_(ll), locked_(true) { ll_.lock_shared(); }
+	~read_lock() { unlock(); }
+	void unlock() { if (locked_) { ll_.unlock_shared(); locked_ = false; } }
+
+private:
+	read_lock(const read_lock &);
+	read_lock &operator=(const read_lock &);
+	rw_lock &ll_;
+	bool locked_;
+};
+
+// Holds a write lock for the life of the object (or until unlock() is called)
+class write_lock
+{
+public:
+	explicit write_lock(rw_lock &ll) : ll_(ll), locked_(true) { ll_.lock(); }
+	~write_lock() { unlock(); }
+	void unlock() { if (locked_) { ll_.unlock(); locked_ = false; } }
+
+private:
+	write_lock(const write_lock &);
+	write_lock &operator=(const write_lock &);
+	rw_lock &ll_;
+	bool locked_;
+};
+
+#endif
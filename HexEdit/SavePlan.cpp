@@ -0,0 +1,78 @@
+// SavePlan.cpp : implements save_plan (see SavePlan.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include "HexEdit.h"
+#include "SavePlan.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+save_plan::save_plan(const loc_tree &loc) : length_(0), total_(0)
+{
+	std::vector<extent> backward;       // Blocks moving towards the start of file
+	FILE_ADDRESS pos;
+	loc_tree::iterator pl;
+	for (pos = 0, pl = loc.begin(); pl != loc.end(); pos += FILE_ADDRESS(pl->dlen&doc_loc::mask), ++pl)
+	{
+		extent ee;
+		ee.type = int(pl->dlen >> 62);
+		ee.address = pos;
+		ee.len = FILE_ADDRESS(pl->dlen&doc_loc::mask);
+		ee.src = -1;
+		ee.fileid = -1;
+		ee.first = ee.count = 0;
+
+		switch (ee.type)
+		{
+		case move:
+			if (pl->fileaddr == pos)
+				continue;               // still in the same place so nothing to do
+			ee.src = pl->fileaddr;
+			if (pos > pl->fileaddr)
+				moves_.push_back(ee);   // reversed below
+			else
+				backward.push_back(ee);
+			break;
+		case memory:
+			pieces_.push_back(mem_piece(pl->memaddr, size_t(ee.len)));
+			if (!writes_.empty() && writes_.back().type == memory &&
+				writes_.back().address + writes_.back().len == pos)
+			{
+				// Follows on from the last memory block so write them together
+				writes_.back().len += ee.len;
+				++writes_.back().count;
+			}
+			else
+			{
+				ee.first = pieces_.size() - 1;
+				ee.count = 1;
+				writes_.push_back(ee);
+			}
+			break;
+		case data_file:
+			ee.src = pl->fileaddr;
+			ee.fileid = pl->fileid;
+			writes_.push_back(ee);
+			break;
+		default:
+			ASSERT(0);
+			continue;
+		}
+		total_ += ee.len;
+	}
+	length_ = pos;
+
+	// Blocks moving towards EOF are done from the end so that they don't overwrite each other
+	std::reverse(moves_.begin(), moves_.end());
+	moves_.insert(moves_.end(), backward.begin(), backward.end());
+}
@@ -0,0 +1,65 @@
+// SavePlan.h : works out what has to be written to save a document in place
+//
+// For implementation see: SavePlan.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// When a document is saved over the original file only the parts that are
+// different need to be written (see CHexEditDoc::WriteInPlace).  A save_plan
+// is made from the location records (loc_tree) and has 2 lists of extents:
+// - moves: blocks of the original file that are now at a different address
+//   (due to insertions/deletions).  These are in the order they must be done
+//   so that a block is never overwritten before it has been moved: those that
+//   move towards EOF from the end backwards, then the others from the start.
+// - writes: data in memory or data files to be written, in address order.
+//   Adjacent memory records (eg many small edits) are combined into one write.
+// Records of the original file that are still at the same address are not in
+// either list, so saving a few patched bytes of a huge file (or disk) only
+// writes those bytes.
+//
+// Note: this only uses LocTree.h (not the document) so can be tested separately.
+
+#ifndef SAVEPLAN_INCLUDED
+#define SAVEPLAN_INCLUDED  1
+
+#include <vector>
+#include <utility>
+#include "LocTree.h"
+
+class save_plan
+{
+public:
+	enum { move = 1, memory = 2, data_file = 3 };  // Extent types (same as doc_loc location types)
+
+	struct extent
+	{
+		int type;                       // move, memory or data_file
+		FILE_ADDRESS address;           // Where to write in the file
+		FILE_ADDRESS len;               // Number of bytes
+		FILE_ADDRESS src;               // Where to read from (in original or data file) - move/data_file only
+		int fileid;                     // Data file (index into CHexEditDoc::data_file_) - data_file only
+		size_t first, count;            // Memory pieces written (see piece()) - memory only
+	};
+	typedef std::pair<const unsigned char *, size_t> mem_piece;
+
+	explicit save_plan(const loc_tree &loc);
+
+	const std::vector<extent> &moves() const { return moves_; }
+	const std::vector<extent> &writes() const { return writes_; }
+	const mem_piece &piece(size_t ii) const { return pieces_[ii]; }
+	FILE_ADDRESS length() const { return length_; }    // Length of the saved file
+	FILE_ADDRESS total() const { return total_; }      // Bytes to be moved or written
+
+private:
+	std::vector<extent> moves_;
+	std::vector<extent> writes_;
+	std::vector<mem_piece> pieces_;     // Memory records in address order (memory extents refer to these)
+	FILE_ADDRESS length_;
+	FILE_ADDRESS total_;
+};
+
+#endif
@@ -0,0 +1,161 @@
+// BookmarkTest.cpp : tests of bookmark_posns (BookmarkPosns.h) against a vector
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Random changes are made to a bookmark_posns and to a plain vector of positions
+// updated the way CHexEditDoc used to (moving every bookmark after an insertion
+// or deletion).  Changes are: adding, removing and moving bookmarks, and inserting
+// and deleting bytes of the document.  After each change all positions are
+// compared and find(), before(), after(), lower() and sorted() are checked.
+
+#include "stdafx.h"
+#include <vector>
+#include "../../BookmarkPosns.h"
+
+typedef std::vector<FILE_ADDRESS> model;
+
+static bool check(bookmark_posns &bm, const model &mm)
+{
+	if (bm.size() != mm.size())
+	{
+		printf("size is %d but should be %d\n", int(bm.size()), int(mm.size()));
+		return false;
+	}
+	for (size_t ii = 0; ii < mm.size(); ++ii)
+		if (bm[ii] != mm[ii])
+		{
+			printf("bookmark %d is at %lld but should be at %lld\n", int(ii), bm[ii], mm[ii]);
+			return false;
+		}
+
+	// Check the searches at a few addresses (including those of bookmarks)
+	FILE_ADDRESS max_pos = 0;
+	for (size_t ii = 0; ii < mm.size(); ++ii)
+		max_pos = std::max(max_pos, mm[ii]);
+	for (int tt = 0; tt < 5; ++tt)
+	{
+		FILE_ADDRESS pos = tt%2 == 0 && !mm.empty() ? mm[rand()%mm.size()] : rand() % (max_pos + 2);
+		FILE_ADDRESS at = -1, prev = -1, next = -1;
+		size_t count_before = 0;        // Number of bookmarks before pos
+		for (size_t ii = 0; ii < mm.size(); ++ii)
+		{
+			if (mm[ii] == pos)
+				at = pos;
+			if (mm[ii] < pos)
+			{
+				prev = std::max(prev, mm[ii]);
+				++count_before;
+			}
+			if (mm[ii] > pos && (next == -1 || mm[ii] < next))
+				next = mm[ii];
+		}
+		int ff = bm.find(pos), bb = bm.before(pos), aa = bm.after(pos);
+		if ((ff == -1 ? -1 : mm[ff]) != at ||
+			(bb == -1 ? -1 : mm[bb]) != prev ||
+			(aa == -1 ? -1 : mm[aa]) != next)
+		{
+			printf("find/before/after(%lld) wrong\n", pos);
+			return false;
+		}
+		if (bm.lower(pos) != count_before)
+		{
+			printf("lower(%lld) is %d but should be %d\n", pos, int(bm.lower(pos)), int(count_before));
+			return false;
+		}
+	}
+
+	// Check bookmarks in address order
+	model sorted(mm);
+	std::sort(sorted.begin(), sorted.end());
+	for (size_t rr = 0; rr < sorted.size(); ++rr)
+		if (bm.sorted(rr) != sorted[rr])
+		{
+			printf("sorted(%d) is %lld but should be %lld\n", int(rr), bm.sorted(rr), sorted[rr]);
+			return false;
+		}
+	return true;
+}
+
+int main()
+{
+	srand(1);
+	long changes = 0;
+	for (int round = 0; round < 500; ++round)
+	{
+		bookmark_posns bm;
+		model mm;
+		FILE_ADDRESS length = 1 + rand()%1000;  // Document length
+
+		for (int cc = 0; cc < 300; ++cc, ++changes)
+		{
+			FILE_ADDRESS address = rand() % (length + 1);
+			FILE_ADDRESS len = rand()%4 == 0 ? 200 : 10;    // (mostly small changes)
+			len = 1 + rand()%len;
+			switch (rand()%8)
+			{
+			case 0:                     // add a bookmark
+			case 1:
+				bm.push_back(address);
+				mm.push_back(address);
+				break;
+			case 2:                     // remove a bookmark
+				if (!mm.empty())
+				{
+					size_t ii = rand()%mm.size();
+					bm.erase(ii);
+					mm.erase(mm.begin() + ii);
+				}
+				break;
+			case 3:                     // move a bookmark
+				if (!mm.empty())
+				{
+					size_t ii = rand()%mm.size();
+					bm.set(ii, address);
+					mm[ii] = address;
+				}
+				break;
+			case 4:                     // insert bytes (bookmarks at or after address move)
+			case 5:
+				bm.insert(address, len);
+				for (size_t ii = 0; ii < mm.size(); ++ii)
+					if (mm[ii] >= address)
+						mm[ii] += len;
+				length += len;
+				break;
+			case 6:                     // delete bytes (bookmarks in them move to address)
+				len = std::min(len, length - address);
+				bm.remove(address, len);
+				for (size_t ii = 0; ii < mm.size(); ++ii)
+					if (mm[ii] > address)
+						mm[ii] = std::max(address, mm[ii] - len);
+				length -= len;
+				break;
+			case 7:                     // get or assign all
+				if (rand()%2)
+				{
+					model all;
+					bm.get(all);
+					if (all != mm)
+					{
+						printf("round %d change %d: get() wrong\n", round, cc);
+						return 1;
+					}
+				}
+				else
+					bm.assign(mm);
+				break;
+			}
+			if (!check(bm, mm))
+			{
+				printf("round %d change %d\n", round, cc);
+				return 1;
+			}
+		}
+	}
+	printf("bookmark_posns: %ld changes OK\n", changes);
+	return 0;
+}
@@ -0,0 +1,139 @@
+// ChangeTrackTest.cpp : tests of change_tracker (ChangeTrack.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Random edits (insert, delete and replace) and undos are made to the location
+// records of a document, as CHexEditDoc::Change and Undo do.  After each one the
+// change lists are updated with change_tracker::update() and compared with lists
+// built from scratch with build().  The base (what changes are relative to) is
+// either the original file or a memory block (as for a new file).
+
+#include "stdafx.h"
+#include <vector>
+#include "../../LocTree.h"
+#include "../../ChangeTrack.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+static unsigned char mem[100000];       // Memory that memory records point into (the base block is at the start)
+
+// An edit that can be undone (like doc_undo)
+struct edit
+{
+	FILE_ADDRESS address, inserted;
+	loc_tree removed;                   // Records deleted or replaced
+};
+
+static bool same(const change_list &c1, const change_list &c2)
+{
+	return c1.addr == c2.addr && c1.len == c2.len;
+}
+
+int main()
+{
+	srand(1);
+	long edits = 0, changes = 0;
+	for (int round = 0; round < 1000; ++round)
+	{
+		loc_tree loc;
+		int type = round%4 == 0 ? change_tracker::mem_block : change_tracker::orig_file;
+		FILE_ADDRESS base_len = 1 + rand()%1000;
+		size_t mem_next = 1000;         // (memory used for the base is not reused)
+		if (type == change_tracker::orig_file)
+			loc.push_back(doc_loc(FILE_ADDRESS(0), base_len));
+		else
+			loc.push_back(doc_loc(mem, base_len));
+		change_tracker tracker(loc, type, base_len, mem);
+
+		change_list repl, ins, del;
+		tracker.build(repl, ins, del);
+		std::vector<edit> undo;
+
+		for (int ee = 0; ee < 200; ++ee, ++edits)
+		{
+			FILE_ADDRESS len = loc.length();
+			FILE_ADDRESS address = rand() % (len + 1);
+			FILE_ADDRESS count = rand()%4 == 0 ? 100 : 5;   // (mostly small changes)
+			count = 1 + rand()%count;
+			if (mem_next + count > sizeof(mem))
+				mem_next = 1000;
+
+			int what = rand()%5;
+			if (what == 4 && undo.empty())
+				what = 0;
+			if ((what == 1 || what == 2) && address == len)
+				what = 0;               // nothing to delete or replace
+			switch (what)
+			{
+			case 0:                     // insert
+				undo.push_back(edit());
+				undo.back().address = address;
+				undo.back().inserted = count;
+				loc.insert(address, doc_loc(mem + mem_next, count));
+				mem_next += size_t(count);
+				tracker.update(address, count, count, repl, ins, del);
+				break;
+			case 1:                     // delete
+				count = std::min(count, len - address);
+				undo.push_back(edit());
+				undo.back().address = address;
+				undo.back().inserted = 0;
+				loc.cut(address, count, undo.back().removed);
+				tracker.update(address, 0, -count, repl, ins, del);
+				break;
+			case 2:                     // replace
+			case 3:
+				count = std::min(count, len - address);
+				undo.push_back(edit());
+				undo.back().address = address;
+				undo.back().inserted = count;
+				loc.cut(address, count, undo.back().removed);
+				loc.insert(address, doc_loc(mem + mem_next, count));
+				mem_next += size_t(count);
+				tracker.update(address, count, 0, repl, ins, del);
+				break;
+			case 4:                     // undo the last edit
+				{
+					edit &uu = undo.back();
+					FILE_ADDRESS removed = uu.removed.length();
+					loc.erase(uu.address, uu.inserted);
+					loc.paste(uu.address, uu.removed);
+					tracker.update(uu.address, removed, removed - uu.inserted, repl, ins, del);
+					undo.pop_back();
+				}
+				break;
+			}
+
+			change_list r2, i2, d2;
+			tracker.build(r2, i2, d2);
+			if (!same(repl, r2) || !same(ins, i2) || !same(del, d2))
+			{
+				printf("change_tracker: FAILED in round %d edit %d\n", round, ee);
+				return 1;
+			}
+			changes += long(r2.addr.size() + i2.addr.size() + d2.addr.size());
+		}
+
+		// After undoing everything there should be no changes
+		while (!undo.empty())
+		{
+			edit &uu = undo.back();
+			FILE_ADDRESS removed = uu.removed.length();
+			loc.erase(uu.address, uu.inserted);
+			loc.paste(uu.address, uu.removed);
+			tracker.update(uu.address, removed, removed - uu.inserted, repl, ins, del);
+			undo.pop_back();
+		}
+		if (!repl.addr.empty() || !ins.addr.empty() || !del.addr.empty())
+		{
+			printf("change_tracker: FAILED in round %d - changes left after undoing all edits\n", round);
+			return 1;
+		}
+	}
+	printf("change_tracker: %ld edits OK (%ld changes)\n", edits, changes);
+	return 0;
+}
@@ -0,0 +1,204 @@
+// DataFileTest.cpp : tests of data_file_table (DataFileTable.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Data files are added, used by undo records and released in the same way as
+// CHexEditDoc does it: a change that inserts a file (Change) or moves old undo
+// data to a temp file (spill_undo) adds references, Undo releases them (and the
+// file is removed when not used), and regenerate recounts the references and
+// removes unused files.  After every step the table is checked against a model:
+// - each file's count is the number of undo records that use it
+// - a new file goes in the first empty slot and there are no empty slots at the end
+// - any number of files can be in use at once (there used to be a limit of 4)
+// Data file location records (doc_loc) with big file numbers are also checked.
+
+#include "stdafx.h"
+#include <vector>
+#include "../../DataFileTable.h"
+#include "../../LocTree.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+class CFile64 { };                      // (only pointers are stored)
+
+// Checks the table against the model (files[ii] is the file in slot ii or NULL) and the
+// data file number (or -1) of every undo record
+static bool check(const data_file_table &table, const std::vector<CFile64 *> &files,
+                  const std::vector<int> &undo)
+{
+	if (table.size() != int(files.size()) || table.empty() != files.empty() ||
+		(!files.empty() && files.back() == NULL))
+	{
+		return false;
+	}
+	for (int ii = 0; ii < table.size(); ++ii)
+	{
+		int count = int(std::count(undo.begin(), undo.end(), ii));
+		if (table[ii] != files[ii] || (files[ii] != NULL && table.refs(ii) != count))
+			return false;
+	}
+	return true;
+}
+
+// Removes file idx from the table (as close_data_file) and the model
+static bool remove_file(data_file_table &table, std::vector<CFile64 *> &files, int idx)
+{
+	CFile64 *pf = table.remove(idx);
+	if (pf != files[idx])
+		return false;
+	delete pf;
+	files[idx] = NULL;
+	while (!files.empty() && files.back() == NULL)
+		files.pop_back();
+	return true;
+}
+
+int main()
+{
+	srand(1);
+	long steps = 0;
+	int most = 0;                       // Most files in use at once
+	for (int round = 0; round < 200; ++round)
+	{
+		data_file_table table;
+		std::vector<CFile64 *> files;   // The model of the table
+		std::vector<int> undo;          // Data file of each undo record (or -1)
+		for (int ss = 0; ss < 500; ++ss, ++steps)
+		{
+			int op = rand()%10;
+			if (op < 2)
+			{
+				// Add a file (AddDataFile) - it is not used until a change refers to it
+				CFile64 *pf = new CFile64;
+				bool temp = rand()%2 == 0;
+				int idx = table.add(pf, temp);
+				size_t expected = std::find(files.begin(), files.end(), (CFile64 *)NULL) - files.begin();
+				if (idx != int(expected) || table.is_temp(idx) != temp || table.refs(idx) != 0)
+				{
+					printf("round %d step %d: file added in slot %d (should be %d)\n", round, ss, idx, int(expected));
+					return 1;
+				}
+				if (expected == files.size())
+					files.push_back(pf);
+				else
+					files[expected] = pf;
+
+				// Sometimes the data of old undo records is moved to the new file (spill_undo)
+				if (rand()%4 == 0)
+				{
+					int moved = 0;
+					for (size_t ii = 0; ii < undo.size(); ++ii)
+						if (undo[ii] == -1 && rand()%3 == 0)
+						{
+							undo[ii] = idx;
+							++moved;
+						}
+					if (moved > 0)
+						table.add_ref(idx, moved);
+				}
+			}
+			else if (op < 6)
+			{
+				// A change (Change) - it inserts a data file that is in the table or has data in memory
+				std::vector<int> in_use;
+				for (int ii = 0; ii < int(files.size()); ++ii)
+					if (files[ii] != NULL)
+						in_use.push_back(ii);
+				int idx = -1;
+				if (!in_use.empty() && rand()%2 == 0)
+				{
+					idx = in_use[rand() % in_use.size()];
+					table.add_ref(idx);
+				}
+				undo.push_back(idx);
+			}
+			else if (op < 9)
+			{
+				// Undo the last change - if it was the last one to use a file the file is removed
+				if (undo.empty())
+					continue;
+				int idx = undo.back();
+				undo.pop_back();
+				if (idx == -1)
+					continue;
+				bool last = std::count(undo.begin(), undo.end(), idx) == 0;
+				if (table.release(idx) != last)
+				{
+					printf("round %d step %d: release() was wrong\n", round, ss);
+					return 1;
+				}
+				if (last && !remove_file(table, files, idx))
+				{
+					printf("round %d step %d: wrong file removed\n", round, ss);
+					return 1;
+				}
+			}
+			else
+			{
+				// Recount references and remove unused files (regenerate)
+				table.clear_refs();
+				for (size_t ii = 0; ii < undo.size(); ++ii)
+					if (undo[ii] != -1)
+						table.add_ref(undo[ii]);
+				for (int ii = table.size() - 1; ii >= 0; --ii)
+					if (table.unused(ii) && !remove_file(table, files, ii))
+					{
+						printf("round %d step %d: wrong file removed\n", round, ss);
+						return 1;
+					}
+				for (int ii = 0; ii < table.size(); ++ii)
+					if (table[ii] != NULL && table.refs(ii) == 0)
+					{
+						printf("round %d step %d: unused file not removed\n", round, ss);
+						return 1;
+					}
+			}
+			if (!check(table, files, undo))
+			{
+				printf("round %d step %d: table does not match the model\n", round, ss);
+				return 1;
+			}
+			most = max(most, int(files.size() - std::count(files.begin(), files.end(), (CFile64 *)NULL)));
+		}
+
+		// Discard all undo records (close_data_files)
+		table.clear_refs();
+		for (int ii = table.size() - 1; ii >= 0; --ii)
+			if (ii < table.size() && table[ii] != NULL)
+				remove_file(table, files, ii);
+		if (!table.empty())
+		{
+			printf("round %d: table not empty\n", round);
+			return 1;
+		}
+	}
+
+	// Location records of data files with big file numbers keep the number and address
+	loc_tree loc;
+	FILE_ADDRESS total = 0;
+	for (int idx = 0; idx < 1000; idx += 37)
+	{
+		loc.push_back(doc_loc(FILE_ADDRESS(idx) << 40, 1000, idx));
+		total += 1000;
+	}
+	for (FILE_ADDRESS aa = 500; aa < total; aa += 1000)
+		loc.split(aa);
+	int count = 0;
+	for (loc_tree::iterator pl = loc.begin(); pl != loc.end(); ++pl, ++count)
+	{
+		int idx = (count/2)*37;
+		FILE_ADDRESS addr = (FILE_ADDRESS(idx) << 40) + (count%2 == 0 ? 0 : 500);
+		if ((pl->dlen >> 62) != 3 || pl->fileid != idx || pl->fileaddr != addr || (pl->dlen & doc_loc::mask) != 500)
+		{
+			printf("data file record %d wrong\n", count);
+			return 1;
+		}
+	}
+
+	printf("data_file_table: %ld steps OK (up to %d files in use)\n", steps, most);
+	return 0;
+}
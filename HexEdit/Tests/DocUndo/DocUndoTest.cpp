@@ -0,0 +1,412 @@
+// DocUndoTest.cpp : tests of undo records (DocUndo.h) applied to a location list
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Changes are made to a location list (that starts as the whole of an original
+// "file") as CHexEditDoc::Change makes them - an undo record is added for each
+// and applied with loc_apply - and undone as CHexEditDoc::Undo does with
+// loc_revert.  The bytes of the document are checked against a model.
+//
+// Batches: random changes are made as a batch (see CHexEditDoc::BeginBatch).
+// Every byte changed must be in the area given by batch_area (that CommitBatch
+// searches again and redraws), and undoing all the records of the batch together
+// (as the view does for a batch) must give exactly the document as it was before
+// the batch, and free all the undo memory of the batch.
+//
+// Replace All: the undo records made by add_replace_all (for all occurrences of
+// a string) must be the same as those of calling Change for each replacement
+// in turn and give the same document.  Undoing some or all of them (one at a
+// time, as Undo does) must give the same as undoing the Change records.  Since
+// the records share one copy of the replacement bytes, a change merged into the
+// last record (as Change merges typing) must not affect the others.
+
+#include "stdafx.h"
+#include <vector>
+#include "../../DocUndo.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+test_app theApp;
+
+typedef std::vector<unsigned char> bytes;
+
+// The location list and undo records of a document (as in CHexEditDoc)
+struct test_doc
+{
+	test_doc(const bytes &orig) : orig_(orig)
+	{
+		if (!orig.empty())
+			loc_.push_back(doc_loc(FILE_ADDRESS(0), orig.size()));
+	}
+
+	// Makes a change (as CHexEditDoc::Change does when not merged with the previous change)
+	void change(mod_type utype, FILE_ADDRESS address, FILE_ADDRESS clen, const unsigned char *buf)
+	{
+		if (utype == mod_delforw || utype == mod_delback)
+			undo_.push_back(doc_undo(&arena_, utype, address, clen));
+		else
+			undo_.push_back(doc_undo(&arena_, utype, address, clen, (unsigned char *)buf));
+		loc_apply(undo_.back(), loc_, undo_.back().removed);
+	}
+
+	// Adds bytes to the end of the last change (as Change merges an insert or replace with the
+	// previous one) or changes its last byte (2nd nybble of a hex edit) - its data is changed
+	// in place so is first unshared if other records use it
+	void merge(const unsigned char *buf, FILE_ADDRESS clen, bool nybble)
+	{
+		doc_undo &uu = undo_.back();
+		ASSERT(uu.len + clen <= FILE_ADDRESS(uu.cap));
+		loc_revert(uu, loc_);
+		if (arena_.shared(uu.ptr))
+			uu.unshare();
+		if (nybble)
+			uu.ptr[size_t(uu.len) - 1] = buf[0];
+		else
+		{
+			memcpy(uu.ptr + size_t(uu.len), buf, size_t(clen));
+			uu.len += clen;
+		}
+		loc_apply(uu, loc_, uu.removed);
+	}
+
+	// Undoes the last change (as CHexEditDoc::Undo)
+	void undo()
+	{
+		loc_revert(undo_.back(), loc_);
+		undo_.pop_back();
+	}
+
+	// Gets all the bytes of the document from the location list
+	bytes contents() const
+	{
+		bytes retval;
+		for (loc_tree::iterator pl = loc_.begin(); pl != loc_.end(); ++pl)
+		{
+			size_t len = size_t(pl->dlen & doc_loc::mask);
+			const unsigned char *pp = (pl->dlen >> 62) == 1 ? &orig_[size_t(pl->fileaddr)] : pl->memaddr;
+			retval.insert(retval.end(), pp, pp + len);
+		}
+		return retval;
+	}
+
+	size_t buffers() const { return arena_.small_count() + arena_.heap_count(); }  // Undo data buffers in use
+
+	const bytes &orig_;
+	undo_arena arena_;                  // (before undo_ so the records are destroyed first)
+	std::vector<doc_undo> undo_;
+	loc_tree loc_;
+};
+
+// Makes a random change to the document and the model (of the document contents)
+static batch_change random_change(test_doc &doc, bytes &model, bool replace_only = false)
+{
+	static const mod_type types[] = { mod_insert, mod_replace, mod_repback, mod_delforw, mod_delback };
+	FILE_ADDRESS length = FILE_ADDRESS(model.size());
+	mod_type utype;
+	FILE_ADDRESS address, clen;
+	for (;;)
+	{
+		utype = types[replace_only ? 1 + rand()%2 : rand()%5];
+		clen = rand()%20 + 1;
+		address = rand() % (length + 1);
+		if (utype == mod_insert || utype == mod_replace)
+			break;                      // (a replacement can go past the end)
+		if (address + clen <= length)
+			break;
+	}
+
+	bytes buf((size_t)clen);
+	for (size_t ii = 0; ii < buf.size(); ++ii)
+		buf[ii] = (unsigned char)(rand()%256);
+	doc.change(utype, address, clen, &buf[0]);
+
+	size_t aa = size_t(address);
+	if (utype == mod_insert)
+		model.insert(model.begin() + aa, buf.begin(), buf.end());
+	else if (utype == mod_delforw || utype == mod_delback)
+		model.erase(model.begin() + aa, model.begin() + aa + buf.size());
+	else
+	{
+		if (model.size() < aa + buf.size())
+			model.resize(aa + buf.size());
+		std::copy(buf.begin(), buf.end(), model.begin() + aa);
+	}
+	return batch_change(utype, address, clen);
+}
+
+static bool test_batches()
+{
+	long changes = 0;
+	for (int round = 0; round < 2000; ++round)
+	{
+		bytes orig(rand()%500);
+		for (size_t ii = 0; ii < orig.size(); ++ii)
+			orig[ii] = (unsigned char)(rand()%256);
+		test_doc doc(orig);
+		bytes model(orig);
+
+		// Some changes before the batch
+		int before = rand()%10;
+		for (int ii = 0; ii < before; ++ii, ++changes)
+			random_change(doc, model);
+		bytes prev(model);
+		size_t batch_first = doc.undo_.size();
+		size_t prev_buffers = doc.buffers();
+
+		// The batch - the document must match the model after every change
+		std::vector<batch_change> batch;
+		int count = rand()%30 + 1;
+		bool replace_only = rand()%4 == 0;
+		for (int ii = 0; ii < count; ++ii, ++changes)
+		{
+			batch.push_back(random_change(doc, model, replace_only));
+			if (doc.contents() != model || doc.loc_.length() != FILE_ADDRESS(model.size()))
+			{
+				printf("round %d: wrong contents after change %d of batch\n", round, ii);
+				return false;
+			}
+		}
+
+		// All changed bytes must be in the area searched again (and redrawn) by CommitBatch
+		FILE_ADDRESS lo, hi;
+		bool shift = batch_area(batch, FILE_ADDRESS(model.size()), lo, hi);
+		bool expected = false;
+		for (size_t ii = 0; ii < batch.size(); ++ii)
+			if (batch[ii].utype != mod_replace && batch[ii].utype != mod_repback)
+				expected = true;
+		if (shift != expected || (shift && hi != FILE_ADDRESS(model.size())))
+		{
+			printf("round %d: batch_area gave the wrong shift or end\n", round);
+			return false;
+		}
+		if (!shift && model.size() != prev.size() && hi != FILE_ADDRESS(model.size()))
+		{
+			printf("round %d: batch_area does not include bytes added at the end\n", round);
+			return false;
+		}
+		for (size_t ii = 0; ii < max(model.size(), prev.size()); ++ii)
+		{
+			bool same = ii < model.size() && ii < prev.size() && model[ii] == prev[ii];
+			if (!same && (FILE_ADDRESS(ii) < lo || (FILE_ADDRESS(ii) >= hi && ii < model.size())))
+			{
+				printf("round %d: byte %d changed but not in the batch area (%lld to %lld)\n", round, int(ii), lo, hi);
+				return false;
+			}
+		}
+
+		// Undo the batch as one unit
+		while (doc.undo_.size() > batch_first)
+			doc.undo();
+		if (doc.contents() != prev || doc.loc_.length() != FILE_ADDRESS(prev.size()))
+		{
+			printf("round %d: undoing the batch did not restore the document\n", round);
+			return false;
+		}
+		if (doc.buffers() != prev_buffers)
+		{
+			printf("round %d: undoing the batch left %d buffers (should be %d)\n",
+			       round, int(doc.buffers()), int(prev_buffers));
+			return false;
+		}
+
+		// Undo the rest
+		while (!doc.undo_.empty())
+			doc.undo();
+		if (doc.contents() != orig || doc.buffers() != 0)
+		{
+			printf("round %d: undoing everything did not restore the original\n", round);
+			return false;
+		}
+	}
+	printf("batches: %ld changes OK\n", changes);
+	return true;
+}
+
+// Describes an undo record (including its data) so records can be compared
+static bytes describe(const doc_undo &uu)
+{
+	char buf[64];
+	sprintf(buf, "%c %lld %lld:", char(uu.utype), uu.address, uu.len);
+	bytes retval(buf, buf + strlen(buf));
+	if (uu.ptr != NULL)
+		retval.insert(retval.end(), uu.ptr, uu.ptr + size_t(uu.len));
+	return retval;
+}
+
+static bool test_replace_all()
+{
+	long replacements = 0;
+	for (int round = 0; round < 2000; ++round)
+	{
+		// Use few different byte values so that there are lots of occurrences
+		bytes orig(rand()%500);
+		for (size_t ii = 0; ii < orig.size(); ++ii)
+			orig[ii] = (unsigned char)(rand()%3);
+		test_doc doc(orig);
+		bytes model(orig);
+
+		// Some changes before the Replace All
+		int before = rand()%10;
+		for (int ii = 0; ii < before; ++ii)
+			random_change(doc, model);
+		bytes prev(model);
+		size_t first_new = doc.undo_.size();
+		size_t prev_buffers = doc.buffers();
+
+		// Find all (non-overlapping) occurrences of a string and work out the result
+		bytes str(rand()%3 + 1), rep;
+		for (size_t ii = 0; ii < str.size(); ++ii)
+			str[ii] = (unsigned char)(rand()%3);
+		switch (rand()%3)
+		{
+		case 0:
+			rep.resize(str.size());     // same length (mod_replace)
+			break;
+		case 1:
+			rep.resize(rand()%6 + 1);   // different length (mod_delforw + mod_insert)
+			break;
+		default:
+			break;                      // nothing (mod_delforw only)
+		}
+		for (size_t ii = 0; ii < rep.size(); ++ii)
+			rep[ii] = (unsigned char)(rand()%256);
+		FILE_ADDRESS len = FILE_ADDRESS(str.size());
+
+		std::vector<FILE_ADDRESS> found;
+		bytes expected;
+		for (size_t ii = 0; ii < model.size(); )
+		{
+			if (ii + str.size() <= model.size() && std::equal(str.begin(), str.end(), model.begin() + ii))
+			{
+				found.push_back(FILE_ADDRESS(ii));
+				expected.insert(expected.end(), rep.begin(), rep.end());
+				ii += str.size();
+			}
+			else
+				expected.push_back(model[ii++]);
+		}
+		if (found.empty())
+			continue;
+		replacements += long(found.size());
+
+		// Replace All
+		add_replace_all(doc.undo_, &doc.arena_, found, len, rep.empty() ? NULL : &rep[0], rep.size());
+		for (size_t ii = first_new; ii < doc.undo_.size(); ++ii)
+			loc_apply(doc.undo_[ii], doc.loc_, doc.undo_[ii].removed);
+		if (doc.contents() != expected)
+		{
+			printf("round %d: wrong contents after Replace All\n", round);
+			return false;
+		}
+		std::vector<bytes> records;
+		for (size_t ii = first_new; ii < doc.undo_.size(); ++ii)
+		{
+			records.push_back(describe(doc.undo_[ii]));
+			if (doc.undo_[ii].ptr != NULL && doc.undo_[ii].ptr != doc.undo_.back().ptr)
+			{
+				printf("round %d: replacement bytes not shared\n", round);
+				return false;
+			}
+		}
+		if (doc.buffers() > prev_buffers + 1)
+		{
+			printf("round %d: %d buffers used for one replacement string\n", round, int(doc.buffers() - prev_buffers));
+			return false;
+		}
+
+		// Undo some of it (and keep the result to compare with Change below)
+		size_t undo_count = rand() % (doc.undo_.size() - first_new + 1);
+		for (size_t ii = 0; ii < undo_count; ++ii)
+			doc.undo();
+		bytes part(doc.contents());
+
+		// Add to or change the end of the last replacement (as typing is merged with it)
+		if (undo_count == 0 && !rep.empty() && rep.size() < 6)
+		{
+			unsigned char extra[2] = { 0xEE, 0xFF };
+			bool nybble = rand()%2 == 0;
+			doc.merge(extra, 2, nybble);
+			bytes merged(expected);
+			FILE_ADDRESS at = doc.undo_.back().address + FILE_ADDRESS(rep.size());
+			if (nybble)
+				merged[size_t(at) - 1] = extra[0];
+			else if (doc.undo_.back().utype == mod_insert)
+				merged.insert(merged.begin() + size_t(at), extra, extra + 2);
+			else
+			{
+				if (merged.size() < size_t(at) + 2)
+					merged.resize(size_t(at) + 2);
+				std::copy(extra, extra + 2, merged.begin() + size_t(at));
+			}
+			if (doc.contents() != merged)
+			{
+				printf("round %d: merging with the last replacement changed other bytes\n", round);
+				return false;
+			}
+		}
+
+		while (doc.undo_.size() > first_new)
+			doc.undo();
+		if (doc.contents() != prev || doc.buffers() != prev_buffers)
+		{
+			printf("round %d: undoing Replace All did not restore the document\n", round);
+			return false;
+		}
+
+		// Now the same with Change for each replacement
+		FILE_ADDRESS delta = 0;
+		for (size_t ii = 0; ii < found.size(); ++ii)
+		{
+			FILE_ADDRESS address = found[ii] + delta;
+			if (rep.size() == str.size())
+				doc.change(mod_replace, address, len, &rep[0]);
+			else
+			{
+				doc.change(mod_delforw, address, len, NULL);
+				if (!rep.empty())
+					doc.change(mod_insert, address, FILE_ADDRESS(rep.size()), &rep[0]);
+			}
+			delta += FILE_ADDRESS(rep.size()) - len;
+		}
+		if (doc.contents() != expected || doc.undo_.size() - first_new != records.size())
+		{
+			printf("round %d: Change gave a different result to Replace All\n", round);
+			return false;
+		}
+		for (size_t ii = 0; ii < records.size(); ++ii)
+			if (describe(doc.undo_[first_new + ii]) != records[ii])
+			{
+				printf("round %d: undo record %d is different to that of Change\n", round, int(ii));
+				return false;
+			}
+		for (size_t ii = 0; ii < undo_count; ++ii)
+			doc.undo();
+		if (doc.contents() != part)
+		{
+			printf("round %d: undoing %d changes gave a different result to Replace All\n", round, int(undo_count));
+			return false;
+		}
+		while (doc.undo_.size() > first_new)
+			doc.undo();
+		while (!doc.undo_.empty())
+			doc.undo();
+		if (doc.contents() != orig || doc.buffers() != 0)
+		{
+			printf("round %d: undoing everything did not restore the original\n", round);
+			return false;
+		}
+	}
+	printf("Replace All: %ld replacements OK\n", replacements);
+	return true;
+}
+
+int main()
+{
+	srand(1);
+	if (!test_batches() || !test_replace_all())
+		return 1;
+	return 0;
+}
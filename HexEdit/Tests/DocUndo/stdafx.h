@@ -0,0 +1,42 @@
+// stdafx.h : stands in for HexEdit's stdafx.h so the undo records build without MFC
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// DocUndo.cpp (with LocTree.cpp and UndoArena.cpp) needs FILE_ADDRESS, USE_MOVE
+// and theApp.undo_limit_ (from HexEdit.h), ASSERT and InterlockedIncrement.
+// These are provided here (for g++ or clang) and the include guard of HexEdit.h
+// is defined so that the includes of it are skipped.
+
+#pragma once
+
+#include <assert.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define HEXEDIT_H__INCLUDED_
+#define USE_MOVE         1
+
+#define __int64 long long
+typedef __int64 FILE_ADDRESS;
+typedef long LONG;
+#define ASSERT(ff) assert(ff)
+using std::min;
+using std::max;
+
+inline LONG InterlockedIncrement(volatile LONG *pp) { return __sync_add_and_fetch(pp, 1); }
+
+// Stands in for CHexEditApp (only the undo merge limit is used)
+struct test_app
+{
+	int undo_limit_;
+	test_app() : undo_limit_(8) { }
+};
+extern test_app theApp;
@@ -0,0 +1,379 @@
+// EditJournalTest.cpp : tests of edit_journal (EditJournal.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Random edits (as made by CHexEditDoc::Change and Undo) are written to a
+// journal and to a model of the undo stack.  The journal is then read back:
+// - every entry must be read with the same fields and data as were added
+// - replay() must give the undo records of the model and the new file length
+// - a journal cut short (as if HexEdit crashed while writing) or with a bad
+//   end marker must give just the complete entries before that point, and
+//   reopen() must then be able to add to it
+// - the header must match the file: a different length or time gives 0, and
+//   bad magic or a different path (or no journal) gives -1
+
+#include "stdafx.h"
+#include <vector>
+#include "../../EditJournal.h"
+
+typedef std::vector<unsigned char> bytes;
+
+static const char *doc_path = "C:\\Data\\Big File.bin";
+static const char *src_name = "JournalTest.tmp/src.bin";
+
+// What was added to the journal for an undo record
+struct model_rec
+{
+	int op;
+	int utype;
+	FILE_ADDRESS address;
+	FILE_ADDRESS len;
+	bytes data;                         // data (or pattern) written to the journal
+	FILE_ADDRESS len_before;            // file length before the change
+	FILE_ADDRESS len_after;             // file length after the change
+};
+
+static bool is_del(int utype) { return utype == mod_delforw || utype == mod_delback; }
+
+static FILE_ADDRESS length_after(int utype, FILE_ADDRESS address, FILE_ADDRESS len, FILE_ADDRESS before)
+{
+	if (is_del(utype))
+		return before - len;
+	else if (utype == mod_insert || utype == mod_insert_file)
+		return before + len;
+	else
+		return std::max(before, address + len);
+}
+
+static FILE_ADDRESS file_length(const char *name)
+{
+	struct stat st;
+	return stat(name, &st) == 0 ? st.st_size : -1;
+}
+
+static bytes read_bytes(const char *name, FILE_ADDRESS addr, size_t len)
+{
+	bytes bb(len);
+	CFile64 ff;
+	if (len > 0 && (!ff.Open(name, CFile::modeRead) || ff.ReadAt(addr, &bb[0], UINT(len)) != len))
+		bb.clear();
+	return bb;
+}
+
+static void write_byte(const char *name, FILE_ADDRESS addr, unsigned char cc)
+{
+	CFile64 ff;
+	if (ff.Open(name, CFile::modeWrite))
+	{
+		ff.Seek(addr, CFile::begin);
+		ff.Write(&cc, 1);
+	}
+}
+
+static bytes random_bytes(size_t len)
+{
+	bytes bb(len);
+	for (size_t ii = 0; ii < len; ++ii)
+		bb[ii] = (unsigned char)rand();
+	return bb;
+}
+
+// Checks that the entries read are those added (in order) with the data at the right place
+static bool check_entries(const std::vector<edit_journal::entry> &entries, const std::vector<model_rec> &added,
+                          const char *name)
+{
+	if (entries.size() != added.size())
+		return false;
+	for (size_t ii = 0; ii < entries.size(); ++ii)
+	{
+		const edit_journal::entry &ee = entries[ii];
+		const model_rec &mm = added[ii];
+		if (ee.op != mm.op || ee.utype != mm.utype || ee.address != mm.address || ee.len != mm.len ||
+			ee.size != FILE_ADDRESS(mm.data.size()) || (ee.data == -1) != mm.data.empty() ||
+			(!mm.data.empty() && read_bytes(name, ee.data, mm.data.size()) != mm.data))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Makes a random change (or merges it into the last one) and adds it to the journal and the model
+static bool random_change(edit_journal &journal, CFile64 &src, std::vector<model_rec> &stack,
+                          std::vector<model_rec> &added, FILE_ADDRESS doc_len)
+{
+	model_rec mm;
+	mm.len_before = stack.empty() ? doc_len : stack.back().len_after;
+	bool ok;
+	int rr = rand()%10;
+	if (rr == 0)
+	{
+		// Undo the last change (an undo with nothing to undo is ignored)
+		mm.op = edit_journal::rec_undo;
+		mm.utype = 0;
+		mm.address = mm.len = 0;
+		ok = journal.add_undo();
+		if (!stack.empty())
+			stack.pop_back();
+		added.push_back(mm);
+		return ok;
+	}
+	else if (rr < 3 && !stack.empty() && stack.back().op != edit_journal::rec_pattern &&
+	         stack.back().utype != mod_insert_file &&
+	         (!is_del(stack.back().utype) || stack.back().address + stack.back().len < stack.back().len_before))
+	{
+		// Extend the last change (eg another character typed)
+		mm = stack.back();
+		mm.op = edit_journal::rec_merge;
+		FILE_ADDRESS extra = 1 + rand()%8;
+		if (is_del(mm.utype))
+			extra = std::min(extra, mm.len_before - mm.address - mm.len);
+		else
+		{
+			bytes more = random_bytes(size_t(extra));
+			mm.data.insert(mm.data.end(), more.begin(), more.end());
+		}
+		mm.len += extra;
+		ok = journal.add(mm.op, mm.utype, mm.address, mm.len, mm.data.empty() ? NULL : &mm.data[0]);
+		stack.back() = mm;
+	}
+	else
+	{
+		static const int types[] = { mod_insert, mod_replace, mod_repback, mod_delforw, mod_delback, mod_insert_file };
+		mm.op = edit_journal::rec_new;
+		mm.utype = types[rand() % (sizeof(types)/sizeof(*types))];
+		if (is_del(mm.utype) && mm.len_before == 0)
+			mm.utype = mod_insert;
+		mm.address = rand() % (mm.len_before + 1);
+		if (is_del(mm.utype))
+		{
+			if (mm.address == mm.len_before)
+				--mm.address;
+			mm.len = 1 + rand() % std::min(mm.len_before - mm.address, FILE_ADDRESS(100));
+			ok = journal.add(mm.op, mm.utype, mm.address, mm.len, NULL);
+		}
+		else if (mm.utype == mod_insert_file)
+		{
+			// Data copied from another file (more than the 1 MByte copy buffer sometimes)
+			mm.len = rand()%20 == 0 ? 1024*1024 + rand()%5000 : 1 + rand()%5000;
+			FILE_ADDRESS src_addr = rand() % (file_length(src_name) - mm.len + 1);
+			mm.data = read_bytes(src_name, src_addr, size_t(mm.len));
+			ok = journal.add(mm.op, mm.utype, mm.address, mm.len, &src, src_addr);
+		}
+		else if (rand()%4 == 0)
+		{
+			// A repeated pattern (eg Edit/Insert Block)
+			mm.op = edit_journal::rec_pattern;
+			mm.data = random_bytes(1 + rand()%16);
+			mm.len = mm.data.size() * (1 + rand()%1000);
+			ok = journal.add_pattern(mm.utype, mm.address, mm.len, &mm.data[0], mm.data.size());
+		}
+		else
+		{
+			mm.data = random_bytes(1 + rand()%300);
+			mm.len = mm.data.size();
+			ok = journal.add(mm.op, mm.utype, mm.address, mm.len, &mm.data[0]);
+		}
+		mm.len_after = length_after(mm.utype, mm.address, mm.len, mm.len_before);
+		stack.push_back(mm);
+	}
+	added.push_back(mm);
+	if (stack.back().op == edit_journal::rec_merge)
+		stack.back().len_after = length_after(mm.utype, mm.address, mm.len, mm.len_before);
+	return ok;
+}
+
+int main()
+{
+	srand(1);
+	mkdir("JournalTest.tmp", 0777);
+	{
+		bytes bb = random_bytes(3*1024*1024);
+		FILE *fp = fopen(src_name, "wb");
+		if (fp == NULL || fwrite(&bb[0], 1, bb.size(), fp) != bb.size() || fclose(fp) != 0)
+		{
+			printf("edit_journal: can't create %s\n", src_name);
+			return 1;
+		}
+	}
+	CFile64 src;
+	src.Open(src_name, CFile::modeRead);
+	CString name = edit_journal::file_name(doc_path);
+
+	long entries_read = 0, cuts = 0;
+	for (int round = 0; round < 200; ++round)
+	{
+		FILE_ADDRESS doc_len = rand()%1000;
+		FILETIME doc_time = { DWORD(rand()), DWORD(rand()) };
+		edit_journal journal;
+		if (!journal.create(doc_path, doc_len, doc_time) || journal.name() != name)
+		{
+			printf("round %d: create failed\n", round);
+			return 1;
+		}
+
+		std::vector<model_rec> stack;   // the undo records
+		std::vector<model_rec> added;   // what was added to the journal
+		std::vector<FILE_ADDRESS> ends; // where each entry ends in the journal
+		FILE_ADDRESS head_end = file_length(name);
+		int changes = rand()%100;
+		for (int cc = 0; cc < changes; ++cc)
+		{
+			if (!random_change(journal, src, stack, added, doc_len))
+			{
+				printf("round %d change %d: add failed\n", round, cc);
+				return 1;
+			}
+			ends.push_back(file_length(name));
+		}
+		journal.close();
+
+		// Read it all back
+		std::vector<edit_journal::entry> entries;
+		FILE_ADDRESS valid_len;
+		if (edit_journal::read(doc_path, doc_len, doc_time, entries, valid_len) != 1 ||
+			valid_len != file_length(name) || !check_entries(entries, added, name))
+		{
+			printf("round %d: entries read are not those added\n", round);
+			return 1;
+		}
+		entries_read += entries.size();
+
+		// Replay must give the model's undo records
+		std::vector<edit_journal::entry> recs;
+		FILE_ADDRESS new_len;
+		bool replay_ok = edit_journal::replay(entries, doc_len, recs, new_len);
+		bool same = replay_ok && recs.size() == stack.size() &&
+		            new_len == (stack.empty() ? doc_len : stack.back().len_after);
+		for (size_t ii = 0; same && ii < recs.size(); ++ii)
+			same = recs[ii].utype == stack[ii].utype && recs[ii].address == stack[ii].address &&
+			       recs[ii].len == stack[ii].len && read_bytes(name, recs[ii].data, size_t(recs[ii].size)) == stack[ii].data;
+		if (!same)
+		{
+			printf("round %d: replay gives the wrong undo records\n", round);
+			return 1;
+		}
+
+		// Header checks
+		FILETIME other_time = doc_time;
+		++other_time.dwLowDateTime;
+		CString upper(doc_path);
+		for (int ii = 0; ii < upper.GetLength(); ++ii)
+			upper.GetBuffer(upper.GetLength())[ii] = char(toupper((unsigned char)upper[ii]));
+		if (edit_journal::read(doc_path, doc_len + 1, doc_time, entries, valid_len) != 0 || !entries.empty() ||
+			edit_journal::read(doc_path, doc_len, other_time, entries, valid_len) != 0 || !entries.empty() ||
+			edit_journal::read(upper, doc_len, doc_time, entries, valid_len) != 1 || entries.size() != added.size() ||
+			edit_journal::read("C:\\Data\\Other.bin", doc_len, doc_time, entries, valid_len) != -1)
+		{
+			printf("round %d: journal header not checked\n", round);
+			return 1;
+		}
+
+		if (!ends.empty())
+		{
+			// A bad end marker stops reading at that entry
+			size_t bad = rand() % ends.size();
+			bytes save = read_bytes(name, ends[bad] - 1, 1);
+			write_byte(name, ends[bad] - 1, save[0] ^ 0x20);
+			if (edit_journal::read(doc_path, doc_len, doc_time, entries, valid_len) != 1 ||
+				entries.size() != bad || valid_len != (bad == 0 ? head_end : ends[bad - 1]))
+			{
+				printf("round %d: bad end marker of entry %d not found\n", round, int(bad));
+				return 1;
+			}
+			write_byte(name, ends[bad] - 1, save[0]);
+
+			// Cut the journal short then add to it
+			FILE_ADDRESS cut = head_end + rand() % (ends.back() - head_end);
+			if (truncate(name, cut) != 0)
+				return 1;
+			size_t complete = std::upper_bound(ends.begin(), ends.end(), cut) - ends.begin();
+			if (edit_journal::read(doc_path, doc_len, doc_time, entries, valid_len) != 1 ||
+				entries.size() != complete || valid_len != (complete == 0 ? head_end : ends[complete - 1]))
+			{
+				printf("round %d: journal cut at %lld not read correctly\n", round, cut);
+				return 1;
+			}
+			added.resize(complete);
+			stack.clear();              // (the model is only right for the whole journal)
+			if (!journal.reopen(doc_path, valid_len) || journal.name() != name ||
+				!random_change(journal, src, stack, added, doc_len))
+			{
+				printf("round %d: reopen failed\n", round);
+				return 1;
+			}
+			journal.close();
+			if (edit_journal::read(doc_path, doc_len, doc_time, entries, valid_len) != 1 ||
+				!check_entries(entries, added, name))
+			{
+				printf("round %d: entries added after reopen are not read correctly\n", round);
+				return 1;
+			}
+			++cuts;
+		}
+
+		// Bad magic or a different path in the header
+		if (rand()%2 == 0)
+		{
+			write_byte(name, 0, 'X');
+			if (edit_journal::read(doc_path, doc_len, doc_time, entries, valid_len) != -1)
+			{
+				printf("round %d: bad magic not found\n", round);
+				return 1;
+			}
+		}
+		else
+		{
+			write_byte(name, head_end - 1, 'x');    // last char of the path
+			if (edit_journal::read(doc_path, doc_len, doc_time, entries, valid_len) != -1)
+			{
+				printf("round %d: different path not found\n", round);
+				return 1;
+			}
+		}
+
+		// Remove must delete it
+		if (!journal.reopen(doc_path, file_length(name)))
+			return 1;
+		journal.remove();
+		if (file_length(name) != -1 || edit_journal::read(doc_path, doc_len, doc_time, entries, valid_len) != -1)
+		{
+			printf("round %d: journal not removed\n", round);
+			return 1;
+		}
+	}
+
+	// Replay of records that are not valid for the file
+	struct { int op, utype; FILE_ADDRESS address, len, data; } bad[] =
+	{
+		{ edit_journal::rec_new, mod_delforw,  90, 20, -1 },    // delete past EOF
+		{ edit_journal::rec_new, mod_delback, 101,  1, -1 },    // starts past EOF
+		{ edit_journal::rec_new, mod_replace,  10,  5, -1 },    // no data
+		{ edit_journal::rec_new, mod_insert,   10,  0, 64 },    // nothing inserted
+		{ edit_journal::rec_new, mod_insert,   -1,  5, 64 },
+	};
+	for (size_t ii = 0; ii < sizeof(bad)/sizeof(*bad); ++ii)
+	{
+		std::vector<edit_journal::entry> entries(1), recs;
+		FILE_ADDRESS new_len;
+		edit_journal::entry &ee = entries[0];
+		ee.op = bad[ii].op;
+		ee.utype = bad[ii].utype;
+		ee.address = bad[ii].address;
+		ee.len = bad[ii].len;
+		ee.data = bad[ii].data;
+		ee.size = bad[ii].data == -1 ? 0 : bad[ii].len;
+		if (edit_journal::replay(entries, 100, recs, new_len))
+		{
+			printf("replay of bad record %d not found\n", int(ii));
+			return 1;
+		}
+	}
+
+	printf("edit_journal: %ld entries and %ld cut journals OK\n", entries_read, cuts);
+	return 0;
+}
@@ -0,0 +1,14 @@
+// io.h : stands in for the Windows io.h (only _access is used)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#pragma once
+
+#include <unistd.h>
+
+#define _access access
@@ -0,0 +1,171 @@
+// stdafx.h : stands in for HexEdit's stdafx.h so edit_journal builds without MFC
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// EditJournal.cpp uses CString, CFile64 and a few Windows functions.  Just
+// enough of these is provided here (for g++ or clang on POSIX) and the include
+// guards of HexEdit.h, CFile64.h, DocUndo.h and Misc.h are defined so that
+// EditJournal.cpp's includes of them are skipped.  The journals are written
+// to a folder (see GetDataPath) under the current directory.
+
+#pragma once
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <algorithm>
+
+#define HEXEDIT_H__INCLUDED_
+#define FILE_64_CLASS_HEADER
+#define DOCUNDO_INCLUDED
+#define MISC_INCLUDED_
+
+#define __int64 long long
+typedef __int64 FILE_ADDRESS;
+typedef unsigned int UINT;
+typedef unsigned int DWORD;
+typedef char TCHAR;
+typedef const char *LPCTSTR;
+#define _T(ss) ss
+#define ASSERT(ff) assert(ff)
+using std::min;
+using std::max;
+
+enum mod_type
+{
+	mod_unknown = '0',
+	mod_insert  = 'I',
+	mod_replace = 'R',
+	mod_delforw = 'D',
+	mod_delback = 'B',
+	mod_repback = '<',
+	mod_insert_file = 'F',
+};
+
+class CString
+{
+public:
+	CString() { }
+	CString(LPCTSTR ss) : str_(ss) { }
+	int GetLength() const { return int(str_.size()); }
+	bool IsEmpty() const { return str_.empty(); }
+	void Empty() { str_.clear(); }
+	char operator[](int ii) const { return str_[ii]; }
+	operator LPCTSTR() const { return str_.c_str(); }
+	CString &operator+=(LPCTSTR ss) { str_ += ss; return *this; }
+	friend bool operator==(const CString &s1, const CString &s2) { return s1.str_ == s2.str_; }
+	friend bool operator!=(const CString &s1, const CString &s2) { return s1.str_ != s2.str_; }
+	friend CString operator+(const CString &s1, const CString &s2) { CString rr(s1); rr.str_ += s2.str_; return rr; }
+	void MakeLower() { for (size_t ii = 0; ii < str_.size(); ++ii) str_[ii] = char(tolower((unsigned char)str_[ii])); }
+	int CompareNoCase(LPCTSTR ss) const { return strcasecmp(str_.c_str(), ss); }
+	char *GetBuffer(int len) { str_.resize(len); return &str_[0]; }
+	void ReleaseBuffer(int len) { str_.resize(len); }
+	void Format(LPCTSTR fmt, ...)
+	{
+		char buf[1024];
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(buf, sizeof(buf), fmt, args);
+		va_end(args);
+		str_ = buf;
+	}
+private:
+	std::string str_;
+};
+
+struct FILETIME { DWORD dwLowDateTime; DWORD dwHighDateTime; };
+inline long CompareFileTime(const FILETIME *t1, const FILETIME *t2)
+{
+	if (t1->dwHighDateTime != t2->dwHighDateTime)
+		return t1->dwHighDateTime < t2->dwHighDateTime ? -1 : 1;
+	if (t1->dwLowDateTime != t2->dwLowDateTime)
+		return t1->dwLowDateTime < t2->dwLowDateTime ? -1 : 1;
+	return 0;
+}
+
+#define DIRNAME_JOURNAL _T("Journal/")
+inline bool GetDataPath(CString &data_path) { data_path = "JournalTest.tmp/"; return true; }
+inline bool CreateDirectory(LPCTSTR name, void *) { return mkdir(name, 0777) == 0; }
+
+class CFileException
+{
+public:
+	enum { none, generic, endOfFile };
+	CFileException(int cause = none) : m_cause(cause) { }
+	void Delete() { delete this; }
+	int m_cause;
+};
+inline void AfxThrowFileException(int cause) { throw new CFileException(cause); }
+
+class CFile
+{
+public:
+	enum { modeRead = 0x0, modeWrite = 0x1, shareDenyNone = 0x40, modeCreate = 0x1000, typeBinary = 0x8000 };
+	enum { begin, current, end };
+};
+
+// Only the CFile64 members used by EditJournal.cpp (and the test)
+class CFile64 : public CFile
+{
+public:
+	CFile64() : fd_(-1) { }
+	~CFile64() { Close(); }
+	bool Open(LPCTSTR name, UINT flags, CFileException * = NULL)
+	{
+		int oflags = (flags & modeWrite) ? O_RDWR : O_RDONLY;
+		if (flags & modeCreate)
+			oflags |= O_CREAT | O_TRUNC;
+		fd_ = open(name, oflags, 0666);
+		return fd_ != -1;
+	}
+	void Close() { if (fd_ != -1) close(fd_); fd_ = -1; }
+	UINT Read(void *buf, UINT count)
+	{
+		ssize_t got = read(fd_, buf, count);
+		if (got < 0) AfxThrowFileException(CFileException::generic);
+		return UINT(got);
+	}
+	UINT ReadAt(FILE_ADDRESS addr, void *buf, UINT count)
+	{
+		ssize_t got = pread(fd_, buf, count, addr);
+		if (got < 0) AfxThrowFileException(CFileException::generic);
+		return UINT(got);
+	}
+	void Write(const void *buf, UINT count)
+	{
+		if (write(fd_, buf, count) != ssize_t(count))
+			AfxThrowFileException(CFileException::generic);
+	}
+	FILE_ADDRESS Seek(FILE_ADDRESS off, UINT from)
+	{
+		FILE_ADDRESS pos = lseek(fd_, off, from == begin ? SEEK_SET : from == current ? SEEK_CUR : SEEK_END);
+		if (pos < 0) AfxThrowFileException(CFileException::generic);
+		return pos;
+	}
+	FILE_ADDRESS SeekToEnd() { return Seek(0, end); }
+	FILE_ADDRESS GetPosition() { return Seek(0, current); }
+	FILE_ADDRESS GetLength()
+	{
+		struct stat st;
+		if (fstat(fd_, &st) != 0) AfxThrowFileException(CFileException::generic);
+		return st.st_size;
+	}
+	void SetLength(FILE_ADDRESS len)
+	{
+		if (ftruncate(fd_, len) != 0) AfxThrowFileException(CFileException::generic);
+	}
+private:
+	int fd_;
+};
@@ -0,0 +1,172 @@
+// EditLogTest.cpp : tests of edit_log (EditLog.h) against a simple model
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Random changes (insertions, deletions and replacements) are recorded in an
+// edit_log and made to a model of the document where every byte has a unique id
+// (new bytes get new ids).  The model keeps every version of the document so that
+// map() and diff() can be checked for any version still in the log:
+// - map() must give where the same bytes are now, or -1 if any have been deleted
+//   or replaced or they have not stayed next to each other in every version since
+// - diff() must give the ranges of ids that are only in one of the versions
+// Old versions are dropped with trim() (as when snapshots are released) and
+// sometimes all are forgotten with skip().
+
+#include "stdafx.h"
+#include <vector>
+#include "../../EditLog.h"
+
+typedef std::vector<long> version;      // Id of each byte of the document
+typedef std::vector<edit_log::range> ranges;
+
+// Returns the ranges of vv that contain ids not in other
+static ranges not_in(const version &vv, const version &other)
+{
+	std::vector<bool> in_other;
+	for (size_t ii = 0; ii < other.size(); ++ii)
+	{
+		if (size_t(other[ii]) >= in_other.size())
+			in_other.resize(other[ii] + 1);
+		in_other[other[ii]] = true;
+	}
+
+	ranges rr;
+	for (size_t ii = 0; ii < vv.size(); ++ii)
+	{
+		if (size_t(vv[ii]) < in_other.size() && in_other[vv[ii]])
+			continue;
+		if (!rr.empty() && rr.back().second == FILE_ADDRESS(ii))
+			++rr.back().second;
+		else
+			rr.push_back(edit_log::range(ii, ii + 1));
+	}
+	return rr;
+}
+
+// Returns where each id is in vv (or -1)
+static std::vector<long> positions(const version &vv, long next_id)
+{
+	std::vector<long> where(next_id, -1);
+	for (size_t ii = 0; ii < vv.size(); ++ii)
+		where[vv[ii]] = ii;
+	return where;
+}
+
+// Where the len bytes at address in version edit are now (or -1).  where has the
+// positions of the ids in every version after edit.  Ids are never reused and stay
+// in the same order so the bytes have stayed together if they are all in the
+// current version and the first and last were always len-1 apart.
+static FILE_ADDRESS model_map(const version &vv, FILE_ADDRESS address, FILE_ADDRESS len,
+                              const std::vector<std::vector<long> > &where, unsigned edit)
+{
+	long first = vv[size_t(address)], last = vv[size_t(address + len - 1)];
+	const std::vector<long> &now = where.back();
+	for (FILE_ADDRESS ii = address; ii < address + len; ++ii)
+		if (now[vv[size_t(ii)]] == -1)
+			return -1;
+	for (size_t ee = edit + 1; ee < where.size(); ++ee)
+		if (where[ee][last] - where[ee][first] != len - 1)
+			return -1;
+	return now[first];
+}
+
+int main()
+{
+	srand(1);
+	long maps = 0, diffs = 0;
+	for (int round = 0; round < 300; ++round)
+	{
+		edit_log log;
+		std::vector<version> versions;  // All versions (versions[ee] is before change ee)
+		std::vector<std::vector<long> > where;  // Index of each version and the current one
+		long next_id = 0;
+
+		version current;
+		size_t len = rand()%300;
+		for (size_t ii = 0; ii < len; ++ii)
+			current.push_back(next_id++);
+		unsigned oldest = 0;            // Oldest version still in the log
+		where.push_back(positions(current, next_id));
+
+		for (int cc = 0; cc < 300; ++cc)
+		{
+			versions.push_back(current);
+			FILE_ADDRESS address = rand() % (current.size() + 1);
+			FILE_ADDRESS removed = 0, inserted = 0;
+			switch (rand()%3)
+			{
+			case 0:                     // insertion
+				inserted = 1 + rand()%20;
+				break;
+			case 1:                     // deletion
+				removed = std::min(FILE_ADDRESS(1 + rand()%20), FILE_ADDRESS(current.size()) - address);
+				break;
+			case 2:                     // replacement (may extend the file)
+				removed = std::min(FILE_ADDRESS(1 + rand()%20), FILE_ADDRESS(current.size()) - address);
+				inserted = rand()%4 == 0 ? removed + 1 + rand()%5 : removed;
+				break;
+			}
+			if (removed == 0 && inserted == 0)
+				inserted = 1;           // (a deletion at EOF)
+			current.erase(current.begin() + size_t(address), current.begin() + size_t(address + removed));
+			for (FILE_ADDRESS ii = 0; ii < inserted; ++ii)
+				current.insert(current.begin() + size_t(address + ii), next_id++);
+			where.push_back(positions(current, next_id));
+
+			if (rand()%100 == 0)
+			{
+				log.skip();             // change not remembered (no snapshots)
+				oldest = log.count();
+			}
+			else
+				log.add(address, removed, inserted);
+			if (oldest < log.count() && rand()%20 == 0)
+			{
+				oldest += rand() % (log.count() - oldest);
+				log.trim(oldest);       // oldest snapshot released
+			}
+			if (log.count() != versions.size() || (oldest > 0 && log.has(oldest - 1)) || !log.has(oldest))
+			{
+				printf("round %d change %d: count() or has() wrong\n", round, cc);
+				return 1;
+			}
+
+			// Check map and diff for a few versions still in the log
+			for (int tt = 0; tt < 3; ++tt)
+			{
+				unsigned edit = oldest + rand() % (log.count() - oldest + 1);
+				const version &vv = edit < versions.size() ? versions[edit] : current;
+				if (!vv.empty())
+				{
+					FILE_ADDRESS from = rand() % vv.size();
+					FILE_ADDRESS count = 1 + rand() % std::min(FILE_ADDRESS(vv.size()) - from, FILE_ADDRESS(30));
+					FILE_ADDRESS expected = model_map(vv, from, count, where, edit);
+					if (log.map(edit, from, count) != expected)
+					{
+						printf("round %d change %d: map(%u, %lld, %lld) is %lld but should be %lld\n",
+							   round, cc, edit, from, count, log.map(edit, from, count), expected);
+						return 1;
+					}
+					++maps;
+				}
+
+				unsigned to = edit + rand() % (log.count() - edit + 1);
+				const version &ww = to < versions.size() ? versions[to] : current;
+				ranges removed_ranges, added_ranges;
+				log.diff(edit, to, vv.size(), removed_ranges, added_ranges);
+				if (removed_ranges != not_in(vv, ww) || added_ranges != not_in(ww, vv))
+				{
+					printf("round %d change %d: diff(%u, %u) wrong\n", round, cc, edit, to);
+					return 1;
+				}
+				++diffs;
+			}
+		}
+	}
+	printf("edit_log: %ld maps and %ld diffs OK\n", maps, diffs);
+	return 0;
+}
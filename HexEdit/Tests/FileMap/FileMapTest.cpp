@@ -0,0 +1,204 @@
+// FileMapTest.cpp : tests of file_map (FileMap.h) using its POSIX code
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Uses small windows (64 KB) and only 3 views so that views are often discarded:
+// - reads (including across windows) and pinned bytes must match the file
+// - the least recently used view that is not pinned is discarded when there
+//   are too many, and if they are all pinned we go over max_views for a while
+// - a view that is pinned when reset() is called stays mapped until unpinned
+// - bytes added past the length of the file when mapped are read with pread
+//   (as after SetEndOfFile) until reset(), when they are mapped too
+// - an empty file is not mapped but can still be read (with pread) once it grows
+// Then several threads read and pin at random while another thread makes the
+// file longer and calls reset().  Build with -fsanitize=thread to check locking.
+
+#include "stdafx.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+#include "../../FileMap.h"
+
+enum { window = 64*1024, max_views = 3, num_readers = 6, reads_per_thread = 20000 };
+
+static const char *file_name = "FileMapTest.tmp";
+static std::vector<unsigned char> contents;     // What the file will have (when grown to the end)
+
+#define CHECK(cond) do { if (!(cond)) { printf("file_map: FAILED line %d: %s\n", __LINE__, #cond); exit(1); } } while (0)
+
+// Reads len bytes at pos and checks they are what is in the file (which is file_len
+// bytes long, or at least that if it is growing)
+static void check_read(file_map &fm, __int64 pos, size_t len, __int64 file_len, bool growing = false)
+{
+	std::vector<unsigned char> buf(len + 1);
+	size_t got;
+	CHECK(fm.read(pos, &buf[0], len, got));
+	size_t expected = pos >= file_len ? 0 : size_t(std::min(__int64(len), file_len - pos));
+	CHECK(got == expected || (growing && got > expected && got <= len));
+	CHECK(got == 0 || memcmp(&buf[0], &contents[size_t(pos)], got) == 0);
+}
+
+// Appends bytes from contents to the file so that it is new_len long
+static void grow(int fd, __int64 old_len, __int64 new_len)
+{
+	CHECK(pwrite(fd, &contents[size_t(old_len)], size_t(new_len - old_len), old_len) == new_len - old_len);
+}
+
+static void test_views(int fd, __int64 len)
+{
+	file_map fm(fd, window, max_views);
+	CHECK(fm.mapped() && fm.length() == len && fm.view_count() == 0);
+
+	// Reads, including across windows and past EOF
+	check_read(fm, 0, 100, len);
+	check_read(fm, window - 10, 20, len);
+	check_read(fm, 3*window + 5, 2*window + 7, len);
+	check_read(fm, len - 10, 100, len);
+	check_read(fm, len, 10, len);
+	CHECK(fm.view_count() == max_views);
+
+	// Discarding the least recently used view
+	size_t avail;
+	file_map::view *pv[max_views + 2];
+	check_read(fm, 0, 1, len);          // window 0 is now the most recently used
+	const unsigned char *p0 = fm.pin(10, avail, pv[0]);
+	CHECK(p0 != NULL && avail == window - 10 && memcmp(p0, &contents[10], avail) == 0);
+	for (int ii = 1; ii < max_views + 2; ++ii)
+	{
+		const unsigned char *pp = fm.pin(__int64(ii)*window, avail, pv[ii]);
+		CHECK(pp != NULL && avail == window && memcmp(pp, &contents[ii*window], window) == 0);
+	}
+	CHECK(fm.view_count() == max_views + 2);   // all pinned so more than max_views
+	file_map::view *pv0;
+	CHECK(fm.pin(10, avail, pv0) == p0 && pv0 == pv[0]);    // still the same view
+	fm.unpin(pv0);
+	CHECK(memcmp(p0, &contents[10], window - 10) == 0);
+	for (int ii = 0; ii < max_views + 2; ++ii)
+		fm.unpin(pv[ii]);
+	check_read(fm, 7*window, 10, len);  // discards unpinned views until there is room
+	CHECK(fm.view_count() == max_views);
+
+	// A view pinned when the file is remapped
+	p0 = fm.pin(window + 1, avail, pv[0]);
+	CHECK(p0 != NULL);
+	fm.reset();
+	CHECK(fm.view_count() == 1);
+	check_read(fm, window + 1, 100, len);
+	CHECK(fm.view_count() == 2 && memcmp(p0, &contents[window + 1], avail) == 0);
+	fm.unpin(pv[0]);
+	CHECK(fm.view_count() == 1);
+
+	// Beyond what is mapped (as after SetEndOfFile) is read with pread until reset()
+	__int64 new_len = len + window + 99;
+	grow(fd, len, new_len);
+	CHECK(fm.pin(len, avail, pv[0]) == NULL);
+	check_read(fm, len - 50, 200, new_len);
+	check_read(fm, len + window, 1000, new_len);
+	fm.reset();
+	CHECK(fm.length() == new_len && fm.pin(len, avail, pv[0]) != NULL);
+	fm.unpin(pv[0]);
+	check_read(fm, len - 50, window, new_len);
+	CHECK(ftruncate(fd, len) == 0);
+}
+
+static void test_empty()
+{
+	int fd = open("FileMapTest2.tmp", O_RDWR|O_CREAT|O_TRUNC, 0666);
+	CHECK(fd != -1);
+	{
+		file_map fm(fd, window, max_views);
+		CHECK(!fm.mapped() && fm.length() == 0);
+		check_read(fm, 0, 10, 0);
+		grow(fd, 0, 1000);
+		check_read(fm, 0, 2000, 1000);
+		fm.reset();
+		CHECK(fm.mapped() && fm.length() == 1000);
+		check_read(fm, 500, 2000, 1000);
+	}
+	close(fd);
+	remove("FileMapTest2.tmp");
+}
+
+// Several threads read and pin while the file is made longer and remapped
+static file_map *pfm;
+static volatile __int64 cur_len;                // Bytes of the file written so far
+static volatile long pins_done = 0;
+
+static void *reader(void *arg)
+{
+	unsigned seed = unsigned(size_t(arg));
+	for (int ii = 0; ii < reads_per_thread; ++ii)
+	{
+		__int64 len = __sync_add_and_fetch(&cur_len, 0);
+		__int64 pos = rand_r(&seed) % len;
+		if (rand_r(&seed)%2 == 0)
+			check_read(*pfm, pos, 1 + rand_r(&seed) % (3*window), len, true);
+		else
+		{
+			size_t avail;
+			file_map::view *pv;
+			const unsigned char *pp = pfm->pin(pos, avail, pv);
+			if (pp != NULL)
+			{
+				CHECK(avail > 0 && pos + avail <= contents.size() && memcmp(pp, &contents[size_t(pos)], avail) == 0);
+				pfm->unpin(pv);
+				__sync_add_and_fetch(&pins_done, 1);
+			}
+		}
+	}
+	return NULL;
+}
+
+static void *grower(void *arg)
+{
+	int fd = int(size_t(arg));
+	__int64 len = __sync_add_and_fetch(&cur_len, 0);
+	while (len < __int64(contents.size()))
+	{
+		__int64 new_len = std::min(len + window/3, __int64(contents.size()));
+		grow(fd, len, new_len);
+		len = new_len;
+		__sync_lock_test_and_set(&cur_len, new_len);
+		pfm->reset();
+		usleep(200);
+	}
+	return NULL;
+}
+
+int main()
+{
+	srand(1);
+	contents.resize(60*window + 1234);
+	for (size_t ii = 0; ii < contents.size(); ++ii)
+		contents[ii] = (unsigned char)rand();
+
+	int fd = open(file_name, O_RDWR|O_CREAT|O_TRUNC, 0666);
+	CHECK(fd != -1);
+	__int64 len = 10*window + 1234;
+	grow(fd, 0, len);
+	test_views(fd, len);
+	test_empty();
+
+	cur_len = len;
+	pfm = new file_map(fd, window, max_views);
+	pthread_t readers[num_readers], gg;
+	for (int ii = 0; ii < num_readers; ++ii)
+		pthread_create(&readers[ii], NULL, reader, (void *)size_t(ii + 1));
+	pthread_create(&gg, NULL, grower, (void *)size_t(fd));
+	for (int ii = 0; ii < num_readers; ++ii)
+		pthread_join(readers[ii], NULL);
+	pthread_join(gg, NULL);
+	CHECK(pfm->view_count() <= max_views);
+	delete pfm;
+	close(fd);
+	remove(file_name);
+
+	printf("file_map: views OK, %d threads did %d reads/pins (%ld pinned) while the file grew to %lld\n",
+	       num_readers, num_readers*reads_per_thread, pins_done, __int64(contents.size()));
+	return 0;
+}
@@ -0,0 +1,160 @@
+// SpanBench.cpp : times the BGstats scan of a file with and without copying the bytes
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: SpanBench [MB [file]]
+//
+// Writes a file of random bytes (256 MB by default) then counts the occurrences of
+// each byte value, as the BGstats scan does, in blocks of 16 KB (stats_buf_size)
+// three ways:
+//   read:    Seek and Read into a buffer (as GetData did for the original file)
+//   copy:    file_map::read into a buffer (as GetData does now - see CFile64::ReadAt)
+//   in place: file_map::pin and count the mapped bytes without copying them (as
+//            GetSpan does now for a mapped file)
+// Each is run 3 times after one pass to get the file into the page cache, and the
+// fastest time is printed.  The counts must all be the same.  Each is then run again
+// just reading one byte of every 64 (instead of counting) to show the cost of getting
+// the bytes on its own.
+
+#include "stdafx.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include "../../FileMap.h"
+#include "../../Timer.h"
+
+enum { block = 16384, passes = 3 };
+
+static unsigned char buf[block];
+
+static bool touch_only = false;         // Just read a byte of each cache line (not count them all)
+
+static void count_bytes(const unsigned char *pp, size_t len, __int64 *cnt)
+{
+	if (touch_only)
+	{
+		for (size_t ii = 0; ii < len; ii += 64)
+			++cnt[pp[ii]];
+		return;
+	}
+	for (size_t ii = 0; ii < len; ++ii)
+		++cnt[pp[ii]];
+}
+
+static void scan_read(int fd, __int64 len, __int64 *cnt)
+{
+	lseek(fd, 0, SEEK_SET);
+	for (__int64 addr = 0; addr < len; )
+	{
+		ssize_t got = read(fd, buf, block);
+		if (got <= 0)
+			break;
+		count_bytes(buf, size_t(got), cnt);
+		addr += got;
+	}
+}
+
+static void scan_copy(file_map &fm, __int64 len, __int64 *cnt)
+{
+	for (__int64 addr = 0; addr < len; )
+	{
+		size_t got;
+		if (!fm.read(addr, buf, size_t(min(__int64(block), len - addr)), got) || got == 0)
+			break;
+		count_bytes(buf, got, cnt);
+		addr += got;
+	}
+}
+
+static void scan_in_place(file_map &fm, __int64 len, __int64 *cnt)
+{
+	for (__int64 addr = 0; addr < len; )
+	{
+		size_t avail;
+		file_map::view *pv;
+		const unsigned char *pp = fm.pin(addr, avail, pv);
+		if (pp == NULL)
+			break;
+		size_t got = size_t(min(__int64(min(avail, size_t(block))), len - addr));
+		count_bytes(pp, got, cnt);
+		fm.unpin(pv);
+		addr += got;
+	}
+}
+
+// Times each way of scanning the file and returns true if they all get the same counts
+static bool run(int fd, file_map &fm, __int64 len)
+{
+	static const char *name[3] = { "read", "copy", "in place" };
+	__int64 cnt[3][256];
+	for (int how = 0; how < 3; ++how)
+	{
+		double best = 0.0;
+		for (int pass = 0; pass <= passes; ++pass)
+		{
+			memset(cnt[how], '\0', sizeof(cnt[how]));
+			timer tt(true);
+			if (how == 0)
+				scan_read(fd, len, cnt[how]);
+			else if (how == 1)
+				scan_copy(fm, len, cnt[how]);
+			else
+				scan_in_place(fm, len, cnt[how]);
+			tt.stop();
+			if (pass == 1 || (pass > 1 && tt.elapsed() < best))
+				best = tt.elapsed();    // (pass 0 just gets the file into the cache)
+		}
+		printf("  %-9s %7.3f sec %8.0f MB/sec\n", name[how], best, best > 0.0 ? double(len)/(1024*1024)/best : 0.0);
+	}
+	return memcmp(cnt[0], cnt[1], sizeof(cnt[0])) == 0 && memcmp(cnt[0], cnt[2], sizeof(cnt[0])) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	__int64 len = (argc > 1 ? atoi(argv[1]) : 256) * __int64(1024*1024);
+	const char *fname = argc > 2 ? argv[2] : "SpanBench.tmp";
+
+	// Create the file
+	int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+	{
+		printf("SpanBench: can't create %s\n", fname);
+		return 1;
+	}
+	srand(1);
+	for (__int64 addr = 0; addr < len; addr += block)
+	{
+		for (size_t ii = 0; ii < block; ++ii)
+			buf[ii] = (unsigned char)rand();
+		if (write(fd, buf, block) != block)
+		{
+			printf("SpanBench: can't write %s\n", fname);
+			return 1;
+		}
+	}
+
+	file_map fm(fd);
+	if (!fm.mapped())
+	{
+		printf("SpanBench: can't map %s\n", fname);
+		return 1;
+	}
+
+	printf("Counting bytes:\n");
+	bool ok = run(fd, fm, len);
+	touch_only = true;
+	printf("Reading 1 byte in 64:\n");
+	ok = run(fd, fm, len) && ok;
+
+	close(fd);
+	remove(fname);
+	if (!ok)
+	{
+		printf("SpanBench: FAILED - the byte counts are different\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,24 @@
+// stdafx.h : stands in for HexEdit's stdafx.h so file_map builds without MFC
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// FileMap.cpp uses mmap, pread and POSIX threads when _WIN32 is not defined so
+// only needs __int64 and ASSERT.
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+typedef long long __int64;         // (a typedef as FileMap.cpp uses __int64(x))
+#define ASSERT(ff) assert(ff)
+using std::min;
+using std::max;
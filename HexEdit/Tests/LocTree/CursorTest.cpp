@@ -0,0 +1,230 @@
+// CursorTest.cpp : tests of reading a loc_tree with a doc_cursor kept across changes
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Readers (as the background threads and OnDraw do) keep a doc_cursor for all
+// their reads of the document, even when it is changed between reads.  Here the
+// reads are done as CHexEditDoc::read_data does them (find() with the cursor, then
+// remember() the last record read) and checked against a model, with changes
+// made between reads as Change, Undo, regenerate and spill_undo make them
+// (replace, insert, delete, undo with paste, rebuilding from a checkpoint and
+// swapping in a new tree).  Some reads use the same cursor on a snapshot (a copy
+// of the tree) and some are backwards or overlap the last read.  A cursor that
+// was not noticed to be out of date would read the wrong bytes (or freed nodes -
+// build with -fsanitize=address).
+
+#include "stdafx.h"
+#include <vector>
+#include "../../LocTree.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+static unsigned char mem[100000];       // Memory that memory records point into
+
+// The model stores a value for each byte: its address in the file or -1 - its offset in mem
+typedef std::vector<FILE_ADDRESS> model;
+
+static void add_bytes(model &mm, size_t at, const doc_loc &dl)
+{
+	FILE_ADDRESS len = FILE_ADDRESS(dl.dlen & doc_loc::mask);
+	for (FILE_ADDRESS ii = 0; ii < len; ++ii)
+	{
+		FILE_ADDRESS val = (dl.dlen >> 62) == 1 ? dl.fileaddr + ii : -1 - ((dl.memaddr - mem) + ii);
+		mm.insert(mm.begin() + at + size_t(ii), val);
+	}
+}
+
+static model make_model(const loc_tree &tree)
+{
+	model mm;
+	for (loc_tree::iterator pl = tree.begin(); pl != tree.end(); ++pl)
+		add_bytes(mm, mm.size(), *pl);
+	return mm;
+}
+
+// What a change did (so it can be undone)
+struct change
+{
+	FILE_ADDRESS address;
+	FILE_ADDRESS inserted;              // Bytes inserted at address
+	loc_tree removed;                   // Records removed from address
+};
+
+// Reads len bytes (the model values of them) at address as read_data does
+static model read(const loc_tree &loc, FILE_ADDRESS address, size_t len, doc_cursor &cursor)
+{
+	model retval;
+	FILE_ADDRESS pos;
+	loc_tree::iterator pl = loc.find(address, pos, cursor);
+	FILE_ADDRESS start = address - pos;
+	size_t left, tocopy;
+	for (left = len; left > 0 && pl != loc.end(); left -= tocopy)
+	{
+		tocopy = size_t(min(FILE_ADDRESS(left), FILE_ADDRESS(pl->dlen&doc_loc::mask) - start));
+		doc_loc dl(*pl);
+		model bytes;
+		add_bytes(bytes, 0, dl);
+		retval.insert(retval.end(), bytes.begin() + size_t(start), bytes.begin() + size_t(start) + tocopy);
+		start = 0;
+		pos += (pl->dlen&doc_loc::mask);
+		++pl;
+	}
+	if (left < len)
+	{
+		if (pos >= address + FILE_ADDRESS(len - left))
+		{
+			--pl;
+			pos -= (pl->dlen&doc_loc::mask);
+		}
+		loc.remember(cursor, pl, pos);
+	}
+	return retval;
+}
+
+// Reads from the tree with the cursor (mostly just after the last read) and checks the bytes
+static bool check_read(const loc_tree &loc, const model &mm, doc_cursor &cursor, FILE_ADDRESS &next)
+{
+	FILE_ADDRESS address;
+	switch (rand()%4)
+	{
+	case 0:                             // anywhere
+		address = mm.empty() ? 0 : rand() % (mm.size() + 1);
+		break;
+	case 1:                             // overlapping/before the last read
+		address = max(FILE_ADDRESS(0), next - rand()%20);
+		break;
+	default:                            // following on from the last read
+		address = next;
+		break;
+	}
+	if (address > FILE_ADDRESS(mm.size()))
+		address = mm.size();
+	size_t len = 1 + rand()%40;
+	model expected(mm.begin() + size_t(address), mm.begin() + size_t(min(FILE_ADDRESS(mm.size()), address + FILE_ADDRESS(len))));
+	next = address + expected.size();
+	return read(loc, address, len, cursor) == expected;
+}
+
+int main()
+{
+	srand(1);
+	long reads = 0, changes = 0;
+	for (int round = 0; round < 300; ++round)
+	{
+		loc_tree loc;                   // The document (CHexEditDoc::loc_)
+		model mm;
+		std::vector<change> done;       // Changes that can be undone
+		loc_tree checkpoint;            // A copy of loc (as kept by set_checkpoint)
+		model checkpoint_mm;
+		size_t mem_next = 0;
+
+		FILE_ADDRESS file_len = 1 + rand()%500;
+		loc.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+		add_bytes(mm, 0, *loc.begin());
+		checkpoint = loc;
+		checkpoint_mm = mm;
+
+		doc_cursor cursor[2];           // Kept by two readers for the whole round
+		FILE_ADDRESS next[2] = { 0, 0 };
+		for (int cc = 0; cc < 300; ++cc)
+		{
+			// A few reads by each reader
+			for (int rr = 0; rr < 6; ++rr, ++reads)
+			{
+				int who = rand()%2;
+				if (!check_read(loc, mm, cursor[who], next[who]))
+				{
+					printf("round %d change %d: read with a cursor gave the wrong bytes\n", round, cc);
+					return 1;
+				}
+			}
+
+			// Reads of a snapshot using the same cursor as for the document
+			if (rand()%10 == 0)
+			{
+				loc_tree snap(loc);
+				if (!check_read(snap, mm, cursor[0], next[0]) || !check_read(loc, mm, cursor[0], next[0]) ||
+					!check_read(snap, mm, cursor[0], next[0]))
+				{
+					printf("round %d change %d: read of a snapshot with a cursor gave the wrong bytes\n", round, cc);
+					return 1;
+				}
+				reads += 3;
+			}
+
+			// Change the document
+			FILE_ADDRESS len = mm.size();
+			FILE_ADDRESS address = rand() % (len + 1);
+			FILE_ADDRESS count = 1 + rand()%30;
+			if (mem_next + count > sizeof(mem))
+				mem_next = 0;
+			doc_loc dl(mem + mem_next, count);
+			int what = rand()%7;
+			switch (what)
+			{
+			case 0:                     // replace (as loc_apply)
+			case 1:                     // delete
+			case 2:                     // insert
+				done.push_back(change());
+				done.back().address = address;
+				done.back().inserted = what == 1 ? 0 : count;
+				if (what != 2)
+				{
+					loc.cut(address, count, done.back().removed);
+					mm.erase(mm.begin() + size_t(address), mm.begin() + size_t(min(len, address + count)));
+				}
+				if (what != 1)
+				{
+					loc.insert(address, dl);
+					add_bytes(mm, size_t(address), dl);
+					mem_next += size_t(count);
+				}
+				break;
+			case 3:                     // undo the last change (as loc_revert)
+				if (!done.empty())
+				{
+					change &uu = done.back();
+					model cut_mm(make_model(uu.removed));
+					loc.erase(uu.address, uu.inserted);
+					mm.erase(mm.begin() + size_t(uu.address), mm.begin() + size_t(uu.address + uu.inserted));
+					loc.paste(uu.address, uu.removed);
+					mm.insert(mm.begin() + size_t(uu.address), cut_mm.begin(), cut_mm.end());
+					done.pop_back();
+				}
+				break;
+			case 4:                     // split (as done before a change) - no change to the bytes
+				loc.split(address);
+				break;
+			case 5:                     // rebuild from a checkpoint (as regenerate) or keep a new one
+				if (rand()%2 == 0)
+				{
+					loc = checkpoint;
+					mm = checkpoint_mm;
+					done.clear();
+				}
+				else
+				{
+					checkpoint = loc;
+					checkpoint_mm = mm;
+				}
+				break;
+			case 6:                     // swap in a new tree with the same bytes (as spill_undo)
+				{
+					loc_tree fresh;
+					for (loc_tree::iterator pl = loc.begin(); pl != loc.end(); ++pl)
+						fresh.push_back(*pl);
+					loc.swap(fresh);
+					fresh.clear();
+				}
+				break;
+			}
+			++changes;
+		}
+	}
+	printf("doc_cursor: %ld reads with cursors kept across %ld changes OK\n", reads, changes);
+	return 0;
+}
@@ -0,0 +1,116 @@
+// EditBench.cpp : time taken by an edit as the undo history grows
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: EditBench [changes]
+//
+// Makes random small changes (default 1,000,000) to a 100 MB file, updating the
+// location records the way CHexEditDoc::Change does (loc_apply, which only applies
+// the new change, saving what it removes for undo).  The average time of the last
+// 1000 changes is printed as the number of undo records grows, together with the
+// time a single regenerate() takes (what every change used to do), which replays
+// all the changes from the original file.  At the end the records made by the
+// changes are checked against a regenerate.
+
+#include "stdafx.h"
+#include <vector>
+#include "../../LocTree.h"
+#include "../../Timer.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+static unsigned char mem[1024*1024];    // Memory that memory records point into
+
+// The parts of doc_undo (see HexEditDoc.h) used to update the location records
+struct change
+{
+	int type;                           // 0 = insert, 1 = replace, 2 = delete
+	FILE_ADDRESS address, len;
+	unsigned char *ptr;
+};
+
+// Does what CHexEditDoc::loc_apply does for the change (removed gets what is deleted or replaced)
+static void loc_apply(const change &cc, loc_tree &loc, loc_tree &removed)
+{
+	if (cc.type != 0)
+		loc.cut(cc.address, cc.len, removed);
+	if (cc.type != 2)
+		loc.insert(cc.address, doc_loc(cc.ptr, cc.len));
+}
+
+// Rebuilds the records from the original file and all the changes (as regenerate does)
+static void regenerate(FILE_ADDRESS file_len, const std::vector<change> &changes, loc_tree &loc)
+{
+	loc.clear();
+	loc.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+	for (size_t ii = 0; ii < changes.size(); ++ii)
+	{
+		loc_tree removed;
+		loc_apply(changes[ii], loc, removed);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const FILE_ADDRESS file_len = 100*1024*1024;
+	long count = argc > 1 ? atol(argv[1]) : 1000000;
+	const long batch = 1000;
+
+	loc_tree loc;
+	loc.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+	std::vector<change> changes;
+	std::vector<loc_tree> removed;      // doc_undo::removed of each change
+	changes.reserve(count);
+	removed.reserve(count);
+	size_t mem_next = 0;
+
+	printf("%10s %18s %16s\n", "Changes", "Change (usecs)", "Regenerate (s)");
+	srand(1);
+	timer tt;
+	for (long ii = 0; ii < count; ++ii)
+	{
+		change cc;
+		cc.type = rand()%3;
+		cc.len = 1 + rand()%8;
+		cc.address = ((FILE_ADDRESS(rand()) << 31) ^ rand()) % (loc.length() - cc.len);
+		if (mem_next + cc.len > sizeof(mem))
+			mem_next = 0;
+		cc.ptr = mem + mem_next;
+		mem_next += size_t(cc.len);
+
+		tt.restart();
+		changes.push_back(cc);
+		removed.push_back(loc_tree());
+		loc_apply(cc, loc, removed.back());
+		tt.stop();
+
+		if ((ii + 1) % batch == 0 && ((ii + 1) == batch || (ii + 1) % (count/10 > batch ? count/10 : batch) == 0))
+		{
+			timer treg(true);
+			loc_tree tmp;
+			regenerate(file_len, changes, tmp);
+			treg.stop();
+			printf("%10ld %18.2f %16.3f\n", ii + 1, tt.elapsed()*1e6/batch, treg.elapsed());
+		}
+		if ((ii + 1) % batch == 0)
+			tt.reset(false);
+	}
+
+	// The changes must give the same records as a regenerate
+	loc_tree check;
+	regenerate(file_len, changes, check);
+	loc_tree::iterator p1 = loc.begin(), p2 = check.begin();
+	for ( ; p1 != loc.end() && p2 != check.end(); ++p1, ++p2)
+		if (p1->dlen != p2->dlen || p1->fileaddr != p2->fileaddr)
+			break;
+	if (p1 != loc.end() || p2 != check.end())
+	{
+		printf("Records do not match a regenerate\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,211 @@
+// LocTreeBench.cpp : compares loc_tree with the std::list of location records it replaced
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: LocTreeBench [edits]
+//
+// Makes the same random edits (default 100,000) to a 1 GB file using loc_tree and
+// using a std::list<doc_loc> updated the way CHexEditDoc used to (loc_split, loc_add
+// and loc_del after walking the list from the start to find the address).  After
+// each edit the record at another random address is looked up, as GetData does.
+// The times are printed every 10% of the edits and both must give the same records.
+
+#include "stdafx.h"
+#include <list>
+#include <vector>
+#include "../../LocTree.h"
+#include "../../Timer.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+// The location list as it was before loc_tree (see CHexEditDoc::loc_add etc in earlier versions)
+class loc_list
+{
+public:
+	typedef std::list<doc_loc>::iterator ploc_t;
+
+	explicit loc_list(FILE_ADDRESS file_len) { loc_.push_back(doc_loc(FILE_ADDRESS(0), file_len)); }
+
+	// Find the record containing address by adding up the lengths from the start
+	ploc_t find(FILE_ADDRESS address, FILE_ADDRESS &pos)
+	{
+		ploc_t pl;
+		for (pos = 0, pl = loc_.begin(); pl != loc_.end(); pos += (pl->dlen&doc_loc::mask), ++pl)
+			if (address < pos + FILE_ADDRESS(pl->dlen&doc_loc::mask))
+				break;
+		return pl;
+	}
+
+	void insert(FILE_ADDRESS address, const doc_loc &dl)
+	{
+		FILE_ADDRESS pos;
+		ploc_t pl = find(address, pos);
+		add(address, dl, pos, pl);
+	}
+	void replace(FILE_ADDRESS address, const doc_loc &dl)
+	{
+		FILE_ADDRESS pos;
+		ploc_t pl = find(address, pos);
+		del(address, FILE_ADDRESS(dl.dlen&doc_loc::mask), pos, pl);
+		add(address, dl, pos, pl);
+	}
+	void erase(FILE_ADDRESS address, FILE_ADDRESS len)
+	{
+		FILE_ADDRESS pos;
+		ploc_t pl = find(address, pos);
+		del(address, len, pos, pl);
+	}
+
+	const std::list<doc_loc> &records() const { return loc_; }
+
+private:
+	void add(FILE_ADDRESS address, const doc_loc &dl, FILE_ADDRESS &pos, ploc_t &pl)
+	{
+		if (address != pos)
+		{
+			split(address, pos, pl);
+			pos += (pl->dlen&doc_loc::mask);
+			++pl;
+		}
+		loc_.insert(pl, dl);
+		pos += (dl.dlen&doc_loc::mask);
+	}
+	void del(FILE_ADDRESS address, FILE_ADDRESS len, FILE_ADDRESS &pos, ploc_t &pl)
+	{
+		ploc_t byebye;
+		if (address != pos)
+		{
+			split(address, pos, pl);
+			pos += (pl->dlen&doc_loc::mask);
+			++pl;
+		}
+		FILE_ADDRESS deleted = 0;
+		while (pl != loc_.end() && len >= deleted + FILE_ADDRESS(pl->dlen&doc_loc::mask))
+		{
+			byebye = pl;
+			deleted += (pl->dlen&doc_loc::mask);
+			++pl;
+			loc_.erase(byebye);
+		}
+		if (pl != loc_.end() && len > deleted)
+		{
+			split(address + len, address + deleted, pl);
+			byebye = pl;
+			++pl;
+			loc_.erase(byebye);
+		}
+	}
+	void split(FILE_ADDRESS address, FILE_ADDRESS pos, ploc_t pl)
+	{
+		FILE_ADDRESS split = pos + (pl->dlen&doc_loc::mask) - address;
+		ploc_t plnext = pl; ++plnext;
+		if ((pl->dlen >> 62) == 1)
+		{
+			loc_.insert(plnext, doc_loc(pl->fileaddr + (pl->dlen&doc_loc::mask) - split, split));
+			pl->dlen = ((pl->dlen&doc_loc::mask) - split) | ((unsigned __int64)1 << 62);
+		}
+		else
+		{
+			loc_.insert(plnext, doc_loc(pl->memaddr + (pl->dlen&doc_loc::mask) - split, split));
+			pl->dlen = ((pl->dlen&doc_loc::mask) - split) | ((unsigned __int64)2 << 62);
+		}
+	}
+
+	std::list<doc_loc> loc_;
+};
+
+static unsigned char mem[1024*1024];    // Memory that memory records point into
+
+struct edit
+{
+	int type;                           // 0 = insert, 1 = replace, 2 = delete
+	FILE_ADDRESS address, len;
+	unsigned char *ptr;
+	FILE_ADDRESS lookup;                // Address read after the edit
+};
+
+// Random number big enough for a 1 GB file
+static FILE_ADDRESS random(FILE_ADDRESS limit)
+{
+	return ((FILE_ADDRESS(rand()) << 31) ^ rand()) % limit;
+}
+
+int main(int argc, char *argv[])
+{
+	const FILE_ADDRESS file_len = FILE_ADDRESS(1) << 30;
+	long count = argc > 1 ? atol(argv[1]) : 100000;
+
+	// Work out the edits first so that both get exactly the same ones
+	std::vector<edit> edits(count);
+	FILE_ADDRESS length = file_len;
+	size_t mem_next = 0;
+	srand(1);
+	for (long ii = 0; ii < count; ++ii)
+	{
+		edit &ee = edits[ii];
+		ee.type = rand()%3;
+		ee.len = 1 + rand()%8;
+		ee.address = random(length - ee.len);
+		if (mem_next + ee.len > sizeof(mem))
+			mem_next = 0;
+		ee.ptr = mem + mem_next;
+		mem_next += size_t(ee.len);
+		if (ee.type == 0)
+			length += ee.len;
+		else if (ee.type == 2)
+			length -= ee.len;
+		ee.lookup = random(length);
+	}
+
+	printf("%10s %12s %12s %10s\n", "Edits", "Tree secs", "List secs", "Records");
+	loc_tree tree;
+	loc_list list(file_len);
+	tree.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+	timer ttree, tlist;
+	FILE_ADDRESS pos;
+	for (long ii = 0; ii < count; ++ii)
+	{
+		const edit &ee = edits[ii];
+		ttree.restart();
+		switch (ee.type)
+		{
+		case 0: tree.insert(ee.address, doc_loc(ee.ptr, ee.len)); break;
+		case 1: tree.erase(ee.address, ee.len); tree.insert(ee.address, doc_loc(ee.ptr, ee.len)); break;
+		case 2: tree.erase(ee.address, ee.len); break;
+		}
+		tree.find(ee.lookup, pos);
+		ttree.stop();
+
+		tlist.restart();
+		switch (ee.type)
+		{
+		case 0: list.insert(ee.address, doc_loc(ee.ptr, ee.len)); break;
+		case 1: list.replace(ee.address, doc_loc(ee.ptr, ee.len)); break;
+		case 2: list.erase(ee.address, ee.len); break;
+		}
+		list.find(ee.lookup, pos);
+		tlist.stop();
+
+		if ((ii + 1) % (count/10 > 0 ? count/10 : 1) == 0)
+			printf("%10ld %12.3f %12.3f %10d\n", ii + 1, ttree.elapsed(), tlist.elapsed(), int(tree.size()));
+	}
+
+	// Both must give the same records
+	std::list<doc_loc>::const_iterator pl2 = list.records().begin();
+	for (loc_tree::iterator pl = tree.begin(); pl != tree.end(); ++pl, ++pl2)
+		if (pl2 == list.records().end() || pl->dlen != pl2->dlen || pl->fileaddr != pl2->fileaddr)
+		{
+			printf("Tree and list records differ\n");
+			return 1;
+		}
+	if (pl2 != list.records().end() || tree.size() != list.records().size())
+	{
+		printf("Tree and list have a different number of records\n");
+		return 1;
+	}
+	return 0;
+}
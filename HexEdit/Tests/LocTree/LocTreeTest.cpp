@@ -0,0 +1,180 @@
+// LocTreeTest.cpp : tests of loc_tree (LocTree.h) against a simple model
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Random edits (insert, erase, split, cut and paste) are made to a loc_tree and to
+// a model that just stores, for every byte of the document, where it comes from.
+// After each edit the tree is checked against the model by iterating forwards and
+// backwards and with find().  Copies of the tree are also kept to check that
+// changing a tree never changes a copy (ie shared nodes are not modified).
+
+#include "stdafx.h"
+#include <vector>
+#include "../../LocTree.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+static unsigned char mem[100000];       // Memory that memory records point into
+
+// The model stores a value for each byte: its address in the file or -1 - its offset in mem
+typedef std::vector<FILE_ADDRESS> model;
+
+static void add_bytes(model &mm, size_t at, const doc_loc &dl)
+{
+	FILE_ADDRESS len = FILE_ADDRESS(dl.dlen & doc_loc::mask);
+	for (FILE_ADDRESS ii = 0; ii < len; ++ii)
+	{
+		FILE_ADDRESS val = (dl.dlen >> 62) == 1 ? dl.fileaddr + ii : -1 - ((dl.memaddr - mem) + ii);
+		mm.insert(mm.begin() + at + size_t(ii), val);
+	}
+}
+
+static model make_model(const loc_tree &tree)
+{
+	model mm;
+	for (loc_tree::iterator pl = tree.begin(); pl != tree.end(); ++pl)
+		add_bytes(mm, mm.size(), *pl);
+	return mm;
+}
+
+static bool check(const loc_tree &tree, const model &mm, const char *what)
+{
+	if (tree.length() != FILE_ADDRESS(mm.size()))
+	{
+		printf("%s: length %lld should be %lld\n", what, tree.length(), FILE_ADDRESS(mm.size()));
+		return false;
+	}
+	if (make_model(tree) != mm)
+	{
+		printf("%s: records do not match the model\n", what);
+		return false;
+	}
+
+	// Iterate backwards from end() to check the count and that no record is empty
+	size_t count = 0;
+	for (loc_tree::iterator pl = tree.end(); pl != tree.begin(); )
+	{
+		--pl;
+		if ((pl->dlen & doc_loc::mask) == 0)
+		{
+			printf("%s: empty record\n", what);
+			return false;
+		}
+		++count;
+	}
+	if (count != tree.size())
+	{
+		printf("%s: %d records going backwards but size() is %d\n", what, int(count), int(tree.size()));
+		return false;
+	}
+
+	// Check find() (with and without a cursor) at a few addresses and at EOF
+	doc_cursor cursor;
+	for (int ii = 0; ii < 4 && !mm.empty(); ++ii)
+	{
+		FILE_ADDRESS address = rand() % mm.size();
+		FILE_ADDRESS pos, pos2;
+		loc_tree::iterator pl = tree.find(address, pos);
+		loc_tree::iterator pl2 = tree.find(address, pos2, cursor);
+		if (pl == tree.end() || address < pos || address >= pos + FILE_ADDRESS(pl->dlen & doc_loc::mask) ||
+			pl2 != pl || pos2 != pos)
+		{
+			printf("%s: find(%lld) failed\n", what, address);
+			return false;
+		}
+		tree.remember(cursor, pl, pos);
+	}
+	FILE_ADDRESS pos;
+	if (tree.find(FILE_ADDRESS(mm.size()), pos) != tree.end() || pos != FILE_ADDRESS(mm.size()))
+	{
+		printf("%s: find(EOF) failed\n", what);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	srand(1);
+	long edits = 0;
+	for (int round = 0; round < 300; ++round)
+	{
+		loc_tree tree;
+		model mm;
+		std::vector<loc_tree> copies;   // Earlier versions of tree (all sharing nodes with it)
+		std::vector<model> copy_mm;     // What each copy should still contain
+		size_t mem_next = 0;
+
+		FILE_ADDRESS file_len = 1 + rand()%500;
+		tree.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+		add_bytes(mm, 0, *tree.begin());
+
+		for (int ee = 0; ee < 200; ++ee, ++edits)
+		{
+			FILE_ADDRESS len = mm.size();
+			FILE_ADDRESS address = rand() % (len + 1);
+			FILE_ADDRESS count = 1 + rand()%30;
+			switch (rand()%5)
+			{
+			case 0:                     // insert
+				if (mem_next + count > sizeof(mem))
+					mem_next = 0;
+				tree.insert(address, doc_loc(mem + mem_next, count));
+				add_bytes(mm, size_t(address), doc_loc(mem + mem_next, count));
+				mem_next += size_t(count);
+				break;
+			case 1:                     // erase (may go past EOF)
+				tree.erase(address, count);
+				mm.erase(mm.begin() + size_t(address), mm.begin() + size_t(std::min(len, address + count)));
+				break;
+			case 2:                     // split (does not change the bytes)
+				tree.split(address);
+				break;
+			case 3:                     // cut then paste back (as done by undo)
+				{
+					loc_tree removed;
+					tree.cut(address, count, removed);
+					model cut_mm(mm.begin() + size_t(address), mm.begin() + size_t(std::min(len, address + count)));
+					if (removed.length() != FILE_ADDRESS(cut_mm.size()) || make_model(removed) != cut_mm)
+					{
+						printf("round %d edit %d: cut records wrong\n", round, ee);
+						return 1;
+					}
+					mm.erase(mm.begin() + size_t(address), mm.begin() + size_t(address) + cut_mm.size());
+					if (!check(tree, mm, "cut"))
+						return 1;
+					FILE_ADDRESS to = rand() % (mm.size() + 1);
+					tree.paste(to, removed);
+					mm.insert(mm.begin() + size_t(to), cut_mm.begin(), cut_mm.end());
+					if (!removed.empty())
+					{
+						printf("round %d edit %d: paste did not empty the tree\n", round, ee);
+						return 1;
+					}
+				}
+				break;
+			case 4:                     // keep a copy
+				copies.push_back(tree);
+				copy_mm.push_back(mm);
+				break;
+			}
+			if (!check(tree, mm, "edit"))
+			{
+				printf("round %d edit %d\n", round, ee);
+				return 1;
+			}
+		}
+		for (size_t ii = 0; ii < copies.size(); ++ii)
+			if (!check(copies[ii], copy_mm[ii], "copy"))
+			{
+				printf("round %d copy %d was changed\n", round, int(ii));
+				return 1;
+			}
+	}
+	printf("loc_tree: %ld edits OK\n", edits);
+	return 0;
+}
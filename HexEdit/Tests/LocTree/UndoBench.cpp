@@ -0,0 +1,179 @@
+// UndoBench.cpp : time taken to undo many changes
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: UndoBench [changes]
+//
+// Makes random small changes (default 10,000) to a 100 MB file then undoes all of
+// them, updating the location records in three ways:
+// - reverting each change using the records it removed (as CHexEditDoc::Undo does)
+// - regenerating after each undo starting from the last checkpoint (a copy of the
+//   records kept every 256 changes) as CHexEditDoc::regenerate does
+// - regenerating after each undo from the original file (what Undo used to do)
+// The records after each undo are checked to be the same for all of them.
+
+#include "stdafx.h"
+#include <vector>
+#include "../../LocTree.h"
+#include "../../Timer.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+enum { checkpoint_every = 256 };        // As CHexEditDoc::checkpoint_every
+
+static unsigned char mem[1024*1024];    // Memory that memory records point into
+
+// The parts of doc_undo (see HexEditDoc.h) used to update the location records
+struct change
+{
+	int type;                           // 0 = insert, 1 = replace, 2 = delete
+	FILE_ADDRESS address, len;
+	unsigned char *ptr;
+	loc_tree removed;                   // What the change deleted or replaced
+};
+
+// Does what CHexEditDoc::loc_apply does
+static void loc_apply(change &cc, loc_tree &loc)
+{
+	loc_tree removed;
+	if (cc.type != 0)
+		loc.cut(cc.address, cc.len, removed);
+	if (cc.type != 2)
+		loc.insert(cc.address, doc_loc(cc.ptr, cc.len));
+	cc.removed.swap(removed);
+}
+
+// Does what CHexEditDoc::loc_revert does
+static void loc_revert(change &cc, loc_tree &loc)
+{
+	if (cc.type != 2)
+		loc.erase(cc.address, cc.len);
+	if (cc.type != 0)
+		loc.paste(cc.address, cc.removed);
+}
+
+// Rebuilds loc from changes, starting from the last checkpoint that does not
+// include a change from index "from" (as CHexEditDoc::regenerate does)
+static void regenerate(FILE_ADDRESS file_len, std::vector<change> &changes, size_t from,
+					   std::vector<loc_tree> &checkpoint, loc_tree &loc)
+{
+	size_t start = std::min(from/checkpoint_every, checkpoint.size());
+	checkpoint.erase(checkpoint.begin() + start, checkpoint.end());
+	start *= checkpoint_every;
+	if (start > 0)
+		loc = checkpoint.back();
+	else
+	{
+		loc.clear();
+		loc.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+	}
+	for (size_t ii = start; ii < changes.size(); ++ii)
+	{
+		change cc = changes[ii];        // (so that removed of the real change is not replaced)
+		loc_apply(cc, loc);
+		if ((ii + 1) % checkpoint_every == 0)
+			checkpoint.push_back(loc);
+	}
+}
+
+// Where the bytes of a document come from: a record for each run of consecutive bytes
+// (reverting a change can leave a record split where regenerate would not).
+struct run
+{
+	int type;
+	FILE_ADDRESS start, len;
+	bool operator!=(const run &other) const { return type != other.type || start != other.start || len != other.len; }
+};
+
+static std::vector<run> runs(const loc_tree &loc)
+{
+	std::vector<run> retval;
+	for (loc_tree::iterator pl = loc.begin(); pl != loc.end(); ++pl)
+	{
+		run rr;
+		rr.type = int(pl->dlen >> 62);
+		rr.start = rr.type == 1 ? pl->fileaddr : FILE_ADDRESS(pl->memaddr - mem);
+		rr.len = FILE_ADDRESS(pl->dlen & doc_loc::mask);
+		if (!retval.empty() && retval.back().type == rr.type && retval.back().start + retval.back().len == rr.start)
+			retval.back().len += rr.len;
+		else
+			retval.push_back(rr);
+	}
+	return retval;
+}
+
+static bool same(const loc_tree &t1, const loc_tree &t2)
+{
+	std::vector<run> r1 = runs(t1), r2 = runs(t2);
+	if (r1.size() != r2.size())
+		return false;
+	for (size_t ii = 0; ii < r1.size(); ++ii)
+		if (r1[ii] != r2[ii])
+			return false;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	const FILE_ADDRESS file_len = 100*1024*1024;
+	size_t count = argc > 1 ? size_t(atol(argv[1])) : 10000;
+
+	// Make the changes, keeping checkpoints
+	loc_tree loc;
+	loc.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+	std::vector<change> changes;
+	std::vector<loc_tree> checkpoint;
+	size_t mem_next = 0;
+	srand(1);
+	for (size_t ii = 0; ii < count; ++ii)
+	{
+		change cc;
+		cc.type = rand()%3;
+		cc.len = 1 + rand()%8;
+		cc.address = ((FILE_ADDRESS(rand()) << 31) ^ rand()) % (loc.length() - cc.len);
+		if (mem_next + cc.len > sizeof(mem))
+			mem_next = 0;
+		cc.ptr = mem + mem_next;
+		mem_next += size_t(cc.len);
+		changes.push_back(cc);
+		loc_apply(changes.back(), loc);
+		if (changes.size() % checkpoint_every == 0)
+			checkpoint.push_back(loc);
+	}
+	printf("%d changes (%d records)\n", int(count), int(loc.size()));
+
+	// Undo them all
+	loc_tree loc_ckpt = loc, loc_full;
+	std::vector<loc_tree> no_checkpoints;
+	timer trevert, tckpt, tfull;
+	while (!changes.empty())
+	{
+		trevert.restart();
+		loc_revert(changes.back(), loc);
+		trevert.stop();
+
+		change last = changes.back();
+		changes.pop_back();
+		tckpt.restart();
+		regenerate(file_len, changes, changes.size(), checkpoint, loc_ckpt);
+		tckpt.stop();
+
+		tfull.restart();
+		regenerate(file_len, changes, 0, no_checkpoints, loc_full);
+		tfull.stop();
+
+		if (!same(loc, loc_ckpt) || !same(loc, loc_full))
+		{
+			printf("Records differ after undoing change %d\n", int(changes.size()));
+			return 1;
+		}
+	}
+	printf("Revert each change:                    %8.2f secs\n", trevert.elapsed());
+	printf("Regenerate from checkpoint each undo:  %8.2f secs\n", tckpt.elapsed());
+	printf("Regenerate from start each undo:       %8.2f secs\n", tfull.elapsed());
+	return 0;
+}
@@ -0,0 +1,31 @@
+// stdafx.h : stands in for HexEdit's stdafx.h so the location tree builds without MFC
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// LocTree.cpp only needs FILE_ADDRESS (from HexEdit.h), ASSERT and InterlockedIncrement.
+// These are provided here (for g++ or clang) and the include guard of HexEdit.h is
+// defined so that LocTree.cpp's include of it is skipped.
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define HEXEDIT_H__INCLUDED_
+
+#define __int64 long long
+typedef __int64 FILE_ADDRESS;
+typedef long LONG;
+#define ASSERT(ff) assert(ff)
+using std::min;
+using std::max;
+
+inline LONG InterlockedIncrement(volatile LONG *pp) { return __sync_add_and_fetch(pp, 1); }
@@ -0,0 +1,128 @@
+// PatternFileTest.cpp : tests of CPatternFile (PatternFile.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// CPatternFile::ReadAt copies from a block holding the pattern repeated a whole
+// number of times (about 4 KB).  For patterns of different lengths (including
+// ones just under, at and over the block size) reads are done at every position
+// near the ends of the pattern and of the block, with lengths near the pattern
+// and block lengths, and near the end of the "file".  Every byte read must be
+// the pattern byte for that address, reads must stop at the end, and nothing
+// after the bytes read may be written.
+
+#include "stdafx.h"
+#include <vector>
+#include "../../PatternFile.h"
+
+const unsigned char guard = 0xA5;       // Fills the read buffer after the bytes to be read
+
+// Reads len bytes at pos and checks them against the pattern
+static bool check_read(CPatternFile &pf, const std::vector<unsigned char> &pat, FILE_ADDRESS total,
+                       FILE_ADDRESS pos, size_t len, std::vector<unsigned char> &buf)
+{
+	buf.assign(len + 16, guard);
+	DWORD got = pf.ReadAt(pos, &buf[0], DWORD(len));
+	size_t expected = pos >= total ? 0 : size_t(min(FILE_ADDRESS(len), total - pos));
+	if (got != expected)
+	{
+		printf("pattern length %d: read of %d at %lld returned %d (should be %d)\n",
+		       int(pat.size()), int(len), pos, int(got), int(expected));
+		return false;
+	}
+	for (size_t ii = 0; ii < got; ++ii)
+		if (buf[ii] != pat[size_t((pos + ii) % pat.size())])
+		{
+			printf("pattern length %d: read of %d at %lld wrong at byte %d\n",
+			       int(pat.size()), int(len), pos, int(ii));
+			return false;
+		}
+	for (size_t ii = got; ii < buf.size(); ++ii)
+		if (buf[ii] != guard)
+		{
+			printf("pattern length %d: read of %d at %lld wrote past the end of the data\n",
+			       int(pat.size()), int(len), pos);
+			return false;
+		}
+	return true;
+}
+
+int main()
+{
+	static const size_t lengths[] = { 1, 2, 3, 7, 100, 2048, 2049, 4095, 4096, 4097, 5000, 8192 };
+	srand(1);
+	long reads = 0;
+	std::vector<unsigned char> buf;
+	for (size_t ll = 0; ll < sizeof(lengths)/sizeof(*lengths); ++ll)
+	{
+		for (int zero = 0; zero < 2; ++zero)
+		{
+			size_t plen = lengths[ll];
+			std::vector<unsigned char> pat(plen, 0);
+			if (!zero)
+			{
+				for (size_t ii = 0; ii < plen; ++ii)
+					pat[ii] = (unsigned char)(rand()%256);
+				pat[plen - 1] = 1;      // (make sure it is not all zero)
+			}
+			size_t block = plen < 4096 ? (4096/plen)*plen : plen;  // Length of the repeated pattern in CPatternFile
+
+			// Test a short "file" and a huge one (reads near the end of a 64 GB file)
+			FILE_ADDRESS totals[] = { FILE_ADDRESS(3*block + plen/2 + 1), FILE_ADDRESS(64) << 30 };
+			for (int tt = 0; tt < 2; ++tt)
+			{
+				FILE_ADDRESS total = totals[tt];
+				CPatternFile pf(&pat[0], plen, total);
+				if (pf.IsZero() != (zero != 0) || pf.PatternLength() != plen ||
+					memcmp(pf.Pattern(), &pat[0], plen) != 0 || pf.GetLength() != total)
+				{
+					printf("pattern length %d: wrong pattern information\n", int(plen));
+					return 1;
+				}
+
+				// Positions near the start of the file, the ends of blocks and patterns, and the end of the file
+				std::vector<FILE_ADDRESS> starts;
+				for (FILE_ADDRESS aa = 0; aa < 3; ++aa)
+				{
+					starts.push_back(aa*block);
+					starts.push_back(aa*plen);
+				}
+				starts.push_back(total - 2*block);
+				starts.push_back(total - block);
+				starts.push_back(total - plen);
+				starts.push_back(total);
+
+				// Read lengths near the pattern and block lengths
+				std::vector<size_t> lens;
+				size_t near[] = { 1, plen, block, 2*block, 4096 };
+				for (size_t nn = 0; nn < sizeof(near)/sizeof(*near); ++nn)
+					for (int dd = -2; dd <= 2; ++dd)
+						if (int(near[nn]) + dd > 0)
+							lens.push_back(near[nn] + dd);
+
+				for (size_t ss = 0; ss < starts.size(); ++ss)
+					for (FILE_ADDRESS pos = starts[ss] - 3; pos <= starts[ss] + 3; ++pos)
+					{
+						if (pos < 0)
+							continue;
+						for (size_t ii = 0; ii < lens.size(); ++ii, ++reads)
+							if (!check_read(pf, pat, total, pos, lens[ii], buf))
+								return 1;
+					}
+
+				// Random reads anywhere
+				for (int ii = 0; ii < 2000; ++ii, ++reads)
+				{
+					FILE_ADDRESS pos = (FILE_ADDRESS(rand()) << 20 | rand()) % (total + 10);
+					if (!check_read(pf, pat, total, pos, size_t(rand()%(3*block) + 1), buf))
+						return 1;
+				}
+			}
+		}
+	}
+	printf("CPatternFile: %ld reads OK\n", reads);
+	return 0;
+}
@@ -0,0 +1,43 @@
+// stdafx.h : stands in for HexEdit's stdafx.h so CPatternFile builds without MFC
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// CPatternFile only uses the virtual functions of its base class CFile64 that
+// it overrides, so a CFile64 with just those stands in for the real one (the
+// include guards of CFile64.h and HexEdit.h are defined so they are skipped).
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define HEXEDIT_H__INCLUDED_
+#define FILE_64_CLASS_HEADER
+
+#define __int64 long long
+typedef __int64 FILE_ADDRESS;
+typedef __int64 LONGLONG;
+typedef unsigned int DWORD;
+typedef int BOOL;
+#define TRUE 1
+#define FALSE 0
+#define ASSERT(ff) assert(ff)
+using std::min;
+using std::max;
+
+class CFile64
+{
+public:
+	virtual ~CFile64() { }
+	virtual DWORD ReadAt(LONGLONG position, void * buffer, DWORD len) = 0;
+	virtual BOOL EnableMapping(BOOL enable = TRUE) = 0;
+	virtual LONGLONG GetLength(void) const = 0;
+};
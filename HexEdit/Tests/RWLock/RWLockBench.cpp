@@ -0,0 +1,180 @@
+// RWLockBench.cpp : background readers of the document with rw_lock and a critical section
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: RWLockBench [edits]
+//
+// Four threads (standing in for the search, stats, aerial view and compare
+// threads) read a 64 MB document in 64K blocks, as CHexEditDoc::GetData does,
+// while the main thread makes a small edit every millisecond (2000 by default).
+// This is done first with the document locked by a recursive mutex (as the
+// CCriticalSection docdata_ was) then with an rw_lock (as docrw_ is now).
+// For each it prints how fast the readers read and how long each edit waited
+// for the lock.
+
+#include "stdafx.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "../../LocTree.h"
+#include "../../RWLock.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+enum { num_readers = 4, block_size = 65536 };
+static const char *reader_name[num_readers] = { "search", "stats", "aerial", "compare" };
+
+static std::vector<unsigned char> mem(64*1024*1024);   // Memory that records point into
+static loc_tree loc;                    // The document
+
+// A recursive lock like CCriticalSection or an rw_lock
+static bool use_rw;
+static pthread_mutex_t cs;
+static rw_lock rw;
+
+static volatile long stop;              // Set (atomically) to make readers finish
+static volatile long long bytes_read[num_readers];  // Bytes read by each reader
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// Does what CHexEditDoc::GetData does (all records point to memory)
+static size_t get_data(unsigned char *buf, size_t len, FILE_ADDRESS address, doc_cursor &cursor)
+{
+	if (use_rw)
+		rw.lock_shared();
+	else
+		pthread_mutex_lock(&cs);
+
+	FILE_ADDRESS pos;
+	loc_tree::iterator pl = loc.find(address, pos, cursor);
+	size_t left = len;
+	FILE_ADDRESS start = address - pos;
+	while (left > 0 && pl != loc.end())
+	{
+		size_t tocopy = size_t(min(FILE_ADDRESS(left), FILE_ADDRESS(pl->dlen & doc_loc::mask) - start));
+		memcpy(buf, pl->memaddr + start, tocopy);
+		buf += tocopy;
+		left -= tocopy;
+		start = 0;
+		if (left > 0)
+		{
+			pos += pl->dlen & doc_loc::mask;
+			++pl;
+		}
+	}
+	if (pl != loc.end())
+		loc.remember(cursor, pl, pos);
+
+	if (use_rw)
+		rw.unlock_shared();
+	else
+		pthread_mutex_unlock(&cs);
+	return len - left;
+}
+
+// Reads the document from start to end over and over
+static void *reader(void *param)
+{
+	int idx = int((size_t)param);
+	std::vector<unsigned char> buf(block_size);
+	doc_cursor cursor;
+	FILE_ADDRESS address = 0;
+	unsigned sum = 0;
+	while (__sync_add_and_fetch(&stop, 0) == 0)
+	{
+		size_t got = get_data(&buf[0], buf.size(), address, cursor);
+		for (size_t ii = 0; ii < got; ii += 64)
+			sum += buf[ii];             // look at the data
+		bytes_read[idx] += got;
+		address = got < buf.size() ? 0 : address + got;
+	}
+	return (void *)(size_t)sum;
+}
+
+static void run(bool rw_lock_used, int edits)
+{
+	use_rw = rw_lock_used;
+	stop = 0;
+	for (int ii = 0; ii < num_readers; ++ii)
+		bytes_read[ii] = 0;
+
+	pthread_t th[num_readers];
+	for (int ii = 0; ii < num_readers; ++ii)
+		pthread_create(&th[ii], NULL, reader, (void *)(size_t)ii);
+
+	std::vector<double> wait;
+	double start = now();
+	for (int ii = 0; ii < edits; ++ii)
+	{
+		usleep(1000);
+		double tt = now();
+		if (use_rw)
+			rw.lock();
+		else
+			pthread_mutex_lock(&cs);
+		wait.push_back((now() - tt) * 1e6);
+
+		FILE_ADDRESS address = FILE_ADDRESS(rand()) * 16 % loc.length();
+		if (ii%2 == 0)
+			loc.insert(address, doc_loc(&mem[rand()%1000], 1));
+		else
+			loc.erase(address, 1);
+
+		if (use_rw)
+			rw.unlock();
+		else
+			pthread_mutex_unlock(&cs);
+	}
+	double secs = now() - start;
+	__sync_lock_test_and_set(&stop, 1);
+	for (int ii = 0; ii < num_readers; ++ii)
+		pthread_join(th[ii], NULL);
+
+	std::sort(wait.begin(), wait.end());
+	double total = 0.0;
+	for (size_t ii = 0; ii < wait.size(); ++ii)
+		total += wait[ii];
+	printf("%s:\n", use_rw ? "rw_lock" : "critical section");
+	for (int ii = 0; ii < num_readers; ++ii)
+		printf("  %-8s %8.0f MB/s\n", reader_name[ii], bytes_read[ii] / secs / (1024*1024));
+	printf("  edit waited: average %.1f usecs, 99%% %.1f usecs, max %.1f usecs\n",
+	       total / wait.size(), wait[wait.size()*99/100], wait.back());
+}
+
+int main(int argc, char *argv[])
+{
+	int edits = argc > 1 ? atoi(argv[1]) : 2000;
+	if (edits < 1)
+	{
+		fprintf(stderr, "Usage: RWLockBench [edits]\n");
+		return 2;
+	}
+
+	for (size_t ii = 0; ii < mem.size(); ++ii)
+		mem[ii] = (unsigned char)ii;
+	loc.push_back(doc_loc(&mem[0], mem.size()));
+	for (int ii = 0; ii < 10000; ++ii)     // start with many records as after a lot of editing
+		loc.insert(FILE_ADDRESS(rand()) * 16 % loc.length(), doc_loc(&mem[rand()%1000], 16));
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&cs, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	run(false, edits);
+	run(true, edits);
+
+	pthread_mutex_destroy(&cs);
+	return 0;
+}
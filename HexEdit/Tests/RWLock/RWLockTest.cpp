@@ -0,0 +1,80 @@
+// RWLockTest.cpp : checks that rw_lock keeps readers and writers apart
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Reader threads check that two values, which writers always change together
+// while holding the write lock, are the same.  Both readers and writers also
+// take the locks recursively (a reader takes the read lock again, a writer
+// takes the write lock again and then the read lock) as the document code does.
+
+#include "stdafx.h"
+#include <pthread.h>
+#include "../../RWLock.h"
+
+enum { num_readers = 6, num_writers = 2, writes = 20000 };
+
+static rw_lock lock;
+static volatile int value_a = 0, value_b = 0;   // Always the same when not write locked
+static volatile long bad = 0;                   // Times a reader saw them different
+static volatile long reads = 0;
+static volatile long stop = 0;                  // Set (atomically) to make readers finish
+
+static void *reader(void *)
+{
+	while (__sync_add_and_fetch(&stop, 0) == 0)
+	{
+		read_lock rl(lock);
+		int aa = value_a;
+		{
+			read_lock rl2(lock);        // nested read lock
+			if (value_b != aa)
+				__sync_add_and_fetch(&bad, 1);
+		}
+		if (value_b != aa)
+			__sync_add_and_fetch(&bad, 1);
+		__sync_add_and_fetch(&reads, 1);
+	}
+	return NULL;
+}
+
+static void *writer(void *)
+{
+	for (int ii = 0; ii < writes; ++ii)
+	{
+		write_lock wl(lock);
+		++value_a;
+		{
+			write_lock wl2(lock);       // nested write lock
+			read_lock rl(lock);         // and read lock by the writer
+			++value_b;
+		}
+	}
+	return NULL;
+}
+
+int main()
+{
+	pthread_t rd[num_readers], wr[num_writers];
+	int ii;
+	for (ii = 0; ii < num_readers; ++ii)
+		pthread_create(&rd[ii], NULL, reader, NULL);
+	for (ii = 0; ii < num_writers; ++ii)
+		pthread_create(&wr[ii], NULL, writer, NULL);
+	for (ii = 0; ii < num_writers; ++ii)
+		pthread_join(wr[ii], NULL);
+	__sync_lock_test_and_set(&stop, 1);
+	for (ii = 0; ii < num_readers; ++ii)
+		pthread_join(rd[ii], NULL);
+
+	if (value_a != num_writers*writes || value_b != num_writers*writes || bad != 0)
+	{
+		printf("rw_lock: FAILED (a = %d, b = %d, %ld bad reads)\n", value_a, value_b, bad);
+		return 1;
+	}
+	printf("rw_lock: %d writes and %ld reads OK\n", num_writers*writes, reads);
+	return 0;
+}
@@ -0,0 +1,114 @@
+// SaveBench.cpp : measures save throughput with and without async_writer
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: SaveBench file
+//
+// Copies the file to a temp file (in the temp directory) the way HexEdit
+// saves a document: the old way (16K blocks, each read then written in turn)
+// and with async_writer (big buffers, reads overlapped with writes).  Each is
+// done twice and the best time kept so that both get the benefit of the file
+// being in the OS cache.  The temp file is always deleted.
+
+#include "stdafx.h"
+#include "../../AsyncWriter.h"
+#include "../../Timer.h"
+
+// Deletes the temp file however we leave main()
+struct temp_file
+{
+	char name[_MAX_PATH];
+	temp_file() { name[0] = '\0'; }
+	~temp_file() { if (name[0] != '\0') remove(name); }
+};
+
+// Copies all of src to dst (both open) and returns the time taken in seconds
+static double save(CFile &src, CFile64 &dst, bool async)
+{
+	FILE_ADDRESS length = FILE_ADDRESS(src.GetLength());
+	timer tt(true);
+	{
+		async_writer aw(&dst, async ? async_writer::default_size : 16384, async);
+		src.SeekToBegin();
+		for (FILE_ADDRESS address = 0; address < length; )
+		{
+			size_t got = src.Read(aw.buffer(), UINT(min(length - address, FILE_ADDRESS(aw.size()))));
+			if (got == 0)
+				break;                  // file truncated while we were reading it
+			aw.write(address, got);
+			address += got;
+		}
+		aw.finish();
+	}
+	dst.Flush();                        // include the time to get it to disk
+	tt.stop();
+	return tt.elapsed();
+}
+
+int main(int argc, char *argv[])
+{
+	if (!AfxWinInit(::GetModuleHandle(NULL), NULL, ::GetCommandLine(), 0))
+	{
+		fprintf(stderr, "MFC failed to initialise\n");
+		return 2;
+	}
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: SaveBench file\n");
+		return 2;
+	}
+
+	temp_file temp;
+	char temp_dir[_MAX_PATH];
+	if (::GetTempPath(sizeof(temp_dir), temp_dir) == 0 ||
+		::GetTempFileName(temp_dir, _T("_HE"), 0, temp.name) == 0)
+	{
+		fprintf(stderr, "Could not create a temp file\n");
+		return 1;
+	}
+
+	double best[2] = { -1.0, -1.0 };
+	FILE_ADDRESS length = 0;
+	try
+	{
+		CFile src(argv[1], CFile::modeRead|CFile::shareDenyWrite|CFile::typeBinary);
+		length = FILE_ADDRESS(src.GetLength());
+		for (int ii = 0; ii < 4; ++ii)
+		{
+			bool async = (ii%2) == 1;
+			CFile64 dst;
+			CFileException fe;
+			if (!dst.Open(temp.name, CFile::modeCreate|CFile::modeWrite|CFile::shareExclusive|CFile::typeBinary, &fe))
+				AfxThrowFileException(fe.m_cause, fe.m_lOsError, temp.name);
+
+			double elapsed = save(src, dst, async);
+			dst.Close();
+			if (best[async] < 0.0 || elapsed < best[async])
+				best[async] = elapsed;
+		}
+	}
+	catch (CFileException *pfe)
+	{
+		fprintf(stderr, "File error %ld on \"%s\"\n", long(pfe->m_lOsError), (const char *)pfe->m_strFileName);
+		pfe->Delete();
+		return 1;
+	}
+	catch (CMemoryException *pme)
+	{
+		fprintf(stderr, "Out of memory\n");
+		pme->Delete();
+		return 1;
+	}
+
+	printf("Save %I64d bytes\n", length);
+	printf("16K read then write: %.2f secs (%.1f MB/sec)\n",
+	       best[0], best[0] > 0.0 ? length/best[0]/(1024*1024) : 0.0);
+	printf("Async %dMB buffers: %.2f secs (%.1f MB/sec)\n",
+	       int(async_writer::default_size/(1024*1024)),
+	       best[1], best[1] > 0.0 ? length/best[1]/(1024*1024) : 0.0);
+	return 0;
+}
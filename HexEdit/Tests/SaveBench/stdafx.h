@@ -0,0 +1,36 @@
+// stdafx.h : precompiled header for the SaveBench test harness
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// ..\..\AsyncWriter.cpp is compiled using this (precompiled) header in place
+// of HexEdit's own stdafx.h so that it does not need the rest of the program.
+// The include guards of HexEdit.h and CFile64.h are defined so that the
+// includes of those headers in AsyncWriter.cpp are skipped, and the little
+// they are needed for (FILE_ADDRESS and the file class) is defined here.
+
+#pragma once
+
+#ifndef VC_EXTRALEAN
+#define VC_EXTRALEAN            // Exclude rarely-used stuff from Windows headers
+#endif
+
+#include <afxwin.h>             // MFC core and standard components
+#include <afxmt.h>              // CEvent
+#include <stdio.h>
+#include <malloc.h>
+
+#define HEXEDIT_H__INCLUDED_
+#define FILE_64_CLASS_HEADER
+
+typedef __int64 FILE_ADDRESS;
+
+// async_writer only uses Seek, Write and GetFilePath (which CFile has) and the handle
+class CFile64 : public CFile
+{
+public:
+	HANDLE GetHandle() const { return m_hFile; }
+};
@@ -0,0 +1,186 @@
+// SavePlanTest.cpp : tests of save_plan (SavePlan.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Random edits are made to the location records of a small "file": inserting
+// memory and data file records, replacing and deleting.  Insertions and deletions
+// move the parts of the original file after them, but (as in the document) they
+// always stay in the same order.  Then a save_plan is made from the records and
+// applied to a copy of the original file the way CHexEditDoc::WriteInPlace does
+// (moves copied in small chunks in the direction WriteInPlace uses, then the
+// writes).  The result must be the same as the contents of the document.
+
+#include "stdafx.h"
+#include <vector>
+#include "../../LocTree.h"
+#include "../../SavePlan.h"
+
+const FILE_ADDRESS doc_loc::mask = 0x3fffFFFFffffFFFF;
+
+enum { num_data_files = 2 };
+static unsigned char mem[100000];       // Memory that memory records point into
+static unsigned char orig[1000];        // Original file
+static unsigned char data_file[num_data_files][1000];
+
+typedef std::vector<unsigned char> bytes;
+
+// Returns what the document contains (as GetData would read it)
+static bytes contents(const loc_tree &tree)
+{
+	bytes bb;
+	for (loc_tree::iterator pl = tree.begin(); pl != tree.end(); ++pl)
+	{
+		size_t len = size_t(pl->dlen & doc_loc::mask);
+		const unsigned char *pp;
+		switch (pl->dlen >> 62)
+		{
+		case 1:  pp = orig + pl->fileaddr; break;
+		case 2:  pp = pl->memaddr; break;
+		default: pp = data_file[pl->fileid] + pl->fileaddr; break;
+		}
+		bb.insert(bb.end(), pp, pp + len);
+	}
+	return bb;
+}
+
+// Saves in place using the plan (returns false if the plan itself is not right)
+static bool apply(const save_plan &plan, bytes &file, size_t chunk)
+{
+	std::vector<save_plan::extent>::const_iterator pe;
+	FILE_ADDRESS total = 0;
+
+	file.resize(std::max(file.size(), size_t(plan.length())));
+	for (pe = plan.moves().begin(); pe != plan.moves().end(); ++pe)
+	{
+		if (pe->type != save_plan::move || pe->src == pe->address)
+			return false;
+		if (pe->address > pe->src)
+		{
+			for (FILE_ADDRESS src = pe->src + pe->len, dst = pe->address + pe->len; src > pe->src; )
+			{
+				size_t count = size_t(std::min(src - pe->src, FILE_ADDRESS(chunk)));
+				src -= count;
+				dst -= count;
+				memmove(&file[size_t(dst)], &file[size_t(src)], count);   // (read then written)
+			}
+		}
+		else
+		{
+			for (FILE_ADDRESS src = pe->src, dst = pe->address; src < pe->src + pe->len; )
+			{
+				size_t count = size_t(std::min(pe->src + pe->len - src, FILE_ADDRESS(chunk)));
+				memmove(&file[size_t(dst)], &file[size_t(src)], count);   // (read then written)
+				src += count;
+				dst += count;
+			}
+		}
+		total += pe->len;
+	}
+
+	FILE_ADDRESS last = 0;              // End of the last write
+	for (pe = plan.writes().begin(); pe != plan.writes().end(); ++pe)
+	{
+		if (pe->address < last)
+			return false;               // not in address order
+		if (pe->type == save_plan::memory)
+		{
+			if (pe->address == last && pe != plan.writes().begin() && (pe-1)->type == save_plan::memory)
+				return false;           // should have been combined with the previous one
+			FILE_ADDRESS dst = pe->address;
+			for (size_t ii = pe->first; ii < pe->first + pe->count; ++ii)
+			{
+				memcpy(&file[size_t(dst)], plan.piece(ii).first, plan.piece(ii).second);
+				dst += plan.piece(ii).second;
+			}
+			if (dst != pe->address + pe->len)
+				return false;
+		}
+		else
+		{
+			if (pe->type != save_plan::data_file || pe->fileid < 0 || pe->fileid >= num_data_files)
+				return false;
+			memcpy(&file[size_t(pe->address)], data_file[pe->fileid] + pe->src, size_t(pe->len));
+		}
+		last = pe->address + pe->len;
+		total += pe->len;
+	}
+	file.resize(size_t(plan.length()));
+	return total == plan.total();
+}
+
+int main()
+{
+	srand(1);
+	for (size_t ii = 0; ii < sizeof(orig); ++ii)
+		orig[ii] = (unsigned char)rand();
+	for (size_t ii = 0; ii < sizeof(mem); ++ii)
+		mem[ii] = (unsigned char)rand();
+	for (int ff = 0; ff < num_data_files; ++ff)
+		for (size_t ii = 0; ii < sizeof(data_file[ff]); ++ii)
+			data_file[ff][ii] = (unsigned char)rand();
+
+	long plans = 0, moves = 0;
+	for (int round = 0; round < 2000; ++round)
+	{
+		loc_tree tree;
+		size_t mem_next = 0;
+		FILE_ADDRESS file_len = 1 + rand()%sizeof(orig);
+		tree.push_back(doc_loc(FILE_ADDRESS(0), file_len));
+
+		int edits = rand()%30;
+		for (int ee = 0; ee <= edits; ++ee)
+		{
+			// Check the plan before the first edit (nothing to do) and after each edit
+			save_plan plan(tree);
+			bytes file(orig, orig + file_len);
+			if (!apply(plan, file, 1 + rand()%16) || file != contents(tree))
+			{
+				printf("save_plan: FAILED in round %d after %d edits\n", round, ee);
+				return 1;
+			}
+			if (ee == 0 && plan.total() != 0)
+			{
+				printf("save_plan: FAILED in round %d - unchanged file is written\n", round);
+				return 1;
+			}
+			++plans;
+			moves += long(plan.moves().size());
+			if (ee == edits)
+				break;
+
+			FILE_ADDRESS len = tree.length();
+			FILE_ADDRESS address = rand() % (len + 1);
+			FILE_ADDRESS count = 1 + rand()%50;
+			switch (rand()%5)
+			{
+			case 0:                     // insert (or replace) from memory
+				if (mem_next + count > sizeof(mem))
+					mem_next = 0;
+				if (rand()%2)
+					tree.erase(address, count);
+				tree.insert(address, doc_loc(mem + mem_next, count));
+				mem_next += size_t(count);
+				break;
+			case 1:                     // insert from a data file
+				{
+					FILE_ADDRESS fileaddr = rand() % (sizeof(data_file[0]) - count);
+					tree.insert(address, doc_loc(fileaddr, count, rand()%num_data_files));
+				}
+				break;
+			case 2:                     // delete
+			case 3:
+				tree.erase(address, count);
+				break;
+			case 4:                     // delete a lot (moves more of the file)
+				tree.erase(address, count * 10);
+				break;
+			}
+		}
+	}
+	printf("save_plan: %ld plans OK (%ld moves)\n", plans, moves);
+	return 0;
+}
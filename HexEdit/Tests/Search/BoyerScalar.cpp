@@ -0,0 +1,19 @@
+// BoyerScalar.cpp : Boyer.cpp built again (as class boyer_scalar) without SSE2
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// boyer only checks once whether SSE2 can be used, so to compare the SSE2 searches
+// with the plain ones in one program the class is compiled a second time under
+// another name, with IsProcessorFeaturePresent saying that SSE2 is not available.
+
+#include "stdafx.h"
+
+static BOOL no_sse2(int) { return FALSE; }
+
+#define IsProcessorFeaturePresent(ff) no_sse2(ff)
+#define boyer boyer_scalar
+#include "../../Boyer.cpp"
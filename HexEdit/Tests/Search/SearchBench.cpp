@@ -0,0 +1,106 @@
+// SearchBench.cpp : times boyer searches with and without SSE2
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: SearchBench file...
+//
+// For each file and each pattern length, searches for all occurrences of the bytes
+// in the middle of the file (so there is at least one) with boyer and boyer_scalar
+// (Boyer.cpp built without SSE2 - see BoyerScalar.cpp), case-sensitive and not.
+// Small files are searched repeatedly so that the times are long enough to measure.
+// Prints the speed of each and checks that both find the same number of matches.
+
+#include "stdafx.h"
+#include <vector>
+#include "boyer.h"
+#include "../../Timer.h"
+
+#define boyer boyer_scalar
+#include "boyer.h"
+#undef boyer
+
+unsigned char e2a_tab[256];
+
+static const size_t min_bytes = 16*1024*1024;   // Search at least this much for each timing
+
+// Finds all occurrences of the pattern in buf, returning how many in count and the seconds taken
+template<class T> double find_all(const T &bb, std::vector<unsigned char> &buf, BOOL icase, long &count)
+{
+	size_t reps = min_bytes/buf.size() + 1;
+	count = 0;
+	timer tt(true);
+	for (size_t rr = 0; rr < reps; ++rr)
+	{
+		unsigned char *pp = &buf[0], *end = &buf[0] + buf.size();
+		unsigned char *found;
+		while ((found = bb.findforw(pp, end - pp, icase, 1, FALSE, FALSE, FALSE, 1, 0, 0, 0)) != NULL)
+		{
+			++count;
+			pp = found + 1;
+		}
+	}
+	tt.stop();
+	count /= long(reps);
+	return tt.elapsed() / reps;
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t lens[] = { 1, 2, 3, 4, 8, 16, 32, 64 };
+	bool ok = true;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: SearchBench file...\n");
+		return 2;
+	}
+	printf("%-24s %4s %5s %10s %10s %7s\n", "File", "Len", "Case", "SSE2 MB/s", "Plain MB/s", "Found");
+	for (int aa = 1; aa < argc; ++aa)
+	{
+		FILE *pf = fopen(argv[aa], "rb");
+		if (pf == NULL)
+		{
+			fprintf(stderr, "Could not open %s\n", argv[aa]);
+			ok = false;
+			continue;
+		}
+		std::vector<unsigned char> buf;
+		unsigned char block[16384];
+		size_t got;
+		while ((got = fread(block, 1, sizeof(block), pf)) > 0)
+			buf.insert(buf.end(), block, block + got);
+		fclose(pf);
+
+		const char *name = strrchr(argv[aa], '/');
+		name = name == NULL ? argv[aa] : name + 1;
+		for (size_t ll = 0; ll < sizeof(lens)/sizeof(*lens); ++ll)
+		{
+			size_t plen = lens[ll];
+			if (plen > buf.size())
+				break;
+			const unsigned char *pat = &buf[(buf.size() - plen)/2];
+			boyer bb(pat, plen, NULL);
+			boyer_scalar bs(pat, plen, NULL);
+
+			for (BOOL icase = FALSE; icase <= TRUE; ++icase)
+			{
+				long count1, count2;
+				double t1 = find_all(bb, buf, icase, count1);
+				double t2 = find_all(bs, buf, icase, count2);
+				double mb = buf.size()/(1024.0*1024.0);
+				printf("%-24s %4d %5s %10.0f %10.0f %7ld\n", name, int(plen), icase ? "no" : "yes",
+				       t1 > 0.0 ? mb/t1 : 0.0, t2 > 0.0 ? mb/t2 : 0.0, count1);
+				if (count1 != count2)
+				{
+					printf("  found %ld without SSE2\n", count2);
+					ok = false;
+				}
+			}
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,362 @@
+// SearchTest.cpp : differential tests of the search methods of boyer (Boyer.h)
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// boyer chooses between several ways to search for the same thing.  Each test
+// here searches lots of small random buffers (with the pattern often planted in
+// them) for random patterns using random options, and checks that the faster
+// method finds the same thing as the simpler one (or a brute force search).  Any difference is printed
+// (with what is needed to repeat it) and the program returns 1.
+
+#include "stdafx.h"
+#include <regex>
+#include "boyer.h"
+
+// The same class built without SSE2 (see BoyerScalar.cpp)
+#define boyer boyer_scalar
+#include "boyer.h"
+#undef boyer
+
+unsigned char e2a_tab[256];             // (EBCDIC.CPP is not used - a match is a match whatever the table)
+
+// Gives the tests access to the search methods that findforw/findback choose between
+struct boyer_test
+{
+	static unsigned char *mask_find(const boyer &bb, unsigned char *pp, size_t len, BOOL icase, int tt,
+	                                BOOL ww, BOOL ab, BOOL aa, int align, int offset)
+	{
+		return bb.mask_find(pp, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+	}
+	static unsigned char *mask_findback(const boyer &bb, unsigned char *pp, size_t len, BOOL icase, int tt,
+	                                    BOOL ww, BOOL ab, BOOL aa, int align, int offset)
+	{
+		return bb.mask_findback(pp, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+	}
+	static bool uses_bitap(const boyer &bb) { return bb.bitap_ != NULL; }
+	static bool uses_simd(const boyer &bb, int mode) { return bb.nfirst_[mode] > 0 && bb.nlast_[mode] > 0; }
+};
+
+static long pos(const unsigned char *found, const unsigned char *buf)
+{
+	return found == NULL ? -1 : long(found - buf);
+}
+
+// Patterns with a mask: bitap_find/bitap_findback (used by findforw/findback) against
+// mask_find/mask_findback.  Patterns are up to 150 bytes so some need more than one
+// 64-bit word of bits.
+static bool test_bitap(int count)
+{
+	const char *alpha = "aAbB \xC1\x81";   // (0xC1 and 0x81 are EBCDIC A and a)
+	unsigned char pat[200], mask[200], buf[600];
+	long hits = 0;
+
+	srand(2);
+	for (int it = 0; it < count; ++it)
+	{
+		size_t plen = 1 + (rand()%4 == 0 ? rand()%150 : rand()%10);
+		size_t len = rand()%(plen*3 + 60);
+		BOOL icase = rand()%2;
+		int tt = 1 + rand()%3;
+		for (size_t ii = 0; ii < plen; ++ii)
+		{
+			pat[ii] = alpha[rand()%7];
+			int rr = rand()%4;
+			mask[ii] = rr == 0 ? 0 : (rr == 1 && !icase ? (unsigned char)rand() : 0xFF);
+		}
+		if (rand()%3 == 0)
+			memset(mask, icase ? 0 : 0x0F, plen);       // no byte fully specified
+		for (size_t ii = 0; ii < len; ++ii)
+			buf[ii] = rand()%4 == 0 ? (unsigned char)rand() : alpha[rand()%7];
+		if (len >= plen && rand()%2 == 0)
+			memcpy(buf + rand()%(len - plen + 1), pat, plen);
+		BOOL ww = rand()%2, ab = rand()%2, aa = rand()%2;
+		int align = rand()%3 == 0 ? 2 + rand()%3 : 1;
+		int offset = align > 1 ? rand()%align : 0;
+
+		boyer bb(pat, plen, mask);
+		if (!boyer_test::uses_bitap(bb))
+		{
+			printf("bitap: pattern of %d bytes not searched with bitap\n", int(plen));
+			return false;
+		}
+		unsigned char *f1 = boyer_test::mask_find(bb, buf, len, icase, tt, ww, ab, aa, align, offset);
+		unsigned char *f2 = bb.findforw(buf, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+		unsigned char *b1 = boyer_test::mask_findback(bb, buf, len, icase, tt, ww, ab, aa, align, offset);
+		unsigned char *b2 = bb.findback(buf, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+		if (f1 != f2 || b1 != b2)
+		{
+			printf("bitap: case %d (plen %d len %d icase %d tt %d ww %d ab %d aa %d align %d/%d) "
+			       "forw %ld (mask_find %ld) back %ld (mask_findback %ld)\n",
+			       it, int(plen), int(len), icase, tt, ww, ab, aa, align, offset,
+			       pos(f2, buf), pos(f1, buf), pos(b2, buf), pos(b1, buf));
+			return false;
+		}
+		if (f2 != NULL)
+			++hits;
+	}
+	printf("bitap: %d cases OK (%ld found)\n", count, hits);
+	return true;
+}
+
+// Patterns without a mask: simd_findforw/simd_findback (used by findforw/findback when
+// SSE2 is available) against the Boyer-Moore searches used without SSE2.  Some buffers
+// are a few hundred bytes so that the SSE2 loop does many 16-byte blocks.
+static bool test_simd(int count)
+{
+	const char *alpha = "aAbB \xC1\x81";
+	unsigned char pat[20], buf[400];
+	long hits = 0, simd = 0;
+
+	srand(1);
+	for (int it = 0; it < count; ++it)
+	{
+		size_t plen = 1 + rand()%10;
+		size_t len = rand()%8 == 0 ? rand()%400 : rand()%80;
+		for (size_t ii = 0; ii < plen; ++ii)
+			pat[ii] = alpha[rand()%7];
+		for (size_t ii = 0; ii < len; ++ii)
+			buf[ii] = rand()%4 == 0 ? (unsigned char)rand() : alpha[rand()%7];
+		if (len >= plen && rand()%2 == 0)
+			memcpy(buf + rand()%(len - plen + 1), pat, plen);
+		BOOL icase = rand()%2;
+		int tt = 1 + rand()%3;
+		BOOL ww = rand()%2, ab = rand()%2, aa = rand()%2;
+		int align = rand()%3 == 0 ? 2 + rand()%3 : 1;
+		int offset = align > 1 ? rand()%align : 0;
+
+		boyer bb(pat, plen, NULL);
+		boyer_scalar bs(pat, plen, NULL);
+		if (boyer_test::uses_simd(bb, !icase ? 0 : (tt == 3 ? 2 : 1)))
+			++simd;
+		unsigned char *f1 = bs.findforw(buf, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+		unsigned char *f2 = bb.findforw(buf, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+		unsigned char *b1 = bs.findback(buf, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+		unsigned char *b2 = bb.findback(buf, len, icase, tt, ww, ab, aa, align, offset, 3, 7);
+		if (f1 != f2 || b1 != b2)
+		{
+			printf("simd: case %d (plen %d len %d icase %d tt %d ww %d ab %d aa %d align %d/%d) "
+			       "forw %ld (scalar %ld) back %ld (scalar %ld)\n",
+			       it, int(plen), int(len), icase, tt, ww, ab, aa, align, offset,
+			       pos(f2, buf), pos(f1, buf), pos(b2, buf), pos(b1, buf));
+			return false;
+		}
+		if (f2 != NULL)
+			++hits;
+	}
+	printf("simd: %d cases OK (%ld used SSE2, %ld found)\n", count, simd, hits);
+	return true;
+}
+
+// Multiple patterns: every occurrence found by scanning with aho_corasick against a
+// brute force comparison of each pattern at each address.  Some pattern sets are 500
+// random 4-byte keys, which use every byte value (so there are 257 byte classes), and
+// some are folded to upper case as for case-insensitive searches.
+static bool test_aho(int count)
+{
+	const char *alpha = "aAbB \xC1\x81";
+	unsigned char fold[256], buf[1000];
+	long hits = 0;
+
+	for (int cc = 0; cc < 256; ++cc)
+		fold[cc] = (unsigned char)toupper(cc);
+
+	srand(3);
+	for (int it = 0; it < count; ++it)
+	{
+		bool keys = rand()%5 == 0;                  // 500 random 4-byte keys
+		bool folded = rand()%2 == 0;
+		size_t npat = keys ? 500 : 1 + rand()%20;
+		std::vector<std::vector<unsigned char> > pats(npat);
+		for (size_t ii = 0; ii < npat; ++ii)
+		{
+			pats[ii].resize(keys ? 4 : 1 + rand()%8);
+			for (size_t jj = 0; jj < pats[ii].size(); ++jj)
+				pats[ii][jj] = keys ? (unsigned char)rand() : alpha[rand()%7];
+		}
+		size_t len = keys ? rand()%400 : rand()%1000;
+		for (size_t ii = 0; ii < len; ++ii)
+			buf[ii] = rand()%4 == 0 || keys ? (unsigned char)rand() : alpha[rand()%7];
+		for (int nn = rand()%8; nn > 0; --nn)
+		{
+			const std::vector<unsigned char> &pp = pats[rand()%npat];
+			if (len >= pp.size())
+				memcpy(buf + rand()%(len - pp.size() + 1), &pp[0], pp.size());
+		}
+
+		// Brute force: (end, id) of every occurrence, where id is the first of equal patterns
+		std::vector<std::pair<size_t, int> > expected, got;
+		for (size_t ii = 0; ii < npat; ++ii)
+		{
+			size_t plen = pats[ii].size();
+			size_t first;
+			for (first = 0; first < ii; ++first)
+			{
+				if (pats[first].size() != plen)
+					continue;
+				size_t jj;
+				for (jj = 0; jj < plen; ++jj)
+					if (folded ? fold[pats[first][jj]] != fold[pats[ii][jj]] : pats[first][jj] != pats[ii][jj])
+						break;
+				if (jj == plen)
+					break;
+			}
+			if (first < ii)
+				continue;                               // (only the first of the same patterns is found)
+			for (size_t spos = 0; spos + plen <= len; ++spos)
+			{
+				size_t jj;
+				for (jj = 0; jj < plen; ++jj)
+					if (folded ? fold[buf[spos+jj]] != fold[pats[ii][jj]] : buf[spos+jj] != pats[ii][jj])
+						break;
+				if (jj == plen)
+					expected.push_back(std::make_pair(spos + plen - 1, int(ii)));
+			}
+		}
+
+		aho_corasick ac(pats, folded ? fold : NULL);
+		int state = 0;
+		for (size_t ii = 0; ii < len; ++ii)
+		{
+			state = ac.next(state, buf[ii]);
+			for (int id = ac.first(state); id != -1; id = ac.after(id))
+				got.push_back(std::make_pair(ii, id));
+		}
+		std::sort(expected.begin(), expected.end());
+		std::sort(got.begin(), got.end());
+		if (got != expected)
+		{
+			printf("aho: case %d (%d patterns, len %d, fold %d) found %d occurrences (brute force %d)\n",
+			       it, int(npat), int(len), int(folded), int(got.size()), int(expected.size()));
+			return false;
+		}
+		hits += long(got.size());
+	}
+	printf("aho: %d cases OK (%ld found)\n", count, hits);
+	return true;
+}
+
+// Makes a random regex that means the same to byte_regex and std::regex (POSIX extended)
+// using the bytes a to c.  Repeats (* and +) are rarer so that most have a small
+// max_length(), which means the searches below use many buffers, and are not used
+// on groups (std::regex takes exponential time for eg (a(b)*)*).
+static std::string random_regex(int depth)
+{
+	static const char *atoms[] = { "a", "b", "c", ".", "[ab]", "[^a]", "[a-b]" };
+	static const char *repeats[] = { "?", "?", "{2}", "{1,3}", "{0,2}", "*", "+" };
+	std::string re;
+	int nalt = rand()%4 == 0 ? 2 : 1;
+	for (int alt = 0; alt < nalt; ++alt)
+	{
+		if (alt > 0)
+			re += '|';
+		for (int natom = 1 + rand()%4; natom > 0; --natom)
+		{
+			bool group = depth > 0 && rand()%5 == 0;
+			if (group)
+				re += "(" + random_regex(depth - 1) + ")";
+			else
+				re += atoms[rand()%7];
+			if (rand()%3 == 0)
+				re += repeats[rand()%(group ? 5 : 7)];
+		}
+	}
+	return re;
+}
+
+// Regexes: boyer::findall (using byte_regex) against the longest match at each address
+// found with std::regex_match (which checks if all of the bytes match - regex_search
+// with POSIX regexes should find the longest match but libstdc++ does not always).  As
+// in the background search, matches do not overlap and the buffer is also searched in
+// parts that overlap by length() - 1 bytes, which must find the same matches.
+static bool test_regex(int count)
+{
+	const char *alpha = "abcAB";
+	unsigned char buf[40];
+	long hits = 0, skipped = 0;
+
+	srand(4);
+	for (int it = 0; it < count; ++it)
+	{
+		std::string re = random_regex(2);
+		BOOL icase = rand()%2;
+		boyer bb(re.c_str(), icase);
+		if (bb.regex_error() != NULL)
+		{
+			++skipped;                  // eg it matches nothing (which byte_regex does not allow)
+			continue;
+		}
+		std::regex sre(re, icase ? std::regex::extended | std::regex::icase : std::regex::extended);
+
+		size_t len = rand()%40;
+		for (size_t ii = 0; ii < len; ++ii)
+			buf[ii] = alpha[rand()%5];
+
+		// Expected matches: the longest at each address that is not inside the previous match
+		std::vector<std::pair<size_t, int> > expected;
+		for (size_t spos = 0; spos < len; ++spos)
+		{
+			size_t mlen;
+			for (mlen = min(len - spos, bb.length()); mlen > 0; --mlen)
+				if (std::regex_match((const char *)buf + spos, (const char *)buf + spos + mlen, sre))
+					break;
+			if (mlen > 0)
+			{
+				expected.push_back(std::make_pair(spos, int(mlen)));
+				spos += mlen - 1;
+			}
+		}
+
+		// All at once
+		std::vector<std::pair<size_t, int> > found;
+		bb.findall(buf, len, len, 0, icase, 1, FALSE, FALSE, FALSE, 1, 0, 0, 0, found);
+		if (found != expected)
+		{
+			printf("regex: case %d (\"%s\" icase %d len %d) found %d matches (std::regex %d)\n",
+			       it, re.c_str(), icase, int(len), int(found.size()), int(expected.size()));
+			return false;
+		}
+
+		// In parts as RunSearchThread does
+		std::vector<std::pair<size_t, int> > parts;
+		size_t overlap = bb.length() - 1;
+		size_t step = 1 + rand()%10;    // Bytes not searched again by the next part
+		size_t match_end = 0;
+		for (size_t addr = 0; addr + bb.min_length() <= len; addr += step)
+		{
+			size_t got = min(step + overlap, len - addr);
+			size_t limit = addr + got < len ? step : got;
+			std::vector<std::pair<size_t, int> > ff;
+			bb.findall(buf + addr, got, limit, match_end > addr ? match_end - addr : 0, icase, 1,
+			           FALSE, FALSE, FALSE, 1, 0, 0, addr, ff);
+			for (size_t ii = 0; ii < ff.size(); ++ii)
+			{
+				parts.push_back(std::make_pair(addr + ff[ii].first, ff[ii].second));
+				match_end = max(match_end, addr + ff[ii].first + ff[ii].second);
+			}
+			if (addr + got >= len)
+				break;
+		}
+		if (parts != expected)
+		{
+			printf("regex: case %d (\"%s\" icase %d len %d) found %d matches in parts of %d (std::regex %d)\n",
+			       it, re.c_str(), icase, int(len), int(parts.size()), int(step), int(expected.size()));
+			return false;
+		}
+		hits += long(found.size());
+	}
+	printf("regex: %d cases OK (%ld skipped, %ld found)\n", count, skipped, hits);
+	return true;
+}
+
+int main()
+{
+	bool ok = test_simd(200000);
+	ok = test_bitap(300000) && ok;
+	ok = test_aho(20000) && ok;
+	ok = test_regex(20000) && ok;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,2 @@
+// boyer.h : Boyer.cpp includes "boyer.h" which is only found on a case-insensitive file system
+#include "../../Boyer.h"
@@ -0,0 +1 @@
+// intrin.h : (empty) Boyer.cpp includes this for _BitScanForward etc which are in stdafx.h
@@ -0,0 +1,71 @@
+// stdafx.h : stands in for HexEdit's stdafx.h so the search code builds without MFC
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Boyer.cpp, AhoCorasick.cpp and ByteRegex.cpp only need a few Windows types
+// and functions, and a CString with the members byte_regex uses.  These are
+// provided here (for g++ or clang on x86/x64) so they can be tested on their own.
+
+#pragma once
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+
+#define __int64 long long
+typedef int BOOL;
+#define TRUE  1
+#define FALSE 0
+#define ASSERT(ff) assert(ff)
+#define VERIFY(ff) do { bool ok_ = (ff); assert(ok_); (void)ok_; } while (0)
+using std::min;
+using std::max;
+
+#define PF_XMMI64_INSTRUCTIONS_AVAILABLE 10
+inline BOOL IsProcessorFeaturePresent(int) { return TRUE; }    // SSE2 is always there on x64
+
+inline unsigned char _BitScanForward(unsigned long *pidx, unsigned long mask)
+{
+	if (mask == 0) return 0;
+	*pidx = __builtin_ctzl(mask);
+	return 1;
+}
+inline unsigned char _BitScanReverse(unsigned long *pidx, unsigned long mask)
+{
+	if (mask == 0) return 0;
+	*pidx = sizeof(mask)*8 - 1 - __builtin_clzl(mask);
+	return 1;
+}
+
+class CString
+{
+public:
+	CString() {}
+	CString(const char *ss) : str_(ss) {}
+	CString &operator=(const char *ss) { str_ = ss; return *this; }
+	bool IsEmpty() const { return str_.empty(); }
+	operator const char *() const { return str_.c_str(); }
+	bool operator==(const CString &other) const { return str_ == other.str_; }
+	bool operator==(const char *ss) const { return str_ == ss; }
+	bool operator!=(const CString &other) const { return str_ != other.str_; }
+	void Format(const char *fmt, ...)
+	{
+		char buf[1024];
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(buf, sizeof(buf), fmt, args);
+		va_end(args);
+		str_ = buf;
+	}
+private:
+	std::string str_;
+};
@@ -0,0 +1,151 @@
+// ArenaBench.cpp : heap use of undo record buffers with and without undo_arena
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Usage: ArenaBench old|new [changes]
+//
+// Adds undo records for 1,000,000 (by default) single byte changes that cannot be
+// merged to a std::vector, as CHexEditDoc::Change does, then frees them all.
+//   old: each record gets its buffer with new[] (at least undo_limit_ bytes) and
+//        is copied (including the buffer) when the vector grows (as doc_undo was)
+//   new: buffers come from an undo_arena and records are moved (as doc_undo is now)
+// Prints the number of heap allocations, the time taken and the peak memory use
+// (the maximum resident set size).  Run once for each as the peak is per process.
+
+#include "stdafx.h"
+#include <new>
+#include <vector>
+#include <sys/resource.h>
+#include "../../UndoArena.h"
+#include "../../Timer.h"
+
+static long allocations = 0;            // Count of calls of operator new
+
+void *operator new(size_t size)
+{
+	++allocations;
+	void *pp = malloc(size == 0 ? 1 : size);
+	if (pp == NULL)
+		throw std::bad_alloc();
+	return pp;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *pp) throw() { free(pp); }
+void operator delete[](void *pp) throw() { free(pp); }
+void operator delete(void *pp, size_t) throw() { free(pp); }
+void operator delete[](void *pp, size_t) throw() { free(pp); }
+
+static const int undo_limit = 5;        // Default of theApp.undo_limit_
+
+// doc_undo as it was before undo_arena (just the parts that matter here)
+struct old_undo
+{
+	FILE_ADDRESS address, len;
+	unsigned char *ptr;
+
+	old_undo(FILE_ADDRESS a, FILE_ADDRESS n, const unsigned char *p) : address(a), len(n)
+	{
+		ptr = new unsigned char[max(undo_limit, int(len))];
+		memcpy(ptr, p, size_t(len));
+	}
+	old_undo(const old_undo &from) : address(from.address), len(from.len)
+	{
+		ptr = new unsigned char[max(undo_limit, int(len))];
+		memcpy(ptr, from.ptr, size_t(len));
+	}
+	old_undo &operator=(const old_undo &from)
+	{
+		if (&from != this)
+		{
+			delete[] ptr;
+			address = from.address; len = from.len;
+			ptr = new unsigned char[max(undo_limit, int(len))];
+			memcpy(ptr, from.ptr, size_t(len));
+		}
+		return *this;
+	}
+	~old_undo() { delete[] ptr; }
+};
+
+// doc_undo as it is now (just the parts that matter here)
+struct new_undo
+{
+	FILE_ADDRESS address, len;
+	unsigned char *ptr;
+	unsigned cap;
+	undo_arena *parena;
+
+	new_undo(undo_arena *pa, FILE_ADDRESS a, FILE_ADDRESS n, const unsigned char *p) : address(a), len(n), parena(pa)
+	{
+		cap = unsigned(max(FILE_ADDRESS(undo_limit), len));
+		ptr = parena->allocate(cap);
+		memcpy(ptr, p, size_t(len));
+	}
+	new_undo(new_undo &&from) : address(from.address), len(from.len), ptr(from.ptr), cap(from.cap), parena(from.parena)
+	{
+		from.ptr = NULL;
+		from.cap = 0;
+	}
+	new_undo &operator=(new_undo &&from)
+	{
+		if (&from != this)
+		{
+			if (ptr != NULL)
+				parena->release(ptr, cap);
+			address = from.address; len = from.len; ptr = from.ptr; cap = from.cap; parena = from.parena;
+			from.ptr = NULL;
+			from.cap = 0;
+		}
+		return *this;
+	}
+	~new_undo() { if (ptr != NULL) parena->release(ptr, cap); }
+
+private:
+	new_undo(const new_undo &);
+	new_undo &operator=(const new_undo &);
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || (strcmp(argv[1], "old") != 0 && strcmp(argv[1], "new") != 0))
+	{
+		fprintf(stderr, "Usage: ArenaBench old|new [changes]\n");
+		return 2;
+	}
+	bool use_arena = strcmp(argv[1], "new") == 0;
+	long count = argc > 2 ? atol(argv[2]) : 1000000;
+
+	long before = allocations;
+	timer tt(true);
+	if (use_arena)
+	{
+		undo_arena arena;
+		std::vector<new_undo> undo;
+		for (long ii = 0; ii < count; ++ii)
+		{
+			unsigned char cc = (unsigned char)ii;
+			undo.push_back(new_undo(&arena, FILE_ADDRESS(ii)*2, 1, &cc));  // (every 2nd byte so they are not merged)
+		}
+		printf("new: %ld records, %d slabs", count, int(arena.slab_count()));
+	}
+	else
+	{
+		std::vector<old_undo> undo;
+		for (long ii = 0; ii < count; ++ii)
+		{
+			unsigned char cc = (unsigned char)ii;
+			undo.push_back(old_undo(FILE_ADDRESS(ii)*2, 1, &cc));
+		}
+		printf("old: %ld records", count);
+	}
+	tt.stop();
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	printf(", %ld allocations, %.2f secs, peak RSS %ld MB\n", allocations - before, tt.elapsed(), long(ru.ru_maxrss/1024));
+	return 0;
+}
@@ -0,0 +1,24 @@
+// stdafx.h : stands in for HexEdit's stdafx.h so undo_arena builds without MFC
+//
+// Copyright (c) 2016 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#pragma once
+
+#include <assert.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define __int64 long long
+typedef __int64 FILE_ADDRESS;
+#define ASSERT(ff) assert(ff)
+using std::min;
+using std::max;
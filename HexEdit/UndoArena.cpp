@@ -0,0 +1,136 @@
+// UndoArena.cpp : implements undo_arena (see UndoArena.h)
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+
+#include "stdafx.h"
+#include "UndoArena.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+undo_arena::undo_arena() : small_count_(0), heap_count_(0), heap_bytes_(0), keep_(0)
+{
+	release_slabs();                    // Sets up free_ and next_
+}
+
+undo_arena::~undo_arena()
+{
+	free_kept(UINT_MAX);
+	ASSERT(small_count_ == 0 && heap_count_ == 0);  // all undo records should have been destroyed first
+	release_slabs();
+}
+
+unsigned char *undo_arena::allocate(size_t len)
+{
+	if (len > small_size)
+	{
+		unsigned char *retval = new unsigned char[len];
+		++heap_count_;
+		heap_bytes_ += len;
+		return retval;
+	}
+
+	ASSERT(len > 0);
+	int cc = int((len - 1)/grain);      // Size class
+	unsigned char *retval;
+	if (free_[cc] != NULL)
+	{
+		// Reuse a released buffer of the same size
+		retval = reinterpret_cast<unsigned char *>(free_[cc]);
+		free_[cc] = free_[cc]->next;
+	}
+	else
+	{
+		size_t sz = (cc + 1)*grain;
+		if (next_ + sz > slab_size)
+		{
+			// Last slab is full so get another
+			slab_.push_back(new unsigned char[slab_size]);
+			next_ = 0;
+		}
+		retval = slab_.back() + next_;
+		next_ += sz;
+	}
+	++small_count_;
+	return retval;
+}
+
+unsigned char *undo_arena::add_ref(unsigned char *pp)
+{
+	ASSERT(pp != NULL);
+	std::map<const unsigned char *, unsigned>::iterator pr = refs_.find(pp);
+	if (pr == refs_.end())
+		refs_[pp] = 2;                  // the original user and this one
+	else
+		++pr->second;
+	return pp;
+}
+
+void undo_arena::release(unsigned char *pp, size_t len)
+{
+	ASSERT(pp != NULL);
+	std::map<const unsigned char *, unsigned>::iterator pr = refs_.find(pp);
+	if (pr != refs_.end())
+	{
+		// Still used by someone else
+		if (--pr->second == 1)
+			refs_.erase(pr);
+		return;
+	}
+
+	if (keep_ != 0)
+	{
+		ASSERT(kept_.empty() || kept_.back().tag <= keep_);
+		kept_.push_back(kept_block(pp, len, keep_));
+		return;
+	}
+	do_release(pp, len);
+}
+
+void undo_arena::free_kept(unsigned tag)
+{
+	std::vector<kept_block>::iterator pk;
+	for (pk = kept_.begin(); pk != kept_.end() && pk->tag <= tag; ++pk)
+		do_release(pk->pp, pk->len);
+	kept_.erase(kept_.begin(), pk);
+}
+
+void undo_arena::do_release(unsigned char *pp, size_t len)
+{
+	if (len > small_size)
+	{
+		ASSERT(heap_count_ > 0 && heap_bytes_ >= len);
+		--heap_count_;
+		heap_bytes_ -= len;
+		delete[] pp;
+		return;
+	}
+
+	ASSERT(small_count_ > 0 && len > 0);
+	int cc = int((len - 1)/grain);
+	free_block *pb = reinterpret_cast<free_block *>(pp);
+	pb->next = free_[cc];
+	free_[cc] = pb;
+
+	// If nothing is in use (eg all undo info discarded when the file is saved) give the memory back
+	if (--small_count_ == 0)
+		release_slabs();
+}
+
+void undo_arena::release_slabs()
+{
+	for (std::vector<unsigned char *>::const_iterator ps = slab_.begin(); ps != slab_.end(); ++ps)
+		delete[] *ps;
+	slab_.clear();
+	for (int cc = 0; cc < small_size/grain; ++cc)
+		free_[cc] = NULL;
+	next_ = slab_size;                  // Forces a new slab for the next buffer
+}
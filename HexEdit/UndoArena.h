@@ -0,0 +1,97 @@
+// UndoArena.h : allocates the data buffers of a document's undo records
+//
+// For implementation see: UndoArena.cpp
+//
+// Copyright (c) 2015 by Andrew W. Phillips
+//
+// This file is distributed under the MIT license, which basically says
+// you can do what you want with it and I take no responsibility for bugs.
+// See http://www.opensource.org/licenses/mit-license.php for full details.
+//
+// Every change to a document has an undo record (doc_undo) which keeps a copy
+// of the bytes inserted or replaced.  Most of these are tiny (typing creates a
+// new record every few bytes - see undo_limit_) so getting each one from the
+// heap wastes a lot of time and memory (heap overhead is more than the data).
+//
+// undo_arena hands out small buffers (rounded up to a multiple of 8 bytes)
+// from large slabs, keeping released ones on a free list for reuse, and only
+// uses the heap for big buffers.  Buffers never move, which matters since
+// memory location records (doc_loc) point into them.
+//
+// While a background thread has a snapshot of the document (see
+// CHexEditDoc::TakeSnapshot) it may still read buffers that the document has
+// released.  So while keep() is on released buffers are just put aside, tagged
+// with the document version, and free_kept() really releases them once no
+// snapshot that old is still in use.
+//
+// A buffer can be used by more than one undo record (eg Replace All makes every
+// replacement use the same bytes) - add_ref() counts another user, and release()
+// only frees it when the last user releases it.  A shared buffer must not be
+// changed in place (see doc_undo::unshare).
+//
+// Note: this is not thread-safe.  The document only uses it with a write lock
+// on docrw_ (or when there are no background threads).
+
+#ifndef UNDOARENA_INCLUDED
+#define UNDOARENA_INCLUDED  1
+
+#include <vector>
+#include <map>
+
+class undo_arena
+{
+public:
+	enum
+	{
+		grain = 8,                      // Small buffer sizes are rounded up to a multiple of this
+		small_size = 32,                // Buffers up to this size come from slabs (must be >= max. undo_limit_)
+		slab_size = 64*1024             // Bytes in each slab
+	};
+
+	undo_arena();
+	~undo_arena();
+
+	unsigned char *allocate(size_t len);            // Get a buffer of at least len bytes
+	void release(unsigned char *pp, size_t len);    // Free buffer (len must be the same as passed to allocate)
+	unsigned char *add_ref(unsigned char *pp);      // Another user of the buffer (returns pp)
+	bool shared(const unsigned char *pp) const { return refs_.find(pp) != refs_.end(); }
+
+	void keep(unsigned tag) { keep_ = tag; }        // Keep buffers released from now on with this tag (0 = don't keep)
+	void free_kept(unsigned tag);                   // Release kept buffers with tags up to tag
+
+	size_t small_count() const { return small_count_; }   // Small buffers in use
+	size_t heap_count() const { return heap_count_; }     // Big buffers in use
+	size_t heap_bytes() const { return heap_bytes_; }    // Memory used by big buffers (incl. kept ones)
+	size_t slab_count() const { return slab_.size(); }    // Slabs allocated
+	size_t bytes() const { return heap_bytes_ + slab_.size()*slab_size; }  // Total memory used
+
+private:
+	undo_arena(const undo_arena &);     // not copyable
+	undo_arena &operator=(const undo_arena &);
+
+	// A released small buffer stores a pointer to the next free one of the same size
+	struct free_block { free_block *next; };
+
+	void release_slabs();
+	void do_release(unsigned char *pp, size_t len);
+
+	struct kept_block
+	{
+		kept_block(unsigned char *p, size_t l, unsigned t) : pp(p), len(l), tag(t) { }
+		unsigned char *pp;
+		size_t len;
+		unsigned tag;
+	};
+
+	std::vector<unsigned char *> slab_; // All slabs allocated
+	free_block *free_[small_size/grain];  // Lists of released buffers (for reuse) for each size
+	size_t next_;                       // Offset of never used bytes in the last slab
+	size_t small_count_;
+	size_t heap_count_;
+	size_t heap_bytes_;
+	unsigned keep_;                     // Tag for released buffers (or 0 if not keeping them)
+	std::vector<kept_block> kept_;      // Buffers released while keep_ was on (in tag order)
+	std::map<const unsigned char *, unsigned> refs_;  // Users of buffers that have more than one
+};
+
+#endif